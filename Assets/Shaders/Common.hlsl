@@ -15,14 +15,15 @@
 #include "LightingUtil.hlsl"
 
 // 每帧都在变化的单个模型的常量数据
+// 64 bytes: the world matrix's first three columns as rows, the 2D part of the texture
+// transform, its rows 0, 1 and 3, as pairs of halves, and the material index in the low 16 bits
+// of materialAndFlags with the instance's flags above it; read them with GetMaterialIndex and
+// GetInstanceFlags.
 struct InstanceData
 {
-    float4x4 world;
-    float4x4 texTransform;
-    uint materialIndex;
-    uint objPad0;
-    uint objPad1;
-    uint objPad2;
+    row_major float3x4 world;
+    uint3 texTransform;
+    uint materialAndFlags;
 };
 
 // 材质数据
@@ -34,8 +35,8 @@ struct MaterialData
     float4x4 matTransform;
     uint diffuseMapIndex;
     uint normalMapIndex;
-    uint matPad1;
-    uint matPad2;
+    uint diffuseMapSlice;
+    uint normalMapSlice;
 };
 
 // 绘制过程中所用的杂项常量数据
@@ -81,17 +82,72 @@ cbuffer ConstBuffer : register(b0)
     ConstBufferPass cbPass;
 };
 TextureCube gCubeMap : register(t0);
-Texture2D gTextureMaps[15] : register(t1);
+// Each texture array has two slots so its view can be replaced while earlier frames are in
+// flight.  Loose textures are arrays of one slice.  The root signature bounds the range.
+Texture2DArray gTextureMaps[] : register(t1);
 
-StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+// The slots of the instances being drawn, from the draw's first on, index every instance's data.
+StructuredBuffer<uint> gVisibleInstances : register(t0, space1);
 StructuredBuffer<MaterialData> gMaterialData : register(t1, space1);
+StructuredBuffer<InstanceData> gInstanceData : register(t2, space1);
+
+// Bounds of the submesh being drawn, when its vertices are quantized (see
+// Common/VertexQuantizer.h).
+cbuffer QuantizationBounds : register(b1)
+{
+    float3 gQuantizationCenter;
+    float quantizationPad0;
+    float3 gQuantizationExtents;
+    float quantizationPad1;
+};
+
+// Model to world space.  Directions take (float3x3) instance.world on the left.
+float4 TransformToWorld(InstanceData instance, float3 posL)
+{
+    return float4(mul(instance.world, float4(posL, 1.0f)), 1.0f);
+}
+
+uint GetMaterialIndex(InstanceData instance)
+{
+    return instance.materialAndFlags & 0xffff;
+}
+
+uint GetInstanceFlags(InstanceData instance)
+{
+    return instance.materialAndFlags >> 16;
+}
+
+float2 TransformTexCoord(InstanceData instance, float2 texCoord)
+{
+    uint3 t = instance.texTransform;
+    return texCoord.x * f16tof32(uint2(t.x, t.x >> 16))
+           + texCoord.y * f16tof32(uint2(t.y, t.y >> 16)) + f16tof32(uint2(t.z, t.z >> 16));
+}
+
+// A quantized position is a fraction of the bounding box along each axis.
+float3 DecodeQuantizedPosition(float4 pos)
+{
+    return gQuantizationCenter + gQuantizationExtents * (2.0f * pos.xyz - 1.0f);
+}
+
+// Octahedral unit vectors, the lower half of the octahedron folded over the upper.
+float3 DecodeOctahedral(float2 e)
+{
+    float3 v = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    if (v.z < 0.0f)
+        v.xy = (1.0f - abs(v.yx)) * (v.xy >= 0.0f ? 1.0f : -1.0f);
+    return normalize(v);
+}
 
 
 // 将一个法线图样本变换至世界空间
 float3 NormalSampleToWorldSpace(float4 normalMapSample, float3 unitNormalW, float3 tangentW)
 {
-    // 将每个坐标分量由范围[0,1]解压至[-1,1]
-    float3 normalT = 2.0f * normalMapSample - 1.0f;
+    // 将x、y分量由范围[0,1]解压至[-1,1]
+    // z is rebuilt from the unit length, as normal maps block compressed to BC5 keep x and y only.
+    float3 normalT;
+    normalT.xy = 2.0f * normalMapSample.xy - 1.0f;
+    normalT.z = sqrt(saturate(1.0f - dot(normalT.xy, normalT.xy)));
     
     // 构建正交规范基
     float3 N = unitNormalW;
@@ -2,6 +2,17 @@
 #include "Common.hlsl"
 
 
+#ifdef QUANTIZED_VERTICES
+// Common/VertexQuantizer's layout: positions are fractions of the submesh's bounding box,
+// normals and tangents octahedral.
+struct VertexIn
+{
+    float4 pos : POSITION;
+    float2 normal : NORMAL;
+    float2 texCoord : TEXCOORD;
+    float2 tangent : TANGENT;
+};
+#else
 struct VertexIn
 {
     float3 pos : POSITION;
@@ -9,6 +20,7 @@ struct VertexIn
     float2 texCoord : TEXCOORD;
     float3 tangent : TANGENT;
 };
+#endif
 
 struct VertexOut
 {
@@ -26,27 +38,35 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout;
     
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 world = instData.world;
-    float4x4 texTransform = instData.texTransform;
-    uint materialIndex = instData.materialIndex;
+    InstanceData instData = gInstanceData[gVisibleInstances[instanceID]];
+    uint materialIndex = GetMaterialIndex(instData);
     
     MaterialData matData = gMaterialData[materialIndex];
     
+#ifdef QUANTIZED_VERTICES
+    float3 posL = DecodeQuantizedPosition(vin.pos);
+    float3 normalL = DecodeOctahedral(vin.normal);
+    float3 tangentL = DecodeOctahedral(vin.tangent);
+#else
+    float3 posL = vin.pos;
+    float3 normalL = vin.normal;
+    float3 tangentL = vin.tangent;
+#endif
+    
     // 将顶点变换到世界空间
-    float4 worldPos = mul(float4(vin.pos, 1.0f), world);
+    float4 worldPos = TransformToWorld(instData, posL);
     vout.posW = worldPos.xyx;
     
     // TODO 假设这里进行的是等比缩放，否则这里需要使用世界矩阵的逆转置矩阵
-    vout.normalW = mul(vin.normal, (float3x3) world);
+    vout.normalW = mul((float3x3) instData.world, normalL);
     
-    vout.tangentW = mul(vin.tangent, (float3x3) world);
+    vout.tangentW = mul((float3x3) instData.world, tangentL);
     
     // 将顶点变换到齐次裁剪空间
     vout.posH = mul(worldPos, cbPass.viewProj);
     
     // 为三角形插值而输出顶点属性
-    float4 texC = mul(float4(vin.texCoord, 0.0f, 1.0f), texTransform);
+    float4 texC = float4(TransformTexCoord(instData, vin.texCoord), 0.0f, 1.0f);
     vout.texCoord = mul(texC, matData.matTransform).xy;
     
     vout.materialIndex = materialIndex;
@@ -64,9 +84,12 @@ float4 PS(VertexOut pin) : SV_TARGET
     float roughness = matData.roughness;
     int diffuseMapIndex = matData.diffuseMapIndex;
     int normalMapIndex = matData.normalMapIndex;
+    float diffuseMapSlice = matData.diffuseMapSlice;
+    float normalMapSlice = matData.normalMapSlice;
     
     // 动态查找数组中的纹理
-    diffuseAlbedo *= gTextureMaps[diffuseMapIndex].Sample(gSamAnisotropicWrap, pin.texCoord);
+    diffuseAlbedo *= gTextureMaps[diffuseMapIndex].Sample(gSamAnisotropicWrap,
+                                                          float3(pin.texCoord, diffuseMapSlice));
     
 #ifdef ALPHA_TEST
     // 若alpha < 0.1 则抛弃该像素。我们要在着色器中尽早执行此项测试，以尽快检测出满足条件的像素并退出着色器，从而跳出后续的相关处理
@@ -77,7 +100,8 @@ float4 PS(VertexOut pin) : SV_TARGET
     pin.normalW = normalize(pin.normalW);
     
     // 法线贴图
-    float4 normalMapSample = gTextureMaps[normalMapIndex].Sample(gSamAnisotropicWrap, pin.texCoord);
+    float4 normalMapSample = gTextureMaps[normalMapIndex].Sample(gSamAnisotropicWrap,
+                                                                 float3(pin.texCoord, normalMapSlice));
     float3 bumpedNormalW = NormalSampleToWorldSpace(normalMapSample, pin.normalW, pin.tangentW);
     
     float3 normalW = normalMapIndex != -1 ? bumpedNormalW : pin.normalW;
@@ -0,0 +1,46 @@
+
+#include "Common.hlsl"
+
+
+// Reads the position-only vertex stream, for passes that need a surface's coverage and nothing
+// else, such as stencil marking.  Surfaces come out in their material's flat colour.
+struct VertexIn
+{
+#ifdef QUANTIZED_VERTICES
+    float4 pos : POSITION;
+#else
+    float3 pos : POSITION;
+#endif
+};
+
+struct VertexOut
+{
+    float4 posH : SV_POSITION;
+    nointerpolation uint materialIndex : MATERIALINDEX;
+};
+
+
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+    VertexOut vout;
+    
+    InstanceData instData = gInstanceData[gVisibleInstances[instanceID]];
+    
+#ifdef QUANTIZED_VERTICES
+    float3 posL = DecodeQuantizedPosition(vin.pos);
+#else
+    float3 posL = vin.pos;
+#endif
+    
+    float4 worldPos = TransformToWorld(instData, posL);
+    vout.posH = mul(worldPos, cbPass.viewProj);
+    vout.materialIndex = GetMaterialIndex(instData);
+    
+    return vout;
+}
+
+
+float4 PS(VertexOut pin) : SV_TARGET
+{
+    return gMaterialData[pin.materialIndex].diffuseAlbedo;
+}
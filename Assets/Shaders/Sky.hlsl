@@ -18,13 +18,13 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout;
     
-    InstanceData instanceData = gInstanceData[instanceID];
+    InstanceData instanceData = gInstanceData[gVisibleInstances[instanceID]];
     
     // 用局部顶点的位置作为立方体图的查找向量
     vout.posL = vin.pos;
     
     // 把顶点变换到世界空间
-    float4 posW = mul(float4(vin.pos, 1.0), instanceData.world);
+    float4 posW = TransformToWorld(instanceData, vin.pos);
     
     // 总是以摄像机作为天空球的中心
     posW.xyz += cbPass.eyePosW;
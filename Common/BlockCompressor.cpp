@@ -0,0 +1,1070 @@
+#include "BlockCompressor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BLOCK_COMPRESSOR_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCK_COMPRESSOR_SSE2 1
+#endif
+
+using namespace BlockCompressor;
+
+namespace
+{
+// A vector of floats in the widest registers compiled in.  The kernels below walk the 16 pixels
+// of a block kWidth at a time, so the same source serves AVX2, SSE2 and the scalar fallback.
+// Masks come from Less and are only consumed by Select.
+#if BLOCK_COMPRESSOR_AVX2
+struct Floats
+{
+    static const int kWidth = 8;
+    __m256 v;
+
+    static Floats Load(const float *p) { return {_mm256_load_ps(p)}; }
+    static Floats Set(float x) { return {_mm256_set1_ps(x)}; }
+    void Store(float *p) const { _mm256_store_ps(p, v); }
+
+    friend Floats operator+(Floats a, Floats b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend Floats operator-(Floats a, Floats b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    friend Floats operator*(Floats a, Floats b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend Floats Min(Floats a, Floats b) { return {_mm256_min_ps(a.v, b.v)}; }
+    friend Floats Max(Floats a, Floats b) { return {_mm256_max_ps(a.v, b.v)}; }
+    friend Floats Less(Floats a, Floats b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+    friend Floats Select(Floats mask, Floats a, Floats b) { return {_mm256_blendv_ps(b.v, a.v, mask.v)}; }
+    friend Floats Round(Floats a) { return {_mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)}; }
+};
+#elif BLOCK_COMPRESSOR_SSE2
+struct Floats
+{
+    static const int kWidth = 4;
+    __m128 v;
+
+    static Floats Load(const float *p) { return {_mm_load_ps(p)}; }
+    static Floats Set(float x) { return {_mm_set1_ps(x)}; }
+    void Store(float *p) const { _mm_store_ps(p, v); }
+
+    friend Floats operator+(Floats a, Floats b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend Floats operator-(Floats a, Floats b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend Floats operator*(Floats a, Floats b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend Floats Min(Floats a, Floats b) { return {_mm_min_ps(a.v, b.v)}; }
+    friend Floats Max(Floats a, Floats b) { return {_mm_max_ps(a.v, b.v)}; }
+    friend Floats Less(Floats a, Floats b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+    friend Floats Select(Floats mask, Floats a, Floats b)
+    {
+        return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+    }
+    // Round to nearest under the default rounding mode.
+    friend Floats Round(Floats a) { return {_mm_cvtepi32_ps(_mm_cvtps_epi32(a.v))}; }
+};
+#else
+struct Floats
+{
+    static const int kWidth = 1;
+    float v;
+
+    static Floats Load(const float *p) { return {*p}; }
+    static Floats Set(float x) { return {x}; }
+    void Store(float *p) const { *p = v; }
+
+    friend Floats operator+(Floats a, Floats b) { return {a.v + b.v}; }
+    friend Floats operator-(Floats a, Floats b) { return {a.v - b.v}; }
+    friend Floats operator*(Floats a, Floats b) { return {a.v * b.v}; }
+    friend Floats Min(Floats a, Floats b) { return {std::min(a.v, b.v)}; }
+    friend Floats Max(Floats a, Floats b) { return {std::max(a.v, b.v)}; }
+    friend Floats Less(Floats a, Floats b) { return {a.v < b.v ? 1.0f : 0.0f}; }
+    friend Floats Select(Floats mask, Floats a, Floats b) { return mask.v != 0.0f ? a : b; }
+    friend Floats Round(Floats a) { return {std::nearbyint(a.v)}; }
+};
+#endif
+
+// Horizontal reductions go through memory; they run once per kernel call.
+float SumLanes(Floats a)
+{
+    alignas(32) float lanes[Floats::kWidth];
+    a.Store(lanes);
+    float sum = 0.0f;
+    for (float lane : lanes) {
+        sum += lane;
+    }
+    return sum;
+}
+
+float MinLane(Floats a)
+{
+    alignas(32) float lanes[Floats::kWidth];
+    a.Store(lanes);
+    return *std::min_element(lanes, lanes + Floats::kWidth);
+}
+
+float MaxLane(Floats a)
+{
+    alignas(32) float lanes[Floats::kWidth];
+    a.Store(lanes);
+    return *std::max_element(lanes, lanes + Floats::kWidth);
+}
+
+// The 16 pixels of a block as one array per channel.
+struct Block
+{
+    alignas(32) float channels[4][16];
+};
+
+Block LoadBlock(const uint8_t rgba[64])
+{
+    Block block;
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            block.channels[c][i] = rgba[4 * i + c];
+        }
+    }
+    return block;
+}
+
+int Clamp(int x, int low, int high)
+{
+    return std::min(std::max(x, low), high);
+}
+
+// ----------------------------------------------------------------------------------------------
+// Color endpoints
+
+uint16_t Quantize565(const float color[3])
+{
+    int r = Clamp(int(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+    int g = Clamp(int(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+    int b = Clamp(int(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+    return uint16_t(r << 11 | g << 5 | b);
+}
+
+void Expand565(uint16_t c, int color[3])
+{
+    int r = c >> 11;
+    int g = (c >> 5) & 63;
+    int b = c & 31;
+    color[0] = r << 3 | r >> 2;
+    color[1] = g << 2 | g >> 4;
+    color[2] = b << 3 | b >> 2;
+}
+
+// Four color mode interpolates at thirds, three color mode at the middle; the fourth three color
+// entry is transparent black and never picked for opaque pixels.
+int BuildColorPalette(uint16_t c0, uint16_t c1, bool threeColor, float palette[4][3])
+{
+    int e0[3];
+    int e1[3];
+    Expand565(c0, e0);
+    Expand565(c1, e1);
+    for (int c = 0; c < 3; ++c) {
+        palette[0][c] = float(e0[c]);
+        palette[1][c] = float(e1[c]);
+        if (threeColor) {
+            palette[2][c] = (e0[c] + e1[c]) / 2.0f;
+        } else {
+            palette[2][c] = (2 * e0[c] + e1[c]) / 3.0f;
+            palette[3][c] = (e0[c] + 2 * e1[c]) / 3.0f;
+        }
+    }
+    return threeColor ? 3 : 4;
+}
+
+// Swapping the endpoints swaps indices 0 and 1, and 2 and 3 in four color mode.  Four color mode
+// needs c0 > c1; with equal endpoints every pixel takes index 0, which decodes the same in the
+// three color mode the decoder then picks.
+void WriteColorBlock(uint16_t c0, uint16_t c1, uint8_t indices[16], bool threeColor, uint8_t *out)
+{
+    if (threeColor ? c0 > c1 : c0 < c1) {
+        std::swap(c0, c1);
+        for (int i = 0; i < 16; ++i) {
+            if (!threeColor || indices[i] < 2) {
+                indices[i] ^= 1;
+            }
+        }
+    }
+    if (!threeColor && c0 == c1) {
+        memset(indices, 0, 16);
+    }
+
+    out[0] = uint8_t(c0);
+    out[1] = uint8_t(c0 >> 8);
+    out[2] = uint8_t(c1);
+    out[3] = uint8_t(c1 >> 8);
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i) {
+        bits |= uint32_t(indices[i]) << (2 * i);
+    }
+    memcpy(out + 4, &bits, 4);
+}
+
+// Endpoints reproducing a single 8 bit value best through the first interpolated entry,
+// indexed by value; 5 bit and 6 bit channels.
+struct SingleColorTable
+{
+    uint8_t endpoints[2][256][2];
+
+    SingleColorTable()
+    {
+        for (int bits = 0; bits < 2; ++bits) {
+            int levels = bits == 0 ? 32 : 64;
+            for (int value = 0; value < 256; ++value) {
+                int bestError = INT32_MAX;
+                for (int a = 0; a < levels; ++a) {
+                    for (int b = 0; b < levels; ++b) {
+                        int ea = bits == 0 ? (a << 3 | a >> 2) : (a << 2 | a >> 4);
+                        int eb = bits == 0 ? (b << 3 | b >> 2) : (b << 2 | b >> 4);
+                        int error = std::abs((2 * ea + eb) / 3 - value);
+                        if (error < bestError) {
+                            bestError = error;
+                            endpoints[bits][value][0] = uint8_t(a);
+                            endpoints[bits][value][1] = uint8_t(b);
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+void EncodeSingleColor(const uint8_t color[3], uint8_t *out)
+{
+    static const SingleColorTable table;
+
+    auto &r = table.endpoints[0][color[0]];
+    auto &g = table.endpoints[1][color[1]];
+    auto &b = table.endpoints[0][color[2]];
+    uint16_t c0 = uint16_t(r[0] << 11 | g[0] << 5 | b[0]);
+    uint16_t c1 = uint16_t(r[1] << 11 | g[1] << 5 | b[1]);
+
+    uint8_t indices[16];
+    memset(indices, 2, sizeof(indices));
+    WriteColorBlock(c0, c1, indices, false, out);
+}
+
+bool IsSingleColor(const uint8_t rgba[64])
+{
+    for (int i = 1; i < 16; ++i) {
+        if (memcmp(rgba, rgba + 4 * i, 3) != 0)
+            return false;
+    }
+    return true;
+}
+
+// BC1 blocks with pixels below half alpha use three color mode, which keeps index 3 for
+// transparent black.  They are rare, so this path stays scalar and simple.
+void EncodeTransparentColorBlock(const uint8_t rgba[64], uint8_t *out)
+{
+    float lo[3] = {255.0f, 255.0f, 255.0f};
+    float hi[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; ++i) {
+        if (rgba[4 * i + 3] < 128)
+            continue;
+        for (int c = 0; c < 3; ++c) {
+            lo[c] = std::min(lo[c], float(rgba[4 * i + c]));
+            hi[c] = std::max(hi[c], float(rgba[4 * i + c]));
+        }
+    }
+
+    uint16_t c0 = lo[0] <= hi[0] ? Quantize565(hi) : 0;
+    uint16_t c1 = lo[0] <= hi[0] ? Quantize565(lo) : 0;
+    float palette[4][3];
+    BuildColorPalette(c0, c1, true, palette);
+
+    uint8_t indices[16];
+    for (int i = 0; i < 16; ++i) {
+        indices[i] = 3;
+        if (rgba[4 * i + 3] < 128)
+            continue;
+
+        float bestError = FLT_MAX;
+        for (uint8_t k = 0; k < 3; ++k) {
+            float error = 0.0f;
+            for (int c = 0; c < 3; ++c) {
+                float d = rgba[4 * i + c] - palette[k][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                indices[i] = k;
+            }
+        }
+    }
+    WriteColorBlock(c0, c1, indices, true, out);
+}
+
+// ----------------------------------------------------------------------------------------------
+// Vector color kernels
+
+void ComputeColorBounds(const Block &block, float lo[3], float hi[3])
+{
+    for (int c = 0; c < 3; ++c) {
+        auto minimum = Floats::Load(block.channels[c]);
+        auto maximum = minimum;
+        for (int i = Floats::kWidth; i < 16; i += Floats::kWidth) {
+            auto x = Floats::Load(block.channels[c] + i);
+            minimum = Min(minimum, x);
+            maximum = Max(maximum, x);
+        }
+        lo[c] = MinLane(minimum);
+        hi[c] = MaxLane(maximum);
+    }
+}
+
+// covariance holds rr, rg, rb, gg, gb, bb.
+void ComputeColorCovariance(const Block &block, float mean[3], float covariance[6])
+{
+    for (int c = 0; c < 3; ++c) {
+        auto sum = Floats::Set(0.0f);
+        for (int i = 0; i < 16; i += Floats::kWidth) {
+            sum = sum + Floats::Load(block.channels[c] + i);
+        }
+        mean[c] = SumLanes(sum) / 16.0f;
+    }
+
+    Floats sums[6];
+    for (auto &sum : sums) {
+        sum = Floats::Set(0.0f);
+    }
+    for (int i = 0; i < 16; i += Floats::kWidth) {
+        auto r = Floats::Load(block.channels[0] + i) - Floats::Set(mean[0]);
+        auto g = Floats::Load(block.channels[1] + i) - Floats::Set(mean[1]);
+        auto b = Floats::Load(block.channels[2] + i) - Floats::Set(mean[2]);
+        sums[0] = sums[0] + r * r;
+        sums[1] = sums[1] + r * g;
+        sums[2] = sums[2] + r * b;
+        sums[3] = sums[3] + g * g;
+        sums[4] = sums[4] + g * b;
+        sums[5] = sums[5] + b * b;
+    }
+    for (int k = 0; k < 6; ++k) {
+        covariance[k] = SumLanes(sums[k]);
+    }
+}
+
+// Picks the nearest palette entry for every pixel and returns the summed squared error.
+float AssignColorIndices(const Block &block,
+                         const float palette[4][3],
+                         int paletteSize,
+                         uint8_t indices[16])
+{
+    float error = 0.0f;
+    for (int i = 0; i < 16; i += Floats::kWidth) {
+        auto r = Floats::Load(block.channels[0] + i);
+        auto g = Floats::Load(block.channels[1] + i);
+        auto b = Floats::Load(block.channels[2] + i);
+
+        auto bestError = Floats::Set(FLT_MAX);
+        auto bestIndex = Floats::Set(0.0f);
+        for (int k = 0; k < paletteSize; ++k) {
+            auto dr = r - Floats::Set(palette[k][0]);
+            auto dg = g - Floats::Set(palette[k][1]);
+            auto db = b - Floats::Set(palette[k][2]);
+            auto d = dr * dr + dg * dg + db * db;
+            auto closer = Less(d, bestError);
+            bestError = Select(closer, d, bestError);
+            bestIndex = Select(closer, Floats::Set(float(k)), bestIndex);
+        }
+        error += SumLanes(bestError);
+
+        alignas(32) float lanes[Floats::kWidth];
+        bestIndex.Store(lanes);
+        for (int j = 0; j < Floats::kWidth; ++j) {
+            indices[i + j] = uint8_t(lanes[j]);
+        }
+    }
+    return error;
+}
+
+// Least squares endpoints for fixed indices.  weights[k] is how much of endpoint 0 palette entry
+// k holds.  Returns false if every pixel uses the same weight.
+bool RefitEndpoints(const float channels[][16],
+                    int channelCount,
+                    const uint8_t indices[16],
+                    const float *weights,
+                    float e0[],
+                    float e1[])
+{
+    alignas(32) float a[16];
+    for (int i = 0; i < 16; ++i) {
+        a[i] = weights[indices[i]];
+    }
+
+    auto aa = Floats::Set(0.0f);
+    auto ab = Floats::Set(0.0f);
+    auto bb = Floats::Set(0.0f);
+    Floats ax[3] = {aa, aa, aa};
+    Floats bx[3] = {aa, aa, aa};
+    for (int i = 0; i < 16; i += Floats::kWidth) {
+        auto wa = Floats::Load(a + i);
+        auto wb = Floats::Set(1.0f) - wa;
+        aa = aa + wa * wa;
+        ab = ab + wa * wb;
+        bb = bb + wb * wb;
+        for (int c = 0; c < channelCount; ++c) {
+            auto x = Floats::Load(channels[c] + i);
+            ax[c] = ax[c] + wa * x;
+            bx[c] = bx[c] + wb * x;
+        }
+    }
+
+    float saa = SumLanes(aa);
+    float sab = SumLanes(ab);
+    float sbb = SumLanes(bb);
+    float det = saa * sbb - sab * sab;
+    if (std::fabs(det) < 1e-4f)
+        return false;
+
+    for (int c = 0; c < channelCount; ++c) {
+        float sax = SumLanes(ax[c]);
+        float sbx = SumLanes(bx[c]);
+        e0[c] = std::min(std::max((sax * sbb - sbx * sab) / det, 0.0f), 255.0f);
+        e1[c] = std::min(std::max((sbx * saa - sax * sab) / det, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+struct ColorCandidate
+{
+    uint16_t c0 = 0;
+    uint16_t c1 = 0;
+    uint8_t indices[16] = {};
+    float error = FLT_MAX;
+};
+
+void TryColorEndpoints(const Block &block, const float e0[3], const float e1[3], ColorCandidate &best)
+{
+    ColorCandidate candidate;
+    candidate.c0 = Quantize565(e0);
+    candidate.c1 = Quantize565(e1);
+
+    float palette[4][3];
+    BuildColorPalette(candidate.c0, candidate.c1, false, palette);
+    candidate.error = AssignColorIndices(block, palette, 4, candidate.indices);
+    if (candidate.error < best.error) {
+        best = candidate;
+    }
+}
+
+void RefineColorEndpoints(const Block &block, int iterations, ColorCandidate &best)
+{
+    static const float kWeights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    for (int i = 0; i < iterations; ++i) {
+        float e0[3];
+        float e1[3];
+        if (!RefitEndpoints(block.channels, 3, best.indices, kWeights, e0, e1))
+            return;
+
+        float previousError = best.error;
+        TryColorEndpoints(block, e0, e1, best);
+        if (best.error >= previousError)
+            return;
+    }
+}
+
+// The corners of the bounding box, inset by a sixteenth of its size since the extremes are
+// rarely worth an endpoint of their own.  The min to max diagonal only suits positively
+// correlated channels, so channels running against the widest one swap their corners.
+void BoundingBoxEndpoints(const Block &block, float e0[3], float e1[3])
+{
+    float lo[3];
+    float hi[3];
+    ComputeColorBounds(block, lo, hi);
+
+    float mean[3];
+    float covariance[6];
+    ComputeColorCovariance(block, mean, covariance);
+
+    int widest = 0;
+    for (int c = 1; c < 3; ++c) {
+        if (hi[c] - lo[c] > hi[widest] - lo[widest]) {
+            widest = c;
+        }
+    }
+    // Index into rr, rg, rb, gg, gb, bb.
+    static const int kCovarianceIndex[3][3] = {{0, 1, 2}, {1, 3, 4}, {2, 4, 5}};
+
+    for (int c = 0; c < 3; ++c) {
+        float inset = (hi[c] - lo[c]) / 16.0f;
+        e0[c] = hi[c] - inset;
+        e1[c] = lo[c] + inset;
+        if (covariance[kCovarianceIndex[widest][c]] < 0.0f) {
+            std::swap(e0[c], e1[c]);
+        }
+    }
+}
+
+// The extremes of the pixels projected on the principal axis of their covariance.
+void PrincipalAxisEndpoints(const Block &block, float e0[3], float e1[3])
+{
+    float mean[3];
+    float covariance[6];
+    ComputeColorCovariance(block, mean, covariance);
+
+    // Power iteration, started from the axis with the largest variance.
+    float axis[3] = {covariance[0], covariance[3], covariance[5]};
+    for (int i = 0; i < 8; ++i) {
+        float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+        if (length < 1e-6f)
+            break;
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+
+    float lengthSq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    if (lengthSq < 1e-12f) {
+        std::copy(mean, mean + 3, e0);
+        std::copy(mean, mean + 3, e1);
+        return;
+    }
+
+    auto projectedMin = Floats::Set(FLT_MAX);
+    auto projectedMax = Floats::Set(-FLT_MAX);
+    for (int i = 0; i < 16; i += Floats::kWidth) {
+        auto t = (Floats::Load(block.channels[0] + i) - Floats::Set(mean[0])) * Floats::Set(axis[0])
+                 + (Floats::Load(block.channels[1] + i) - Floats::Set(mean[1])) * Floats::Set(axis[1])
+                 + (Floats::Load(block.channels[2] + i) - Floats::Set(mean[2])) * Floats::Set(axis[2]);
+        projectedMin = Min(projectedMin, t);
+        projectedMax = Max(projectedMax, t);
+    }
+
+    float tMin = MinLane(projectedMin) / lengthSq;
+    float tMax = MaxLane(projectedMax) / lengthSq;
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = std::min(std::max(mean[c] + axis[c] * tMax, 0.0f), 255.0f);
+        e1[c] = std::min(std::max(mean[c] + axis[c] * tMin, 0.0f), 255.0f);
+    }
+}
+
+void EncodeColorBlock(const uint8_t rgba[64], const Block &block, Quality quality, uint8_t *out)
+{
+    if (IsSingleColor(rgba)) {
+        EncodeSingleColor(rgba, out);
+        return;
+    }
+
+    ColorCandidate best;
+    float e0[3];
+    float e1[3];
+    BoundingBoxEndpoints(block, e0, e1);
+    TryColorEndpoints(block, e0, e1, best);
+
+    if (quality != Quality::Fast) {
+        PrincipalAxisEndpoints(block, e0, e1);
+        TryColorEndpoints(block, e0, e1, best);
+        RefineColorEndpoints(block, quality == Quality::High ? 4 : 1, best);
+    }
+
+    WriteColorBlock(best.c0, best.c1, best.indices, false, out);
+}
+
+// ----------------------------------------------------------------------------------------------
+// Single channel (BC4) blocks
+
+// Eight value mode (a0 > a1) interpolates six values in sevenths, six value mode (a0 <= a1)
+// four values in fifths and adds 0 and 255.
+int BuildAlphaPalette(int a0, int a1, float palette[8])
+{
+    palette[0] = float(a0);
+    palette[1] = float(a1);
+    if (a0 > a1) {
+        for (int i = 1; i < 7; ++i) {
+            palette[i + 1] = ((7 - i) * a0 + i * a1) / 7.0f;
+        }
+        return 8;
+    }
+    for (int i = 1; i < 5; ++i) {
+        palette[i + 1] = ((5 - i) * a0 + i * a1) / 5.0f;
+    }
+    palette[6] = 0.0f;
+    palette[7] = 255.0f;
+    return 8;
+}
+
+void WriteAlphaBlock(int a0, int a1, const uint8_t indices[16], uint8_t *out)
+{
+    out[0] = uint8_t(a0);
+    out[1] = uint8_t(a1);
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i) {
+        bits |= uint64_t(indices[i]) << (3 * i);
+    }
+    for (int i = 0; i < 6; ++i) {
+        out[2 + i] = uint8_t(bits >> (8 * i));
+    }
+}
+
+// Exhaustive nearest entry search, for six value mode and the reference encoder.
+float AssignAlphaIndicesScalar(const float values[16], int a0, int a1, uint8_t indices[16])
+{
+    float palette[8];
+    BuildAlphaPalette(a0, a1, palette);
+
+    float error = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float bestError = FLT_MAX;
+        for (uint8_t k = 0; k < 8; ++k) {
+            float d = values[i] - palette[k];
+            if (d * d < bestError) {
+                bestError = d * d;
+                indices[i] = k;
+            }
+        }
+        error += bestError;
+    }
+    return error;
+}
+
+// Eight value mode only: the entries are evenly spaced, so the nearest one is found by rounding
+// the position between the endpoints.
+float AssignAlphaIndices(const float values[16], int a0, int a1, uint8_t indices[16])
+{
+    // Levels run from a1 (0) to a0 (7); level 7 is index 0, level 0 index 1 and level l in
+    // between index 8 - l.
+    static const uint8_t kLevelToIndex[8] = {1, 7, 6, 5, 4, 3, 2, 0};
+
+    float scale = 7.0f / float(a0 - a1);
+    auto error = Floats::Set(0.0f);
+    for (int i = 0; i < 16; i += Floats::kWidth) {
+        auto v = Floats::Load(values + i);
+        auto level = Round((v - Floats::Set(float(a1))) * Floats::Set(scale));
+        level = Min(Max(level, Floats::Set(0.0f)), Floats::Set(7.0f));
+        auto decoded = Floats::Set(float(a1)) + level * Floats::Set(float(a0 - a1) / 7.0f);
+        auto d = v - decoded;
+        error = error + d * d;
+
+        alignas(32) float lanes[Floats::kWidth];
+        level.Store(lanes);
+        for (int j = 0; j < Floats::kWidth; ++j) {
+            indices[i + j] = kLevelToIndex[int(lanes[j])];
+        }
+    }
+    return SumLanes(error);
+}
+
+struct AlphaCandidate
+{
+    int a0 = 0;
+    int a1 = 0;
+    uint8_t indices[16] = {};
+    float error = FLT_MAX;
+};
+
+void TryAlphaEndpoints(const float values[16], int a0, int a1, AlphaCandidate &best)
+{
+    AlphaCandidate candidate;
+    candidate.a0 = a0;
+    candidate.a1 = a1;
+    candidate.error = a0 > a1 ? AssignAlphaIndices(values, a0, a1, candidate.indices)
+                              : AssignAlphaIndicesScalar(values, a0, a1, candidate.indices);
+    if (candidate.error < best.error) {
+        best = candidate;
+    }
+}
+
+AlphaCandidate FindAlphaEndpoints(const float values[16], Quality quality)
+{
+    auto minimum = Floats::Load(values);
+    auto maximum = minimum;
+    for (int i = Floats::kWidth; i < 16; i += Floats::kWidth) {
+        auto x = Floats::Load(values + i);
+        minimum = Min(minimum, x);
+        maximum = Max(maximum, x);
+    }
+    int lo = int(MinLane(minimum));
+    int hi = int(MaxLane(maximum));
+
+    AlphaCandidate best;
+    if (lo == hi) {
+        best.a0 = hi;
+        best.a1 = lo;
+        best.error = 0.0f;
+        return best;
+    }
+    TryAlphaEndpoints(values, hi, lo, best);
+
+    if (quality != Quality::Fast) {
+        // Weight of a0 for each index in eight value mode.
+        static const float kWeights[8] = {1.0f, 0.0f, 6 / 7.0f, 5 / 7.0f, 4 / 7.0f, 3 / 7.0f, 2 / 7.0f, 1 / 7.0f};
+        int iterations = quality == Quality::High ? 4 : 1;
+        for (int i = 0; i < iterations; ++i) {
+            float e0;
+            float e1;
+            if (!RefitEndpoints(reinterpret_cast<const float(*)[16]>(values), 1, best.indices, kWeights, &e0, &e1))
+                break;
+
+            int a0 = int(e0 + 0.5f);
+            int a1 = int(e1 + 0.5f);
+            float previousError = best.error;
+            if (a0 > a1) {
+                TryAlphaEndpoints(values, a0, a1, best);
+            }
+            if (best.error >= previousError)
+                break;
+        }
+    }
+
+    // Blocks reaching 0 or 255 can leave those to the fixed entries of six value mode and spend
+    // the interpolated ones on the values in between.
+    if (quality == Quality::High && (lo == 0 || hi == 255)) {
+        int innerLo = 255;
+        int innerHi = 0;
+        for (int i = 0; i < 16; ++i) {
+            int v = int(values[i]);
+            if (v != 0 && v != 255) {
+                innerLo = std::min(innerLo, v);
+                innerHi = std::max(innerHi, v);
+            }
+        }
+        if (innerLo <= innerHi) {
+            TryAlphaEndpoints(values, innerLo, innerHi, best);
+        }
+    }
+    return best;
+}
+
+void EncodeAlphaBlock(const float values[16], Quality quality, uint8_t *out)
+{
+    auto best = FindAlphaEndpoints(values, quality);
+    WriteAlphaBlock(best.a0, best.a1, best.indices, out);
+}
+
+// ----------------------------------------------------------------------------------------------
+// Reference encoder: plain scalar code and a greedy search around the best endpoints found.
+
+float ColorErrorScalar(const uint8_t rgba[64], uint16_t c0, uint16_t c1, uint8_t indices[16])
+{
+    float palette[4][3];
+    BuildColorPalette(c0, c1, false, palette);
+
+    float error = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float bestError = FLT_MAX;
+        for (uint8_t k = 0; k < 4; ++k) {
+            float d = 0.0f;
+            for (int c = 0; c < 3; ++c) {
+                float delta = rgba[4 * i + c] - palette[k][c];
+                d += delta * delta;
+            }
+            if (d < bestError) {
+                bestError = d;
+                indices[i] = k;
+            }
+        }
+        error += bestError;
+    }
+    return error;
+}
+
+void EncodeColorBlockReference(const uint8_t rgba[64], const Block &block, uint8_t *out)
+{
+    if (IsSingleColor(rgba)) {
+        EncodeSingleColor(rgba, out);
+        return;
+    }
+
+    ColorCandidate best;
+    float e0[3];
+    float e1[3];
+    BoundingBoxEndpoints(block, e0, e1);
+    TryColorEndpoints(block, e0, e1, best);
+    PrincipalAxisEndpoints(block, e0, e1);
+    TryColorEndpoints(block, e0, e1, best);
+    RefineColorEndpoints(block, 8, best);
+
+    // Step each of the six endpoint channels by one while that lowers the error.
+    static const int kShift[3] = {11, 5, 0};
+    static const int kMax[3] = {31, 63, 31};
+    uint16_t endpoints[2] = {best.c0, best.c1};
+    float bestError = ColorErrorScalar(rgba, endpoints[0], endpoints[1], best.indices);
+    for (bool improved = true; improved;) {
+        improved = false;
+        for (int e = 0; e < 2; ++e) {
+            for (int c = 0; c < 3; ++c) {
+                for (int step = -1; step <= 1; step += 2) {
+                    int value = (endpoints[e] >> kShift[c]) & kMax[c];
+                    if (value + step < 0 || value + step > kMax[c])
+                        continue;
+
+                    uint16_t trial[2] = {endpoints[0], endpoints[1]};
+                    trial[e] = uint16_t((trial[e] & ~(kMax[c] << kShift[c]))
+                                        | (value + step) << kShift[c]);
+                    uint8_t indices[16];
+                    float error = ColorErrorScalar(rgba, trial[0], trial[1], indices);
+                    if (error < bestError) {
+                        bestError = error;
+                        endpoints[e] = trial[e];
+                        memcpy(best.indices, indices, 16);
+                        improved = true;
+                    }
+                }
+            }
+        }
+    }
+
+    WriteColorBlock(endpoints[0], endpoints[1], best.indices, false, out);
+}
+
+void EncodeAlphaBlockReference(const float values[16], uint8_t *out)
+{
+    int lo = int(*std::min_element(values, values + 16));
+    int hi = int(*std::max_element(values, values + 16));
+
+    // Both modes, endpoints within 4 of the extremes and of the best the High level finds.
+    auto best = FindAlphaEndpoints(values, Quality::High);
+    int centers[2][2] = {{std::max(best.a0, best.a1), std::min(best.a0, best.a1)}, {hi, lo}};
+    for (const auto &center : centers) {
+        for (int a0 = std::max(center[0] - 4, 0); a0 <= std::min(center[0] + 4, 255); ++a0) {
+            for (int a1 = std::max(center[1] - 4, 0); a1 <= std::min(center[1] + 4, 255); ++a1) {
+                for (int mode = 0; mode < 2; ++mode) {
+                    AlphaCandidate candidate;
+                    candidate.a0 = mode == 0 ? a0 : a1;
+                    candidate.a1 = mode == 0 ? a1 : a0;
+                    candidate.error = AssignAlphaIndicesScalar(
+                        values, candidate.a0, candidate.a1, candidate.indices);
+                    if (candidate.error < best.error) {
+                        best = candidate;
+                    }
+                }
+            }
+        }
+    }
+    WriteAlphaBlock(best.a0, best.a1, best.indices, out);
+}
+
+// ----------------------------------------------------------------------------------------------
+// Decoding
+
+void DecodeColorBlock(const uint8_t *block, bool allowThreeColor, uint8_t rgba[64])
+{
+    uint16_t c0 = uint16_t(block[0] | block[1] << 8);
+    uint16_t c1 = uint16_t(block[2] | block[3] << 8);
+    int e0[3];
+    int e1[3];
+    Expand565(c0, e0);
+    Expand565(c1, e1);
+
+    bool threeColor = allowThreeColor && c0 <= c1;
+    uint8_t palette[4][4];
+    for (int c = 0; c < 3; ++c) {
+        palette[0][c] = uint8_t(e0[c]);
+        palette[1][c] = uint8_t(e1[c]);
+        if (threeColor) {
+            palette[2][c] = uint8_t((e0[c] + e1[c]) / 2);
+            palette[3][c] = 0;
+        } else {
+            palette[2][c] = uint8_t((2 * e0[c] + e1[c]) / 3);
+            palette[3][c] = uint8_t((e0[c] + 2 * e1[c]) / 3);
+        }
+    }
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = threeColor ? 0 : 255;
+
+    uint32_t bits;
+    memcpy(&bits, block + 4, 4);
+    for (int i = 0; i < 16; ++i) {
+        memcpy(rgba + 4 * i, palette[(bits >> (2 * i)) & 3], 4);
+    }
+}
+
+void DecodeAlphaBlock(const uint8_t *block, uint8_t *rgba, int channel)
+{
+    int a0 = block[0];
+    int a1 = block[1];
+    uint8_t palette[8];
+    palette[0] = uint8_t(a0);
+    palette[1] = uint8_t(a1);
+    if (a0 > a1) {
+        for (int i = 1; i < 7; ++i) {
+            palette[i + 1] = uint8_t(((7 - i) * a0 + i * a1 + 3) / 7);
+        }
+    } else {
+        for (int i = 1; i < 5; ++i) {
+            palette[i + 1] = uint8_t(((5 - i) * a0 + i * a1 + 2) / 5);
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i) {
+        bits |= uint64_t(block[2 + i]) << (8 * i);
+    }
+    for (int i = 0; i < 16; ++i) {
+        rgba[4 * i + channel] = palette[(bits >> (3 * i)) & 7];
+    }
+}
+} // namespace
+
+size_t BlockCompressor::GetBlockBytes(Format format)
+{
+    return format == Format::BC1 || format == Format::BC4 ? 8 : 16;
+}
+
+size_t BlockCompressor::GetCompressedSize(Format format, uint32_t width, uint32_t height)
+{
+    size_t blocksWide = std::max<size_t>(1, (width + 3) / 4);
+    size_t blocksHigh = std::max<size_t>(1, (height + 3) / 4);
+    return blocksWide * blocksHigh * GetBlockBytes(format);
+}
+
+const char *BlockCompressor::GetInstructionSet()
+{
+#if BLOCK_COMPRESSOR_AVX2
+    return "AVX2";
+#elif BLOCK_COMPRESSOR_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+void BlockCompressor::CompressBlock(Format format, Quality quality, const uint8_t rgba[64], uint8_t *block)
+{
+    Block pixels = LoadBlock(rgba);
+    bool reference = quality == Quality::Reference;
+
+    switch (format) {
+    case Format::BC1:
+        for (int i = 0; i < 16; ++i) {
+            if (rgba[4 * i + 3] < 128) {
+                EncodeTransparentColorBlock(rgba, block);
+                return;
+            }
+        }
+        if (reference) {
+            EncodeColorBlockReference(rgba, pixels, block);
+        } else {
+            EncodeColorBlock(rgba, pixels, quality, block);
+        }
+        break;
+
+    case Format::BC3:
+        if (reference) {
+            EncodeAlphaBlockReference(pixels.channels[3], block);
+            EncodeColorBlockReference(rgba, pixels, block + 8);
+        } else {
+            EncodeAlphaBlock(pixels.channels[3], quality, block);
+            EncodeColorBlock(rgba, pixels, quality, block + 8);
+        }
+        break;
+
+    case Format::BC4:
+    case Format::BC5:
+        for (int c = 0; c < (format == Format::BC4 ? 1 : 2); ++c) {
+            if (reference) {
+                EncodeAlphaBlockReference(pixels.channels[c], block + 8 * c);
+            } else {
+                EncodeAlphaBlock(pixels.channels[c], quality, block + 8 * c);
+            }
+        }
+        break;
+    }
+}
+
+void BlockCompressor::DecompressBlock(Format format, const uint8_t *block, uint8_t rgba[64])
+{
+    switch (format) {
+    case Format::BC1:
+        DecodeColorBlock(block, true, rgba);
+        break;
+
+    case Format::BC3:
+        DecodeColorBlock(block + 8, false, rgba);
+        DecodeAlphaBlock(block, rgba, 3);
+        break;
+
+    case Format::BC4:
+    case Format::BC5:
+        for (int i = 0; i < 16; ++i) {
+            rgba[4 * i + 0] = 0;
+            rgba[4 * i + 1] = 0;
+            rgba[4 * i + 2] = 0;
+            rgba[4 * i + 3] = 255;
+        }
+        DecodeAlphaBlock(block, rgba, 0);
+        if (format == Format::BC5) {
+            DecodeAlphaBlock(block + 8, rgba, 1);
+        }
+        break;
+    }
+}
+
+void BlockCompressor::Compress(Format format,
+                               Quality quality,
+                               const uint8_t *rgba,
+                               uint32_t width,
+                               uint32_t height,
+                               size_t rowPitch,
+                               uint8_t *blocks,
+                               unsigned threadCount)
+{
+    uint32_t blocksWide = std::max(1u, (width + 3) / 4);
+    uint32_t blocksHigh = std::max(1u, (height + 3) / 4);
+    size_t blockBytes = GetBlockBytes(format);
+
+    std::atomic<uint32_t> nextRow(0);
+    auto work = [&]() {
+        uint8_t pixels[64];
+        for (uint32_t by = nextRow++; by < blocksHigh; by = nextRow++) {
+            for (uint32_t bx = 0; bx < blocksWide; ++bx) {
+                for (uint32_t i = 0; i < 16; ++i) {
+                    uint32_t x = std::min(4 * bx + i % 4, width - 1);
+                    uint32_t y = std::min(4 * by + i / 4, height - 1);
+                    memcpy(pixels + 4 * i, rgba + y * rowPitch + 4 * x, 4);
+                }
+                CompressBlock(format, quality, pixels, blocks + (size_t(by) * blocksWide + bx) * blockBytes);
+            }
+        }
+    };
+
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threadCount = std::min(threadCount, blocksHigh);
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threadCount; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void BlockCompressor::Decompress(Format format,
+                                 const uint8_t *blocks,
+                                 uint32_t width,
+                                 uint32_t height,
+                                 uint8_t *rgba,
+                                 size_t rowPitch)
+{
+    uint32_t blocksWide = std::max(1u, (width + 3) / 4);
+    uint32_t blocksHigh = std::max(1u, (height + 3) / 4);
+    size_t blockBytes = GetBlockBytes(format);
+
+    uint8_t pixels[64];
+    for (uint32_t by = 0; by < blocksHigh; ++by) {
+        for (uint32_t bx = 0; bx < blocksWide; ++bx) {
+            DecompressBlock(format, blocks + (size_t(by) * blocksWide + bx) * blockBytes, pixels);
+            for (uint32_t i = 0; i < 16; ++i) {
+                uint32_t x = 4 * bx + i % 4;
+                uint32_t y = 4 * by + i / 4;
+                if (x < width && y < height) {
+                    memcpy(rgba + y * rowPitch + 4 * x, pixels + 4 * i, 4);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CPU encoder and decoder for the BC1, BC3, BC4 and BC5 block compressed formats.  Portable so
+// the offline tools share it with the streamer, which compresses uncompressed textures at load
+// time.  The per-block kernels use AVX2 when compiled for it (/arch:AVX2, -mavx2), SSE2 on any
+// other x86 build and plain C++ elsewhere; images are split over threads by rows of blocks.
+namespace BlockCompressor
+{
+enum class Format
+{
+    BC1, // RGB, 1 bit alpha
+    BC3, // RGBA
+    BC4, // R
+    BC5, // RG
+};
+
+// Speed against quality.  Each level roughly halves the speed of the one before it.
+enum class Quality
+{
+    // Bounding box endpoints.
+    Fast,
+    // Principal axis endpoints refined once by least squares.
+    Normal,
+    // As Normal with more refinement, plus the second BC4 interpolation mode.
+    High,
+    // Scalar search over endpoint neighbourhoods the others are measured against; far slower.
+    Reference,
+};
+
+// Bytes per 4x4 block.
+size_t GetBlockBytes(Format format);
+
+// Size of a width x height image in blocks, edge blocks included.
+size_t GetCompressedSize(Format format, uint32_t width, uint32_t height);
+
+// Name of the instruction set the kernels were compiled for.
+const char *GetInstructionSet();
+
+// rgba holds width x height RGBA8 pixels, rowPitch bytes apart.  BC4 encodes R, BC5 R and G.
+// Blocks are written row by row; pixels beyond the image edge repeat the last row and column.
+// threadCount 0 uses every core.
+void Compress(Format format,
+              Quality quality,
+              const uint8_t *rgba,
+              uint32_t width,
+              uint32_t height,
+              size_t rowPitch,
+              uint8_t *blocks,
+              unsigned threadCount = 0);
+
+// rgba holds the 16 pixels of one block, row by row.
+void CompressBlock(Format format, Quality quality, const uint8_t rgba[64], uint8_t *block);
+
+// Channels a format does not store decode as 0, alpha as 255.
+void Decompress(Format format,
+                const uint8_t *blocks,
+                uint32_t width,
+                uint32_t height,
+                uint8_t *rgba,
+                size_t rowPitch);
+
+void DecompressBlock(Format format, const uint8_t *block, uint8_t rgba[64]);
+} // namespace BlockCompressor
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+// Size of a buffer that grows with the scene, for telemetry: the elements it holds, the most it
+// was asked to hold and how many times it was replaced by a larger one.
+struct BufferUsage
+{
+    uint32_t capacity = 0;
+    uint32_t highWater = 0;
+    uint32_t reallocations = 0;
+};
+
+// The capacity a buffer asked to hold count elements needs, or 0 if it is large enough.  It
+// grows to at least half as large again, so that a scene growing a few at a time rarely
+// reallocates.  A buffer replaced by a larger one holds nothing, so everything is written again.
+// Portable so the tools can check it.
+inline uint32_t GrowCapacity(BufferUsage &usage, uint32_t count)
+{
+    usage.highWater = count > usage.highWater ? count : usage.highWater;
+    if (count <= usage.capacity)
+        return 0;
+    uint32_t grown = usage.capacity + usage.capacity / 2;
+    usage.capacity = count > grown ? count : grown;
+    ++usage.reallocations;
+    return usage.capacity;
+}
@@ -1669,16 +1669,14 @@ static HRESULT CreateTextureFromDDS( _In_ ID3D11Device* d3dDevice,
     return hr;
 }
 
-static HRESULT CreateTextureFromDDS12(
-	_In_ ID3D12Device* device,
-	_In_opt_ ID3D12GraphicsCommandList* cmdList,
+static DDS_ALPHA_MODE GetAlphaMode( _In_ const DDS_HEADER* header );
+
+static HRESULT FillTextureData12(
 	_In_ const DDS_HEADER* header,
 	_In_reads_bytes_(bitSize) const uint8_t* bitData,
 	_In_ size_t bitSize,
 	_In_ size_t maxsize,
-	_In_ bool forceSRGB,
-	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap)
+	_Out_ DDSTextureData12& textureData)
 {
 	HRESULT hr = S_OK;
 
@@ -1835,15 +1833,8 @@ static HRESULT CreateTextureFromDDS12(
 		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
 	}
 
-	// Create the texture
-	std::unique_ptr<D3D12_SUBRESOURCE_DATA[]> initData(
-		new (std::nothrow) D3D12_SUBRESOURCE_DATA[mipCount * arraySize]
-		);
-
-	if (!initData)
-	{
-		return E_OUTOFMEMORY;
-	}
+	// Locate the subresources
+	textureData.initData.resize(mipCount * arraySize);
 
 	size_t skipMip = 0;
 	size_t twidth = 0;
@@ -1852,27 +1843,57 @@ static HRESULT CreateTextureFromDDS12(
 
 	hr = FillInitData12(
 		width, height, depth, mipCount, arraySize, format, maxsize, bitSize, bitData,
-		twidth, theight, tdepth, skipMip, initData.get()
+		twidth, theight, tdepth, skipMip, textureData.initData.data()
 		);
 
 	if (SUCCEEDED(hr))
 	{
-		hr = CreateD3DResources12(
-			device, cmdList,
-			resDim, twidth, theight, tdepth,
-			mipCount - skipMip,
-			arraySize,
-			format,
-			false, // forceSRGB
-			isCubeMap,
-			initData.get(),
-			texture, 
-			textureUploadHeap);
+		textureData.resDim = resDim;
+		textureData.width = twidth;
+		textureData.height = theight;
+		textureData.depth = tdepth;
+		textureData.mipCount = mipCount - skipMip;
+		textureData.arraySize = arraySize;
+		textureData.format = format;
+		textureData.isCubeMap = isCubeMap;
+		textureData.initData.resize(textureData.mipCount * arraySize);
+		textureData.alphaMode = GetAlphaMode(header);
 	}
 
 	return hr;
 }
 
+static HRESULT CreateTextureFromDDS12(
+	_In_ ID3D12Device* device,
+	_In_opt_ ID3D12GraphicsCommandList* cmdList,
+	_In_ const DDS_HEADER* header,
+	_In_reads_bytes_(bitSize) const uint8_t* bitData,
+	_In_ size_t bitSize,
+	_In_ size_t maxsize,
+	_In_ bool forceSRGB,
+	ComPtr<ID3D12Resource>& texture,
+	ComPtr<ID3D12Resource>& textureUploadHeap)
+{
+	DDSTextureData12 textureData;
+	HRESULT hr = FillTextureData12(header, bitData, bitSize, maxsize, textureData);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	return CreateD3DResources12(
+		device, cmdList,
+		textureData.resDim, textureData.width, textureData.height, textureData.depth,
+		textureData.mipCount,
+		textureData.arraySize,
+		textureData.format,
+		false, // forceSRGB
+		textureData.isCubeMap,
+		textureData.initData.data(),
+		texture,
+		textureUploadHeap);
+}
+
 //--------------------------------------------------------------------------------------
 static DDS_ALPHA_MODE GetAlphaMode( _In_ const DDS_HEADER* header )
 {
@@ -2121,6 +2142,78 @@ HRESULT DirectX::CreateDDSTextureFromMemoryEx( ID3D11Device* d3dDevice,
 }
 
 //--------------------------------------------------------------------------------------
+HRESULT DirectX::LoadDDSTextureDataFromFile12(_In_z_ const wchar_t* szFileName,
+	_Out_ DDSTextureData12& textureData,
+	_In_ size_t maxsize)
+{
+	textureData = DDSTextureData12();
+
+	if (!szFileName)
+	{
+		return E_INVALIDARG;
+	}
+
+	DDS_HEADER* header = nullptr;
+	uint8_t* bitData = nullptr;
+	size_t bitSize = 0;
+
+	HRESULT hr = LoadTextureDataFromFile(szFileName, textureData.ddsData, &header, &bitData, &bitSize);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	// The subresource pointers reference ddsData, which stays owned by textureData.
+	return FillTextureData12(header, bitData, bitSize, maxsize, textureData);
+}
+
+HRESULT DirectX::CreateDDSTextureFromData12(_In_ ID3D12Device* device,
+	_In_ ID3D12GraphicsCommandList* cmdList,
+	_In_ const DDSTextureData12& textureData,
+	_Out_ ComPtr<ID3D12Resource>& texture,
+	_Out_ ComPtr<ID3D12Resource>& textureUploadHeap,
+	_In_ size_t firstMip)
+{
+	if (!device || !cmdList || textureData.initData.empty() || firstMip >= textureData.mipCount)
+	{
+		return E_INVALIDARG;
+	}
+
+	// Subresources are stored slice by slice, so the kept mips of each slice stay contiguous.
+	std::vector<D3D12_SUBRESOURCE_DATA> initData;
+	initData.reserve((textureData.mipCount - firstMip) * textureData.arraySize);
+	for (size_t j = 0; j < textureData.arraySize; j++)
+	{
+		auto slice = textureData.initData.begin() + j * textureData.mipCount;
+		initData.insert(initData.end(), slice + firstMip, slice + textureData.mipCount);
+	}
+
+	return CreateD3DResources12(
+		device, cmdList,
+		textureData.resDim,
+		std::max<size_t>(textureData.width >> firstMip, 1),
+		std::max<size_t>(textureData.height >> firstMip, 1),
+		std::max<size_t>(textureData.depth >> firstMip, 1),
+		textureData.mipCount - firstMip,
+		textureData.arraySize,
+		textureData.format,
+		false, // forceSRGB
+		textureData.isCubeMap,
+		initData.data(),
+		texture,
+		textureUploadHeap);
+}
+
+size_t DirectX::GetDDSMipLevelBytes12(_In_ const DDSTextureData12& textureData, _In_ size_t mip)
+{
+	size_t bytes = 0;
+	for (size_t j = 0; j < textureData.arraySize; j++)
+	{
+		bytes += textureData.initData[j * textureData.mipCount + mip].SlicePitch;
+	}
+	return bytes;
+}
+
 _Use_decl_annotations_
 HRESULT DirectX::CreateDDSTextureFromFile( ID3D11Device* d3dDevice,
                                            const wchar_t* fileName,
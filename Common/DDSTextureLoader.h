@@ -24,6 +24,8 @@
 
 #include <wrl.h>
 #include <d3d11_1.h>
+#include <memory>
+#include <vector>
 #include "d3dx12.h"
 
 #pragma warning(push)
@@ -92,6 +94,45 @@ namespace DirectX
 		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                               );
 
+	// System memory copy of a DDS file split into the subresources of a D3D12 texture.
+	// Filling one does not touch the device, so it can be done on a worker thread and
+	// handed to CreateDDSTextureFromData12 on the thread that owns the command list.
+	struct DDSTextureData12
+	{
+		std::unique_ptr<uint8_t[]> ddsData;
+
+		uint32_t resDim = 0; // D3D12_RESOURCE_DIMENSION
+		size_t width = 0;
+		size_t height = 0;
+		size_t depth = 0;
+		size_t mipCount = 0;
+		size_t arraySize = 0;
+		DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+		bool isCubeMap = false;
+		DDS_ALPHA_MODE alphaMode = DDS_ALPHA_MODE_UNKNOWN;
+
+		// One entry per subresource (every mip of slice 0, then slice 1, ...), pointing into ddsData.
+		std::vector<D3D12_SUBRESOURCE_DATA> initData;
+	};
+
+	HRESULT LoadDDSTextureDataFromFile12(_In_z_ const wchar_t* szFileName,
+		                                 _Out_ DDSTextureData12& textureData,
+		                                 _In_ size_t maxsize = 0
+		                                 );
+
+	// Creates the texture with mips [firstMip, mipCount) of textureData only, so the
+	// resident part of a mip chain can grow and shrink without keeping the full chain.
+	HRESULT CreateDDSTextureFromData12(_In_ ID3D12Device* device,
+		                               _In_ ID3D12GraphicsCommandList* cmdList,
+		                               _In_ const DDSTextureData12& textureData,
+		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& textureUploadHeap,
+		                               _In_ size_t firstMip = 0
+		                               );
+
+	// Size of one mip level summed over all array slices, as laid out by FillInitData12.
+	size_t GetDDSMipLevelBytes12(_In_ const DDSTextureData12& textureData, _In_ size_t mip);
+
     // Standard version with optional auto-gen mipmap support
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_opt_ ID3D11DeviceContext* d3dContext,
@@ -0,0 +1,107 @@
+#include "DrawSort.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DrawSort;
+
+namespace
+{
+const int kDigitBits = 8;
+const size_t kRadix = size_t(1) << kDigitBits;
+// Entries each task counts and scatters; fixed, so that the order does not depend on the pool.
+const size_t kBlockSize = 16384;
+
+uint64_t Mask(int bits)
+{
+    return (uint64_t(1) << bits) - 1;
+}
+
+template <typename Task>
+void RunTasks(WorkerPool *pool, size_t taskCount, Task task)
+{
+    if (pool != nullptr && taskCount > 1) {
+        pool->Run(taskCount, task);
+        return;
+    }
+    for (size_t i = 0; i < taskCount; ++i) {
+        task(i);
+    }
+}
+} // namespace
+
+uint64_t DrawSort::MakeState(uint32_t pso, uint32_t geometry, uint32_t material)
+{
+    return (uint64_t(pso) & Mask(kPsoBits)) << (kGeometryBits + kMaterialBits)
+           | (uint64_t(geometry) & Mask(kGeometryBits)) << kMaterialBits
+           | (uint64_t(material) & Mask(kMaterialBits));
+}
+
+uint32_t DrawSort::QuantizeDepth(float distance, float nearZ, float farZ)
+{
+    float t = (distance - nearZ) / (farZ - nearZ);
+    if (!(t > 0.0f))
+        return 0;
+    auto maxDepth = uint32_t(Mask(kDepthBits));
+    return t >= 1.0f ? maxDepth : uint32_t(std::lround(t * float(maxDepth)));
+}
+
+uint64_t DrawSort::MakeKey(uint32_t layer, uint64_t state, uint32_t depth, Order order)
+{
+    uint64_t key = (uint64_t(layer) & Mask(kLayerBits)) << (64 - kLayerBits);
+    state &= Mask(kStateBits);
+    uint64_t quantized = uint64_t(depth) & Mask(kDepthBits);
+    if (order == kFrontToBack)
+        return key | state << kDepthBits | quantized;
+    return key | (Mask(kDepthBits) - quantized) << kStateBits | state;
+}
+
+void DrawSort::Sort(std::vector<Entry> &entries, std::vector<Entry> &scratch, WorkerPool *pool)
+{
+    size_t count = entries.size();
+    if (count < 2)
+        return;
+    scratch.resize(count);
+
+    // Bytes every key shares leave the order as it is.
+    uint64_t differing = 0;
+    for (const auto &entry : entries) {
+        differing |= entry.key ^ entries[0].key;
+    }
+
+    // Each pass counts every block's digits, gives each block where its entries of each digit
+    // start, digits first and blocks in order, and moves them there in order, which keeps the
+    // sort stable from one pass to the next.
+    size_t blockCount = (count + kBlockSize - 1) / kBlockSize;
+    std::vector<uint32_t> starts(blockCount * kRadix);
+    for (int shift = 0; shift < 64; shift += kDigitBits) {
+        if (((differing >> shift) & Mask(kDigitBits)) == 0)
+            continue;
+
+        RunTasks(pool, blockCount, [&](size_t block) {
+            uint32_t *blockCounts = &starts[block * kRadix];
+            std::fill(blockCounts, blockCounts + kRadix, 0);
+            size_t end = std::min(count, (block + 1) * kBlockSize);
+            for (size_t i = block * kBlockSize; i < end; ++i) {
+                ++blockCounts[(entries[i].key >> shift) & Mask(kDigitBits)];
+            }
+        });
+        uint32_t start = 0;
+        for (size_t digit = 0; digit < kRadix; ++digit) {
+            for (size_t block = 0; block < blockCount; ++block) {
+                uint32_t digitCount = starts[block * kRadix + digit];
+                starts[block * kRadix + digit] = start;
+                start += digitCount;
+            }
+        }
+        RunTasks(pool, blockCount, [&](size_t block) {
+            uint32_t *blockStarts = &starts[block * kRadix];
+            size_t end = std::min(count, (block + 1) * kBlockSize);
+            for (size_t i = block * kBlockSize; i < end; ++i) {
+                scratch[blockStarts[(entries[i].key >> shift) & Mask(kDigitBits)]++] = entries[i];
+            }
+        });
+        entries.swap(scratch);
+    }
+}
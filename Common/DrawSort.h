@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+// Draws ordered by 64-bit keys: the render layer first, then, for draws that may be submitted in
+// any order, the state they are drawn with (PSO, geometry, material) and their depth front to
+// back, so that draws sharing state are neighbours and the nearest of them hide what is behind
+// first; for blended draws, their depth back to front before their state.  Keys are sorted with
+// an LSD radix sort a byte at a time, skipping the bytes every key shares, whose passes are
+// shared across a WorkerPool in blocks of a fixed size, so the order does not depend on the
+// number of threads.  Portable so the tools can measure it.
+namespace DrawSort
+{
+const int kLayerBits = 4;
+const int kPsoBits = 8;
+const int kGeometryBits = 16;
+const int kMaterialBits = 12;
+const int kDepthBits = 24;
+const int kStateBits = kPsoBits + kMaterialBits + kGeometryBits;
+static_assert(kLayerBits + kStateBits + kDepthBits == 64, "Sort keys must fill 64 bits");
+
+enum Order : uint8_t {
+    // State first, then nearest first.
+    kFrontToBack,
+    // Farthest first, then state.
+    kBackToFront,
+};
+
+struct Entry
+{
+    uint64_t key = 0;
+    // What the caller draws, such as a render item.
+    uint32_t value = 0;
+};
+
+// Packs the state a draw needs, most costly to change first, each field cut to its bits.
+uint64_t MakeState(uint32_t pso, uint32_t geometry, uint32_t material);
+
+// Maps a view distance in [nearZ, farZ] to kDepthBits bits, clamped.
+uint32_t QuantizeDepth(float distance, float nearZ, float farZ);
+
+uint64_t MakeKey(uint32_t layer, uint64_t state, uint32_t depth, Order order);
+
+inline uint32_t GetLayer(uint64_t key)
+{
+    return uint32_t(key >> (64 - kLayerBits));
+}
+
+// Sorts entries by key, keeping the order of equal keys.  scratch is resized to match and holds
+// nothing useful afterwards.  pool may be null to sort on the calling thread alone.
+void Sort(std::vector<Entry> &entries, std::vector<Entry> &scratch, WorkerPool *pool);
+} // namespace DrawSort
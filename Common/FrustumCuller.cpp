@@ -0,0 +1,319 @@
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE2 1
+#endif
+
+using namespace FrustumCuller;
+
+namespace
+{
+// A vector of floats in the widest registers compiled in, as in BlockCompressor.  Masks come
+// from the comparisons and are only consumed by Or and MoveMask.
+#if FRUSTUM_CULLER_AVX2
+struct Floats
+{
+    static const int kWidth = 8;
+    __m256 v;
+
+    static Floats Load(const float *p) { return {_mm256_loadu_ps(p)}; }
+    static Floats Set(float x) { return {_mm256_set1_ps(x)}; }
+    static Floats Zero() { return {_mm256_setzero_ps()}; }
+
+    friend Floats operator+(Floats a, Floats b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend Floats operator*(Floats a, Floats b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend Floats operator-(Floats a) { return {_mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f))}; }
+    friend Floats Less(Floats a, Floats b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+    friend Floats Or(Floats a, Floats b) { return {_mm256_or_ps(a.v, b.v)}; }
+    friend int MoveMask(Floats mask) { return _mm256_movemask_ps(mask.v); }
+};
+#elif FRUSTUM_CULLER_SSE2
+struct Floats
+{
+    static const int kWidth = 4;
+    __m128 v;
+
+    static Floats Load(const float *p) { return {_mm_loadu_ps(p)}; }
+    static Floats Set(float x) { return {_mm_set1_ps(x)}; }
+    static Floats Zero() { return {_mm_setzero_ps()}; }
+
+    friend Floats operator+(Floats a, Floats b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend Floats operator*(Floats a, Floats b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend Floats operator-(Floats a) { return {_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))}; }
+    friend Floats Less(Floats a, Floats b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+    friend Floats Or(Floats a, Floats b) { return {_mm_or_ps(a.v, b.v)}; }
+    friend int MoveMask(Floats mask) { return _mm_movemask_ps(mask.v); }
+};
+#else
+struct Floats
+{
+    static const int kWidth = 1;
+    float v;
+
+    static Floats Load(const float *p) { return {*p}; }
+    static Floats Set(float x) { return {x}; }
+    static Floats Zero() { return {0.0f}; }
+
+    friend Floats operator+(Floats a, Floats b) { return {a.v + b.v}; }
+    friend Floats operator*(Floats a, Floats b) { return {a.v * b.v}; }
+    friend Floats operator-(Floats a) { return {-a.v}; }
+    friend Floats Less(Floats a, Floats b) { return {a.v < b.v ? 1.0f : 0.0f}; }
+    friend Floats Or(Floats a, Floats b) { return {a.v != 0.0f || b.v != 0.0f ? 1.0f : 0.0f}; }
+    friend int MoveMask(Floats mask) { return mask.v != 0.0f ? 1 : 0; }
+};
+#endif
+
+Plane Normalize(float a, float b, float c, float d)
+{
+    float length = std::sqrt(a * a + b * b + c * c);
+    if (length == 0.0f)
+        return {a, b, c, d};
+    return {a / length, b / length, c / length, d / length};
+}
+
+// The box is outside if its center is further behind a plane than its extents reach towards
+// it, and inside if every plane has it further in front.  The distances are summed in the same
+// order as the kernel's so both round alike.  The planes are tried from firstPlane on, which
+// changes how soon an outside box is found but not the result.
+Containment TestPlanes(const Frustum &frustum,
+                       float cx,
+                       float cy,
+                       float cz,
+                       float ex,
+                       float ey,
+                       float ez,
+                       uint8_t &firstPlane)
+{
+    bool intersects = false;
+    for (size_t i = 0; i < kPlaneCount; ++i) {
+        size_t p = firstPlane + i < kPlaneCount ? firstPlane + i : firstPlane + i - kPlaneCount;
+        const auto &plane = frustum.planes[p];
+        float distance = plane.a * cx + plane.b * cy + plane.c * cz + plane.d;
+        float radius = std::abs(plane.a) * ex + std::abs(plane.b) * ey + std::abs(plane.c) * ez;
+        if (distance < -radius) {
+            firstPlane = uint8_t(p);
+            return kOutside;
+        }
+        intersects = intersects || distance < radius;
+    }
+    return intersects ? kIntersects : kInside;
+}
+
+// The planes broadcast across lanes once, for any number of ranges of boxes.
+class Kernel
+{
+public:
+    explicit Kernel(const Frustum &frustum)
+        : mFrustum(frustum)
+    {
+        for (size_t p = 0; p < kPlaneCount; ++p) {
+            const auto &plane = frustum.planes[p];
+            mPlanes[p] = {Floats::Set(plane.a),
+                          Floats::Set(plane.b),
+                          Floats::Set(plane.c),
+                          Floats::Set(plane.d),
+                          Floats::Set(std::abs(plane.a)),
+                          Floats::Set(std::abs(plane.b)),
+                          Floats::Set(std::abs(plane.c))};
+        }
+    }
+
+    void Run(const BoxArray &boxes, size_t begin, size_t end, uint8_t *containments) const
+    {
+        size_t i = begin;
+        for (; i + Floats::kWidth <= end; i += Floats::kWidth) {
+            auto cx = Floats::Load(&boxes.centerX[i]);
+            auto cy = Floats::Load(&boxes.centerY[i]);
+            auto cz = Floats::Load(&boxes.centerZ[i]);
+            auto ex = Floats::Load(&boxes.extentX[i]);
+            auto ey = Floats::Load(&boxes.extentY[i]);
+            auto ez = Floats::Load(&boxes.extentZ[i]);
+
+            auto outside = Floats::Zero();
+            auto intersects = Floats::Zero();
+            for (const auto &plane : mPlanes) {
+                auto distance = plane.a * cx + plane.b * cy + plane.c * cz + plane.d;
+                auto radius = plane.absA * ex + plane.absB * ey + plane.absC * ez;
+                outside = Or(outside, Less(distance, -radius));
+                intersects = Or(intersects, Less(distance, radius));
+            }
+
+            // A box outside a plane also intersects it, so each bit takes one step down from
+            // kInside.
+            int outsideBits = MoveMask(outside);
+            int intersectsBits = MoveMask(intersects);
+            auto *out = containments + (i - begin);
+            for (int lane = 0; lane < Floats::kWidth; ++lane) {
+                out[lane] = uint8_t(kInside - ((intersectsBits >> lane) & 1)
+                                    - ((outsideBits >> lane) & 1));
+            }
+        }
+        for (; i < end; ++i) {
+            uint8_t firstPlane = 0;
+            containments[i - begin] = TestPlanes(mFrustum,
+                                                 boxes.centerX[i],
+                                                 boxes.centerY[i],
+                                                 boxes.centerZ[i],
+                                                 boxes.extentX[i],
+                                                 boxes.extentY[i],
+                                                 boxes.extentZ[i],
+                                                 firstPlane);
+        }
+    }
+
+private:
+    struct PlaneFloats
+    {
+        Floats a, b, c, d;
+        Floats absA, absB, absC;
+    };
+
+    const Frustum &mFrustum;
+    PlaneFloats mPlanes[kPlaneCount];
+};
+} // namespace
+
+void BoxArray::Resize(size_t size)
+{
+    for (auto *array : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ}) {
+        array->resize(size);
+    }
+}
+
+void BoxArray::Set(size_t index, const Box &box)
+{
+    centerX[index] = box.center[0];
+    centerY[index] = box.center[1];
+    centerZ[index] = box.center[2];
+    extentX[index] = box.extents[0];
+    extentY[index] = box.extents[1];
+    extentZ[index] = box.extents[2];
+}
+
+Box BoxArray::Get(size_t index) const
+{
+    return {{centerX[index], centerY[index], centerZ[index]},
+            {extentX[index], extentY[index], extentZ[index]}};
+}
+
+Frustum FrustumCuller::ExtractFrustum(const float viewProj[16])
+{
+    // Clip coordinates are dot products of the point with the matrix's columns; each plane
+    // bounds one of them by w (Gribb and Hartmann).
+    float x[4], y[4], z[4], w[4];
+    for (int k = 0; k < 4; ++k) {
+        x[k] = viewProj[k * 4 + 0];
+        y[k] = viewProj[k * 4 + 1];
+        z[k] = viewProj[k * 4 + 2];
+        w[k] = viewProj[k * 4 + 3];
+    }
+    return {{Normalize(z[0], z[1], z[2], z[3]),
+             Normalize(w[0] - z[0], w[1] - z[1], w[2] - z[2], w[3] - z[3]),
+             Normalize(w[0] + x[0], w[1] + x[1], w[2] + x[2], w[3] + x[3]),
+             Normalize(w[0] - x[0], w[1] - x[1], w[2] - x[2], w[3] - x[3]),
+             Normalize(w[0] - y[0], w[1] - y[1], w[2] - y[2], w[3] - y[3]),
+             Normalize(w[0] + y[0], w[1] + y[1], w[2] + y[2], w[3] + y[3])}};
+}
+
+Box FrustumCuller::TransformBox(const Box &box, const float world[16])
+{
+    Box result;
+    bool affine = world[3] == 0.0f && world[7] == 0.0f && world[11] == 0.0f && world[15] == 1.0f;
+    if (affine) {
+        // Each world axis gathers the extents of the box along the rows' absolute values
+        // (Arvo 1990).
+        for (int j = 0; j < 3; ++j) {
+            result.center[j] = world[12 + j];
+            result.extents[j] = 0.0f;
+            for (int i = 0; i < 3; ++i) {
+                result.center[j] += box.center[i] * world[i * 4 + j];
+                result.extents[j] += box.extents[i] * std::abs(world[i * 4 + j]);
+            }
+        }
+        return result;
+    }
+
+    float lower[3] = {INFINITY, INFINITY, INFINITY};
+    float upper[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (int corner = 0; corner < 8; ++corner) {
+        float p[4];
+        for (int i = 0; i < 3; ++i) {
+            p[i] = box.center[i] + ((corner >> i) & 1 ? box.extents[i] : -box.extents[i]);
+        }
+        p[3] = 1.0f;
+        float transformed[4] = {};
+        for (int j = 0; j < 4; ++j) {
+            for (int i = 0; i < 4; ++i) {
+                transformed[j] += p[i] * world[i * 4 + j];
+            }
+        }
+        for (int j = 0; j < 3; ++j) {
+            float coordinate = transformed[j] / transformed[3];
+            lower[j] = std::min(lower[j], coordinate);
+            upper[j] = std::max(upper[j], coordinate);
+        }
+    }
+    for (int j = 0; j < 3; ++j) {
+        result.center[j] = 0.5f * (lower[j] + upper[j]);
+        result.extents[j] = 0.5f * (upper[j] - lower[j]);
+    }
+    return result;
+}
+
+Containment FrustumCuller::Test(const Frustum &frustum, const Box &box)
+{
+    uint8_t firstPlane = 0;
+    return Test(frustum, box, firstPlane);
+}
+
+Containment FrustumCuller::Test(const Frustum &frustum, const Box &box, uint8_t &firstPlane)
+{
+    return TestPlanes(frustum,
+                      box.center[0],
+                      box.center[1],
+                      box.center[2],
+                      box.extents[0],
+                      box.extents[1],
+                      box.extents[2],
+                      firstPlane);
+}
+
+void FrustumCuller::Cull(const Frustum &frustum,
+                         const BoxArray &boxes,
+                         size_t begin,
+                         size_t end,
+                         uint8_t *containments)
+{
+    Kernel(frustum).Run(boxes, begin, end, containments);
+}
+
+void FrustumCuller::CullRanges(const Frustum &frustum,
+                               const BoxArray &boxes,
+                               const Range *ranges,
+                               size_t rangeCount,
+                               uint8_t *containments)
+{
+    Kernel kernel(frustum);
+    for (size_t r = 0; r < rangeCount; ++r) {
+        kernel.Run(boxes, ranges[r].begin, ranges[r].end, containments);
+        containments += ranges[r].end - ranges[r].begin;
+    }
+}
+
+const char *FrustumCuller::GetInstructionSet()
+{
+#if FRUSTUM_CULLER_AVX2
+    return "AVX2";
+#elif FRUSTUM_CULLER_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
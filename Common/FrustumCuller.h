@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Frustum culling of many boxes at once.  The boxes are world space bounds, kept as one array
+// per coordinate and refreshed only when an instance moves, so a frame's test is six plane
+// distances per box with no matrix work.  The kernel tests boxes eight at a time with AVX2
+// (/arch:AVX2, -mavx2), four with SSE2 on any other x86 build and one elsewhere.  Portable so the
+// tools can measure it.
+namespace FrustumCuller
+{
+// Same values as DirectX::ContainmentType.
+enum Containment : uint8_t
+{
+    kOutside = 0,
+    kIntersects = 1,
+    kInside = 2,
+};
+
+// Points with a x + b y + c z + d >= 0 are inside; (a, b, c) has unit length.
+struct Plane
+{
+    float a, b, c, d;
+};
+
+const size_t kPlaneCount = 6;
+
+// Near, far, left, right, top and bottom.
+struct Frustum
+{
+    Plane planes[kPlaneCount];
+};
+
+struct Box
+{
+    float center[3];
+    float extents[3];
+};
+
+// Boxes begin to end of a BoxArray.
+struct Range
+{
+    uint32_t begin;
+    uint32_t end;
+};
+
+// One array per coordinate of the centers and extents of many boxes.
+struct BoxArray
+{
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    size_t Size() const { return centerX.size(); }
+    void Resize(size_t size);
+    void Set(size_t index, const Box &box);
+    Box Get(size_t index) const;
+};
+
+// The volume a view-projection matrix clips to, z in [0, 1].  Matrices are row-major and
+// transform row vectors, as DirectXMath's do, so an XMFLOAT4X4 can be passed as is.
+Frustum ExtractFrustum(const float viewProj[16]);
+
+// The world bounds of a box of an object with the given world matrix.  Affine matrices take
+// the exact bounds of the transformed box; any other, such as a planar shadow's, the bounds of
+// its projected corners.
+Box TransformBox(const Box &box, const float world[16]);
+
+Containment Test(const Frustum &frustum, const Box &box);
+
+// As Test, trying planes from firstPlane on, and setting it to the plane that put the box outside
+// if one did.  Kept per box from frame to frame, a box that stays outside is usually rejected by
+// the first plane tried.
+Containment Test(const Frustum &frustum, const Box &box, uint8_t &firstPlane);
+
+// The containment of boxes begin to end, stored at containments[0] onwards.  Conservative like
+// Test, which it matches exactly: a box is only outside if one plane has all of it behind, and
+// only inside if every plane has all of it in front.
+void Cull(const Frustum &frustum,
+          const BoxArray &boxes,
+          size_t begin,
+          size_t end,
+          uint8_t *containments);
+
+// As Cull for each range in turn, storing their containments one after the other.
+void CullRanges(const Frustum &frustum,
+                const BoxArray &boxes,
+                const Range *ranges,
+                size_t rangeCount,
+                uint8_t *containments);
+
+// Name of the instruction set the kernel was compiled for.
+const char *GetInstructionSet();
+} // namespace FrustumCuller
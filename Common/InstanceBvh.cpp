@@ -0,0 +1,467 @@
+#include "InstanceBvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace InstanceBvh;
+using FrustumCuller::Box;
+
+namespace
+{
+const int kBinCount = 16;
+// Cost of visiting a node relative to testing one instance.
+const float kTraversalCost = 4.0f;
+
+// Bounds as corners, which union and bin more simply than center and extents.
+struct Corners
+{
+    float lower[3] = {INFINITY, INFINITY, INFINITY};
+    float upper[3] = {-INFINITY, -INFINITY, -INFINITY};
+
+    void Add(const Box &box)
+    {
+        for (int c = 0; c < 3; ++c) {
+            lower[c] = std::min(lower[c], box.center[c] - box.extents[c]);
+            upper[c] = std::max(upper[c], box.center[c] + box.extents[c]);
+        }
+    }
+
+    void Add(const Corners &other)
+    {
+        for (int c = 0; c < 3; ++c) {
+            lower[c] = std::min(lower[c], other.lower[c]);
+            upper[c] = std::max(upper[c], other.upper[c]);
+        }
+    }
+
+    bool Empty() const { return lower[0] > upper[0]; }
+
+    // Proportional to the surface area, which is all the heuristic needs.
+    float Area() const
+    {
+        if (Empty())
+            return 0.0f;
+        float x = upper[0] - lower[0], y = upper[1] - lower[1], z = upper[2] - lower[2];
+        return x * y + y * z + z * x;
+    }
+
+    Box ToBox() const
+    {
+        Box box;
+        for (int c = 0; c < 3; ++c) {
+            box.center[c] = 0.5f * (lower[c] + upper[c]);
+            box.extents[c] = 0.5f * (upper[c] - lower[c]);
+        }
+        return box;
+    }
+};
+
+Box Union(const Box &a, const Box &b)
+{
+    Corners corners;
+    corners.Add(a);
+    corners.Add(b);
+    return corners.ToBox();
+}
+
+float Area(const Box &box)
+{
+    Corners corners;
+    corners.Add(box);
+    return corners.Area();
+}
+
+Box LeafBounds(const Tree &tree, const Node &node)
+{
+    Corners corners;
+    for (uint32_t slot = node.first; slot < node.first + node.count; ++slot) {
+        corners.Add(tree.boxes.Get(slot));
+    }
+    return corners.ToBox();
+}
+
+bool Equal(const Box &a, const Box &b)
+{
+    return std::equal(a.center, a.center + 3, b.center)
+           && std::equal(a.extents, a.extents + 3, b.extents);
+}
+
+// An instance as the build sorts it, kept together so partitioning moves one block of memory.
+struct Primitive
+{
+    Corners bounds;
+    float centroid[3];
+    uint32_t instance;
+};
+
+// Where the surface area heuristic splits a node's instances: those in bins below bin of axis
+// go left.  Axis -1 keeps them in a leaf.
+struct Split
+{
+    int axis = -1;
+    int bin = 0;
+    float lower = 0.0f;
+    float scale = 0.0f;
+};
+
+int GetBin(float centroid, float lower, float scale)
+{
+    return std::min(int((centroid - lower) * scale), kBinCount - 1);
+}
+
+Split FindSplit(const Primitive *primitives, uint32_t count, const Corners &bounds)
+{
+    Corners centroids;
+    for (uint32_t i = 0; i < count; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            centroids.lower[c] = std::min(centroids.lower[c], primitives[i].centroid[c]);
+            centroids.upper[c] = std::max(centroids.upper[c], primitives[i].centroid[c]);
+        }
+    }
+
+    // Every axis is binned in the same pass over the primitives.
+    float scales[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = centroids.upper[axis] - centroids.lower[axis];
+        scales[axis] = extent > 0.0f ? kBinCount / extent : 0.0f;
+    }
+    Corners axisBinBounds[3][kBinCount];
+    uint32_t axisBinCounts[3][kBinCount] = {};
+    for (uint32_t i = 0; i < count; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            int bin = GetBin(primitives[i].centroid[axis], centroids.lower[axis], scales[axis]);
+            axisBinBounds[axis][bin].Add(primitives[i].bounds);
+            ++axisBinCounts[axis][bin];
+        }
+    }
+
+    Split best;
+    float bestCost = float(count);
+    float parentArea = bounds.Area();
+    for (int axis = 0; axis < 3; ++axis) {
+        float lower = centroids.lower[axis];
+        float scale = scales[axis];
+        if (scale == 0.0f)
+            continue;
+
+        const auto &binBounds = axisBinBounds[axis];
+        const auto &binCounts = axisBinCounts[axis];
+
+        // The area and count left of each of the bins' boundaries, then right of them.
+        float leftAreas[kBinCount - 1];
+        uint32_t leftCounts[kBinCount - 1];
+        Corners left;
+        uint32_t leftCount = 0;
+        for (int i = 0; i < kBinCount - 1; ++i) {
+            left.Add(binBounds[i]);
+            leftCount += binCounts[i];
+            leftAreas[i] = left.Area();
+            leftCounts[i] = leftCount;
+        }
+        Corners right;
+        uint32_t rightCount = 0;
+        for (int i = kBinCount - 1; i > 0; --i) {
+            right.Add(binBounds[i]);
+            rightCount += binCounts[i];
+            if (leftCounts[i - 1] == 0 || rightCount == 0)
+                continue;
+            float cost = kTraversalCost
+                         + (leftAreas[i - 1] * leftCounts[i - 1] + right.Area() * rightCount)
+                               / parentArea;
+            if (cost < bestCost) {
+                bestCost = cost;
+                best = {axis, i, lower, scale};
+            }
+        }
+    }
+    return best;
+}
+
+// Instances begin to end of boxes.
+std::vector<Primitive> MakePrimitives(const FrustumCuller::BoxArray &boxes,
+                                      uint32_t begin,
+                                      uint32_t end)
+{
+    std::vector<Primitive> primitives(end - begin);
+    for (uint32_t i = begin; i < end; ++i) {
+        auto box = boxes.Get(i);
+        auto &primitive = primitives[i - begin];
+        primitive.bounds.Add(box);
+        std::copy(box.center, box.center + 3, primitive.centroid);
+        primitive.instance = i;
+    }
+    return primitives;
+}
+
+// Splits nodes[root], whose instances are primitives from its first slot on, down to leaves,
+// appending the nodes it creates and sorting primitives into their slot order.
+void Subdivide(std::vector<Node> &nodes, uint32_t root, Primitive *primitives)
+{
+    uint32_t base = nodes[root].first;
+    std::vector<uint32_t> pending = {root};
+    while (!pending.empty()) {
+        uint32_t index = pending.back();
+        pending.pop_back();
+        uint32_t first = nodes[index].first;
+        uint32_t nodeCount = nodes[index].count;
+        auto *nodePrimitives = &primitives[first - base];
+
+        Corners bounds;
+        for (uint32_t i = 0; i < nodeCount; ++i) {
+            bounds.Add(nodePrimitives[i].bounds);
+        }
+        nodes[index].bounds = bounds.ToBox();
+        if (nodeCount == 1)
+            continue;
+
+        // Splitting is worth it by the heuristic, or needed to keep leaves small; instances
+        // whose centroids coincide are split down the middle.
+        auto split = FindSplit(nodePrimitives, nodeCount, bounds);
+        uint32_t leftCount = 0;
+        if (split.axis >= 0) {
+            auto middle = std::partition(nodePrimitives,
+                                         nodePrimitives + nodeCount,
+                                         [&](const Primitive &primitive) {
+                                             float centroid = primitive.centroid[split.axis];
+                                             return GetBin(centroid, split.lower, split.scale)
+                                                    < split.bin;
+                                         });
+            leftCount = uint32_t(middle - nodePrimitives);
+        } else if (nodeCount > kMaxLeafSize) {
+            leftCount = nodeCount / 2;
+        }
+        if (leftCount == 0 || leftCount == nodeCount)
+            continue;
+
+        auto left = uint32_t(nodes.size());
+        nodes[index].left = left;
+        nodes.push_back({{}, first, leftCount, 0, index});
+        nodes.push_back({{}, first + leftCount, nodeCount - leftCount, 0, index});
+        pending.push_back(left + 1);
+        pending.push_back(left);
+    }
+}
+
+// Gives the primitives' instances the slots from first on, growing the tree to hold them.
+void StoreSlots(Tree &tree,
+                const FrustumCuller::BoxArray &boxes,
+                const std::vector<Primitive> &primitives,
+                uint32_t first)
+{
+    auto count = first + uint32_t(primitives.size());
+    tree.boxes.Resize(count);
+    tree.instances.resize(count);
+    tree.slots.resize(count);
+    tree.leaves.resize(count);
+    for (uint32_t slot = first; slot < count; ++slot) {
+        uint32_t instance = primitives[slot - first].instance;
+        tree.boxes.Set(slot, boxes.Get(instance));
+        tree.instances[slot] = instance;
+        tree.slots[instance] = slot;
+    }
+}
+
+void SetLeaf(Tree &tree, uint32_t index)
+{
+    const auto &node = tree.nodes[index];
+    for (uint32_t slot = node.first; slot < node.first + node.count; ++slot) {
+        tree.leaves[tree.instances[slot]] = index;
+    }
+}
+
+// Adds leaf, whose slots are already stored, beside the node where the surface area heuristic
+// finds it costs least, as Box2D's dynamic tree does: a node it joins grows to cover it, and so
+// do the nodes above, which every step down adds to.
+void InsertLeaf(Tree &tree, Node leaf)
+{
+    uint32_t sibling = 0;
+    while (tree.nodes[sibling].left != 0) {
+        const auto &node = tree.nodes[sibling];
+        float area = Area(node.bounds);
+        float combinedArea = Area(Union(node.bounds, leaf.bounds));
+        float cost = 2.0f * combinedArea;
+        float inheritedCost = 2.0f * (combinedArea - area);
+
+        // Below an inner node the leaf grows it at least as much as it grows the node itself.
+        uint32_t next = 0;
+        for (uint32_t child = node.left; child <= node.left + 1; ++child) {
+            const auto &childNode = tree.nodes[child];
+            float childCost = Area(Union(childNode.bounds, leaf.bounds)) + inheritedCost;
+            if (childNode.left != 0) {
+                childCost -= Area(childNode.bounds);
+            }
+            if (childCost < cost) {
+                cost = childCost;
+                next = child;
+            }
+        }
+        if (next == 0)
+            break;
+        sibling = next;
+    }
+
+    // The sibling moves to the end to make way for the node joining the two, so that the new
+    // leaf can follow it.
+    auto moved = uint32_t(tree.nodes.size());
+    Node siblingNode = tree.nodes[sibling];
+    siblingNode.parent = sibling;
+    leaf.parent = sibling;
+    tree.nodes.push_back(siblingNode);
+    tree.nodes.push_back(leaf);
+    if (siblingNode.left != 0) {
+        tree.nodes[siblingNode.left].parent = moved;
+        tree.nodes[siblingNode.left + 1].parent = moved;
+    } else {
+        SetLeaf(tree, moved);
+    }
+    SetLeaf(tree, moved + 1);
+
+    auto &joined = tree.nodes[sibling];
+    joined.bounds = Union(siblingNode.bounds, leaf.bounds);
+    joined.first = kScattered;
+    joined.count = siblingNode.count + leaf.count;
+    joined.left = moved;
+    for (uint32_t index = sibling; index != 0;) {
+        index = tree.nodes[index].parent;
+        auto &node = tree.nodes[index];
+        node.bounds = Union(tree.nodes[node.left].bounds, tree.nodes[node.left + 1].bounds);
+        node.first = kScattered;
+        node.count += leaf.count;
+    }
+}
+} // namespace
+
+void InstanceBvh::Build(const FrustumCuller::BoxArray &boxes, Tree &tree)
+{
+    auto count = uint32_t(boxes.Size());
+    auto primitives = MakePrimitives(boxes, 0, count);
+
+    tree.nodes.clear();
+    if (count > 0) {
+        tree.nodes.reserve(2 * count);
+        tree.nodes.push_back({{}, 0, count, 0, 0});
+        Subdivide(tree.nodes, 0, primitives.data());
+    }
+
+    StoreSlots(tree, boxes, primitives, 0);
+    for (uint32_t index = 0; index < tree.nodes.size(); ++index) {
+        if (tree.nodes[index].left == 0) {
+            SetLeaf(tree, index);
+        }
+    }
+    tree.builtCount = count;
+}
+
+void InstanceBvh::Insert(Tree &tree, const FrustumCuller::BoxArray &boxes)
+{
+    auto oldCount = uint32_t(tree.instances.size());
+    auto count = uint32_t(boxes.Size());
+    if (count <= oldCount)
+        return;
+    if (tree.nodes.empty() || count >= 2 * tree.builtCount) {
+        Build(boxes, tree);
+        return;
+    }
+
+    // The new instances are split into leaves as Build would split them, each of which then
+    // joins the tree on its own.
+    auto primitives = MakePrimitives(boxes, oldCount, count);
+    std::vector<Node> added = {{{}, oldCount, count - oldCount, 0, 0}};
+    Subdivide(added, 0, primitives.data());
+    StoreSlots(tree, boxes, primitives, oldCount);
+    for (const auto &node : added) {
+        if (node.left == 0) {
+            InsertLeaf(tree, node);
+        }
+    }
+}
+
+void InstanceBvh::Refit(Tree &tree,
+                        const FrustumCuller::BoxArray &boxes,
+                        const uint32_t *moved,
+                        size_t count)
+{
+    std::vector<uint32_t> leaves(count);
+    for (size_t i = 0; i < count; ++i) {
+        tree.boxes.Set(tree.slots[moved[i]], boxes.Get(moved[i]));
+        leaves[i] = tree.leaves[moved[i]];
+    }
+    std::sort(leaves.begin(), leaves.end());
+    leaves.erase(std::unique(leaves.begin(), leaves.end()), leaves.end());
+
+    // Every leaf first, so that walking up from each sees its siblings' final bounds and can
+    // stop at the first node the move did not change.
+    for (uint32_t leaf : leaves) {
+        tree.nodes[leaf].bounds = LeafBounds(tree, tree.nodes[leaf]);
+    }
+    for (uint32_t leaf : leaves) {
+        uint32_t index = leaf;
+        while (index != 0) {
+            auto &parent = tree.nodes[tree.nodes[index].parent];
+            auto bounds = Union(tree.nodes[parent.left].bounds, tree.nodes[parent.left + 1].bounds);
+            if (Equal(bounds, parent.bounds))
+                break;
+            parent.bounds = bounds;
+            index = tree.nodes[index].parent;
+        }
+    }
+}
+
+void InstanceBvh::Cull(const Tree &tree,
+                       const FrustumCuller::Frustum &frustum,
+                       std::vector<VisibleInstance> &visible)
+{
+    visible.clear();
+    if (tree.nodes.empty())
+        return;
+
+    // Subtrees entirely inside go straight out, those with scattered slots leaf by leaf; the
+    // leaves the frustum cuts are gathered and tested in one pass of the kernel.
+    std::vector<FrustumCuller::Range> leaves;
+    std::vector<uint32_t> pending = {0};
+    std::vector<uint32_t> inside;
+    while (!pending.empty()) {
+        uint32_t index = pending.back();
+        pending.pop_back();
+        const auto &node = tree.nodes[index];
+        auto containment = FrustumCuller::Test(frustum, node.bounds);
+        if (containment == FrustumCuller::kOutside)
+            continue;
+
+        if (containment == FrustumCuller::kInside) {
+            inside.push_back(index);
+            while (!inside.empty()) {
+                const auto &insideNode = tree.nodes[inside.back()];
+                inside.pop_back();
+                if (insideNode.first == kScattered) {
+                    inside.push_back(insideNode.left + 1);
+                    inside.push_back(insideNode.left);
+                    continue;
+                }
+                for (uint32_t slot = insideNode.first;
+                     slot < insideNode.first + insideNode.count;
+                     ++slot) {
+                    visible.push_back({tree.instances[slot], FrustumCuller::kInside});
+                }
+            }
+        } else if (node.left == 0) {
+            leaves.push_back({node.first, node.first + node.count});
+        } else {
+            pending.push_back(node.left + 1);
+            pending.push_back(node.left);
+        }
+    }
+
+    std::vector<uint8_t> containments(leaves.size() * kMaxLeafSize);
+    FrustumCuller::CullRanges(
+        frustum, tree.boxes, leaves.data(), leaves.size(), containments.data());
+    size_t i = 0;
+    for (const auto &leaf : leaves) {
+        for (uint32_t slot = leaf.begin; slot < leaf.end; ++slot, ++i) {
+            if (containments[i] != FrustumCuller::kOutside) {
+                auto containment = FrustumCuller::Containment(containments[i]);
+                visible.push_back({tree.instances[slot], containment});
+            }
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "FrustumCuller.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A bounding volume hierarchy over the world bounds of instances, so frustum culling costs in
+// proportion to what is near the frustum rather than to the scene: a node entirely outside is
+// dropped and one entirely inside accepts its whole subtree with one test.  Built with the
+// surface area heuristic over binned centroids, refit bottom up from just the instances that
+// moved, and grown by inserting leaves of the instances added.  Portable so the tools can
+// measure it.
+namespace InstanceBvh
+{
+// Leaves hold up to this many instances, tested together by FrustumCuller::Cull.
+const uint32_t kMaxLeafSize = 16;
+
+// The first slot of an inner node whose instances are not in consecutive slots.
+const uint32_t kScattered = UINT32_MAX;
+
+struct Node
+{
+    FrustumCuller::Box bounds;
+    // The node's instances are slots first to first + count of the tree.  Once leaves are
+    // inserted below an inner node, its count instances are scattered and first is kScattered.
+    uint32_t first;
+    uint32_t count;
+    // The right child follows the left; 0 for leaves, as the root is nobody's child.
+    uint32_t left;
+    uint32_t parent;
+};
+
+struct Tree
+{
+    // nodes[0] is the root.
+    std::vector<Node> nodes;
+    // The instances' bounds in slot order, so that every node's are contiguous.
+    FrustumCuller::BoxArray boxes;
+    // The instance in each slot, and the slot and leaf of each instance.
+    std::vector<uint32_t> instances;
+    std::vector<uint32_t> slots;
+    std::vector<uint32_t> leaves;
+    // The instances the tree was last built over.
+    uint32_t builtCount = 0;
+};
+
+struct VisibleInstance
+{
+    uint32_t instance;
+    FrustumCuller::Containment containment;
+};
+
+// Builds the tree over boxes, instance i being boxes' i-th.
+void Build(const FrustumCuller::BoxArray &boxes, Tree &tree);
+
+// Adds the instances of boxes past the tree's: they are split into leaves as Build would, and each
+// leaf joins the tree where it enlarges it least, so the cost is in proportion to what was added.
+// Inserted leaves overlap more than built ones, so once the tree holds twice the instances it was
+// built over it is built again.  Instances must not have been removed or renumbered; build then.
+void Insert(Tree &tree, const FrustumCuller::BoxArray &boxes);
+
+// Takes the new bounds of the moved instances from boxes and refits their leaves and the
+// nodes above them.  The tree's shape stays, so it loosens if instances move far; rebuild then.
+void Refit(Tree &tree, const FrustumCuller::BoxArray &boxes, const uint32_t *moved, size_t count);
+
+// The instances that are not outside the frustum, with their containment, in an order that
+// depends only on the tree and the frustum.  Instances of a node entirely inside are inside.
+void Cull(const Tree &tree,
+          const FrustumCuller::Frustum &frustum,
+          std::vector<VisibleInstance> &visible);
+} // namespace InstanceBvh
@@ -0,0 +1,179 @@
+#include "Lz4.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+const size_t kMinMatch = 4;
+// The format requires the last 5 bytes to be literals and the last match to start at least 12
+// bytes before the end of the block.
+const size_t kLastLiterals = 5;
+const size_t kMatchStartLimit = 12;
+const size_t kMaxOffset = 65535;
+const int kHashBits = 12;
+
+uint32_t Read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+uint8_t *WriteLength(uint8_t *op, size_t length)
+{
+    for (; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+bool ReadLength(const uint8_t *&ip, const uint8_t *ipEnd, size_t &length)
+{
+    uint8_t byte;
+    do {
+        if (ip >= ipEnd)
+            return false;
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+uint8_t *WriteSequence(uint8_t *op,
+                       const uint8_t *literals,
+                       size_t literalLength,
+                       size_t offset,
+                       size_t matchLength)
+{
+    uint8_t *token = op++;
+    *token = (uint8_t) (std::min<size_t>(literalLength, 15) << 4);
+    if (literalLength >= 15) {
+        op = WriteLength(op, literalLength - 15);
+    }
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+
+    // The last sequence of a block ends after its literals.
+    if (offset == 0)
+        return op;
+
+    *op++ = (uint8_t) (offset & 0xff);
+    *op++ = (uint8_t) (offset >> 8);
+
+    matchLength -= kMinMatch;
+    *token |= (uint8_t) std::min<size_t>(matchLength, 15);
+    if (matchLength >= 15) {
+        op = WriteLength(op, matchLength - 15);
+    }
+    return op;
+}
+} // namespace
+
+size_t Lz4::CompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t Lz4::Compress(const uint8_t *src, size_t srcSize, uint8_t *dst)
+{
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + srcSize;
+    const uint8_t *matchEnd = srcSize > kLastLiterals ? end - kLastLiterals : src;
+    const uint8_t *matchStartEnd = srcSize > kMatchStartLimit ? end - kMatchStartLimit : src;
+    uint8_t *op = dst;
+
+    // Positions of the last occurrence of each hashed 4 byte sequence, -1 if none yet.
+    std::vector<int32_t> table(size_t(1) << kHashBits, -1);
+
+    while (ip < matchStartEnd) {
+        uint32_t sequence = Read32(ip);
+        auto &entry = table[Hash(sequence)];
+        const uint8_t *match = entry >= 0 ? src + entry : nullptr;
+        entry = (int32_t) (ip - src);
+
+        if (match == nullptr || size_t(ip - match) > kMaxOffset || Read32(match) != sequence) {
+            ++ip;
+            continue;
+        }
+
+        while (ip > anchor && match > src && ip[-1] == match[-1]) {
+            --ip;
+            --match;
+        }
+
+        const uint8_t *matchStop = ip + kMinMatch;
+        const uint8_t *reference = match + kMinMatch;
+        while (matchStop < matchEnd && *matchStop == *reference) {
+            ++matchStop;
+            ++reference;
+        }
+
+        op = WriteSequence(op, anchor, ip - anchor, ip - match, matchStop - ip);
+        ip = matchStop;
+        anchor = ip;
+    }
+
+    op = WriteSequence(op, anchor, end - anchor, 0, 0);
+    return op - dst;
+}
+
+bool Lz4::Decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize)
+{
+    const uint8_t *ip = src;
+    const uint8_t *ipEnd = src + srcSize;
+    uint8_t *op = dst;
+    uint8_t *opEnd = dst + dstSize;
+
+    while (ip < ipEnd) {
+        uint8_t token = *ip++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(ip, ipEnd, literalLength))
+            return false;
+        if (literalLength > size_t(ipEnd - ip) || literalLength > size_t(opEnd - op))
+            return false;
+
+        memcpy(op, ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        if (ip == ipEnd)
+            break;
+
+        if (ipEnd - ip < 2)
+            return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > size_t(op - dst))
+            return false;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(ip, ipEnd, matchLength))
+            return false;
+        matchLength += kMinMatch;
+        if (matchLength > size_t(opEnd - op))
+            return false;
+
+        // Matches may overlap the bytes they produce, which repeats the last offset bytes.
+        const uint8_t *match = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, match, matchLength);
+        } else {
+            for (size_t i = 0; i < matchLength; ++i) {
+                op[i] = match[i];
+            }
+        }
+        op += matchLength;
+    }
+
+    return op == opEnd;
+}
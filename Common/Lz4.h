@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Compressor and decoder for the LZ4 block format (no frame header, no checksums).  Used for
+// texture archive chunks; portable so the offline tools can share it.
+namespace Lz4
+{
+// Worst case size of Compress's output for size bytes of input.
+size_t CompressBound(size_t size);
+
+// Compresses src into dst, which must hold at least CompressBound(srcSize) bytes.  Returns the
+// compressed size.
+size_t Compress(const uint8_t *src, size_t srcSize, uint8_t *dst);
+
+// Returns false if src is malformed or does not decode to exactly dstSize bytes.
+bool Decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize);
+} // namespace Lz4
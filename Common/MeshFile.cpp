@@ -0,0 +1,212 @@
+#include "MeshFile.h"
+#include "VertexQuantizer.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace DirectX;
+
+namespace
+{
+BoundingBox ToBoundingBox(const MeshFileBounds &bounds)
+{
+    return BoundingBox(XMFLOAT3(bounds.center), XMFLOAT3(bounds.extents));
+}
+
+MeshletBuilder::Meshlet ToMeshlet(const MeshFileMeshlet &meshlet)
+{
+    MeshletBuilder::Meshlet result;
+    result.startIndex = meshlet.startIndex;
+    result.indexCount = meshlet.indexCount;
+    result.vertexCount = meshlet.vertexCount;
+    std::copy_n(meshlet.center, 3, result.center);
+    result.radius = meshlet.radius;
+    std::copy_n(meshlet.coneAxis, 3, result.coneAxis);
+    result.coneCutoff = meshlet.coneCutoff;
+    return result;
+}
+} // namespace
+
+MeshFile::~MeshFile()
+{
+    Close();
+}
+
+HRESULT MeshFile::Open(const std::wstring &filename)
+{
+    Close();
+
+    mFile = CreateFileW(filename.c_str(),
+                        GENERIC_READ,
+                        FILE_SHARE_READ,
+                        nullptr,
+                        OPEN_EXISTING,
+                        FILE_FLAG_SEQUENTIAL_SCAN,
+                        nullptr);
+    if (mFile == INVALID_HANDLE_VALUE)
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    LARGE_INTEGER fileSize = {};
+    if (!GetFileSizeEx(mFile, &fileSize)) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+    auto size = (uint64_t) fileSize.QuadPart;
+    if (size < sizeof(MeshFileHeader)) {
+        Close();
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mMapping != nullptr) {
+        mView = static_cast<const uint8_t *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (mView == nullptr) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    // Check the tables once so CreateGeometry can trust them.
+    mHeader = reinterpret_cast<const MeshFileHeader *>(mView);
+    if (mHeader->magic != kMeshFileMagic || mHeader->version != kMeshFileVersion) {
+        Close();
+        return E_FAIL;
+    }
+
+    uint64_t tablesSize = sizeof(MeshFileHeader) + sizeof(MeshFileStream) * mHeader->streamCount
+                          + sizeof(MeshFileSubmesh) * uint64_t(mHeader->submeshCount)
+                          + sizeof(MeshFileMeshlet) * uint64_t(mHeader->meshletCount);
+    uint64_t indexSize = uint64_t(mHeader->indexCount)
+                         * (mHeader->indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4);
+    bool valid = tablesSize <= size
+                 && (mHeader->indexFormat == DXGI_FORMAT_R16_UINT
+                     || mHeader->indexFormat == DXGI_FORMAT_R32_UINT)
+                 && mHeader->indexOffset <= size && indexSize <= size - mHeader->indexOffset;
+
+    mStreams = reinterpret_cast<const MeshFileStream *>(mView + sizeof(MeshFileHeader));
+    mSubmeshes = reinterpret_cast<const MeshFileSubmesh *>(mStreams + mHeader->streamCount);
+    mMeshlets = reinterpret_cast<const MeshFileMeshlet *>(mSubmeshes + mHeader->submeshCount);
+    for (uint32_t i = 0; valid && i < mHeader->streamCount; ++i) {
+        const auto &stream = mStreams[i];
+        uint64_t streamSize = uint64_t(mHeader->vertexCount) * stream.stride;
+        valid = stream.stride >= GetMeshFileVertexSize(stream.attributes) && stream.offset <= size
+                && streamSize <= size - stream.offset;
+    }
+    for (uint32_t i = 0; valid && i < mHeader->submeshCount; ++i) {
+        const auto &submesh = mSubmeshes[i];
+        valid = memchr(submesh.name, 0, sizeof(submesh.name)) != nullptr
+                && uint64_t(submesh.startIndex) + submesh.indexCount <= mHeader->indexCount
+                && uint64_t(submesh.firstMeshlet) + submesh.meshletCount <= mHeader->meshletCount;
+        for (uint32_t j = 0; valid && j < submesh.meshletCount; ++j) {
+            const auto &meshlet = mMeshlets[submesh.firstMeshlet + j];
+            valid = uint64_t(submesh.startIndex) + meshlet.startIndex + meshlet.indexCount
+                    <= mHeader->indexCount;
+        }
+    }
+    if (!valid) {
+        Close();
+        return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+    }
+
+    return S_OK;
+}
+
+void MeshFile::Close()
+{
+    if (mView != nullptr) {
+        UnmapViewOfFile(mView);
+        mView = nullptr;
+    }
+    if (mMapping != nullptr) {
+        CloseHandle(mMapping);
+        mMapping = nullptr;
+    }
+    if (mFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+    }
+    mHeader = nullptr;
+    mStreams = nullptr;
+    mSubmeshes = nullptr;
+    mMeshlets = nullptr;
+}
+
+const MeshFileStream *MeshFile::FindStream(uint32_t attributes) const
+{
+    for (uint32_t i = 0; i < mHeader->streamCount; ++i) {
+        if (mStreams[i].attributes == attributes)
+            return &mStreams[i];
+    }
+    return nullptr;
+}
+
+HRESULT MeshFile::CreateGeometry(ID3D12Device *device,
+                                 ID3D12GraphicsCommandList *cmdList,
+                                 uint32_t attributes,
+                                 MeshGeometry &geo) const
+{
+    const auto *stream = FindStream(attributes);
+    if (stream == nullptr)
+        return E_INVALIDARG;
+
+    const UINT vbByteSize = mHeader->vertexCount * stream->stride;
+    const UINT ibByteSize = mHeader->indexCount
+                            * (mHeader->indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4);
+
+    // CreateDefaultBuffer copies into its upload buffer right away, so the view may be unmapped
+    // once this returns.
+    geo.VertexBufferGPU = d3dUtil::CreateDefaultBuffer(
+        device, cmdList, mView + stream->offset, vbByteSize, geo.VertexBufferUploader);
+    geo.IndexBufferGPU = d3dUtil::CreateDefaultBuffer(
+        device, cmdList, mView + mHeader->indexOffset, ibByteSize, geo.IndexBufferUploader);
+
+    geo.VertexByteStride = stream->stride;
+    geo.VertexBufferByteSize = vbByteSize;
+    geo.IndexFormat = (DXGI_FORMAT) mHeader->indexFormat;
+    geo.IndexBufferByteSize = ibByteSize;
+    geo.Quantized = (attributes & kMeshFileQuantized) != 0;
+
+    // Positions lead every vertex, so files without a position-only stream in the same
+    // encoding get theirs extracted from the vertices.
+    if (attributes & kMeshFilePosition) {
+        const uint32_t positionAttributes = kMeshFilePosition | (attributes & kMeshFileQuantized);
+        const auto *positions = FindStream(positionAttributes);
+        const uint8_t *positionData = nullptr;
+        UINT positionStride = GetMeshFileVertexSize(positionAttributes);
+        std::vector<uint8_t> extracted;
+        if (positions != nullptr) {
+            positionData = mView + positions->offset;
+            positionStride = positions->stride;
+        } else {
+            extracted = VertexQuantizer::ExtractPositions(
+                mView + stream->offset, mHeader->vertexCount, stream->stride, positionStride);
+            positionData = extracted.data();
+        }
+
+        const UINT positionByteSize = mHeader->vertexCount * positionStride;
+        geo.PositionBufferGPU = d3dUtil::CreateDefaultBuffer(
+            device, cmdList, positionData, positionByteSize, geo.PositionBufferUploader);
+        geo.PositionByteStride = positionStride;
+        geo.PositionBufferByteSize = positionByteSize;
+    }
+
+    for (uint32_t i = 0; i < mHeader->submeshCount; ++i) {
+        const auto &submesh = mSubmeshes[i];
+        SubmeshGeometry args;
+        args.IndexCount = submesh.indexCount;
+        args.StartIndexLocation = submesh.startIndex;
+        args.BaseVertexLocation = submesh.baseVertex;
+        args.Bounds = ToBoundingBox(submesh.bounds);
+        args.SimplificationError = submesh.simplificationError;
+        const auto *meshlets = mMeshlets + submesh.firstMeshlet;
+        std::transform(meshlets,
+                       meshlets + submesh.meshletCount,
+                       std::back_inserter(args.Meshlets),
+                       ToMeshlet);
+        geo.DrawArgs[submesh.name] = args;
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "MeshFileFormat.h"
+#include "d3dUtil.h"
+
+// Reads a mesh written by MeshConverter (see MeshFileFormat.h).  The file is mapped rather than
+// read, so vertex and index data are copied once, from the page cache into upload memory.
+class MeshFile
+{
+public:
+    MeshFile() = default;
+    MeshFile(const MeshFile &rhs) = delete;
+    MeshFile &operator=(const MeshFile &rhs) = delete;
+    ~MeshFile();
+
+    // Maps the file and checks its tables.  Returns HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) if
+    // the file does not exist.
+    HRESULT Open(const std::wstring &filename);
+    void Close();
+
+    const MeshFileHeader &GetHeader() const { return *mHeader; }
+
+    // The stream holding exactly these attributes, or nullptr.
+    const MeshFileStream *FindStream(uint32_t attributes) const;
+
+    // Creates a geometry from one vertex stream, with a DrawArgs entry per submesh carrying its
+    // meshlets, and a position buffer for the passes that read positions alone.  Only the GPU
+    // buffers are filled in.
+    HRESULT CreateGeometry(ID3D12Device *device,
+                           ID3D12GraphicsCommandList *cmdList,
+                           uint32_t attributes,
+                           MeshGeometry &geo) const;
+
+private:
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+    const uint8_t *mView = nullptr;
+
+    const MeshFileHeader *mHeader = nullptr;
+    const MeshFileStream *mStreams = nullptr;
+    const MeshFileSubmesh *mSubmeshes = nullptr;
+    const MeshFileMeshlet *mMeshlets = nullptr;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// On-disk layout of a binary mesh, shared by the reader (MeshFile) and the offline converter.
+// All values are little endian.
+//
+//   MeshFileHeader
+//   MeshFileStream[streamCount]
+//   MeshFileSubmesh[submeshCount]
+//   MeshFileMeshlet[meshletCount]
+//   stream data, each stream starting at a multiple of kMeshFileDataAlignment
+//   index data, starting at a multiple of kMeshFileDataAlignment
+//
+// Vertex streams hold their vertices exactly as the input assembler reads them and the indices
+// are in indexFormat, so both are copied into upload memory as they are, straight from a
+// mapped view of the file.  Bounds, meshlets and levels of detail are computed by the converter.
+// A level of detail is a submesh of its own, named by MeshSimplifier::GetLevelName and sharing
+// the vertices of the full mesh.  Next to the stream of full vertices the converter writes one
+// of their positions alone, for passes that read nothing else.
+
+const uint32_t kMeshFileMagic = 0x4853454d; // "MESH"
+const uint32_t kMeshFileVersion = 3;
+
+const uint32_t kMeshFileDataAlignment = 16;
+
+// Attributes of a vertex stream.  A stream holds the attributes it names in this order, each as
+// 32 bit floats: position float3, normal float3, texCoord float2, tangent float3.  A quantized
+// stream holds them encoded by Common/VertexQuantizer instead, positions relative to the
+// bounds of the submesh drawing them: position unorm16x4, normal snorm16x2, texCoord half2,
+// tangent snorm16x2.
+enum MeshFileAttributes : uint32_t
+{
+    kMeshFilePosition = 0x1,
+    kMeshFileNormal = 0x2,
+    kMeshFileTexCoord = 0x4,
+    kMeshFileTangent = 0x8,
+    kMeshFileQuantized = 0x10,
+};
+
+struct MeshFileBounds
+{
+    float center[3];
+    float extents[3];
+};
+
+struct MeshFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t streamCount;
+    uint32_t submeshCount;
+    uint32_t indexFormat; // DXGI_FORMAT_R16_UINT or DXGI_FORMAT_R32_UINT
+    uint32_t meshletCount;
+    // From the start of the file.
+    uint64_t indexOffset;
+    MeshFileBounds bounds;
+};
+
+struct MeshFileStream
+{
+    uint32_t attributes;
+    uint32_t stride;
+    // From the start of the file; vertexCount * stride bytes.
+    uint64_t offset;
+};
+
+struct MeshFileSubmesh
+{
+    // Zero terminated; the DrawArgs key.
+    char name[32];
+    uint32_t indexCount;
+    uint32_t startIndex;
+    int32_t baseVertex;
+    MeshFileBounds bounds;
+    // Into the meshlet table; none if the converter did not reorder the submesh.
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    // Distance from the full mesh for a level of detail, 0 otherwise.
+    float simplificationError;
+};
+
+// A cluster of a submesh's triangles, see Common/MeshletBuilder.h.
+struct MeshFileMeshlet
+{
+    // Relative to the submesh's startIndex.  The converter writes the submesh's triangles in
+    // meshlet order past its levels of detail, so the submesh itself keeps its cache order.
+    uint32_t startIndex;
+    uint32_t indexCount;
+    uint32_t vertexCount;
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;
+};
+
+static_assert(sizeof(MeshFileHeader) == 64, "mesh layout changed");
+static_assert(sizeof(MeshFileStream) == 16, "mesh layout changed");
+static_assert(sizeof(MeshFileSubmesh) == 80, "mesh layout changed");
+static_assert(sizeof(MeshFileMeshlet) == 44, "mesh layout changed");
+
+// Bytes of one vertex holding attributes.
+constexpr uint32_t GetMeshFileVertexSize(uint32_t attributes)
+{
+    bool quantized = (attributes & kMeshFileQuantized) != 0;
+    uint32_t size = 0;
+    size += (attributes & kMeshFilePosition) ? (quantized ? 8 : 12) : 0;
+    size += (attributes & kMeshFileNormal) ? (quantized ? 4 : 12) : 0;
+    size += (attributes & kMeshFileTexCoord) ? (quantized ? 4 : 8) : 0;
+    size += (attributes & kMeshFileTangent) ? (quantized ? 4 : 12) : 0;
+    return size;
+}
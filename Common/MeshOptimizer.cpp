@@ -0,0 +1,484 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+using namespace MeshOptimizer;
+
+namespace
+{
+// FIFO cache simulated with insertion times: a vertex is cached while fewer than cacheSize
+// vertices were inserted after it.
+class FifoCache
+{
+public:
+    FifoCache(size_t vertexCount, uint32_t cacheSize)
+        : mInsertTime(vertexCount, 0)
+        , mCacheSize(cacheSize)
+        , mTime(cacheSize + 1)
+    {}
+
+    bool Contains(uint32_t vertex) const { return mTime - mInsertTime[vertex] <= mCacheSize; }
+
+    // Time since the vertex entered the cache, cacheSize + 1 or more if it has left.
+    uint32_t Age(uint32_t vertex) const { return mTime - mInsertTime[vertex]; }
+
+    // Returns true on a miss.
+    bool Access(uint32_t vertex)
+    {
+        if (Contains(vertex))
+            return false;
+        mInsertTime[vertex] = mTime++;
+        return true;
+    }
+
+    void Flush() { mTime += mCacheSize + 1; }
+
+private:
+    std::vector<uint32_t> mInsertTime;
+    uint32_t mCacheSize;
+    uint32_t mTime;
+};
+
+struct Float3
+{
+    double x, y, z;
+};
+
+Float3 LoadPosition(const float *positions, size_t stride, uint32_t vertex)
+{
+    auto p = reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(positions)
+                                             + vertex * stride);
+    return {p[0], p[1], p[2]};
+}
+
+// Triangles around each vertex, in compressed rows.
+struct Adjacency
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+};
+
+Adjacency BuildAdjacency(const uint32_t *indices, size_t indexCount, size_t vertexCount)
+{
+    Adjacency adjacency;
+    adjacency.offsets.assign(vertexCount + 1, 0);
+    for (size_t i = 0; i < indexCount; ++i) {
+        ++adjacency.offsets[indices[i] + 1];
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        adjacency.offsets[v + 1] += adjacency.offsets[v];
+    }
+
+    adjacency.triangles.resize(indexCount);
+    std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i) {
+        adjacency.triangles[fill[indices[i]]++] = uint32_t(i / 3);
+    }
+    return adjacency;
+}
+
+// Tipsify: fans around a vertex, then continues from the cached vertex of those triangles that
+// will stay cached while its remaining triangles are emitted.  Returns triangles in the new
+// order and the positions where the order had to restart from an uncached vertex.
+void Tipsify(const uint32_t *indices,
+             size_t indexCount,
+             size_t vertexCount,
+             uint32_t cacheSize,
+             std::vector<uint32_t> &order,
+             std::vector<size_t> &hardBoundaries)
+{
+    size_t triangleCount = indexCount / 3;
+    auto adjacency = BuildAdjacency(indices, indexCount, vertexCount);
+
+    // Triangles each vertex still has to emit.
+    std::vector<uint32_t> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    size_t cursor = 0;
+
+    order.clear();
+    order.reserve(triangleCount);
+    hardBoundaries.clear();
+
+    auto nextLive = [&]() -> int64_t {
+        // Recently used vertices first, then the first vertex not yet done.
+        while (!deadEnd.empty()) {
+            uint32_t vertex = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[vertex] > 0)
+                return vertex;
+        }
+        for (; cursor < vertexCount; ++cursor) {
+            if (live[cursor] > 0)
+                return int64_t(cursor);
+        }
+        return -1;
+    };
+
+    int64_t fan = nextLive();
+    while (fan >= 0) {
+        if (!cache.Contains(uint32_t(fan))) {
+            hardBoundaries.push_back(order.size());
+        }
+
+        candidates.clear();
+        for (uint32_t k = adjacency.offsets[fan]; k < adjacency.offsets[fan + 1]; ++k) {
+            uint32_t triangle = adjacency.triangles[k];
+            if (emitted[triangle])
+                continue;
+            for (int corner = 0; corner < 3; ++corner) {
+                uint32_t vertex = indices[triangle * 3 + corner];
+                deadEnd.push_back(vertex);
+                candidates.push_back(vertex);
+                --live[vertex];
+                cache.Access(vertex);
+            }
+            emitted[triangle] = true;
+            order.push_back(triangle);
+        }
+
+        // The candidate that stays cached longest while its own fan is emitted.
+        int64_t next = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t vertex : candidates) {
+            if (live[vertex] == 0)
+                continue;
+            int64_t priority = 0;
+            if (cache.Age(vertex) + 2 * live[vertex] <= cacheSize) {
+                priority = cache.Age(vertex);
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+        fan = next >= 0 ? next : nextLive();
+    }
+}
+
+size_t CountMisses(const uint32_t *indices, const std::vector<uint32_t> &order, size_t vertexCount)
+{
+    FifoCache cache(vertexCount, kCacheSize);
+    size_t misses = 0;
+    for (uint32_t triangle : order) {
+        for (int corner = 0; corner < 3; ++corner) {
+            misses += cache.Access(indices[triangle * 3 + corner]);
+        }
+    }
+    return misses;
+}
+
+// Splits each run between hard boundaries where the run so far, starting with a cold cache, is
+// already within threshold of the order's ACMR, so the pieces can be reordered cheaply.
+std::vector<size_t> FindClusters(const uint32_t *indices,
+                                 const std::vector<uint32_t> &order,
+                                 const std::vector<size_t> &hardBoundaries,
+                                 size_t vertexCount,
+                                 size_t misses,
+                                 float threshold)
+{
+    double limit = threshold * double(misses) / std::max<size_t>(order.size(), 1);
+
+    FifoCache cache(vertexCount, kCacheSize);
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h < hardBoundaries.size(); ++h) {
+        size_t end = h + 1 < hardBoundaries.size() ? hardBoundaries[h + 1] : order.size();
+        size_t start = hardBoundaries[h];
+        clusters.push_back(start);
+
+        cache.Flush();
+        size_t clusterMisses = 0;
+        for (size_t t = start; t < end; ++t) {
+            for (int corner = 0; corner < 3; ++corner) {
+                clusterMisses += cache.Access(indices[order[t] * 3 + corner]);
+            }
+            if (t + 1 < end && clusterMisses <= limit * (t + 1 - start)) {
+                start = t + 1;
+                clusters.push_back(start);
+                cache.Flush();
+                clusterMisses = 0;
+            }
+        }
+    }
+    return clusters;
+}
+
+// Area weighted centroid and normal of each cluster.  Clusters facing away from the mesh center
+// occlude the rest, so they go first.  Returns the triangles in the new order.
+std::vector<uint32_t> SortClusters(const uint32_t *indices,
+                                   const std::vector<uint32_t> &order,
+                                   const std::vector<size_t> &clusters,
+                                   const float *positions,
+                                   size_t stride)
+{
+    struct Cluster
+    {
+        size_t begin;
+        size_t end;
+        Float3 centroid;
+        Float3 normal;
+        double area;
+        double sortKey;
+    };
+    std::vector<Cluster> sorted(clusters.size());
+    Float3 meshCentroid = {0.0, 0.0, 0.0};
+    double meshArea = 0.0;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        auto &cluster = sorted[c];
+        cluster = {};
+        cluster.begin = clusters[c];
+        cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : order.size();
+        for (size_t t = cluster.begin; t < cluster.end; ++t) {
+            const uint32_t *triangle = indices + order[t] * 3;
+            auto p0 = LoadPosition(positions, stride, triangle[0]);
+            auto p1 = LoadPosition(positions, stride, triangle[1]);
+            auto p2 = LoadPosition(positions, stride, triangle[2]);
+            Float3 e1 = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+            Float3 e2 = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z};
+            Float3 n = {e1.y * e2.z - e1.z * e2.y,
+                        e1.z * e2.x - e1.x * e2.z,
+                        e1.x * e2.y - e1.y * e2.x};
+            double area = 0.5 * std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+
+            cluster.centroid.x += area * (p0.x + p1.x + p2.x) / 3.0;
+            cluster.centroid.y += area * (p0.y + p1.y + p2.y) / 3.0;
+            cluster.centroid.z += area * (p0.z + p1.z + p2.z) / 3.0;
+            cluster.normal.x += n.x;
+            cluster.normal.y += n.y;
+            cluster.normal.z += n.z;
+            cluster.area += area;
+        }
+
+        meshCentroid.x += cluster.centroid.x;
+        meshCentroid.y += cluster.centroid.y;
+        meshCentroid.z += cluster.centroid.z;
+        meshArea += cluster.area;
+        if (cluster.area > 0.0) {
+            cluster.centroid.x /= cluster.area;
+            cluster.centroid.y /= cluster.area;
+            cluster.centroid.z /= cluster.area;
+        }
+    }
+    if (meshArea > 0.0) {
+        meshCentroid.x /= meshArea;
+        meshCentroid.y /= meshArea;
+        meshCentroid.z /= meshArea;
+    }
+
+    for (auto &cluster : sorted) {
+        const auto &n = cluster.normal;
+        double length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+        cluster.sortKey = length > 0.0 ? ((cluster.centroid.x - meshCentroid.x) * n.x
+                                          + (cluster.centroid.y - meshCentroid.y) * n.y
+                                          + (cluster.centroid.z - meshCentroid.z) * n.z)
+                                             / length
+                                       : 0.0;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster &a, const Cluster &b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<uint32_t> sortedOrder;
+    sortedOrder.reserve(order.size());
+    for (const auto &cluster : sorted) {
+        sortedOrder.insert(
+            sortedOrder.end(), order.begin() + cluster.begin, order.begin() + cluster.end);
+    }
+    return sortedOrder;
+}
+} // namespace
+
+CacheStats MeshOptimizer::AnalyzeVertexCache(const uint32_t *indices,
+                                             size_t indexCount,
+                                             size_t vertexCount,
+                                             uint32_t cacheSize)
+{
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t misses = 0;
+    size_t referencedCount = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        misses += cache.Access(indices[i]);
+        if (!referenced[indices[i]]) {
+            referenced[indices[i]] = true;
+            ++referencedCount;
+        }
+    }
+
+    CacheStats stats = {};
+    if (indexCount >= 3) {
+        stats.acmr = float(misses) / float(indexCount / 3);
+        stats.atvr = float(misses) / float(referencedCount);
+    }
+    return stats;
+}
+
+size_t MeshOptimizer::WeldVertices(void *vertices,
+                                   size_t vertexCount,
+                                   size_t stride,
+                                   uint32_t *indices,
+                                   size_t indexCount,
+                                   float epsilon)
+{
+    size_t floatCount = stride / sizeof(float);
+    auto bytes = static_cast<uint8_t *>(vertices);
+
+    std::vector<int32_t> keys(vertexCount * floatCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        auto attributes = reinterpret_cast<const float *>(bytes + v * stride);
+        for (size_t c = 0; c < floatCount; ++c) {
+            double step = std::floor(double(attributes[c]) / epsilon + 0.5);
+            keys[v * floatCount + c] = std::isnan(step) ? INT32_MIN
+                                                        : int32_t(std::clamp(step, -2e9, 2e9));
+        }
+    }
+    auto key = [&](size_t v) { return keys.data() + v * floatCount; };
+
+    // Open addressing over the surviving vertices, keyed by their rounded attributes.
+    size_t tableSize = 1;
+    while (tableSize < vertexCount * 2) {
+        tableSize *= 2;
+    }
+    std::vector<uint32_t> table(tableSize, UINT32_MAX);
+
+    std::vector<uint32_t> remap(vertexCount);
+    size_t weldedCount = 0;
+    for (size_t v = 0; v < vertexCount; ++v) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t c = 0; c < floatCount; ++c) {
+            hash = (hash ^ uint32_t(key(v)[c])) * 1099511628211ull;
+        }
+
+        size_t slot = size_t(hash) & (tableSize - 1);
+        while (table[slot] != UINT32_MAX
+               && memcmp(key(table[slot]), key(v), floatCount * sizeof(int32_t)) != 0) {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+
+        if (table[slot] == UINT32_MAX) {
+            // Survivors keep their relative order, so moving them down never overwrites one
+            // still to be read.
+            auto welded = uint32_t(weldedCount++);
+            if (welded != v) {
+                memmove(bytes + welded * stride, bytes + v * stride, stride);
+                memmove(key(welded), key(v), floatCount * sizeof(int32_t));
+            }
+            table[slot] = welded;
+        }
+        remap[v] = table[slot];
+    }
+
+    for (size_t i = 0; i < indexCount; ++i) {
+        indices[i] = remap[indices[i]];
+    }
+    return weldedCount;
+}
+
+void MeshOptimizer::OptimizeTriangleOrder(uint32_t *indices,
+                                          size_t indexCount,
+                                          const float *positions,
+                                          size_t stride,
+                                          size_t vertexCount,
+                                          float overdrawThreshold)
+{
+    std::vector<uint32_t> order;
+    std::vector<size_t> hardBoundaries;
+    Tipsify(indices, indexCount, vertexCount, kCacheSize, order, hardBoundaries);
+
+    // Meshes exported already ordered for the cache can beat Tipsify; they keep their order.
+    std::vector<uint32_t> inputOrder(indexCount / 3);
+    std::iota(inputOrder.begin(), inputOrder.end(), 0);
+    size_t misses = CountMisses(indices, order, vertexCount);
+    size_t inputMisses = CountMisses(indices, inputOrder, vertexCount);
+    if (inputMisses < misses) {
+        order.swap(inputOrder);
+        hardBoundaries.assign(order.empty() ? 0 : 1, 0);
+        misses = inputMisses;
+    }
+
+    // The last piece of each run may end up over the threshold, so the result is checked; the
+    // runs alone, or the cache order as it is, are the fallbacks.
+    auto clusters
+        = FindClusters(indices, order, hardBoundaries, vertexCount, misses, overdrawThreshold);
+    for (const auto *candidate : {&clusters, &hardBoundaries}) {
+        auto sortedOrder = SortClusters(indices, order, *candidate, positions, stride);
+        if (CountMisses(indices, sortedOrder, vertexCount) <= overdrawThreshold * misses) {
+            order.swap(sortedOrder);
+            break;
+        }
+    }
+
+    std::vector<uint32_t> source(indices, indices + indexCount);
+    for (size_t t = 0; t < order.size(); ++t) {
+        memcpy(indices + t * 3, source.data() + order[t] * 3, 3 * sizeof(uint32_t));
+    }
+}
+
+size_t MeshOptimizer::OptimizeVertexFetch(void *vertices,
+                                          size_t vertexCount,
+                                          size_t stride,
+                                          uint32_t *indices,
+                                          size_t indexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+    uint32_t usedCount = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        auto &vertex = remap[indices[i]];
+        if (vertex == UINT32_MAX) {
+            vertex = usedCount++;
+        }
+        indices[i] = vertex;
+    }
+
+    auto bytes = static_cast<uint8_t *>(vertices);
+    std::vector<uint8_t> source(bytes, bytes + vertexCount * stride);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        if (remap[v] != UINT32_MAX) {
+            memcpy(bytes + remap[v] * stride, source.data() + v * stride, stride);
+        }
+    }
+    return usedCount;
+}
+
+Report MeshOptimizer::Optimize(void *vertices,
+                               size_t vertexCount,
+                               size_t stride,
+                               uint32_t *indices,
+                               size_t indexCount,
+                               float weldEpsilon,
+                               float overdrawThreshold)
+{
+    Report report = {};
+    report.before = AnalyzeVertexCache(indices, indexCount, vertexCount);
+    report.vertexCountBefore = vertexCount;
+
+    vertexCount = WeldVertices(vertices, vertexCount, stride, indices, indexCount, weldEpsilon);
+
+    // Meshes already in a good cache order can come out of Tipsify worse; keep the order that
+    // misses least.
+    std::vector<uint32_t> original(indices, indices + indexCount);
+    float originalAcmr = AnalyzeVertexCache(indices, indexCount, vertexCount).acmr;
+    OptimizeTriangleOrder(indices,
+                          indexCount,
+                          static_cast<const float *>(vertices),
+                          stride,
+                          vertexCount,
+                          overdrawThreshold);
+    if (!(AnalyzeVertexCache(indices, indexCount, vertexCount).acmr < originalAcmr)) {
+        std::copy(original.begin(), original.end(), indices);
+    }
+    vertexCount = OptimizeVertexFetch(vertices, vertexCount, stride, indices, indexCount);
+
+    report.after = AnalyzeVertexCache(indices, indexCount, vertexCount);
+    report.vertexCountAfter = vertexCount;
+    return report;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reorders indexed triangle lists for the GPU: welds duplicate vertices, orders triangles for
+// the post-transform vertex cache (Tipsify, Sander et al. 2007) and then for overdraw, and
+// finally orders vertices by first use so fetches walk the vertex buffer forwards.  Vertices
+// are any layout made only of 32 bit floats, position first.  Portable so the offline tools
+// share it.
+namespace MeshOptimizer
+{
+// FIFO cache size the orderings are tuned for and measured against.
+const uint32_t kCacheSize = 16;
+
+// Attributes equal after rounding to this step are one vertex.
+const float kWeldEpsilon = 1e-5f;
+
+// How much worse than the pure cache order the overdraw order may make the ACMR.
+const float kOverdrawThreshold = 1.05f;
+
+struct CacheStats
+{
+    // Average cache miss ratio: vertex shader invocations per triangle, 0.5 at best for large
+    // regular meshes, 3 at worst.
+    float acmr;
+    // Average transform to vertex ratio: invocations per referenced vertex, 1 at best.
+    float atvr;
+};
+
+struct Report
+{
+    CacheStats before;
+    CacheStats after;
+    size_t vertexCountBefore;
+    size_t vertexCountAfter;
+};
+
+CacheStats AnalyzeVertexCache(const uint32_t *indices,
+                              size_t indexCount,
+                              size_t vertexCount,
+                              uint32_t cacheSize = kCacheSize);
+
+// Merges vertices whose attributes agree after rounding to epsilon, compacting the survivors
+// to the front of vertices in their original order and remapping indices.  Returns the new
+// vertex count.
+size_t WeldVertices(void *vertices,
+                    size_t vertexCount,
+                    size_t stride,
+                    uint32_t *indices,
+                    size_t indexCount,
+                    float epsilon = kWeldEpsilon);
+
+// Tipsify for the vertex cache, then clusters of that order sorted so triangles facing out of
+// the mesh come first, as long as the ACMR stays within overdrawThreshold of the cache order.
+// positions points at the first vertex's position, stride bytes apart.
+void OptimizeTriangleOrder(uint32_t *indices,
+                           size_t indexCount,
+                           const float *positions,
+                           size_t stride,
+                           size_t vertexCount,
+                           float overdrawThreshold = kOverdrawThreshold);
+
+// Renumbers vertices in order of first use, dropping unreferenced ones.  Returns the new vertex
+// count.
+size_t OptimizeVertexFetch(void *vertices,
+                           size_t vertexCount,
+                           size_t stride,
+                           uint32_t *indices,
+                           size_t indexCount);
+
+// The whole pipeline, keeping the welded triangle order where the optimized one misses the
+// cache no less often.  Returns the vertex count after welding and the cache statistics before
+// and after.
+Report Optimize(void *vertices,
+                size_t vertexCount,
+                size_t stride,
+                uint32_t *indices,
+                size_t indexCount,
+                float weldEpsilon = kWeldEpsilon,
+                float overdrawThreshold = kOverdrawThreshold);
+
+template <typename Vertex>
+Report Optimize(std::vector<Vertex> &vertices,
+                std::vector<uint32_t> &indices,
+                float weldEpsilon = kWeldEpsilon)
+{
+    static_assert(sizeof(Vertex) % sizeof(float) == 0, "vertices are welded as float arrays");
+    auto report = Optimize(vertices.data(),
+                           vertices.size(),
+                           sizeof(Vertex),
+                           indices.data(),
+                           indices.size(),
+                           weldEpsilon);
+    vertices.resize(report.vertexCountAfter);
+    return report;
+}
+} // namespace MeshOptimizer
@@ -0,0 +1,418 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace MeshSimplifier;
+
+namespace
+{
+// Error cap of the first level as a fraction of the mesh's bounding radius, and how much more
+// each further level may lose.
+const double kFirstLevelError = 0.005;
+const double kLevelErrorGrowth = 2.75;
+
+// A level has to drop at least this share of the indices of the level before to be kept.
+const double kMinLevelReduction = 0.25;
+
+// Collapses that turn a triangle further than acos of this are refused as flips.
+const double kMinFlipCos = 0.2;
+
+struct Float3
+{
+    double x, y, z;
+};
+
+Float3 operator-(const Float3 &a, const Float3 &b)
+{
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+double Dot(const Float3 &a, const Float3 &b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+Float3 Cross(const Float3 &a, const Float3 &b)
+{
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+// Sum of squared distances to a set of planes, weighted by the area of the triangles they came
+// from, as the symmetric matrix of the plane equations.
+struct Quadric
+{
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    double weight;
+
+    Quadric &operator+=(const Quadric &rhs)
+    {
+        a2 += rhs.a2, ab += rhs.ab, ac += rhs.ac, ad += rhs.ad;
+        b2 += rhs.b2, bc += rhs.bc, bd += rhs.bd;
+        c2 += rhs.c2, cd += rhs.cd;
+        d2 += rhs.d2;
+        weight += rhs.weight;
+        return *this;
+    }
+};
+
+Quadric MakePlaneQuadric(const Float3 &normal, double d, double weight)
+{
+    const double a = normal.x, b = normal.y, c = normal.z;
+    return {a * a * weight,
+            a * b * weight,
+            a * c * weight,
+            a * d * weight,
+            b * b * weight,
+            b * c * weight,
+            b * d * weight,
+            c * c * weight,
+            c * d * weight,
+            d * d * weight,
+            weight};
+}
+
+// Mean squared distance from p to the quadric's planes.
+double Evaluate(const Quadric &q, const Float3 &p)
+{
+    double sum = q.a2 * p.x * p.x + 2.0 * q.ab * p.x * p.y + 2.0 * q.ac * p.x * p.z
+                 + 2.0 * q.ad * p.x + q.b2 * p.y * p.y + 2.0 * q.bc * p.y * p.z
+                 + 2.0 * q.bd * p.y + q.c2 * p.z * p.z + 2.0 * q.cd * p.z + q.d2;
+    return q.weight > 0.0 ? std::max(sum, 0.0) / q.weight : 0.0;
+}
+
+class Simplifier
+{
+public:
+    Simplifier(const uint32_t *indices,
+               size_t indexCount,
+               const float *positions,
+               size_t stride,
+               size_t vertexCount);
+
+    // Collapses until targetIndexCount is reached or every collapse left costs more than
+    // targetError.  May be called again with larger targets to go on from where it stopped.
+    void Run(size_t targetIndexCount, double targetError);
+
+    const std::vector<uint32_t> &GetIndices() const { return mIndices; }
+    float GetError() const { return float(std::sqrt(mError)); }
+    double GetRadius() const { return mRadius; }
+
+private:
+    void BuildAdjacency();
+    void LockBordersAndSeams();
+    bool CanCollapse(uint32_t from, uint32_t to) const;
+
+    // Triangles around a vertex, valid for vertices untouched since BuildAdjacency.
+    const uint32_t *TrianglesBegin(uint32_t vertex) const
+    {
+        return mTriangles.data() + mOffsets[vertex];
+    }
+    const uint32_t *TrianglesEnd(uint32_t vertex) const
+    {
+        return mTriangles.data() + mOffsets[vertex + 1];
+    }
+
+    std::vector<uint32_t> mIndices;
+    std::vector<Float3> mPositions;
+    std::vector<Quadric> mQuadrics;
+    std::vector<bool> mLocked;
+    std::vector<uint32_t> mOffsets;
+    std::vector<uint32_t> mTriangles;
+    double mError = 0.0;
+    double mRadius = 0.0;
+};
+
+Simplifier::Simplifier(const uint32_t *indices,
+                       size_t indexCount,
+                       const float *positions,
+                       size_t stride,
+                       size_t vertexCount)
+    : mPositions(vertexCount)
+    , mQuadrics(vertexCount, Quadric{})
+    , mLocked(vertexCount, false)
+{
+    for (size_t v = 0; v < vertexCount; ++v) {
+        auto p = reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(positions)
+                                                 + v * stride);
+        mPositions[v] = {p[0], p[1], p[2]};
+    }
+
+    Float3 lo = {INFINITY, INFINITY, INFINITY};
+    Float3 hi = {-INFINITY, -INFINITY, -INFINITY};
+    mIndices.reserve(indexCount);
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (a == b || b == c || c == a)
+            continue;
+        mIndices.insert(mIndices.end(), {a, b, c});
+
+        const Float3 &p0 = mPositions[a];
+        Float3 n = Cross(mPositions[b] - p0, mPositions[c] - p0);
+        double length = std::sqrt(Dot(n, n));
+        if (length > 0.0) {
+            Float3 unit = {n.x / length, n.y / length, n.z / length};
+            auto quadric = MakePlaneQuadric(unit, -Dot(unit, p0), 0.5 * length);
+            mQuadrics[a] += quadric;
+            mQuadrics[b] += quadric;
+            mQuadrics[c] += quadric;
+        }
+
+        for (auto v : {a, b, c}) {
+            const Float3 &p = mPositions[v];
+            lo = {std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+            hi = {std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+        }
+    }
+    if (!mIndices.empty()) {
+        Float3 diagonal = hi - lo;
+        mRadius = 0.5 * std::sqrt(Dot(diagonal, diagonal));
+    }
+
+    BuildAdjacency();
+    LockBordersAndSeams();
+}
+
+void Simplifier::BuildAdjacency()
+{
+    mOffsets.assign(mPositions.size() + 1, 0);
+    for (auto index : mIndices) {
+        ++mOffsets[index + 1];
+    }
+    std::partial_sum(mOffsets.begin(), mOffsets.end(), mOffsets.begin());
+
+    mTriangles.resize(mIndices.size());
+    std::vector<uint32_t> fill(mOffsets.begin(), mOffsets.end() - 1);
+    for (size_t i = 0; i < mIndices.size(); ++i) {
+        mTriangles[fill[mIndices[i]]++] = uint32_t(i / 3);
+    }
+}
+
+void Simplifier::LockBordersAndSeams()
+{
+    // An edge used by one triangle is an open border, by more than two a non-manifold one.
+    std::vector<uint32_t> neighbours;
+    for (uint32_t v = 0; v < mPositions.size(); ++v) {
+        neighbours.clear();
+        for (auto t = TrianglesBegin(v); t != TrianglesEnd(v); ++t) {
+            for (int k = 0; k < 3; ++k) {
+                uint32_t other = mIndices[*t * 3 + k];
+                if (other != v) {
+                    neighbours.push_back(other);
+                }
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        for (size_t i = 0; i < neighbours.size();) {
+            size_t j = i;
+            while (j < neighbours.size() && neighbours[j] == neighbours[i]) {
+                ++j;
+            }
+            if (j - i != 2) {
+                mLocked[v] = true;
+            }
+            i = j;
+        }
+    }
+
+    // Vertices at the same position differ in some other attribute.
+    std::vector<uint32_t> order(mPositions.size());
+    std::iota(order.begin(), order.end(), 0u);
+    auto less = [&](uint32_t a, uint32_t b) {
+        const Float3 &p = mPositions[a], &q = mPositions[b];
+        return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+    };
+    std::sort(order.begin(), order.end(), less);
+    for (size_t i = 1; i < order.size(); ++i) {
+        if (!less(order[i - 1], order[i])) {
+            mLocked[order[i - 1]] = true;
+            mLocked[order[i]] = true;
+        }
+    }
+}
+
+bool Simplifier::CanCollapse(uint32_t from, uint32_t to) const
+{
+    // Link condition: from and to may only share the neighbours opposite their shared edge, or
+    // the collapse pinches the surface.
+    size_t sharedTriangles = 0;
+    std::vector<uint32_t> fromNeighbours;
+    for (auto t = TrianglesBegin(from); t != TrianglesEnd(from); ++t) {
+        const uint32_t *corners = &mIndices[*t * 3];
+        bool shared = corners[0] == to || corners[1] == to || corners[2] == to;
+        sharedTriangles += shared ? 1 : 0;
+        for (int k = 0; k < 3; ++k) {
+            if (corners[k] != from && corners[k] != to) {
+                fromNeighbours.push_back(corners[k]);
+            }
+        }
+
+        // The triangles that survive must not flip or collapse to slivers.
+        if (!shared) {
+            const Float3 *p[3];
+            for (int k = 0; k < 3; ++k) {
+                p[k] = &mPositions[corners[k]];
+            }
+            Float3 before = Cross(*p[1] - *p[0], *p[2] - *p[0]);
+            for (int k = 0; k < 3; ++k) {
+                if (corners[k] == from) {
+                    p[k] = &mPositions[to];
+                }
+            }
+            Float3 after = Cross(*p[1] - *p[0], *p[2] - *p[0]);
+            if (Dot(before, after) < kMinFlipCos * std::sqrt(Dot(before, before) * Dot(after, after)))
+                return false;
+        }
+    }
+    std::sort(fromNeighbours.begin(), fromNeighbours.end());
+    fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()),
+                         fromNeighbours.end());
+
+    std::vector<uint32_t> toNeighbours;
+    for (auto t = TrianglesBegin(to); t != TrianglesEnd(to); ++t) {
+        for (int k = 0; k < 3; ++k) {
+            uint32_t corner = mIndices[*t * 3 + k];
+            if (corner != from && corner != to) {
+                toNeighbours.push_back(corner);
+            }
+        }
+    }
+    std::sort(toNeighbours.begin(), toNeighbours.end());
+    toNeighbours.erase(std::unique(toNeighbours.begin(), toNeighbours.end()), toNeighbours.end());
+
+    size_t common = 0;
+    for (size_t i = 0, j = 0; i < fromNeighbours.size() && j < toNeighbours.size();) {
+        if (fromNeighbours[i] < toNeighbours[j]) {
+            ++i;
+        } else if (toNeighbours[j] < fromNeighbours[i]) {
+            ++j;
+        } else {
+            ++common, ++i, ++j;
+        }
+    }
+    return common == sharedTriangles;
+}
+
+void Simplifier::Run(size_t targetIndexCount, double targetError)
+{
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    double limit = targetError * targetError;
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched;
+    while (mIndices.size() > targetIndexCount) {
+        BuildAdjacency();
+
+        collapses.clear();
+        for (size_t i = 0; i < mIndices.size(); i += 3) {
+            for (int k = 0; k < 3; ++k) {
+                uint32_t a = mIndices[i + k];
+                uint32_t b = mIndices[i + (k + 1) % 3];
+                for (auto [from, to] : {std::make_pair(a, b), std::make_pair(b, a)}) {
+                    if (mLocked[from])
+                        continue;
+                    Quadric merged = mQuadrics[from];
+                    merged += mQuadrics[to];
+                    double cost = Evaluate(merged, mPositions[to]);
+                    if (cost <= limit) {
+                        collapses.push_back({from, to, cost});
+                    }
+                }
+            }
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+            return a.cost < b.cost;
+        });
+
+        // Collapses in one pass touch disjoint neighbourhoods, so the adjacency stays valid for
+        // every vertex that is still to be looked at.
+        size_t trianglesToRemove = (mIndices.size() - targetIndexCount + 2) / 3;
+        size_t removed = 0;
+        touched.assign(mPositions.size(), false);
+        for (const auto &collapse : collapses) {
+            if (removed >= trianglesToRemove)
+                break;
+            if (touched[collapse.from] || touched[collapse.to]
+                || !CanCollapse(collapse.from, collapse.to)) {
+                continue;
+            }
+
+            for (auto t = TrianglesBegin(collapse.from); t != TrianglesEnd(collapse.from); ++t) {
+                uint32_t *corners = &mIndices[*t * 3];
+                for (int k = 0; k < 3; ++k) {
+                    touched[corners[k]] = true;
+                }
+                bool shared = corners[0] == collapse.to || corners[1] == collapse.to
+                              || corners[2] == collapse.to;
+                removed += shared ? 1 : 0;
+                std::replace(corners, corners + 3, collapse.from, collapse.to);
+            }
+            mQuadrics[collapse.to] += mQuadrics[collapse.from];
+            mError = std::max(mError, collapse.cost);
+        }
+        if (removed == 0)
+            break;
+
+        size_t count = 0;
+        for (size_t i = 0; i < mIndices.size(); i += 3) {
+            uint32_t a = mIndices[i], b = mIndices[i + 1], c = mIndices[i + 2];
+            if (a != b && b != c && c != a) {
+                mIndices[count++] = a;
+                mIndices[count++] = b;
+                mIndices[count++] = c;
+            }
+        }
+        mIndices.resize(count);
+    }
+}
+} // namespace
+
+std::vector<uint32_t> MeshSimplifier::Simplify(const uint32_t *indices,
+                                               size_t indexCount,
+                                               const float *positions,
+                                               size_t stride,
+                                               size_t vertexCount,
+                                               size_t targetIndexCount,
+                                               float targetError,
+                                               float *error)
+{
+    Simplifier simplifier(indices, indexCount, positions, stride, vertexCount);
+    simplifier.Run(targetIndexCount, targetError);
+    if (error != nullptr) {
+        *error = simplifier.GetError();
+    }
+    return simplifier.GetIndices();
+}
+
+std::vector<Level> MeshSimplifier::BuildLodChain(const uint32_t *indices,
+                                                 size_t indexCount,
+                                                 const float *positions,
+                                                 size_t stride,
+                                                 size_t vertexCount,
+                                                 size_t levelCount)
+{
+    // One simplification run, stopped at each level's target to copy the level out, so every
+    // level's error is measured against the full mesh.
+    Simplifier simplifier(indices, indexCount, positions, stride, vertexCount);
+    std::vector<Level> levels;
+    size_t previousCount = indexCount;
+    double errorCap = simplifier.GetRadius() * kFirstLevelError;
+    for (size_t level = 0; level < levelCount; ++level, errorCap *= kLevelErrorGrowth) {
+        simplifier.Run(previousCount / 6 * 3, errorCap);
+
+        const auto &simplified = simplifier.GetIndices();
+        if (simplified.size() > previousCount * (1.0 - kMinLevelReduction))
+            continue;
+        levels.push_back({simplified, simplifier.GetError()});
+        previousCount = simplified.size();
+    }
+    return levels;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Builds levels of detail by collapsing edges in order of their quadric error (Garland and
+// Heckbert 1997).  Each collapse moves a vertex onto a neighbour, so every level indexes the
+// original vertex buffer and only needs an index range of its own.  Vertices on open borders and
+// attribute seams (vertices sharing a position) never move, which keeps texture and normal
+// seams intact.  Portable so the offline tools share it.
+namespace MeshSimplifier
+{
+// Levels below the full mesh BuildLodChain aims for.
+const size_t kMaxLevels = 4;
+
+struct Level
+{
+    std::vector<uint32_t> indices;
+    // Largest distance from the original surface any collapse of the level made, in the mesh's
+    // units.
+    float error;
+};
+
+// Collapses edges until no more than targetIndexCount indices are left or the next collapse
+// would move the surface further than targetError.  positions points at the first vertex's
+// position, stride bytes apart.  The error reached is stored in error if it is not null.
+std::vector<uint32_t> Simplify(const uint32_t *indices,
+                               size_t indexCount,
+                               const float *positions,
+                               size_t stride,
+                               size_t vertexCount,
+                               size_t targetIndexCount,
+                               float targetError,
+                               float *error = nullptr);
+
+// Up to levelCount levels, halving the triangle count each, coarsest last.  Each level's error
+// is capped relative to the mesh's size; levels that would barely differ from the one before
+// are left out.
+std::vector<Level> BuildLodChain(const uint32_t *indices,
+                                 size_t indexCount,
+                                 const float *positions,
+                                 size_t stride,
+                                 size_t vertexCount,
+                                 size_t levelCount = kMaxLevels);
+
+// The DrawArgs and mesh file name of a level, level 1 being the first below the full mesh.
+inline std::string GetLevelName(const std::string &name, size_t level)
+{
+    return name + "_lod" + std::to_string(level);
+}
+
+// The level to draw, 0 being the full mesh: the coarsest of levelCount levels whose error on
+// screen, levelError(i) for level i + 1 and growing with i, stays under maxError.  The level
+// drawn before, current, is kept while that error is within hysteresis of the limit either way,
+// so that an instance does not pop back and forth at the boundary.
+template <typename LevelError>
+size_t SelectLevel(size_t levelCount,
+                   LevelError levelError,
+                   float maxError,
+                   float hysteresis,
+                   size_t current)
+{
+    auto coarsestUnder = [&](float limit) {
+        size_t level = 0;
+        while (level < levelCount && levelError(level) <= limit) {
+            ++level;
+        }
+        return level;
+    };
+    size_t finest = coarsestUnder(maxError / (1.0f + hysteresis));
+    size_t coarsest = coarsestUnder(maxError * (1.0f + hysteresis));
+    return current < finest ? finest : current > coarsest ? coarsest : current;
+}
+
+template <typename Vertex>
+std::vector<Level> BuildLodChain(const std::vector<Vertex> &vertices,
+                                 const std::vector<uint32_t> &indices,
+                                 size_t levelCount = kMaxLevels)
+{
+    return BuildLodChain(indices.data(),
+                         indices.size(),
+                         reinterpret_cast<const float *>(vertices.data()),
+                         sizeof(Vertex),
+                         vertices.size(),
+                         levelCount);
+}
+} // namespace MeshSimplifier
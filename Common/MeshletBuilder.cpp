@@ -0,0 +1,268 @@
+#include "MeshletBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace MeshletBuilder;
+
+namespace
+{
+struct Float3
+{
+    double x, y, z;
+};
+
+Float3 operator-(const Float3 &a, const Float3 &b)
+{
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+double Dot(const Float3 &a, const Float3 &b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+Float3 Cross(const Float3 &a, const Float3 &b)
+{
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+// Unit length, or zero for a zero vector.
+Float3 Normalize(const Float3 &v)
+{
+    double length = std::sqrt(Dot(v, v));
+    return length > 0.0 ? Float3{v.x / length, v.y / length, v.z / length} : Float3{0, 0, 0};
+}
+
+Float3 LoadPosition(const float *positions, size_t stride, uint32_t vertex)
+{
+    auto p = reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(positions)
+                                             + vertex * stride);
+    return {p[0], p[1], p[2]};
+}
+
+// Triangles around each vertex, in compressed rows.
+struct Adjacency
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+};
+
+Adjacency BuildAdjacency(const uint32_t *indices, size_t indexCount, size_t vertexCount)
+{
+    Adjacency adjacency;
+    adjacency.offsets.assign(vertexCount + 1, 0);
+    for (size_t i = 0; i < indexCount; ++i) {
+        ++adjacency.offsets[indices[i] + 1];
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        adjacency.offsets[v + 1] += adjacency.offsets[v];
+    }
+
+    adjacency.triangles.resize(indexCount);
+    std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i) {
+        adjacency.triangles[fill[indices[i]]++] = uint32_t(i / 3);
+    }
+    return adjacency;
+}
+
+// Sphere around the meshlet's vertices, centred on their box; within a few percent of the
+// smallest sphere for the compact clusters Build makes.
+void ComputeSphere(const std::vector<uint32_t> &vertices,
+                   const float *positions,
+                   size_t stride,
+                   Meshlet &meshlet)
+{
+    Float3 lo = LoadPosition(positions, stride, vertices[0]);
+    Float3 hi = lo;
+    for (auto vertex : vertices) {
+        Float3 p = LoadPosition(positions, stride, vertex);
+        lo = {std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+        hi = {std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+    }
+
+    Float3 center = {0.5 * (lo.x + hi.x), 0.5 * (lo.y + hi.y), 0.5 * (lo.z + hi.z)};
+    double radiusSq = 0.0;
+    for (auto vertex : vertices) {
+        Float3 d = LoadPosition(positions, stride, vertex) - center;
+        radiusSq = std::max(radiusSq, Dot(d, d));
+    }
+
+    meshlet.center[0] = float(center.x);
+    meshlet.center[1] = float(center.y);
+    meshlet.center[2] = float(center.z);
+    // Rounded up so float rounding of the center cannot leave a vertex outside.
+    meshlet.radius = float(std::sqrt(radiusSq) * (1.0 + 1e-5));
+}
+
+// Axis is the mean of the triangle normals, the cutoff the cosine to the normal furthest from
+// it.  Degenerate triangles face nowhere and are left out.
+void ComputeCone(const std::vector<Float3> &normals,
+                 const std::vector<uint32_t> &triangles,
+                 Meshlet &meshlet)
+{
+    Float3 sum = {0, 0, 0};
+    for (auto triangle : triangles) {
+        const auto &n = normals[triangle];
+        sum = {sum.x + n.x, sum.y + n.y, sum.z + n.z};
+    }
+    Float3 axis = Normalize(sum);
+
+    double cutoff = Dot(axis, axis) > 0.0 ? 1.0 : 0.0;
+    for (auto triangle : triangles) {
+        const auto &n = normals[triangle];
+        if (Dot(n, n) > 0.0) {
+            cutoff = std::min(cutoff, Dot(n, axis));
+        }
+    }
+
+    meshlet.coneAxis[0] = float(axis.x);
+    meshlet.coneAxis[1] = float(axis.y);
+    meshlet.coneAxis[2] = float(axis.z);
+    // Widened slightly for the rounding of the axis.
+    meshlet.coneCutoff = float(cutoff - 1e-5);
+}
+} // namespace
+
+std::vector<Meshlet> MeshletBuilder::Build(uint32_t *indices,
+                                           size_t indexCount,
+                                           const float *positions,
+                                           size_t stride,
+                                           size_t vertexCount,
+                                           uint32_t maxVertices,
+                                           uint32_t maxTriangles)
+{
+    std::vector<Meshlet> meshlets;
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0 || maxVertices < 3 || maxTriangles == 0)
+        return meshlets;
+
+    std::vector<Float3> normals(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const uint32_t *triangle = indices + t * 3;
+        Float3 a = LoadPosition(positions, stride, triangle[0]);
+        Float3 b = LoadPosition(positions, stride, triangle[1]);
+        Float3 c = LoadPosition(positions, stride, triangle[2]);
+        // Clockwise front faces, as Direct3D draws them by default.
+        normals[t] = Normalize(Cross(b - a, c - a));
+    }
+
+    auto adjacency = BuildAdjacency(indices, indexCount, vertexCount);
+
+    std::vector<bool> emitted(triangleCount, false);
+    // Meshlet number + 1 of the meshlet a vertex was last added to.
+    std::vector<uint32_t> vertexMeshlet(vertexCount, 0);
+    std::vector<uint32_t> order;
+    order.reserve(indexCount);
+
+    std::vector<uint32_t> vertices;
+    std::vector<uint32_t> triangles;
+    size_t cursor = 0;
+    while (true) {
+        while (cursor < triangleCount && emitted[cursor]) {
+            ++cursor;
+        }
+        if (cursor == triangleCount)
+            break;
+
+        uint32_t stamp = uint32_t(meshlets.size() + 1);
+        vertices.clear();
+        triangles.clear();
+        Float3 normalSum = {0, 0, 0};
+
+        auto newVertexCount = [&](uint32_t triangle) {
+            const uint32_t *corners = indices + triangle * 3;
+            uint32_t count = 0;
+            for (int k = 0; k < 3; ++k) {
+                // Repeated corners of a degenerate triangle count once.
+                bool repeated = (k > 0 && corners[k] == corners[0])
+                                || (k > 1 && corners[k] == corners[1]);
+                count += (vertexMeshlet[corners[k]] != stamp && !repeated) ? 1 : 0;
+            }
+            return count;
+        };
+        auto add = [&](uint32_t triangle) {
+            const uint32_t *corners = indices + triangle * 3;
+            for (int k = 0; k < 3; ++k) {
+                if (vertexMeshlet[corners[k]] != stamp) {
+                    vertexMeshlet[corners[k]] = stamp;
+                    vertices.push_back(corners[k]);
+                }
+            }
+            emitted[triangle] = true;
+            triangles.push_back(triangle);
+            const auto &n = normals[triangle];
+            normalSum = {normalSum.x + n.x, normalSum.y + n.y, normalSum.z + n.z};
+        };
+
+        // Seeded with the first triangle of the existing order left over, then grown by the
+        // neighbour that adds the fewest vertices, ties going to the one facing most like the
+        // meshlet so far, which keeps the cones narrow.
+        add(uint32_t(cursor));
+        while (triangles.size() < maxTriangles) {
+            Float3 axis = Normalize(normalSum);
+            uint32_t best = UINT32_MAX;
+            uint32_t bestNew = UINT32_MAX;
+            double bestDot = -2.0;
+            for (auto vertex : vertices) {
+                for (uint32_t i = adjacency.offsets[vertex]; i < adjacency.offsets[vertex + 1];
+                     ++i) {
+                    uint32_t triangle = adjacency.triangles[i];
+                    if (emitted[triangle])
+                        continue;
+                    uint32_t added = newVertexCount(triangle);
+                    if (vertices.size() + added > maxVertices)
+                        continue;
+                    double dot = Dot(normals[triangle], axis);
+                    if (added < bestNew || (added == bestNew && dot > bestDot)) {
+                        best = triangle;
+                        bestNew = added;
+                        bestDot = dot;
+                    }
+                }
+            }
+            if (best == UINT32_MAX)
+                break;
+            add(best);
+        }
+
+        Meshlet meshlet = {};
+        meshlet.startIndex = uint32_t(order.size());
+        meshlet.indexCount = uint32_t(triangles.size() * 3);
+        meshlet.vertexCount = uint32_t(vertices.size());
+        ComputeSphere(vertices, positions, stride, meshlet);
+        ComputeCone(normals, triangles, meshlet);
+        meshlets.push_back(meshlet);
+
+        // The triangles keep their relative order, so the cache order survives within meshlets.
+        std::sort(triangles.begin(), triangles.end());
+        for (auto triangle : triangles) {
+            order.insert(order.end(), indices + triangle * 3, indices + triangle * 3 + 3);
+        }
+    }
+
+    // A trailing partial triangle, if any, stays where it was.
+    std::copy(order.begin(), order.end(), indices);
+    return meshlets;
+}
+
+bool MeshletBuilder::IsBackfacing(const Meshlet &meshlet, const float eye[3])
+{
+    // Each triangle faces away if the eye is behind its plane.  With the normals within the cone
+    // and the points within the sphere that holds for all of them when
+    //   cos * dot(axis, v) - sin * |v - dot(axis, v) axis| >= (cos + sin) * radius,
+    // v being the vector from the eye to the center.
+    float cos = meshlet.coneCutoff;
+    if (cos <= 0.0f)
+        return false;
+    float sin = std::sqrt(std::max(1.0f - cos * cos, 0.0f));
+
+    float v[3] = {
+        meshlet.center[0] - eye[0], meshlet.center[1] - eye[1], meshlet.center[2] - eye[2]};
+    float along = meshlet.coneAxis[0] * v[0] + meshlet.coneAxis[1] * v[1]
+                  + meshlet.coneAxis[2] * v[2];
+    float lengthSq = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+    float across = std::sqrt(std::max(lengthSq - along * along, 0.0f));
+    return cos * along - sin * across >= (cos + sin) * meshlet.radius;
+}
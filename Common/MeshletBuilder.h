@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits an indexed triangle list into meshlets, small clusters of neighbouring triangles, and
+// bounds each with a sphere and a cone of normals so whole clusters can be culled on the CPU
+// when they are off screen or face away from the eye.  Portable so the offline tools share it.
+namespace MeshletBuilder
+{
+// Limits that keep a cluster within one mesh shader thread group.
+const uint32_t kMaxVertices = 64;
+const uint32_t kMaxTriangles = 124;
+
+struct Meshlet
+{
+    // Into the index list the meshlet was built from; its triangles are contiguous there.
+    uint32_t startIndex;
+    uint32_t indexCount;
+    uint32_t vertexCount;
+    // Bounding sphere.
+    float center[3];
+    float radius;
+    // Every triangle normal is within acos(coneCutoff) of coneAxis.  A cutoff of 0 or less means
+    // the cluster faces too many ways to be backface culled.
+    float coneAxis[3];
+    float coneCutoff;
+};
+
+// Reorders the triangles of indices so each meshlet's are contiguous, growing meshlets from the
+// existing order through shared vertices and similar normals, so the result keeps most of a
+// cache optimized order.  positions points at the first vertex's position, stride bytes apart.
+std::vector<Meshlet> Build(uint32_t *indices,
+                           size_t indexCount,
+                           const float *positions,
+                           size_t stride,
+                           size_t vertexCount,
+                           uint32_t maxVertices = kMaxVertices,
+                           uint32_t maxTriangles = kMaxTriangles);
+
+// True if every triangle of the meshlet faces away from eye, given in the space the meshlet
+// was built in.  Exact for any affine transform of the mesh, as long as the eye is transformed
+// into the mesh's space.
+bool IsBackfacing(const Meshlet &meshlet, const float eye[3]);
+
+template <typename Vertex>
+std::vector<Meshlet> Build(const std::vector<Vertex> &vertices, std::vector<uint32_t> &indices)
+{
+    return Build(indices.data(),
+                 indices.size(),
+                 reinterpret_cast<const float *>(vertices.data()),
+                 sizeof(Vertex),
+                 vertices.size());
+}
+} // namespace MeshletBuilder
@@ -0,0 +1,384 @@
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE2 1
+#endif
+
+using namespace MipGenerator;
+
+namespace
+{
+// One RGBA pixel in float.  Filtering treats the four channels alike, so a pixel fills an SSE
+// register exactly.
+#if MIP_GENERATOR_SSE2
+struct Pixel
+{
+    __m128 v;
+
+    static Pixel Load(const float *p) { return {_mm_loadu_ps(p)}; }
+    static Pixel Set(float x) { return {_mm_set1_ps(x)}; }
+    void Store(float *p) const { _mm_storeu_ps(p, v); }
+
+    friend Pixel operator+(Pixel a, Pixel b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend Pixel operator*(Pixel a, Pixel b) { return {_mm_mul_ps(a.v, b.v)}; }
+};
+#else
+struct Pixel
+{
+    float v[4];
+
+    static Pixel Load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+    static Pixel Set(float x) { return {{x, x, x, x}}; }
+    void Store(float *p) const { memcpy(p, v, sizeof(v)); }
+
+    friend Pixel operator+(Pixel a, Pixel b)
+    {
+        return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}};
+    }
+    friend Pixel operator*(Pixel a, Pixel b)
+    {
+        return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}};
+    }
+};
+#endif
+
+// Output rows per job.
+const uint32_t kBandRows = 16;
+
+// Kaiser filter radius in output pixels and window shape.
+const double kKaiserRadius = 3.0;
+const double kKaiserAlpha = 4.0;
+
+struct ColorTables
+{
+    float unormToFloat[256];
+    float srgbToLinear[256];
+    // srgbThresholds[k] is the linear value halfway (in sRGB) between codes k and k + 1.
+    float srgbThresholds[255];
+
+    static double SrgbToLinear(double x)
+    {
+        return x <= 0.04045 ? x / 12.92 : std::pow((x + 0.055) / 1.055, 2.4);
+    }
+
+    ColorTables()
+    {
+        for (int i = 0; i < 256; ++i) {
+            unormToFloat[i] = float(i / 255.0);
+            srgbToLinear[i] = float(SrgbToLinear(i / 255.0));
+        }
+        for (int i = 0; i < 255; ++i) {
+            srgbThresholds[i] = float(SrgbToLinear((i + 0.5) / 255.0));
+        }
+    }
+};
+
+const ColorTables &GetColorTables()
+{
+    static const ColorTables tables;
+    return tables;
+}
+
+uint8_t LinearToSrgb(const ColorTables &tables, float x)
+{
+    // Counts the thresholds below x, which rounds in sRGB space.
+    return uint8_t(std::upper_bound(tables.srgbThresholds, tables.srgbThresholds + 255, x)
+                   - tables.srgbThresholds);
+}
+
+uint8_t FloatToUnorm(float x)
+{
+    return uint8_t(std::min(std::max(x, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// Weights of one axis: output pixel i sums weights[i * tapCount + k] times source pixel
+// indices[i * tapCount + k].  Indices are clamped to the image, so edges repeat.
+struct Taps
+{
+    uint32_t tapCount = 0;
+    std::vector<uint32_t> indices;
+    std::vector<float> weights;
+};
+
+double BesselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+double KaiserSinc(double x)
+{
+    if (std::fabs(x) >= kKaiserRadius)
+        return 0.0;
+
+    const double pi = 3.14159265358979323846;
+    double sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+    double t = x / kKaiserRadius;
+    return sinc * BesselI0(kKaiserAlpha * std::sqrt(1.0 - t * t)) / BesselI0(kKaiserAlpha);
+}
+
+Taps ComputeTaps(Filter filter, uint32_t srcSize, uint32_t dstSize)
+{
+    double scale = double(srcSize) / dstSize;
+    double support = filter == Filter::Box ? 0.5 * scale : kKaiserRadius * scale;
+    // A 1 pixel axis only repeats itself.
+    if (srcSize == dstSize) {
+        support = 0.5;
+    }
+
+    Taps taps;
+    taps.tapCount = uint32_t(std::ceil(2.0 * support)) + 1;
+    taps.indices.resize(size_t(dstSize) * taps.tapCount);
+    taps.weights.resize(size_t(dstSize) * taps.tapCount);
+
+    std::vector<double> weights(taps.tapCount);
+    for (uint32_t i = 0; i < dstSize; ++i) {
+        double center = (i + 0.5) * scale;
+        int first = int(std::floor(center - support));
+
+        double sum = 0.0;
+        for (uint32_t k = 0; k < taps.tapCount; ++k) {
+            double pixelCenter = first + k + 0.5;
+            if (srcSize == dstSize || filter == Filter::Box) {
+                // Overlap of the source pixel with the output pixel's footprint.
+                double lo = std::max(double(first + int(k)), center - support);
+                double hi = std::min(double(first + int(k)) + 1.0, center + support);
+                weights[k] = std::max(hi - lo, 0.0);
+            } else {
+                weights[k] = KaiserSinc((pixelCenter - center) / scale);
+            }
+            sum += weights[k];
+        }
+
+        for (uint32_t k = 0; k < taps.tapCount; ++k) {
+            size_t tap = size_t(i) * taps.tapCount + k;
+            taps.indices[tap] = uint32_t(std::min(std::max(first + int(k), 0), int(srcSize) - 1));
+            taps.weights[tap] = float(weights[k] / sum);
+        }
+    }
+    return taps;
+}
+
+struct Level
+{
+    uint32_t width;
+    uint32_t height;
+    size_t offset; // within a slice's chain
+};
+
+struct LevelJob
+{
+    uint32_t slice;
+    uint32_t firstRow;
+};
+
+// Everything the jobs of one level share.
+struct LevelContext
+{
+    bool srgb;
+    Level src;
+    Level dst;
+    Taps horizontal;
+    Taps vertical;
+    size_t chainSize;
+    uint8_t *chains;
+    // Source in float, or null to read the 8 bit level (the top one).
+    const std::vector<std::vector<float>> *srcFloats;
+    // Receives the level in float when a level below still needs it.
+    std::vector<std::vector<float>> *dstFloats;
+};
+
+void RunLevelJob(const LevelContext &level,
+                 const LevelJob &job,
+                 std::vector<float> &rowScratch,
+                 std::vector<float> &filteredRows)
+{
+    const auto &tables = GetColorTables();
+    uint32_t srcWidth = level.src.width;
+    uint32_t dstWidth = level.dst.width;
+    uint32_t lastRow = std::min(job.firstRow + kBandRows, level.dst.height);
+    uint32_t vTaps = level.vertical.tapCount;
+    uint32_t hTaps = level.horizontal.tapCount;
+
+    // Source rows this band reads.
+    auto rowsBegin = level.vertical.indices.begin() + size_t(job.firstRow) * vTaps;
+    auto rowsEnd = level.vertical.indices.begin() + size_t(lastRow) * vTaps;
+    uint32_t firstSrcRow = *std::min_element(rowsBegin, rowsEnd);
+    uint32_t lastSrcRow = *std::max_element(rowsBegin, rowsEnd);
+
+    // Horizontal pass.
+    filteredRows.resize(size_t(lastSrcRow - firstSrcRow + 1) * dstWidth * 4);
+    rowScratch.resize(size_t(srcWidth) * 4);
+    const uint8_t *srcChain = level.chains + job.slice * level.chainSize + level.src.offset;
+    for (uint32_t y = firstSrcRow; y <= lastSrcRow; ++y) {
+        const float *row = nullptr;
+        if (level.srcFloats != nullptr) {
+            row = (*level.srcFloats)[job.slice].data() + size_t(y) * srcWidth * 4;
+        } else {
+            const uint8_t *src = srcChain + size_t(y) * srcWidth * 4;
+            const float *colorTable = level.srgb ? tables.srgbToLinear : tables.unormToFloat;
+            for (size_t i = 0; i < size_t(srcWidth) * 4; i += 4) {
+                rowScratch[i + 0] = colorTable[src[i + 0]];
+                rowScratch[i + 1] = colorTable[src[i + 1]];
+                rowScratch[i + 2] = colorTable[src[i + 2]];
+                rowScratch[i + 3] = tables.unormToFloat[src[i + 3]];
+            }
+            row = rowScratch.data();
+        }
+
+        float *filtered = filteredRows.data() + size_t(y - firstSrcRow) * dstWidth * 4;
+        for (uint32_t x = 0; x < dstWidth; ++x) {
+            const uint32_t *indices = level.horizontal.indices.data() + size_t(x) * hTaps;
+            const float *weights = level.horizontal.weights.data() + size_t(x) * hTaps;
+            auto sum = Pixel::Set(0.0f);
+            for (uint32_t k = 0; k < hTaps; ++k) {
+                sum = sum + Pixel::Set(weights[k]) * Pixel::Load(row + size_t(indices[k]) * 4);
+            }
+            sum.Store(filtered + size_t(x) * 4);
+        }
+    }
+
+    // Vertical pass and output.
+    uint8_t *dstChain = level.chains + job.slice * level.chainSize + level.dst.offset;
+    float *dstFloats = level.dstFloats != nullptr ? (*level.dstFloats)[job.slice].data() : nullptr;
+    alignas(16) float pixel[4];
+    for (uint32_t y = job.firstRow; y < lastRow; ++y) {
+        const uint32_t *indices = level.vertical.indices.data() + size_t(y) * vTaps;
+        const float *weights = level.vertical.weights.data() + size_t(y) * vTaps;
+        uint8_t *dst = dstChain + size_t(y) * dstWidth * 4;
+
+        for (uint32_t x = 0; x < dstWidth; ++x) {
+            auto sum = Pixel::Set(0.0f);
+            for (uint32_t k = 0; k < vTaps; ++k) {
+                const float *filtered = filteredRows.data()
+                                        + (size_t(indices[k] - firstSrcRow) * dstWidth + x) * 4;
+                sum = sum + Pixel::Set(weights[k]) * Pixel::Load(filtered);
+            }
+            sum.Store(pixel);
+
+            if (dstFloats != nullptr) {
+                memcpy(dstFloats + (size_t(y) * dstWidth + x) * 4, pixel, sizeof(pixel));
+            }
+            for (int c = 0; c < 3; ++c) {
+                dst[4 * x + c] = level.srgb ? LinearToSrgb(tables, pixel[c]) : FloatToUnorm(pixel[c]);
+            }
+            dst[4 * x + 3] = FloatToUnorm(pixel[3]);
+        }
+    }
+}
+} // namespace
+
+uint32_t MipGenerator::GetFullMipCount(uint32_t width, uint32_t height)
+{
+    uint32_t count = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+        ++count;
+    }
+    return count;
+}
+
+size_t MipGenerator::GetChainSize(uint32_t width, uint32_t height, uint32_t mipCount)
+{
+    size_t size = 0;
+    for (uint32_t mip = 0; mip < mipCount; ++mip) {
+        size += size_t(width) * height * 4;
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+    return size;
+}
+
+void MipGenerator::Generate(Filter filter,
+                            bool srgb,
+                            const uint8_t *src,
+                            uint32_t width,
+                            uint32_t height,
+                            uint32_t sliceCount,
+                            uint32_t mipCount,
+                            uint8_t *dst,
+                            unsigned threadCount)
+{
+    mipCount = std::max(std::min(mipCount, GetFullMipCount(width, height)), 1u);
+
+    std::vector<Level> levels;
+    size_t chainSize = 0;
+    for (uint32_t mip = 0; mip < mipCount; ++mip) {
+        levels.push_back({width, height, chainSize});
+        chainSize += size_t(width) * height * 4;
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    size_t topSize = size_t(levels[0].width) * levels[0].height * 4;
+    for (uint32_t slice = 0; slice < sliceCount; ++slice) {
+        memcpy(dst + slice * chainSize, src + slice * topSize, topSize);
+    }
+
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Levels depend on the one above, so they run in order; within a level every slice and band
+    // of rows is an independent job.
+    std::vector<std::vector<float>> srcFloats(sliceCount);
+    std::vector<std::vector<float>> dstFloats(sliceCount);
+    for (uint32_t mip = 1; mip < mipCount; ++mip) {
+        LevelContext level;
+        level.srgb = srgb;
+        level.src = levels[mip - 1];
+        level.dst = levels[mip];
+        level.horizontal = ComputeTaps(filter, level.src.width, level.dst.width);
+        level.vertical = ComputeTaps(filter, level.src.height, level.dst.height);
+        level.chainSize = chainSize;
+        level.chains = dst;
+        level.srcFloats = mip > 1 ? &srcFloats : nullptr;
+        level.dstFloats = mip + 1 < mipCount ? &dstFloats : nullptr;
+        if (level.dstFloats != nullptr) {
+            for (auto &floats : dstFloats) {
+                floats.resize(size_t(level.dst.width) * level.dst.height * 4);
+            }
+        }
+
+        std::vector<LevelJob> jobs;
+        for (uint32_t slice = 0; slice < sliceCount; ++slice) {
+            for (uint32_t row = 0; row < level.dst.height; row += kBandRows) {
+                jobs.push_back({slice, row});
+            }
+        }
+
+        std::atomic<size_t> nextJob(0);
+        auto work = [&]() {
+            std::vector<float> rowScratch;
+            std::vector<float> filteredRows;
+            for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+                RunLevelJob(level, jobs[i], rowScratch, filteredRows);
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < std::min<size_t>(threadCount, jobs.size()); ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        srcFloats.swap(dstFloats);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Builds mip chains on the CPU for textures stored without them.  Pixels are 4 channel 8 bit in
+// any channel order with alpha last (RGBA, BGRA, BGRX).  Every level is filtered from the level
+// above it, kept in float so rounding does not pile up down the chain.  Work is split over
+// threads by array slice and by rows, and each pixel is computed the same way whatever the split,
+// so the output does not depend on the thread count.  Portable so the offline tools share it.
+namespace MipGenerator
+{
+enum class Filter
+{
+    // Averages the source pixels each output pixel covers.
+    Box,
+    // Kaiser windowed sinc over three output pixels each side; sharper than Box, at the price
+    // of slight ringing.
+    Kaiser,
+};
+
+// Mips down to 1x1.
+uint32_t GetFullMipCount(uint32_t width, uint32_t height);
+
+// Bytes of levels [0, mipCount) of one slice, tightly packed.
+size_t GetChainSize(uint32_t width, uint32_t height, uint32_t mipCount);
+
+// src holds sliceCount top levels of width x height pixels one after another, tightly packed;
+// cube maps are six slices.  dst receives sliceCount chains of mipCount levels in DDS order
+// (every level of slice 0, then slice 1, ...), level 0 copied from src.  With srgb the color
+// channels are decoded to linear before filtering and encoded again after; alpha is always
+// linear.  threadCount 0 uses every core.
+void Generate(Filter filter,
+              bool srgb,
+              const uint8_t *src,
+              uint32_t width,
+              uint32_t height,
+              uint32_t sliceCount,
+              uint32_t mipCount,
+              uint8_t *dst,
+              unsigned threadCount = 0);
+} // namespace MipGenerator
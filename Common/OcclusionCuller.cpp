@@ -0,0 +1,361 @@
+#include "OcclusionCuller.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OCCLUSION_CULLER_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_CULLER_SSE2 1
+#endif
+
+using namespace OcclusionCuller;
+
+namespace
+{
+const int kTilesX = kWidth / kTileWidth;
+// Triangles each task sets up and bins.
+const size_t kBinTriangleCount = 1024;
+
+// A vector of floats in the widest registers compiled in, as in FrustumCuller.  Masks come from
+// the comparisons and are only consumed by And, Select and MoveMask.
+#if OCCLUSION_CULLER_AVX2
+struct Floats
+{
+    static const int kWidth = 8;
+    __m256 v;
+
+    static Floats Load(const float *p) { return {_mm256_loadu_ps(p)}; }
+    static Floats Set(float x) { return {_mm256_set1_ps(x)}; }
+    static Floats Zero() { return {_mm256_setzero_ps()}; }
+    void Store(float *p) const { _mm256_storeu_ps(p, v); }
+
+    friend Floats operator+(Floats a, Floats b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend Floats operator*(Floats a, Floats b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend Floats Min(Floats a, Floats b) { return {_mm256_min_ps(a.v, b.v)}; }
+    friend Floats GreaterEqual(Floats a, Floats b)
+    {
+        return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)};
+    }
+    friend Floats And(Floats a, Floats b) { return {_mm256_and_ps(a.v, b.v)}; }
+    friend Floats Select(Floats mask, Floats a, Floats b)
+    {
+        return {_mm256_blendv_ps(b.v, a.v, mask.v)};
+    }
+    friend int MoveMask(Floats mask) { return _mm256_movemask_ps(mask.v); }
+};
+#elif OCCLUSION_CULLER_SSE2
+struct Floats
+{
+    static const int kWidth = 4;
+    __m128 v;
+
+    static Floats Load(const float *p) { return {_mm_loadu_ps(p)}; }
+    static Floats Set(float x) { return {_mm_set1_ps(x)}; }
+    static Floats Zero() { return {_mm_setzero_ps()}; }
+    void Store(float *p) const { _mm_storeu_ps(p, v); }
+
+    friend Floats operator+(Floats a, Floats b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend Floats operator*(Floats a, Floats b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend Floats Min(Floats a, Floats b) { return {_mm_min_ps(a.v, b.v)}; }
+    friend Floats GreaterEqual(Floats a, Floats b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+    friend Floats And(Floats a, Floats b) { return {_mm_and_ps(a.v, b.v)}; }
+    friend Floats Select(Floats mask, Floats a, Floats b)
+    {
+        return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+    }
+    friend int MoveMask(Floats mask) { return _mm_movemask_ps(mask.v); }
+};
+#else
+struct Floats
+{
+    static const int kWidth = 1;
+    float v;
+
+    static Floats Load(const float *p) { return {*p}; }
+    static Floats Set(float x) { return {x}; }
+    static Floats Zero() { return {0.0f}; }
+    void Store(float *p) const { *p = v; }
+
+    friend Floats operator+(Floats a, Floats b) { return {a.v + b.v}; }
+    friend Floats operator*(Floats a, Floats b) { return {a.v * b.v}; }
+    friend Floats Min(Floats a, Floats b) { return {std::min(a.v, b.v)}; }
+    friend Floats GreaterEqual(Floats a, Floats b) { return {a.v >= b.v ? 1.0f : 0.0f}; }
+    friend Floats And(Floats a, Floats b) { return {a.v != 0.0f && b.v != 0.0f ? 1.0f : 0.0f}; }
+    friend Floats Select(Floats mask, Floats a, Floats b) { return mask.v != 0.0f ? a : b; }
+    friend int MoveMask(Floats mask) { return mask.v != 0.0f ? 1 : 0; }
+};
+#endif
+
+// Offsets of the lanes' pixel centers from the first lane's pixel.
+const float kLaneCenters[8] = {0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f};
+
+struct ClipVertex
+{
+    float x, y, z, w;
+};
+
+ClipVertex Transform(const float m[16], const float *p)
+{
+    return {p[0] * m[0] + p[1] * m[4] + p[2] * m[8] + m[12],
+            p[0] * m[1] + p[1] * m[5] + p[2] * m[9] + m[13],
+            p[0] * m[2] + p[1] * m[6] + p[2] * m[10] + m[14],
+            p[0] * m[3] + p[1] * m[7] + p[2] * m[11] + m[15]};
+}
+
+// Pixel coordinates, y down, of a vertex in front of the near plane.
+float ScreenX(const ClipVertex &v)
+{
+    return (0.5f + 0.5f * v.x / v.w) * kWidth;
+}
+
+float ScreenY(const ClipVertex &v)
+{
+    return (0.5f - 0.5f * v.y / v.w) * kHeight;
+}
+
+int PixelBound(float x, int size)
+{
+    return int(std::min(std::max(x, 0.0f), float(size)));
+}
+
+// The part of the triangle in front of the near plane, z >= 0, as a polygon of up to four
+// vertices.  Returns the number of vertices.
+int ClipNear(const ClipVertex in[3], ClipVertex out[4])
+{
+    int count = 0;
+    for (int i = 0; i < 3; ++i) {
+        const auto &a = in[i];
+        const auto &b = in[(i + 1) % 3];
+        bool aInside = a.z >= 0.0f;
+        bool bInside = b.z >= 0.0f;
+        if (aInside) {
+            out[count++] = a;
+        }
+        if (aInside != bInside) {
+            float t = a.z / (a.z - b.z);
+            out[count++]
+                = {a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), 0.0f, a.w + t * (b.w - a.w)};
+        }
+    }
+    return count;
+}
+
+// Sets up a triangle with its vertices in front of the near plane, unless it faces away or
+// covers no pixel.
+void AddTriangle(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c, Bin &bin)
+{
+    float x[3] = {ScreenX(a), ScreenX(b), ScreenX(c)};
+    float y[3] = {ScreenY(a), ScreenY(b), ScreenY(c)};
+    float z[3] = {a.z / a.w, b.z / b.w, c.z / c.w};
+
+    // Positive for triangles turning clockwise on screen, as y grows downwards.
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (!(area > 0.0f))
+        return;
+
+    Triangle triangle;
+    triangle.minX = PixelBound(std::floor(std::min({x[0], x[1], x[2]})), kWidth);
+    triangle.maxX = PixelBound(std::ceil(std::max({x[0], x[1], x[2]})), kWidth);
+    triangle.minY = PixelBound(std::floor(std::min({y[0], y[1], y[2]})), kHeight);
+    triangle.maxY = PixelBound(std::ceil(std::max({y[0], y[1], y[2]})), kHeight);
+    if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY)
+        return;
+
+    // Each edge's function is positive on the side of the opposite vertex.
+    for (int i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        triangle.edgeA[i] = y[i] - y[j];
+        triangle.edgeB[i] = x[j] - x[i];
+        triangle.edgeC[i] = (y[j] - y[i]) * x[i] - (x[j] - x[i]) * y[i];
+    }
+    float dzdx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+    float dzdy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+    triangle.depthA = dzdx;
+    triangle.depthB = dzdy;
+    triangle.depthC = z[0] - dzdx * x[0] - dzdy * y[0];
+    bin.triangles.push_back(triangle);
+}
+
+template <typename Function>
+void ForEachTile(const Triangle &triangle, Function function)
+{
+    for (int ty = triangle.minY / kTileHeight; ty <= (triangle.maxY - 1) / kTileHeight; ++ty) {
+        for (int tx = triangle.minX / kTileWidth; tx <= (triangle.maxX - 1) / kTileWidth; ++tx) {
+            function(ty * kTilesX + tx);
+        }
+    }
+}
+
+void SetUp(const Mesh &mesh, size_t begin, size_t end, const float viewProj[16], Bin &bin)
+{
+    bin.triangles.clear();
+    for (size_t t = begin; t < end; ++t) {
+        ClipVertex vertices[3];
+        for (int i = 0; i < 3; ++i) {
+            vertices[i] = Transform(viewProj, &mesh.positions[3 * mesh.indices[3 * t + i]]);
+        }
+        ClipVertex polygon[4];
+        int count = ClipNear(vertices, polygon);
+        for (int i = 1; i + 1 < count; ++i) {
+            AddTriangle(polygon[0], polygon[i], polygon[i + 1], bin);
+        }
+    }
+
+    // Counted, then filled.
+    bin.tileStarts.assign(kTileCount + 1, 0);
+    for (const auto &triangle : bin.triangles) {
+        ForEachTile(triangle, [&](int tile) { ++bin.tileStarts[tile + 1]; });
+    }
+    std::partial_sum(bin.tileStarts.begin(), bin.tileStarts.end(), bin.tileStarts.begin());
+    bin.tileTriangles.resize(bin.tileStarts.back());
+    uint32_t next[kTileCount];
+    std::copy(bin.tileStarts.begin(), bin.tileStarts.end() - 1, next);
+    for (uint32_t i = 0; i < uint32_t(bin.triangles.size()); ++i) {
+        ForEachTile(bin.triangles[i], [&](int tile) { bin.tileTriangles[next[tile]++] = i; });
+    }
+}
+
+// Clears the tile and draws every bin's triangles overlapping it.  Rows are walked from the first
+// lane-aligned pixel, so vectors never leave the tile and tiles can be drawn at the same time.
+void RasterizeTile(DepthBuffer &buffer, int tile)
+{
+    int tileX = (tile % kTilesX) * kTileWidth;
+    int tileY = (tile / kTilesX) * kTileHeight;
+    for (int y = tileY; y < tileY + kTileHeight; ++y) {
+        std::fill_n(&buffer.depth[y * kWidth + tileX], kTileWidth, 1.0f);
+    }
+
+    auto laneCenters = Floats::Load(kLaneCenters);
+    auto zero = Floats::Zero();
+    for (const auto &bin : buffer.bins) {
+        for (uint32_t k = bin.tileStarts[tile]; k < bin.tileStarts[tile + 1]; ++k) {
+            const auto &triangle = bin.triangles[bin.tileTriangles[k]];
+            int x0 = std::max(triangle.minX, tileX);
+            int x1 = std::min(triangle.maxX, tileX + kTileWidth);
+            int y0 = std::max(triangle.minY, tileY);
+            int y1 = std::min(triangle.maxY, tileY + kTileHeight);
+            x0 = tileX + (x0 - tileX) / Floats::kWidth * Floats::kWidth;
+
+            Floats edgeA[3];
+            for (int i = 0; i < 3; ++i) {
+                edgeA[i] = Floats::Set(triangle.edgeA[i]);
+            }
+            auto depthA = Floats::Set(triangle.depthA);
+            for (int y = y0; y < y1; ++y) {
+                float py = y + 0.5f;
+                Floats edgeRow[3];
+                for (int i = 0; i < 3; ++i) {
+                    edgeRow[i] = Floats::Set(triangle.edgeB[i] * py + triangle.edgeC[i]);
+                }
+                auto depthRow = Floats::Set(triangle.depthB * py + triangle.depthC);
+                float *row = &buffer.depth[y * kWidth];
+                for (int x = x0; x < x1; x += Floats::kWidth) {
+                    auto px = Floats::Set(float(x)) + laneCenters;
+                    auto inside = And(And(GreaterEqual(edgeA[0] * px + edgeRow[0], zero),
+                                          GreaterEqual(edgeA[1] * px + edgeRow[1], zero)),
+                                      GreaterEqual(edgeA[2] * px + edgeRow[2], zero));
+                    if (MoveMask(inside) == 0)
+                        continue;
+                    auto current = Floats::Load(row + x);
+                    auto depth = depthA * px + depthRow;
+                    Select(inside, Min(current, depth), current).Store(row + x);
+                }
+            }
+        }
+    }
+}
+
+template <typename Task>
+void RunTasks(WorkerPool *pool, size_t taskCount, Task task)
+{
+    if (pool != nullptr) {
+        pool->Run(taskCount, task);
+        return;
+    }
+    for (size_t i = 0; i < taskCount; ++i) {
+        task(i);
+    }
+}
+} // namespace
+
+void OcclusionCuller::Render(DepthBuffer &buffer,
+                             const float viewProj[16],
+                             const Mesh *meshes,
+                             size_t meshCount,
+                             WorkerPool *pool)
+{
+    struct Run
+    {
+        size_t mesh, begin, end;
+    };
+    std::vector<Run> runs;
+    for (size_t m = 0; m < meshCount; ++m) {
+        size_t triangleCount = meshes[m].indices.size() / 3;
+        for (size_t begin = 0; begin < triangleCount; begin += kBinTriangleCount) {
+            runs.push_back({m, begin, std::min(begin + kBinTriangleCount, triangleCount)});
+        }
+    }
+
+    buffer.depth.resize(kWidth * kHeight);
+    buffer.bins.resize(runs.size());
+    RunTasks(pool, runs.size(), [&](size_t i) {
+        SetUp(meshes[runs[i].mesh], runs[i].begin, runs[i].end, viewProj, buffer.bins[i]);
+    });
+    RunTasks(pool, kTileCount, [&](size_t tile) { RasterizeTile(buffer, int(tile)); });
+}
+
+bool OcclusionCuller::IsVisible(const DepthBuffer &buffer,
+                                const float viewProj[16],
+                                const FrustumCuller::Box &box)
+{
+    if (buffer.depth.empty())
+        return true;
+
+    float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+    float nearest = INFINITY;
+    for (int corner = 0; corner < 8; ++corner) {
+        float p[3];
+        for (int c = 0; c < 3; ++c) {
+            p[c] = box.center[c] + ((corner >> c) & 1 ? box.extents[c] : -box.extents[c]);
+        }
+        auto v = Transform(viewProj, p);
+        if (v.z < 0.0f)
+            return true;
+        float x = ScreenX(v), y = ScreenY(v);
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, v.z / v.w);
+    }
+
+    // Off screen boxes are left to the frustum.
+    int x0 = PixelBound(std::floor(minX), kWidth), x1 = PixelBound(std::ceil(maxX), kWidth);
+    int y0 = PixelBound(std::floor(minY), kHeight), y1 = PixelBound(std::ceil(maxY), kHeight);
+    if (x0 >= x1 || y0 >= y1)
+        return true;
+    for (int y = y0; y < y1; ++y) {
+        const float *row = &buffer.depth[y * kWidth];
+        for (int x = x0; x < x1; ++x) {
+            if (row[x] >= nearest)
+                return true;
+        }
+    }
+    return false;
+}
+
+const char *OcclusionCuller::GetInstructionSet()
+{
+#if OCCLUSION_CULLER_AVX2
+    return "AVX2";
+#elif OCCLUSION_CULLER_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
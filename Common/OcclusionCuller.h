@@ -0,0 +1,76 @@
+#pragma once
+
+#include "FrustumCuller.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+// Occlusion culling against a small depth buffer the CPU draws from a few large occluders, such
+// as terrain and walls.  Triangles are set up in chunks and binned into tiles, then every tile is
+// rasterized on its own, a row of eight pixels at a time with AVX2 (/arch:AVX2, -mavx2), four with
+// SSE2 on any other x86 build and one elsewhere; both passes are shared across a WorkerPool.  The
+// buffer keeps each pixel's nearest depth, so it does not depend on the order triangles are drawn
+// in or on the number of threads.  Portable so the tools can measure it.
+namespace OcclusionCuller
+{
+const int kWidth = 256;
+const int kHeight = 128;
+const int kTileWidth = 32;
+const int kTileHeight = 16;
+const int kTileCount = (kWidth / kTileWidth) * (kHeight / kTileHeight);
+
+// Triangles of an occluder in world space.  Front faces turn clockwise on screen, as Direct3D's
+// do by default, and back faces are skipped as the GPU skips them.
+struct Mesh
+{
+    // x, y and z of each vertex.
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+};
+
+// A triangle set up for the rasterizer over pixel centers: it covers the pixels where its three
+// edge functions a x + b y + c are not negative, and its depth there is the depth plane's.
+struct Triangle
+{
+    float edgeA[3], edgeB[3], edgeC[3];
+    float depthA, depthB, depthC;
+    // The pixels its bounds cover, ends excluded.
+    int minX, minY, maxX, maxY;
+};
+
+// Triangles set up from a run of a mesh's, and the ones overlapping each tile.
+struct Bin
+{
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> tileStarts;
+    std::vector<uint32_t> tileTriangles;
+};
+
+struct DepthBuffer
+{
+    // Nearest occluder depth of each pixel, rows from the top; 1 where there is none.
+    std::vector<float> depth;
+    // Scratch kept between frames.
+    std::vector<Bin> bins;
+};
+
+// Draws the meshes as seen through viewProj, z in [0, 1], into a cleared buffer.  Matrices are
+// row-major and transform row vectors, as DirectXMath's do.  Triangles are clipped to the near
+// plane.  pool may be null to draw on the calling thread alone.
+void Render(DepthBuffer &buffer,
+            const float viewProj[16],
+            const Mesh *meshes,
+            size_t meshCount,
+            WorkerPool *pool);
+
+// False if the occluders hide all of box, a world space bounding box: every pixel its screen
+// bounds touch holds an occluder nearer than its nearest point.  Boxes crossing the near plane
+// are visible.  Safe to call from several threads at once.
+bool IsVisible(const DepthBuffer &buffer, const float viewProj[16], const FrustumCuller::Box &box);
+
+// Name of the instruction set the rasterizer was compiled for.
+const char *GetInstructionSet();
+} // namespace OcclusionCuller
@@ -0,0 +1,108 @@
+#include "SceneStore.h"
+
+using namespace SceneStore;
+
+namespace
+{
+void MarkMoved(Store &store, uint32_t instance)
+{
+    // Each instance is listed once per generation, however often it moves.
+    if (store.movedGenerations[instance] != store.generation + 1) {
+        store.movedGenerations[instance] = store.generation + 1;
+        store.moved.push_back(instance);
+    }
+}
+} // namespace
+
+Handle SceneStore::Add(Store &store, const Instance &instance)
+{
+    uint32_t slot;
+    if (!store.freeSlots.empty()) {
+        slot = store.freeSlots.back();
+        store.freeSlots.pop_back();
+    } else {
+        slot = uint32_t(store.slotInstances.size());
+        store.slotInstances.push_back(kInvalid);
+        store.slotGenerations.push_back(0);
+    }
+
+    auto index = uint32_t(Size(store));
+    store.worlds.push_back(instance.world);
+    store.texTransforms.push_back(instance.texTransform);
+    store.materialIndices.push_back(instance.materialIndex);
+    store.meshes.push_back(instance.mesh);
+    store.flags.push_back(instance.flags);
+    store.bounds.Resize(index + 1);
+    store.movedGenerations.push_back(store.generation);
+    store.slots.push_back(slot);
+    store.slotInstances[slot] = index;
+    MarkMoved(store, index);
+    return {slot, store.slotGenerations[slot]};
+}
+
+bool SceneStore::Remove(Store &store, Handle handle)
+{
+    uint32_t index = Find(store, handle);
+    if (index == kInvalid)
+        return false;
+
+    // Neither the instance removed nor the last one keeps its place in the moved list.
+    auto last = uint32_t(Size(store) - 1);
+    for (size_t i = 0; i < store.moved.size();) {
+        if (store.moved[i] == index || store.moved[i] == last) {
+            store.moved[i] = store.moved.back();
+            store.moved.pop_back();
+        } else {
+            ++i;
+        }
+    }
+
+    if (index != last) {
+        store.worlds[index] = store.worlds[last];
+        store.texTransforms[index] = store.texTransforms[last];
+        store.materialIndices[index] = store.materialIndices[last];
+        store.meshes[index] = store.meshes[last];
+        store.flags[index] = store.flags[last];
+        store.bounds.Set(index, store.bounds.Get(last));
+        store.movedGenerations[index] = store.generation;
+        store.slots[index] = store.slots[last];
+        store.slotInstances[store.slots[index]] = index;
+        MarkMoved(store, index);
+    }
+    store.worlds.pop_back();
+    store.texTransforms.pop_back();
+    store.materialIndices.pop_back();
+    store.meshes.pop_back();
+    store.flags.pop_back();
+    store.bounds.Resize(last);
+    store.movedGenerations.pop_back();
+    store.slots.pop_back();
+
+    store.slotInstances[handle.slot] = kInvalid;
+    ++store.slotGenerations[handle.slot];
+    store.freeSlots.push_back(handle.slot);
+    return true;
+}
+
+uint32_t SceneStore::Find(const Store &store, Handle handle)
+{
+    if (handle.slot >= store.slotInstances.size()
+        || store.slotGenerations[handle.slot] != handle.generation)
+        return kInvalid;
+    return store.slotInstances[handle.slot];
+}
+
+void SceneStore::SetWorld(Store &store, uint32_t instance, const Matrix &world)
+{
+    store.worlds[instance] = world;
+    MarkMoved(store, instance);
+}
+
+uint32_t SceneStore::TakeMoved(Store &store, std::vector<uint32_t> &moved)
+{
+    moved.clear();
+    if (store.moved.empty())
+        return store.generation;
+    moved.swap(store.moved);
+    return ++store.generation;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "FrustumCuller.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The instances of a scene as arrays of each of their fields, so that the passes over all of
+// them each frame (bounds, culling, upload, sorting) read only the fields they need, one after
+// the other.  Instances are numbered densely; removing one moves the last into its place, so
+// that numbers change and handles, which look the instance up through a slot, are what to keep.
+// A handle whose instance was removed no longer finds anything, even once its slot is reused.
+// Portable so the tools can measure it.
+namespace SceneStore
+{
+const uint32_t kInvalid = UINT32_MAX;
+
+struct Handle
+{
+    uint32_t slot = kInvalid;
+    uint32_t generation = 0;
+};
+
+// Row-major, transforming row vectors, as an XMFLOAT4X4.
+struct Matrix
+{
+    float m[4][4];
+};
+
+struct Instance
+{
+    Matrix world;
+    Matrix texTransform;
+    uint32_t materialIndex = 0;
+    // What the caller draws it with, such as a render item.
+    uint32_t mesh = 0;
+    // Whatever the caller marks it with.
+    uint32_t flags = 0;
+};
+
+struct Store
+{
+    // One entry per instance.
+    std::vector<Matrix> worlds;
+    std::vector<Matrix> texTransforms;
+    std::vector<uint32_t> materialIndices;
+    std::vector<uint32_t> meshes;
+    std::vector<uint32_t> flags;
+    // World bounds, which the caller keeps up to date from the moved instances.
+    FrustumCuller::BoxArray bounds;
+
+    // The generation each instance last moved or was renumbered at, and the latest closed one;
+    // generation + 1 is open until TakeMoved.
+    std::vector<uint32_t> movedGenerations;
+    uint32_t generation = 0;
+    // Instances moved in the open generation.
+    std::vector<uint32_t> moved;
+
+    // The slot of each instance, and each slot's instance, or kInvalid, and generation.
+    std::vector<uint32_t> slots;
+    std::vector<uint32_t> slotInstances;
+    std::vector<uint32_t> slotGenerations;
+    std::vector<uint32_t> freeSlots;
+};
+
+inline size_t Size(const Store &store)
+{
+    return store.worlds.size();
+}
+
+// Adds an instance as the last one, with empty bounds, and marks it moved.
+Handle Add(Store &store, const Instance &instance);
+
+// Removes the handle's instance, moving the last one into its place and marking that moved.
+// Returns false if the handle finds nothing.
+bool Remove(Store &store, Handle handle);
+
+// The number of the handle's instance, or kInvalid.
+uint32_t Find(const Store &store, Handle handle);
+
+// Sets the world transform of an instance by number and marks it moved.
+void SetWorld(Store &store, uint32_t instance, const Matrix &world);
+
+// Closes the open generation and swaps the instances moved in it into moved, clearing the
+// store's list.  Returns the generation closed, the one they moved at.  With nothing moved the
+// generation stays open, moved comes back empty and the latest closed generation is returned, so
+// that whatever compares generations sees no change.
+uint32_t TakeMoved(Store &store, std::vector<uint32_t> &moved);
+
+// Calls write(i) for each instance whose slot, numbered as the instance, in a copy of the store
+// last brought up to date at generation holds something else: those moved or renumbered since,
+// or every one if the copy lost its contents.  Returns the generation the copy is then up to
+// date at.
+template <typename Write>
+uint32_t WriteStale(const Store &store, uint32_t generation, bool contentsLost, Write write)
+{
+    if (!contentsLost && generation == store.generation)
+        return generation;
+    for (uint32_t i = 0; i < (uint32_t) Size(store); ++i) {
+        if (contentsLost || int32_t(store.movedGenerations[i] - generation) > 0) {
+            write(i);
+        }
+    }
+    return store.generation;
+}
+} // namespace SceneStore
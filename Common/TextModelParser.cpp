@@ -0,0 +1,274 @@
+#include "TextModelParser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace TextModelParser;
+
+namespace
+{
+// Smaller sections are not worth a thread; car.txt parses on one.
+const size_t kMinChunkSize = 64 * 1024;
+
+static_assert(sizeof(Vertex) == 6 * sizeof(float), "vertices are parsed as a float array");
+
+// Read-only view of a whole file.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::filesystem::path &path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileW(path.c_str(),
+                                  GENERIC_READ,
+                                  FILE_SHARE_READ,
+                                  nullptr,
+                                  OPEN_EXISTING,
+                                  FILE_FLAG_SEQUENTIAL_SCAN,
+                                  nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER fileSize = {};
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                mData = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                mSize = mData != nullptr ? (size_t) fileSize.QuadPart : 0;
+                // The view keeps the mapping alive.
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return;
+
+        struct stat status = {};
+        if (fstat(file, &status) == 0 && status.st_size > 0) {
+            void *data = mmap(nullptr, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (data != MAP_FAILED) {
+                mData = static_cast<const char *>(data);
+                mSize = (size_t) status.st_size;
+                madvise(data, mSize, MADV_SEQUENTIAL);
+            }
+        }
+        close(file);
+#endif
+    }
+
+    MappedFile(const MappedFile &rhs) = delete;
+    MappedFile &operator=(const MappedFile &rhs) = delete;
+
+    ~MappedFile()
+    {
+        if (mData == nullptr)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(mData);
+#else
+        munmap(const_cast<char *>(mData), mSize);
+#endif
+    }
+
+    const char *Data() const { return mData; }
+    size_t Size() const { return mSize; }
+
+private:
+    const char *mData = nullptr;
+    size_t mSize = 0;
+};
+
+bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Position just past key, searching from p, or nullptr.
+const char *Skip(const char *p, const char *end, std::string_view key)
+{
+    if (p == nullptr)
+        return nullptr;
+    auto found = std::search(p, end, key.begin(), key.end());
+    return found == end ? nullptr : found + key.size();
+}
+
+const char *SkipSpace(const char *p, const char *end)
+{
+    while (p < end && IsSpace(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+// Reads the count following key, e.g. "VertexCount: 31076".
+const char *ReadCount(const char *p, const char *end, std::string_view key, uint32_t &count)
+{
+    p = Skip(p, end, key);
+    if (p == nullptr)
+        return nullptr;
+    p = SkipSpace(p, end);
+    auto result = std::from_chars(p, end, count);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+// The text between the braces following key.
+bool FindSection(const char *&p, const char *end, std::string_view key, const char *&sectionBegin)
+{
+    sectionBegin = Skip(Skip(p, end, key), end, "{");
+    if (sectionBegin == nullptr)
+        return false;
+    p = std::find(sectionBegin, end, '}');
+    return p != end;
+}
+
+// A run of whole lines of one section.  Each job collects its numbers on its own; they are
+// concatenated once every job is done, so chunks need not know where their lines start.
+struct Job
+{
+    const char *begin;
+    const char *end;
+    bool indices;
+
+    std::vector<float> floats;
+    std::vector<uint32_t> uints;
+    bool valid = true;
+};
+
+template <typename T>
+bool ReadNumbers(const char *p, const char *end, std::vector<T> &values)
+{
+    // Numbers in these files take at least 8 characters with their separator on average.
+    values.reserve((end - p) / 8);
+    for (p = SkipSpace(p, end); p < end; p = SkipSpace(p, end)) {
+        T value;
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc())
+            return false;
+        values.push_back(value);
+        p = result.ptr;
+    }
+    return true;
+}
+
+void AddJobs(
+    const char *begin, const char *end, bool indices, size_t chunkSize, std::vector<Job> &jobs)
+{
+    while (begin < end) {
+        const char *chunkEnd = end;
+        if (size_t(end - begin) > chunkSize) {
+            chunkEnd = std::find(begin + chunkSize, end, '\n');
+        }
+        jobs.push_back({begin, chunkEnd, indices, {}, {}});
+        begin = chunkEnd;
+    }
+}
+
+template <typename T>
+bool Gather(
+    const std::vector<Job> &jobs, bool indices, std::vector<T> Job::*values, T *dst, size_t count)
+{
+    size_t offset = 0;
+    for (const auto &job : jobs) {
+        if (job.indices != indices)
+            continue;
+        const auto &chunk = job.*values;
+        if (chunk.size() > count - offset)
+            return false;
+        std::copy(chunk.begin(), chunk.end(), dst + offset);
+        offset += chunk.size();
+    }
+    return offset == count;
+}
+} // namespace
+
+bool TextModelParser::Parse(const char *text, size_t size, Model &model, unsigned threadCount)
+{
+    const char *end = text + size;
+
+    uint32_t vertexCount = 0;
+    uint32_t triangleCount = 0;
+    const char *p = ReadCount(text, end, "VertexCount:", vertexCount);
+    p = ReadCount(p, end, "TriangleCount:", triangleCount);
+
+    const char *vertexBegin = nullptr;
+    const char *triangleBegin = nullptr;
+    if (p == nullptr || !FindSection(p, end, "VertexList", vertexBegin))
+        return false;
+    const char *vertexEnd = p;
+    if (!FindSection(p, end, "TriangleList", triangleBegin))
+        return false;
+    const char *triangleEnd = p;
+
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    size_t textSize = size_t(vertexEnd - vertexBegin) + size_t(triangleEnd - triangleBegin);
+    size_t chunkSize = std::max(textSize / threadCount, kMinChunkSize);
+
+    std::vector<Job> jobs;
+    AddJobs(vertexBegin, vertexEnd, false, chunkSize, jobs);
+    AddJobs(triangleBegin, triangleEnd, true, chunkSize, jobs);
+
+    std::atomic<size_t> nextJob(0);
+    auto work = [&]() {
+        for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+            auto &job = jobs[i];
+            job.valid = job.indices ? ReadNumbers(job.begin, job.end, job.uints)
+                                    : ReadNumbers(job.begin, job.end, job.floats);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min<size_t>(threadCount, jobs.size()); ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    for (const auto &job : jobs) {
+        if (!job.valid)
+            return false;
+    }
+
+    model.vertices.resize(vertexCount);
+    model.indices.resize(size_t(triangleCount) * 3);
+    auto vertexFloats = reinterpret_cast<float *>(model.vertices.data());
+    if (!Gather(jobs, false, &Job::floats, vertexFloats, model.vertices.size() * 6)
+        || !Gather(jobs, true, &Job::uints, model.indices.data(), model.indices.size())) {
+        return false;
+    }
+
+    return std::all_of(model.indices.begin(), model.indices.end(), [&](uint32_t index) {
+        return index < vertexCount;
+    });
+}
+
+bool TextModelParser::ParseFile(const std::filesystem::path &path,
+                                Model &model,
+                                unsigned threadCount)
+{
+    MappedFile file(path);
+    if (file.Data() == nullptr)
+        return false;
+    return Parse(file.Data(), file.Size(), model, threadCount);
+}
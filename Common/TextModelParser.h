@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Parses the text models the book's exporter writes (Assets/Models/*.txt):
+//
+//   VertexCount: n
+//   TriangleCount: m
+//   VertexList (pos, normal)
+//   {
+//       px py pz nx ny nz       n lines
+//   }
+//   TriangleList
+//   {
+//       i0 i1 i2                m lines
+//   }
+//
+// The file is mapped rather than streamed and numbers are read with std::from_chars, so no
+// locale or stream state is involved.  Long sections are split at line breaks into chunks that
+// parse on several threads.  Portable so the offline tools share it.
+namespace TextModelParser
+{
+struct Vertex
+{
+    float pos[3];
+    float normal[3];
+};
+
+struct Model
+{
+    std::vector<Vertex> vertices;
+    // Three per triangle.
+    std::vector<uint32_t> indices;
+};
+
+// Returns false if the text does not follow the format, holds a different number of vertices or
+// triangles than it announces, or indexes a vertex it does not have.  threadCount 0 uses every
+// core.
+bool Parse(const char *text, size_t size, Model &model, unsigned threadCount = 0);
+
+// Maps the file and parses it.  Returns false if the file cannot be read or Parse fails.
+bool ParseFile(const std::filesystem::path &path, Model &model, unsigned threadCount = 0);
+} // namespace TextModelParser
@@ -0,0 +1,292 @@
+#include "TextureArchive.h"
+#include "Lz4.h"
+
+#include <atomic>
+#include <thread>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+template <typename T>
+bool ReadArray(std::ifstream &file, std::vector<T> &values, size_t count)
+{
+    values.resize(count);
+    return count == 0 || file.read(reinterpret_cast<char *>(values.data()), count * sizeof(T));
+}
+} // namespace
+
+HRESULT TextureArchive::Open(const std::wstring &filename)
+{
+    std::lock_guard<std::mutex> lock(mFileMutex);
+
+    mFile.open(filename, std::ios::binary);
+    if (!mFile)
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+    if (!mFile.read(reinterpret_cast<char *>(&mHeader), sizeof(mHeader)))
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+
+    if (mHeader.magic != kTextureArchiveMagic || mHeader.version != kTextureArchiveVersion)
+        return E_FAIL;
+
+    if (!ReadArray(mFile, mEntries, mHeader.entryCount)
+        || !ReadArray(mFile, mSubresources, mHeader.subresourceCount)
+        || !ReadArray(mFile, mChunks, mHeader.chunkCount)
+        || !ReadArray(mFile, mArraySlices, mHeader.arraySliceCount)) {
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    // Check the index once so loads can trust it.
+    for (const auto &entry : mEntries) {
+        uint64_t subresourceCount = uint64_t(entry.mipCount) * entry.arraySize;
+        if (subresourceCount == 0
+            || entry.firstSubresource + subresourceCount > mSubresources.size()
+            || uint64_t(entry.firstChunk) + entry.chunkCount > mChunks.size()) {
+            return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+        }
+
+        for (uint64_t i = 0; i < subresourceCount; ++i) {
+            const auto &subresource = mSubresources[entry.firstSubresource + i];
+            uint64_t size = uint64_t(subresource.rowPitch) * subresource.rowCount * subresource.depth;
+            if (subresource.rowSize > subresource.rowPitch
+                || subresource.offset + size > entry.payloadSize) {
+                return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+            }
+        }
+    }
+
+    for (const auto &arraySlice : mArraySlices) {
+        auto arrayName = TextureArchiveArrayName(arraySlice.arrayIndex);
+        auto entry = Find(std::wstring(arrayName.begin(), arrayName.end()));
+        if (entry == nullptr || arraySlice.slice >= entry->arraySize)
+            return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+    }
+
+    return S_OK;
+}
+
+bool TextureArchive::Contains(const std::wstring &textureFilename) const
+{
+    return Find(textureFilename) != nullptr;
+}
+
+bool TextureArchive::FindArraySlice(const std::wstring &textureFilename,
+                                    std::string &arrayName,
+                                    uint32_t &slice) const
+{
+    uint64_t hash = HashTextureArchivePath(textureFilename.c_str(), textureFilename.size());
+    auto it = std::lower_bound(mArraySlices.begin(),
+                               mArraySlices.end(),
+                               hash,
+                               [](const TextureArchiveArraySlice &arraySlice, uint64_t hash) {
+                                   return arraySlice.nameHash < hash;
+                               });
+    if (it == mArraySlices.end() || it->nameHash != hash)
+        return false;
+
+    arrayName = TextureArchiveArrayName(it->arrayIndex);
+    slice = it->slice;
+    return true;
+}
+
+HRESULT TextureArchive::LoadTextureData(const std::wstring &textureFilename,
+                                        DirectX::DDSTextureData12 &textureData) const
+{
+    textureData = DirectX::DDSTextureData12();
+
+    auto entry = Find(textureFilename);
+    if (entry == nullptr)
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+
+    textureData.ddsData.reset(new (std::nothrow) uint8_t[entry->payloadSize]);
+    if (!textureData.ddsData)
+        return E_OUTOFMEMORY;
+
+    HRESULT hr = ReadPayload(*entry, textureData.ddsData.get());
+    if (FAILED(hr))
+        return hr;
+
+    textureData.resDim = entry->depth > 1 ? D3D12_RESOURCE_DIMENSION_TEXTURE3D
+                                          : D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    textureData.width = entry->width;
+    textureData.height = entry->height;
+    textureData.depth = entry->depth;
+    textureData.mipCount = entry->mipCount;
+    textureData.arraySize = entry->arraySize;
+    textureData.format = (DXGI_FORMAT) entry->format;
+    textureData.isCubeMap = (entry->flags & kTextureArchiveCubeMap) != 0;
+
+    textureData.initData.resize(entry->mipCount * entry->arraySize);
+    for (size_t i = 0; i < textureData.initData.size(); ++i) {
+        const auto &subresource = mSubresources[entry->firstSubresource + i];
+        auto &initData = textureData.initData[i];
+        initData.pData = textureData.ddsData.get() + subresource.offset;
+        initData.RowPitch = subresource.rowPitch;
+        initData.SlicePitch = LONG_PTR(subresource.rowPitch) * subresource.rowCount;
+    }
+
+    return S_OK;
+}
+
+HRESULT TextureArchive::CreateTexture(ID3D12Device *device,
+                                      ID3D12GraphicsCommandList *cmdList,
+                                      const std::wstring &textureFilename,
+                                      ComPtr<ID3D12Resource> &texture,
+                                      ComPtr<ID3D12Resource> &textureUploadHeap) const
+{
+    auto entry = Find(textureFilename);
+    if (entry == nullptr)
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+
+    if (entry->depth > 1)
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+    auto texDesc = CD3DX12_RESOURCE_DESC::Tex2D((DXGI_FORMAT) entry->format,
+                                                entry->width,
+                                                entry->height,
+                                                (UINT16) entry->arraySize,
+                                                (UINT16) entry->mipCount);
+
+    UINT subresourceCount = entry->mipCount * entry->arraySize;
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(subresourceCount);
+    UINT64 uploadSize = 0;
+    device->GetCopyableFootprints(
+        &texDesc, 0, subresourceCount, 0, layouts.data(), nullptr, nullptr, &uploadSize);
+
+    // The builder follows the same alignment rules, so this only trips on layouts it cannot
+    // predict; those take the row by row upload instead.
+    for (UINT i = 0; i < subresourceCount; ++i) {
+        const auto &subresource = mSubresources[entry->firstSubresource + i];
+        if (layouts[i].Offset != subresource.offset
+            || layouts[i].Footprint.RowPitch != subresource.rowPitch) {
+            DirectX::DDSTextureData12 textureData;
+            HRESULT hr = LoadTextureData(textureFilename, textureData);
+            if (FAILED(hr))
+                return hr;
+
+            return DirectX::CreateDDSTextureFromData12(
+                device, cmdList, textureData, texture, textureUploadHeap);
+        }
+    }
+
+    HRESULT hr = device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+                                                 D3D12_HEAP_FLAG_NONE,
+                                                 &texDesc,
+                                                 D3D12_RESOURCE_STATE_COPY_DEST,
+                                                 nullptr,
+                                                 IID_PPV_ARGS(&texture));
+    if (FAILED(hr))
+        return hr;
+
+    hr = device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(std::max<UINT64>(uploadSize, entry->payloadSize)),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&textureUploadHeap));
+    if (FAILED(hr)) {
+        texture = nullptr;
+        return hr;
+    }
+
+    uint8_t *mappedData = nullptr;
+    hr = textureUploadHeap->Map(0, nullptr, reinterpret_cast<void **>(&mappedData));
+    if (SUCCEEDED(hr)) {
+        hr = ReadPayload(*entry, mappedData);
+        textureUploadHeap->Unmap(0, nullptr);
+    }
+    if (FAILED(hr)) {
+        texture = nullptr;
+        textureUploadHeap = nullptr;
+        return hr;
+    }
+
+    for (UINT i = 0; i < subresourceCount; ++i) {
+        CD3DX12_TEXTURE_COPY_LOCATION dst(texture.Get(), i);
+        CD3DX12_TEXTURE_COPY_LOCATION src(textureUploadHeap.Get(), layouts[i]);
+        cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+    }
+
+    cmdList->ResourceBarrier(1,
+                             &CD3DX12_RESOURCE_BARRIER::Transition(
+                                 texture.Get(),
+                                 D3D12_RESOURCE_STATE_COPY_DEST,
+                                 D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+    return S_OK;
+}
+
+const TextureArchiveEntry *TextureArchive::Find(const std::wstring &textureFilename) const
+{
+    uint64_t hash = HashTextureArchivePath(textureFilename.c_str(), textureFilename.size());
+    auto it = std::lower_bound(mEntries.begin(),
+                               mEntries.end(),
+                               hash,
+                               [](const TextureArchiveEntry &entry, uint64_t hash) {
+                                   return entry.nameHash < hash;
+                               });
+    return it != mEntries.end() && it->nameHash == hash ? &*it : nullptr;
+}
+
+HRESULT TextureArchive::ReadPayload(const TextureArchiveEntry &entry, uint8_t *payload) const
+{
+    auto chunks = mChunks.data() + entry.firstChunk;
+
+    // The builder stores a texture's chunks back to back, so one read fetches all of them.
+    std::vector<uint64_t> storedOffsets(entry.chunkCount + 1, 0);
+    std::vector<uint64_t> payloadOffsets(entry.chunkCount + 1, 0);
+    bool compressed = false;
+    for (uint32_t i = 0; i < entry.chunkCount; ++i) {
+        if (chunks[i].fileOffset != chunks[0].fileOffset + storedOffsets[i])
+            return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+
+        storedOffsets[i + 1] = storedOffsets[i] + chunks[i].storedSize;
+        payloadOffsets[i + 1] = payloadOffsets[i] + chunks[i].size;
+        compressed |= chunks[i].storedSize != chunks[i].size;
+    }
+    if (entry.chunkCount == 0 || payloadOffsets.back() != entry.payloadSize)
+        return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+
+    // Raw payloads are read in place, compressed ones through a staging copy.
+    std::vector<uint8_t> stored(compressed ? storedOffsets.back() : 0);
+    uint8_t *storedData = compressed ? stored.data() : payload;
+    {
+        std::lock_guard<std::mutex> lock(mFileMutex);
+        mFile.clear();
+        mFile.seekg(chunks[0].fileOffset);
+        if (!mFile.read(reinterpret_cast<char *>(storedData), storedOffsets.back()))
+            return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    if (!compressed)
+        return S_OK;
+
+    std::atomic<uint32_t> nextChunk(0);
+    std::atomic<bool> failed(false);
+    auto decode = [&]() {
+        for (uint32_t i = nextChunk++; i < entry.chunkCount; i = nextChunk++) {
+            const uint8_t *src = storedData + storedOffsets[i];
+            uint8_t *dst = payload + payloadOffsets[i];
+            if (chunks[i].storedSize == chunks[i].size) {
+                memcpy(dst, src, chunks[i].size);
+            } else if (!Lz4::Decompress(src, chunks[i].storedSize, dst, chunks[i].size)) {
+                failed = true;
+            }
+        }
+    };
+
+    // The calling thread decodes too, so small textures do not pay for starting threads.
+    UINT threadCount = MathHelper::Min(std::thread::hardware_concurrency(), entry.chunkCount);
+    std::vector<std::thread> workers;
+    for (UINT i = 1; i < threadCount; ++i) {
+        workers.emplace_back(decode);
+    }
+    decode();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    return failed ? HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT) : S_OK;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "TextureArchiveFormat.h"
+#include "d3dUtil.h"
+
+#include <mutex>
+
+// Reads textures out of an archive written by TextureArchiveBuilder (see TextureArchiveFormat.h).
+// The file stays open while the archive lives; textures may be loaded from several threads at
+// once.  Textures are named by their original file path, of which only the file name counts.
+class TextureArchive
+{
+public:
+    TextureArchive() = default;
+    TextureArchive(const TextureArchive &rhs) = delete;
+    TextureArchive &operator=(const TextureArchive &rhs) = delete;
+
+    // Reads the header and index.  Returns HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) if the file
+    // does not exist.
+    HRESULT Open(const std::wstring &filename);
+
+    bool Contains(const std::wstring &textureFilename) const;
+
+    // Textures the builder packed into a texture array (--pack-arrays) are not entries of their
+    // own.  Finds the array's entry name, TextureArchiveArrayName(index), and the texture's slice.
+    bool FindArraySlice(const std::wstring &textureFilename,
+                        std::string &arrayName,
+                        uint32_t &slice) const;
+
+    // Decodes the texture into system memory, for TextureStreamer and CreateDDSTextureFromData12.
+    HRESULT LoadTextureData(const std::wstring &textureFilename,
+                            DirectX::DDSTextureData12 &textureData) const;
+
+    // Decodes the texture straight into a new upload heap and records the copies into cmdList.
+    HRESULT CreateTexture(ID3D12Device *device,
+                          ID3D12GraphicsCommandList *cmdList,
+                          const std::wstring &textureFilename,
+                          Microsoft::WRL::ComPtr<ID3D12Resource> &texture,
+                          Microsoft::WRL::ComPtr<ID3D12Resource> &textureUploadHeap) const;
+
+private:
+    const TextureArchiveEntry *Find(const std::wstring &textureFilename) const;
+
+    // Reads the entry's chunks and decodes them in parallel into payload.
+    HRESULT ReadPayload(const TextureArchiveEntry &entry, uint8_t *payload) const;
+
+private:
+    mutable std::ifstream mFile;
+    mutable std::mutex mFileMutex;
+
+    TextureArchiveHeader mHeader = {};
+    std::vector<TextureArchiveEntry> mEntries;
+    std::vector<TextureArchiveSubresource> mSubresources;
+    std::vector<TextureArchiveChunk> mChunks;
+    std::vector<TextureArchiveArraySlice> mArraySlices;
+};
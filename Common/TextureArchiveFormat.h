@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// On-disk layout of a texture archive, shared by the reader (TextureArchive) and the offline
+// builder.  All values are little endian.
+//
+//   TextureArchiveHeader
+//   TextureArchiveEntry[entryCount]            sorted by nameHash
+//   TextureArchiveSubresource[subresourceCount]
+//   TextureArchiveChunk[chunkCount]
+//   TextureArchiveArraySlice[arraySliceCount]  sorted by nameHash
+//   chunk data
+//
+// A texture's payload is laid out the way ID3D12Device::GetCopyableFootprints lays out an upload
+// buffer (subresource offsets aligned to 512 bytes, row pitches to 256 bytes), so it can be read
+// straight into upload memory and copied with CopyTextureRegion.  The payload is split into
+// chunks of chunkSize bytes that are each stored raw or LZ4 compressed, and decode independently.
+//
+// Textures the builder packs into texture arrays have no entry of their own.  The array is an
+// entry named TextureArchiveArrayName(index), and an array slice record maps each original name
+// to its array and slice.
+
+const uint32_t kTextureArchiveMagic = 0x52415854; // "TXAR"
+const uint32_t kTextureArchiveVersion = 2;
+
+// D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT and D3D12_TEXTURE_DATA_PITCH_ALIGNMENT.
+const uint32_t kTextureArchivePlacementAlignment = 512;
+const uint32_t kTextureArchivePitchAlignment = 256;
+
+enum TextureArchiveEntryFlags : uint32_t
+{
+    kTextureArchiveCubeMap = 0x1,
+};
+
+struct TextureArchiveHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t subresourceCount;
+    uint32_t chunkCount;
+    uint32_t chunkSize;
+    uint32_t arraySliceCount;
+    uint32_t reserved;
+};
+
+struct TextureArchiveEntry
+{
+    uint64_t nameHash;
+    uint64_t payloadSize;
+
+    uint32_t format; // DXGI_FORMAT
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t mipCount;
+    // Includes the 6 faces of cube maps.
+    uint32_t arraySize;
+
+    // mipCount * arraySize subresources, every mip of slice 0, then slice 1, ...
+    uint32_t firstSubresource;
+    uint32_t firstChunk;
+    uint32_t chunkCount;
+};
+
+struct TextureArchiveSubresource
+{
+    // From the start of the texture's payload.
+    uint64_t offset;
+    uint32_t rowPitch;
+    uint32_t rowSize;
+    uint32_t rowCount;
+    uint32_t depth;
+};
+
+struct TextureArchiveChunk
+{
+    // From the start of the file.
+    uint64_t fileOffset;
+    uint32_t storedSize;
+    // storedSize == size means the chunk is stored raw.
+    uint32_t size;
+};
+
+struct TextureArchiveArraySlice
+{
+    // Of the texture's original name.
+    uint64_t nameHash;
+    uint32_t arrayIndex;
+    uint32_t slice;
+};
+
+static_assert(sizeof(TextureArchiveHeader) == 32, "archive layout changed");
+static_assert(sizeof(TextureArchiveEntry) == 56, "archive layout changed");
+static_assert(sizeof(TextureArchiveSubresource) == 24, "archive layout changed");
+static_assert(sizeof(TextureArchiveChunk) == 16, "archive layout changed");
+static_assert(sizeof(TextureArchiveArraySlice) == 16, "archive layout changed");
+
+// Textures are looked up by file name without directory or extension, ignoring ASCII case, so
+// "Assets/Textures/bricks.dds" is found as "bricks".  FNV-1a, 64 bit.
+template <typename CharT>
+uint64_t HashTextureArchiveName(const CharT *name, size_t length)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; ++i) {
+        auto c = (uint32_t) name[i];
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        hash = (hash ^ (c & 0xff)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Hash of the name a texture file is stored under, see HashTextureArchiveName.
+template <typename CharT>
+uint64_t HashTextureArchivePath(const CharT *path, size_t length)
+{
+    size_t begin = 0;
+    size_t end = length;
+    for (size_t i = 0; i < length; ++i) {
+        if (path[i] == '/' || path[i] == '\\') {
+            begin = i + 1;
+            end = length;
+        } else if (path[i] == '.') {
+            end = i;
+        }
+    }
+    return HashTextureArchiveName(path + begin, end - begin);
+}
+
+// Name of the entry holding texture array arrayIndex.
+inline std::string TextureArchiveArrayName(uint32_t arrayIndex)
+{
+    return "TextureArray" + std::to_string(arrayIndex);
+}
@@ -0,0 +1,39 @@
+#include "TextureArrayPacker.h"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+using namespace TextureArrayPacker;
+
+Packing TextureArrayPacker::Pack(const std::vector<TextureDesc> &textures, uint32_t maxArraySize)
+{
+    maxArraySize = std::max(maxArraySize, 1u);
+
+    Packing packing;
+    packing.slices.resize(textures.size());
+
+    // Array currently being filled for each (format, width, height, mip count, normal map).
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, bool>, uint32_t> openArrays;
+    for (uint32_t i = 0; i < (uint32_t) textures.size(); ++i) {
+        const auto &texture = textures[i];
+        bool packable = texture.arraySize == 1 && texture.depth == 1 && !texture.cubeMap;
+
+        auto key = std::make_tuple(
+            texture.format, texture.width, texture.height, texture.mipCount, texture.normalMap);
+        auto it = packable ? openArrays.find(key) : openArrays.end();
+        if (it == openArrays.end() || packing.arrays[it->second].size() >= maxArraySize) {
+            packing.arrays.emplace_back();
+            if (packable) {
+                openArrays[key] = uint32_t(packing.arrays.size() - 1);
+            }
+            it = openArrays.end();
+        }
+
+        uint32_t array = it != openArrays.end() ? it->second : uint32_t(packing.arrays.size() - 1);
+        packing.slices[i] = {array, uint32_t(packing.arrays[array].size())};
+        packing.arrays[array].push_back(i);
+    }
+
+    return packing;
+}
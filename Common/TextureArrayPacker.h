@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Groups textures that can share a Texture2DArray: same format, size and mip count, both normal
+// maps or both not, and not arrays, cube maps or volumes themselves.  Pure bookkeeping without a
+// device, so the archive builder decides the packing offline and the app only follows the remap
+// table it stores.
+namespace TextureArrayPacker
+{
+struct TextureDesc
+{
+    uint32_t format; // DXGI_FORMAT
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t mipCount;
+    uint32_t arraySize;
+    bool cubeMap;
+    // Tangent space normals, which the shaders read as two channels and never share an array
+    // with colour, even in a format that holds both.
+    bool normalMap;
+};
+
+// Where a texture ended up.
+struct ArraySlice
+{
+    uint32_t array;
+    uint32_t slice;
+};
+
+struct Packing
+{
+    // Indices of the textures in each array, in slice order.  Textures that found no partner
+    // are arrays of one.
+    std::vector<std::vector<uint32_t>> arrays;
+    // Indexed like the textures passed to Pack.
+    std::vector<ArraySlice> slices;
+};
+
+// D3D12_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION.
+const uint32_t kMaxArraySize = 2048;
+
+// Arrays are ordered by their first texture and keep the textures' relative order, so the
+// result only depends on the input order.  Buckets larger than maxArraySize are split.
+Packing Pack(const std::vector<TextureDesc> &textures, uint32_t maxArraySize = kMaxArraySize);
+} // namespace TextureArrayPacker
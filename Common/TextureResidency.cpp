@@ -0,0 +1,181 @@
+#include "TextureResidency.h"
+
+#include <algorithm>
+#include <numeric>
+
+TextureResidency::TextureResidency(uint64_t budgetBytes)
+    : mBudget(budgetBytes)
+{}
+
+uint32_t TextureResidency::AddTexture(const std::vector<uint64_t> &mipBytes, uint32_t tailMip)
+{
+    TextureState state;
+    state.mipBytes = mipBytes;
+    state.tailMip = std::min(tailMip, (uint32_t) mipBytes.size() - 1);
+    state.residentMip = (uint32_t) mipBytes.size();
+    state.desiredMip = state.tailMip;
+
+    mTextures.push_back(std::move(state));
+    return (uint32_t) mTextures.size() - 1;
+}
+
+void TextureResidency::SetDesired(uint32_t texture, uint32_t desiredMip, float priority)
+{
+    auto &state = mTextures[texture];
+    state.desiredMip = std::min(desiredMip, state.tailMip);
+    state.priority = priority;
+}
+
+std::vector<TextureResidency::Change> TextureResidency::Plan() const
+{
+    std::vector<uint32_t> order(mTextures.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return mTextures[a].priority > mTextures[b].priority;
+    });
+
+    // Every mip tail is paid for up front; the rest of the budget goes to detail, one mip at a
+    // time, in priority order.
+    std::vector<uint32_t> targets(mTextures.size());
+    uint64_t targetBytes = 0;
+    for (size_t i = 0; i < mTextures.size(); ++i) {
+        targets[i] = mTextures[i].tailMip;
+        targetBytes += ChainBytes(mTextures[i], targets[i]);
+    }
+
+    for (auto i : order) {
+        const auto &state = mTextures[i];
+        while (targets[i] > state.desiredMip
+               && targetBytes + state.mipBytes[targets[i] - 1] <= mBudget) {
+            targetBytes += state.mipBytes[--targets[i]];
+        }
+    }
+
+    // Every change creates the texture's new chain next to the old one, which is only released
+    // once the change has ended, so each has to fit whole next to what is resident now, pending
+    // chains included.  Tails and loads also leave room for any texture holding detail to drop
+    // to its tail, so that an eviction always fits once the changes in flight have ended.
+    uint64_t residentBytes = GetResidentBytes();
+    uint64_t reserveBytes = 0;
+    for (const auto &state : mTextures) {
+        uint32_t mostDetailed = state.changePending ? std::min(state.residentMip, state.pendingMip)
+                                                    : state.residentMip;
+        if (mostDetailed < state.tailMip) {
+            reserveBytes = std::max(reserveBytes, ChainBytes(state, state.tailMip));
+        }
+    }
+    std::vector<Change> changes;
+    auto fits = [&](uint64_t bytes, uint64_t reserve) {
+        return residentBytes + bytes + reserve <= mBudget;
+    };
+
+    // An eviction that does not fit drops further, down to the tail, rather than wait.
+    for (auto i : order) {
+        const auto &state = mTextures[i];
+        if (state.changePending || state.residentMip == state.mipBytes.size()
+            || targets[i] <= state.residentMip)
+            continue;
+        uint32_t mip = targets[i];
+        while (mip < state.tailMip && !fits(ChainBytes(state, mip), 0)) {
+            ++mip;
+        }
+        if (fits(ChainBytes(state, mip), 0)) {
+            residentBytes += ChainBytes(state, mip);
+            changes.push_back({i, mip});
+        }
+    }
+    for (auto i : order) {
+        const auto &state = mTextures[i];
+        if (state.changePending || state.residentMip != state.mipBytes.size())
+            continue;
+        uint64_t bytes = ChainBytes(state, state.tailMip);
+        if (fits(bytes, reserveBytes)) {
+            residentBytes += bytes;
+            changes.push_back({i, state.tailMip});
+        }
+    }
+    for (auto i : order) {
+        const auto &state = mTextures[i];
+        if (state.changePending || state.residentMip == state.mipBytes.size()
+            || targets[i] >= state.residentMip)
+            continue;
+        uint32_t mip = state.residentMip - 1;
+        uint64_t bytes = ChainBytes(state, mip);
+        uint64_t reserve = std::max(reserveBytes, ChainBytes(state, state.tailMip));
+        if (fits(bytes, reserve)) {
+            residentBytes += bytes;
+            reserveBytes = reserve;
+            changes.push_back({i, mip});
+        }
+    }
+    return changes;
+}
+
+void TextureResidency::BeginChange(uint32_t texture, uint32_t mip)
+{
+    auto &state = mTextures[texture];
+    state.pendingMip = mip;
+    state.changePending = true;
+}
+
+void TextureResidency::EndChange(uint32_t texture)
+{
+    auto &state = mTextures[texture];
+    if (state.changePending) {
+        state.residentMip = state.pendingMip;
+        state.changePending = false;
+    }
+}
+
+uint32_t TextureResidency::GetResidentMip(uint32_t texture) const
+{
+    return mTextures[texture].residentMip;
+}
+
+uint32_t TextureResidency::GetMipCount(uint32_t texture) const
+{
+    return (uint32_t) mTextures[texture].mipBytes.size();
+}
+
+uint64_t TextureResidency::GetResidentBytes() const
+{
+    uint64_t bytes = 0;
+    for (const auto &state : mTextures) {
+        bytes += FootprintBytes(state);
+    }
+    return bytes;
+}
+
+uint64_t TextureResidency::GetBudget() const
+{
+    return mBudget;
+}
+
+uint32_t TextureResidency::MipForScreenSize(uint32_t width, uint32_t height, float screenPixels)
+{
+    // Drop mips while the next smaller one still has at least one texel per pixel.
+    uint32_t largest = std::max(width, height);
+    uint32_t mip = 0;
+    while ((largest >> (mip + 1)) > 0 && (largest >> (mip + 1)) >= screenPixels) {
+        ++mip;
+    }
+    return mip;
+}
+
+uint64_t TextureResidency::ChainBytes(const TextureState &state, uint32_t mip)
+{
+    uint64_t bytes = 0;
+    for (size_t i = mip; i < state.mipBytes.size(); ++i) {
+        bytes += state.mipBytes[i];
+    }
+    return bytes;
+}
+
+uint64_t TextureResidency::FootprintBytes(const TextureState &state)
+{
+    uint64_t bytes = ChainBytes(state, state.residentMip);
+    if (state.changePending) {
+        bytes += ChainBytes(state, state.pendingMip);
+    }
+    return bytes;
+}
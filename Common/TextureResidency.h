@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Decides how many mips of each streamed texture should be resident on the GPU.  Mips are
+// numbered as in D3D (0 is the most detailed), and a texture with resident mip m holds every mip
+// from m down to the smallest one.  The mip tail (tailMip and smaller) is always resident; more
+// detailed mips are granted in priority order while they fit in the memory budget, and evicted
+// again once they are no longer wanted or a higher priority texture needs the room.
+//
+// The policy does not touch the device.  Plan() only proposes changes; the caller applies some of
+// them with BeginChange() and reports with EndChange() once the old copy has been released, so
+// a texture never has more than one change in flight.
+class TextureResidency
+{
+public:
+    struct Change
+    {
+        uint32_t texture;
+        // The new most detailed resident mip.
+        uint32_t mip;
+    };
+
+    explicit TextureResidency(uint64_t budgetBytes);
+
+    // mipBytes[i] is the size of mip i summed over all array slices.  Returns the texture's id;
+    // nothing is resident until the first change to the mip tail has been applied.
+    uint32_t AddTexture(const std::vector<uint64_t> &mipBytes, uint32_t tailMip);
+
+    // desiredMip is clamped to the mip tail.  Higher priorities are served first.
+    void SetDesired(uint32_t texture, uint32_t desiredMip, float priority);
+
+    // Evictions come first, then mip tails, then loads, each by decreasing priority.  Loads step
+    // one mip at a time so detail sharpens progressively.  While a change is in flight both of
+    // the texture's chains are resident, and no change pushes that over the budget.
+    std::vector<Change> Plan() const;
+
+    void BeginChange(uint32_t texture, uint32_t mip);
+    void EndChange(uint32_t texture);
+
+    // Returns the mip count when nothing is resident yet.
+    uint32_t GetResidentMip(uint32_t texture) const;
+    uint32_t GetMipCount(uint32_t texture) const;
+
+    // Includes both copies of textures with a change in flight.
+    uint64_t GetResidentBytes() const;
+    uint64_t GetBudget() const;
+
+    // Most detailed mip worth keeping for a width x height texture covering screenPixels pixels
+    // across its largest on-screen use.
+    static uint32_t MipForScreenSize(uint32_t width, uint32_t height, float screenPixels);
+
+private:
+    struct TextureState
+    {
+        std::vector<uint64_t> mipBytes;
+        uint32_t tailMip = 0;
+        uint32_t residentMip = 0;
+        uint32_t pendingMip = 0;
+        bool changePending = false;
+
+        uint32_t desiredMip = 0;
+        float priority = 0.0f;
+    };
+
+    // Bytes of mips [mip, mipCount).
+    static uint64_t ChainBytes(const TextureState &state, uint32_t mip);
+    // While a change is in flight the old and the new copy are both alive.
+    static uint64_t FootprintBytes(const TextureState &state);
+
+private:
+    uint64_t mBudget = 0;
+    std::vector<TextureState> mTextures;
+};
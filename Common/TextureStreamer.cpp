@@ -0,0 +1,503 @@
+#include "TextureStreamer.h"
+
+using Microsoft::WRL::ComPtr;
+
+// Mips no larger than this are uploaded together as soon as a file has been read and are never
+// evicted.
+static const float kMipTailSize = 64.0f;
+
+TextureStreamer::TextureStreamer(ID3D12Device *device,
+                                 UINT workerCount,
+                                 UINT64 uploadBudgetPerFrame,
+                                 UINT64 residencyBudget,
+                                 const TextureArchive *archive)
+    : mDevice(device)
+    , mUploadBudgetPerFrame(uploadBudgetPerFrame)
+    , mArchive(archive)
+    , mResidency(residencyBudget)
+{
+    workerCount = MathHelper::Max(workerCount, 1u);
+    for (UINT i = 0; i < workerCount; ++i) {
+        mWorkers.emplace_back(&TextureStreamer::WorkerLoop, this);
+    }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mShutdown = true;
+    }
+    mWorkAvailable.notify_all();
+
+    for (auto &worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void TextureStreamer::SetBlockCompressOnLoad(bool enable, BlockCompressor::Quality quality)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBlockCompressOnLoad = enable;
+    mBlockCompressQuality = quality;
+}
+
+void TextureStreamer::SetGenerateMipsOnLoad(bool enable, MipGenerator::Filter filter)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mGenerateMipsOnLoad = enable;
+    mMipFilter = filter;
+}
+
+void TextureStreamer::Request(Texture *texture, float screenPixels)
+{
+    auto request = std::make_unique<StreamRequest>();
+    request->texture = texture;
+    request->filename = texture->Filename;
+    request->content = texture->Contents;
+    request->priority = screenPixels;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueued.push_back(std::move(request));
+    }
+    mWorkAvailable.notify_one();
+}
+
+void TextureStreamer::SetScreenSize(const Texture *texture, float screenPixels)
+{
+    auto it = mStreamedIndex.find(texture);
+    if (it != mStreamedIndex.end()) {
+        const auto &data = mStreamed[it->second]->data;
+        auto desiredMip = TextureResidency::MipForScreenSize(
+            (uint32_t) data.width, (uint32_t) data.height, screenPixels);
+        mResidency.SetDesired(it->second, desiredMip, screenPixels);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto *requests : {&mQueued, &mLoaded}) {
+        for (auto &request : *requests) {
+            if (request->texture == texture) {
+                request->priority = screenPixels;
+                return;
+            }
+        }
+    }
+}
+
+std::vector<Texture *> TextureStreamer::FlushUploads(
+    ID3D12GraphicsCommandList *cmdList, UINT64 fenceValue)
+{
+    RequestList loaded;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        loaded.swap(mLoaded);
+    }
+    for (auto &request : loaded) {
+        AddStreamedTexture(std::move(request));
+    }
+
+    std::vector<Texture *> changedTextures;
+
+    UINT64 uploadedBytes = 0;
+    for (const auto &change : mResidency.Plan()) {
+        auto streamed = mStreamed[change.texture].get();
+
+        UINT64 bytes = 0;
+        for (size_t mip = change.mip; mip < streamed->data.mipCount; ++mip) {
+            bytes += DirectX::GetDDSMipLevelBytes12(streamed->data, mip);
+        }
+        if (!changedTextures.empty() && uploadedBytes + bytes > mUploadBudgetPerFrame)
+            break;
+
+        // Frames in flight may still sample the old resource. The whole new mip range is
+        // uploaded from system memory, which costs at most a third more than the added mip.
+        auto texture = streamed->texture;
+        streamed->retiredResource = texture->Resource;
+        ThrowIfFailed(DirectX::CreateDDSTextureFromData12(
+            mDevice, cmdList, streamed->data, texture->Resource, texture->UploadHeap, change.mip));
+
+        streamed->changePending = true;
+        streamed->fenceValue = fenceValue;
+        mResidency.BeginChange(change.texture, change.mip);
+
+        uploadedBytes += bytes;
+        changedTextures.push_back(texture);
+    }
+
+    return changedTextures;
+}
+
+void TextureStreamer::ReleaseUploadHeaps(UINT64 completedFenceValue)
+{
+    for (auto &streamed : mStreamed) {
+        if (!streamed->changePending || streamed->fenceValue > completedFenceValue)
+            continue;
+
+        streamed->texture->UploadHeap = nullptr;
+        streamed->retiredResource = nullptr;
+        streamed->changePending = false;
+        mResidency.EndChange(streamed->residencyId);
+    }
+}
+
+bool TextureStreamer::IsIdle() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mQueued.empty() && mLoadingCount == 0 && mLoaded.empty();
+}
+
+UINT64 TextureStreamer::GetResidentBytes() const
+{
+    return mResidency.GetResidentBytes();
+}
+
+void TextureStreamer::WorkerLoop()
+{
+    for (;;) {
+        std::unique_ptr<StreamRequest> request;
+        bool blockCompress = false;
+        auto blockCompressQuality = BlockCompressor::Quality::Fast;
+        bool generateMips = false;
+        auto mipFilter = MipGenerator::Filter::Kaiser;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWorkAvailable.wait(lock, [this] { return mShutdown || !mQueued.empty(); });
+            if (mShutdown)
+                return;
+
+            auto it = FindHighestPriority(mQueued);
+            request = std::move(*it);
+            mQueued.erase(it);
+            ++mLoadingCount;
+
+            blockCompress = mBlockCompressOnLoad;
+            blockCompressQuality = mBlockCompressQuality;
+            generateMips = mGenerateMipsOnLoad;
+            mipFilter = mMipFilter;
+        }
+
+        // File IO and header parsing happen without the lock held.
+        if (mArchive != nullptr && mArchive->Contains(request->filename)) {
+            request->result = mArchive->LoadTextureData(request->filename, request->data);
+        } else {
+            request->result = DirectX::LoadDDSTextureDataFromFile12(
+                request->filename.c_str(), request->data);
+        }
+        // Mips first, so block compression covers the new levels too.
+        if (SUCCEEDED(request->result) && generateMips) {
+            request->result = GenerateMips(request->data, mipFilter);
+        }
+        if (SUCCEEDED(request->result) && blockCompress) {
+            request->result
+                = BlockCompress(request->data, blockCompressQuality, request->content);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mLoaded.push_back(std::move(request));
+            --mLoadingCount;
+        }
+    }
+}
+
+void TextureStreamer::AddStreamedTexture(std::unique_ptr<StreamRequest> request)
+{
+    ThrowIfFailed(request->result);
+
+    auto streamed = std::make_unique<StreamedTexture>();
+    streamed->texture = request->texture;
+    streamed->data = std::move(request->data);
+
+    const auto &data = streamed->data;
+    std::vector<uint64_t> mipBytes(data.mipCount);
+    for (size_t mip = 0; mip < data.mipCount; ++mip) {
+        mipBytes[mip] = DirectX::GetDDSMipLevelBytes12(data, mip);
+    }
+
+    auto width = (uint32_t) data.width;
+    auto height = (uint32_t) data.height;
+    streamed->residencyId = mResidency.AddTexture(
+        mipBytes, TextureResidency::MipForScreenSize(width, height, kMipTailSize));
+    mResidency.SetDesired(
+        streamed->residencyId,
+        TextureResidency::MipForScreenSize(width, height, request->priority),
+        request->priority);
+
+    mStreamedIndex[streamed->texture] = streamed->residencyId;
+    mStreamed.push_back(std::move(streamed));
+}
+
+TextureStreamer::RequestList::iterator TextureStreamer::FindHighestPriority(RequestList &requests)
+{
+    // The lists hold a few dozen entries at most, so a linear scan beats keeping a heap in sync
+    // with SetPriority.
+    return std::max_element(
+        requests.begin(),
+        requests.end(),
+        [](const std::unique_ptr<StreamRequest> &a, const std::unique_ptr<StreamRequest> &b) {
+            return a->priority < b->priority;
+        });
+}
+
+HRESULT TextureStreamer::GenerateMips(DirectX::DDSTextureData12 &data, MipGenerator::Filter filter)
+{
+    if (data.resDim != D3D12_RESOURCE_DIMENSION_TEXTURE2D || data.mipCount != 1)
+        return S_FALSE;
+
+    bool srgb = false;
+    bool blockCompressed = false;
+    auto blockFormat = BlockCompressor::Format::BC1;
+    switch (data.format) {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+        break;
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+        srgb = true;
+        break;
+    case DXGI_FORMAT_BC1_UNORM:
+        blockCompressed = true;
+        break;
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+        blockCompressed = true;
+        srgb = true;
+        break;
+    case DXGI_FORMAT_BC3_UNORM:
+        blockCompressed = true;
+        blockFormat = BlockCompressor::Format::BC3;
+        break;
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+        blockCompressed = true;
+        blockFormat = BlockCompressor::Format::BC3;
+        srgb = true;
+        break;
+    default:
+        return S_FALSE;
+    }
+
+    auto width = (uint32_t) data.width;
+    auto height = (uint32_t) data.height;
+    auto sliceCount = (uint32_t) data.arraySize;
+    auto mipCount = MipGenerator::GetFullMipCount(width, height);
+    if (mipCount == 1 || (blockCompressed && (width % 4 != 0 || height % 4 != 0)))
+        return S_FALSE;
+
+    // The top level of every slice as tightly packed pixels.
+    size_t topSize = size_t(width) * height * 4;
+    std::vector<uint8_t> top(topSize * sliceCount);
+    for (uint32_t slice = 0; slice < sliceCount; ++slice) {
+        const auto &initData = data.initData[slice];
+        uint8_t *pixels = top.data() + slice * topSize;
+        if (blockCompressed) {
+            BlockCompressor::Decompress(blockFormat,
+                                        static_cast<const uint8_t *>(initData.pData),
+                                        width,
+                                        height,
+                                        pixels,
+                                        size_t(width) * 4);
+        } else {
+            for (uint32_t y = 0; y < height; ++y) {
+                memcpy(pixels + size_t(y) * width * 4,
+                       static_cast<const uint8_t *>(initData.pData) + y * initData.RowPitch,
+                       size_t(width) * 4);
+            }
+        }
+    }
+
+    size_t chainSize = MipGenerator::GetChainSize(width, height, mipCount);
+    std::vector<uint8_t> chains(chainSize * sliceCount);
+    MipGenerator::Generate(
+        filter, srgb, top.data(), width, height, sliceCount, mipCount, chains.data(), 1);
+
+    auto levelSize = [&](uint32_t levelWidth, uint32_t levelHeight) {
+        return blockCompressed
+                   ? BlockCompressor::GetCompressedSize(blockFormat, levelWidth, levelHeight)
+                   : size_t(levelWidth) * levelHeight * 4;
+    };
+    size_t totalSize = 0;
+    for (uint32_t mip = 0; mip < mipCount; ++mip) {
+        totalSize += levelSize(MathHelper::Max(width >> mip, 1u),
+                               MathHelper::Max(height >> mip, 1u));
+    }
+    totalSize *= sliceCount;
+
+    std::unique_ptr<uint8_t[]> ddsData(new (std::nothrow) uint8_t[totalSize]);
+    if (!ddsData)
+        return E_OUTOFMEMORY;
+
+    // Same layout as a file with mips: every level of slice 0, then slice 1 and so on.
+    std::vector<D3D12_SUBRESOURCE_DATA> initData(size_t(sliceCount) * mipCount);
+    size_t offset = 0;
+    for (uint32_t slice = 0; slice < sliceCount; ++slice) {
+        const uint8_t *level = chains.data() + slice * chainSize;
+        for (uint32_t mip = 0; mip < mipCount; ++mip) {
+            uint32_t levelWidth = MathHelper::Max(width >> mip, 1u);
+            uint32_t levelHeight = MathHelper::Max(height >> mip, 1u);
+            uint32_t rowCount = blockCompressed ? MathHelper::Max(1u, (levelHeight + 3) / 4)
+                                                : levelHeight;
+            size_t size = levelSize(levelWidth, levelHeight);
+            size_t rowSize = size / rowCount;
+            uint8_t *dst = ddsData.get() + offset;
+
+            if (!blockCompressed) {
+                memcpy(dst, level, size);
+            } else if (mip == 0) {
+                // The original blocks, rather than a second round of compression.
+                const auto &original = data.initData[slice];
+                for (uint32_t row = 0; row < rowCount; ++row) {
+                    memcpy(dst + row * rowSize,
+                           static_cast<const uint8_t *>(original.pData) + row * original.RowPitch,
+                           rowSize);
+                }
+            } else {
+                BlockCompressor::Compress(blockFormat,
+                                          BlockCompressor::Quality::Normal,
+                                          level,
+                                          levelWidth,
+                                          levelHeight,
+                                          size_t(levelWidth) * 4,
+                                          dst,
+                                          1);
+            }
+
+            auto &subresource = initData[size_t(slice) * mipCount + mip];
+            subresource.pData = dst;
+            subresource.RowPitch = LONG_PTR(rowSize);
+            subresource.SlicePitch = LONG_PTR(size);
+
+            level += size_t(levelWidth) * levelHeight * 4;
+            offset += size;
+        }
+    }
+
+    data.ddsData = std::move(ddsData);
+    data.initData = std::move(initData);
+    data.mipCount = mipCount;
+    return S_OK;
+}
+
+HRESULT TextureStreamer::BlockCompress(DirectX::DDSTextureData12 &data,
+                                       BlockCompressor::Quality quality,
+                                       Texture::Content content)
+{
+    // BC1 and BC3 blur tangent space normals far more than colour; normal maps keep x and y at
+    // full precision in BC5 instead.  Arrays mixing them with colour have no format for both.
+    if (content == Texture::Content::Mixed)
+        return S_FALSE;
+    bool normalMap = content == Texture::Content::NormalMap;
+
+    // Opaque and alpha block formats for each source format.
+    DXGI_FORMAT opaqueFormat = DXGI_FORMAT_BC1_UNORM;
+    DXGI_FORMAT alphaFormat = DXGI_FORMAT_BC3_UNORM;
+    bool bgra = true;
+    bool hasAlphaChannel = true;
+    switch (data.format) {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+        bgra = false;
+        break;
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+        bgra = false;
+        opaqueFormat = DXGI_FORMAT_BC1_UNORM_SRGB;
+        alphaFormat = DXGI_FORMAT_BC3_UNORM_SRGB;
+        break;
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+        break;
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+        opaqueFormat = DXGI_FORMAT_BC1_UNORM_SRGB;
+        alphaFormat = DXGI_FORMAT_BC3_UNORM_SRGB;
+        break;
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+        hasAlphaChannel = false;
+        break;
+    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+        hasAlphaChannel = false;
+        opaqueFormat = DXGI_FORMAT_BC1_UNORM_SRGB;
+        break;
+    default:
+        return S_FALSE;
+    }
+
+    // Block compressed textures need a top level made of whole blocks.
+    if (data.resDim != D3D12_RESOURCE_DIMENSION_TEXTURE2D || data.width % 4 != 0
+        || data.height % 4 != 0) {
+        return S_FALSE;
+    }
+
+    // initData holds every mip of slice 0, then of slice 1 and so on.
+    auto mipWidth = [&data](size_t i) {
+        return (uint32_t) MathHelper::Max<size_t>(data.width >> (i % data.mipCount), 1);
+    };
+    auto mipHeight = [&data](size_t i) {
+        return (uint32_t) MathHelper::Max<size_t>(data.height >> (i % data.mipCount), 1);
+    };
+
+    bool opaque = true;
+    for (size_t i = 0; i < data.initData.size() && hasAlphaChannel && opaque && !normalMap; ++i) {
+        const auto &initData = data.initData[i];
+        for (uint32_t y = 0; y < mipHeight(i) && opaque; ++y) {
+            auto row = static_cast<const uint8_t *>(initData.pData) + y * initData.RowPitch;
+            for (uint32_t x = 0; x < mipWidth(i); ++x) {
+                if (row[4 * x + 3] != 255) {
+                    opaque = false;
+                    break;
+                }
+            }
+        }
+    }
+    auto blockFormat = normalMap ? BlockCompressor::Format::BC5
+                       : opaque  ? BlockCompressor::Format::BC1
+                                 : BlockCompressor::Format::BC3;
+
+    size_t totalSize = 0;
+    for (size_t i = 0; i < data.initData.size(); ++i) {
+        totalSize += BlockCompressor::GetCompressedSize(blockFormat, mipWidth(i), mipHeight(i));
+    }
+    std::unique_ptr<uint8_t[]> blocks(new (std::nothrow) uint8_t[totalSize]);
+    if (!blocks)
+        return E_OUTOFMEMORY;
+
+    // Each subresource goes through a tightly packed RGBA copy; workers run in parallel already,
+    // so every texture is compressed on one thread.
+    std::vector<uint8_t> rgba;
+    size_t offset = 0;
+    for (size_t i = 0; i < data.initData.size(); ++i) {
+        auto &initData = data.initData[i];
+        uint32_t width = mipWidth(i);
+        uint32_t height = mipHeight(i);
+
+        rgba.resize(size_t(width) * height * 4);
+        for (uint32_t y = 0; y < height; ++y) {
+            auto src = static_cast<const uint8_t *>(initData.pData) + y * initData.RowPitch;
+            auto dst = rgba.data() + size_t(y) * width * 4;
+            for (uint32_t x = 0; x < width; ++x) {
+                dst[4 * x + 0] = src[4 * x + (bgra ? 2 : 0)];
+                dst[4 * x + 1] = src[4 * x + 1];
+                dst[4 * x + 2] = src[4 * x + (bgra ? 0 : 2)];
+                dst[4 * x + 3] = hasAlphaChannel ? src[4 * x + 3] : 255;
+            }
+        }
+
+        BlockCompressor::Compress(blockFormat,
+                                  quality,
+                                  rgba.data(),
+                                  width,
+                                  height,
+                                  size_t(width) * 4,
+                                  blocks.get() + offset,
+                                  1);
+
+        size_t size = BlockCompressor::GetCompressedSize(blockFormat, width, height);
+        initData.pData = blocks.get() + offset;
+        initData.RowPitch = LONG_PTR(size / MathHelper::Max(1u, (height + 3) / 4));
+        initData.SlicePitch = LONG_PTR(size);
+        offset += size;
+    }
+
+    data.ddsData = std::move(blocks);
+    data.format = normalMap ? DXGI_FORMAT_BC5_UNORM : opaque ? opaqueFormat : alphaFormat;
+    return S_OK;
+}
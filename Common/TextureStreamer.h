@@ -0,0 +1,138 @@
+#pragma once
+
+#include "BlockCompressor.h"
+#include "MipGenerator.h"
+#include "TextureArchive.h"
+#include "TextureResidency.h"
+#include "d3dUtil.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Streams textures in the background.  Worker threads read and parse the DDS files, highest
+// priority first; the render thread then uploads them, spending at most a fixed number of upload
+// bytes per frame.  A texture's Resource stays null until its mip tail has been uploaded, so
+// callers keep binding a placeholder until then.
+//
+// After that the texture is streamed progressively: TextureResidency decides how many mips each
+// texture keeps within the memory budget, and every change re-creates Resource with the new mip
+// range.  The parsed file stays in system memory so mips can be brought back after an eviction.
+class TextureStreamer
+{
+public:
+    // Textures found in archive are read from it, everything else from its own file.  The
+    // archive must outlive the streamer.
+    TextureStreamer(ID3D12Device *device,
+                    UINT workerCount,
+                    UINT64 uploadBudgetPerFrame,
+                    UINT64 residencyBudget,
+                    const TextureArchive *archive = nullptr);
+    TextureStreamer(const TextureStreamer &rhs) = delete;
+    TextureStreamer &operator=(const TextureStreamer &rhs) = delete;
+    ~TextureStreamer();
+
+    // Has the worker threads block compress 8 bit RGBA and BGRA textures whose size is a multiple
+    // of 4, to BC1 or to BC3 if they use alpha, so they take a quarter or half of the memory and
+    // upload bandwidth.  Normal maps keep their x and y in BC5, the shaders rebuilding z, and
+    // textures mixing normal maps with colour are left as they are.  Applies to textures read
+    // after the call.
+    void SetBlockCompressOnLoad(bool enable,
+                                BlockCompressor::Quality quality = BlockCompressor::Quality::Fast);
+
+    // Has the worker threads build the mip chain of 2D textures stored with a single level, for
+    // 8 bit RGBA and BGRA, BC1 and BC3 formats.  Block compressed textures keep their top level
+    // and get the new levels encoded at Normal quality.  Applies to textures read after the call.
+    void SetGenerateMipsOnLoad(bool enable,
+                               MipGenerator::Filter filter = MipGenerator::Filter::Kaiser);
+
+    // Queues texture->Filename for loading.  The texture must outlive the streamer.
+    void Request(Texture *texture, float screenPixels = 0.0f);
+
+    // screenPixels is the size of the texture's largest on-screen use, zero if it is not visible.
+    // It orders file reads and uploads, and picks how many mips the texture should keep.
+    void SetScreenSize(const Texture *texture, float screenPixels);
+
+    // Records uploads into cmdList until the per-frame budget is spent (at least one upload per
+    // call so large textures cannot starve).  fenceValue is the fence value signaled once cmdList
+    // has executed.  Returns the textures whose Resource was replaced; the new resource may be
+    // used by commands recorded after this call, the old one stays alive until fenceValue.
+    std::vector<Texture *> FlushUploads(ID3D12GraphicsCommandList *cmdList, UINT64 fenceValue);
+
+    // Frees the upload heaps and replaced resources the GPU is done with.
+    void ReleaseUploadHeaps(UINT64 completedFenceValue);
+
+    bool IsIdle() const;
+
+    UINT64 GetResidentBytes() const;
+
+private:
+    struct StreamRequest
+    {
+        Texture *texture = nullptr;
+        std::wstring filename;
+        Texture::Content content = Texture::Content::Color;
+        float priority = 0.0f;
+
+        DirectX::DDSTextureData12 data;
+        HRESULT result = S_OK;
+    };
+
+    // A texture whose file has been parsed.  Render thread only.
+    struct StreamedTexture
+    {
+        Texture *texture = nullptr;
+        DirectX::DDSTextureData12 data;
+        uint32_t residencyId = 0;
+
+        // Resource and UploadHeap replaced by the last change, kept until fenceValue.
+        bool changePending = false;
+        UINT64 fenceValue = 0;
+        Microsoft::WRL::ComPtr<ID3D12Resource> retiredResource;
+    };
+
+    using RequestList = std::vector<std::unique_ptr<StreamRequest>>;
+
+    void WorkerLoop();
+
+    void AddStreamedTexture(std::unique_ptr<StreamRequest> request);
+
+    static RequestList::iterator FindHighestPriority(RequestList &requests);
+
+    // Replaces data with a version holding the full mip chain; S_FALSE if it has mips already or
+    // its format is not supported.
+    static HRESULT GenerateMips(DirectX::DDSTextureData12 &data, MipGenerator::Filter filter);
+
+    // Replaces data with its block compressed version; S_FALSE if its format, size or content
+    // does not allow it.
+    static HRESULT BlockCompress(DirectX::DDSTextureData12 &data,
+                                 BlockCompressor::Quality quality,
+                                 Texture::Content content);
+
+private:
+    ID3D12Device *mDevice = nullptr;
+    UINT64 mUploadBudgetPerFrame = 0;
+    const TextureArchive *mArchive = nullptr;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWorkAvailable;
+
+    // Waiting for a worker thread.
+    RequestList mQueued;
+    // Number of requests a worker thread is reading right now.
+    UINT mLoadingCount = 0;
+    // Parsed and waiting for FlushUploads.
+    RequestList mLoaded;
+
+    bool mShutdown = false;
+    bool mBlockCompressOnLoad = false;
+    BlockCompressor::Quality mBlockCompressQuality = BlockCompressor::Quality::Fast;
+    bool mGenerateMipsOnLoad = false;
+    MipGenerator::Filter mMipFilter = MipGenerator::Filter::Kaiser;
+    std::vector<std::thread> mWorkers;
+
+    // Render thread only; indexed by residency id.
+    std::vector<std::unique_ptr<StreamedTexture>> mStreamed;
+    std::unordered_map<const Texture *, uint32_t> mStreamedIndex;
+    TextureResidency mResidency;
+};
@@ -0,0 +1,128 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TRANSFORM_HIERARCHY_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_HIERARCHY_SSE2 1
+#endif
+
+using namespace TransformHierarchy;
+
+Matrix TransformHierarchy::Multiply(const Matrix &a, const Matrix &b)
+{
+    // Each row of the product is a's row weighting b's rows.
+    Matrix result;
+#if TRANSFORM_HIERARCHY_AVX2
+    __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(b.m[0]));
+    __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(b.m[1]));
+    __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(b.m[2]));
+    __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(b.m[3]));
+    for (int i = 0; i < 4; i += 2) {
+        // Rows i and i + 1 of a, each element across the half of its row of the product.
+        auto element = [&](int j) {
+            return _mm256_setr_m128(_mm_set1_ps(a.m[i][j]), _mm_set1_ps(a.m[i + 1][j]));
+        };
+        __m256 row = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(element(0), b0), _mm256_mul_ps(element(1), b1)),
+            _mm256_add_ps(_mm256_mul_ps(element(2), b2), _mm256_mul_ps(element(3), b3)));
+        _mm256_storeu_ps(result.m[i], row);
+    }
+#elif TRANSFORM_HIERARCHY_SSE2
+    __m128 b0 = _mm_loadu_ps(b.m[0]);
+    __m128 b1 = _mm_loadu_ps(b.m[1]);
+    __m128 b2 = _mm_loadu_ps(b.m[2]);
+    __m128 b3 = _mm_loadu_ps(b.m[3]);
+    for (int i = 0; i < 4; ++i) {
+        __m128 row01 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a.m[i][0]), b0),
+                                  _mm_mul_ps(_mm_set1_ps(a.m[i][1]), b1));
+        __m128 row23 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a.m[i][2]), b2),
+                                  _mm_mul_ps(_mm_set1_ps(a.m[i][3]), b3));
+        __m128 row = _mm_add_ps(row01, row23);
+        _mm_storeu_ps(result.m[i], row);
+    }
+#else
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            // Summed in the same order as the vector kernels so all round alike.
+            result.m[i][j] = (a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j])
+                             + (a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j]);
+        }
+    }
+#endif
+    return result;
+}
+
+uint32_t TransformHierarchy::Add(Hierarchy &hierarchy,
+                                 uint32_t parent,
+                                 const Matrix &local,
+                                 Composition composition)
+{
+    auto node = uint32_t(hierarchy.locals.size());
+    hierarchy.locals.push_back(local);
+    hierarchy.worlds.push_back(local);
+    hierarchy.parents.push_back(parent < node ? parent : kNoParent);
+    hierarchy.compositions.push_back(composition);
+    hierarchy.dirty.push_back(1);
+    hierarchy.firstDirty = std::min(hierarchy.firstDirty, node);
+    return node;
+}
+
+void TransformHierarchy::SetLocal(Hierarchy &hierarchy, uint32_t node, const Matrix &local)
+{
+    if (std::memcmp(&hierarchy.locals[node], &local, sizeof(Matrix)) == 0)
+        return;
+    hierarchy.locals[node] = local;
+    hierarchy.dirty[node] = 1;
+    hierarchy.firstDirty = std::min(hierarchy.firstDirty, node);
+}
+
+void TransformHierarchy::Update(Hierarchy &hierarchy, std::vector<uint32_t> &changed)
+{
+    changed.clear();
+    auto count = uint32_t(hierarchy.locals.size());
+    if (hierarchy.firstDirty >= count)
+        return;
+
+    // A node is composed again if its own local transform or its parent's world changed;
+    // parents come first, so theirs is known by then, and nothing before the first dirty node
+    // changes.  dirty marks whose world changed until the pass ends.
+    for (uint32_t node = hierarchy.firstDirty; node < count; ++node) {
+        uint32_t parent = hierarchy.parents[node];
+        if (parent != kNoParent && hierarchy.dirty[parent]) {
+            hierarchy.dirty[node] = 1;
+        }
+        if (!hierarchy.dirty[node])
+            continue;
+
+        const auto &local = hierarchy.locals[node];
+        if (parent == kNoParent) {
+            hierarchy.worlds[node] = local;
+        } else if (hierarchy.compositions[node] == kAttached) {
+            hierarchy.worlds[node] = Multiply(local, hierarchy.worlds[parent]);
+        } else {
+            hierarchy.worlds[node] = Multiply(hierarchy.worlds[parent], local);
+        }
+        changed.push_back(node);
+    }
+
+    for (uint32_t node : changed) {
+        hierarchy.dirty[node] = 0;
+    }
+    hierarchy.firstDirty = UINT32_MAX;
+}
+
+const char *TransformHierarchy::GetInstructionSet()
+{
+#if TRANSFORM_HIERARCHY_AVX2
+    return "AVX2";
+#elif TRANSFORM_HIERARCHY_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
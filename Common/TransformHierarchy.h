@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Parent and child transforms kept in arrays in topological order, every parent before its
+// children, so that one pass from the first changed node on brings every world transform up to
+// date.  Only the nodes whose local transform changed and their descendants are composed again,
+// with SSE2, or AVX2 two rows at a time (/arch:AVX2, -mavx2), and plain C++ elsewhere.  Portable
+// so the tools can measure it.
+namespace TransformHierarchy
+{
+const uint32_t kNoParent = UINT32_MAX;
+
+// Row-major, transforming row vectors, as an XMFLOAT4X4.
+struct Matrix
+{
+    float m[4][4];
+};
+
+enum Composition : uint8_t {
+    // The node moves with its parent: its local transform, then its parent's world.
+    kAttached,
+    // The node is its parent seen through a world space transform, such as a reflection or a
+    // planar shadow's projection: its parent's world, then its local transform.
+    kDerived,
+};
+
+struct Hierarchy
+{
+    std::vector<Matrix> locals;
+    std::vector<Matrix> worlds;
+    std::vector<uint32_t> parents;
+    std::vector<Composition> compositions;
+    // Nodes whose local transform changed since the last update, and the first of them.
+    std::vector<uint8_t> dirty;
+    uint32_t firstDirty = UINT32_MAX;
+};
+
+// Adds a node after every other, so parent must already exist or be kNoParent.  Returns its
+// index.
+uint32_t Add(Hierarchy &hierarchy, uint32_t parent, const Matrix &local, Composition composition);
+
+// Sets a node's local transform.  Setting the one it already has changes nothing.
+void SetLocal(Hierarchy &hierarchy, uint32_t node, const Matrix &local);
+
+// Composes the world transforms of the changed nodes and their descendants, listing them in
+// changed in order.
+void Update(Hierarchy &hierarchy, std::vector<uint32_t> &changed);
+
+// a * b.
+Matrix Multiply(const Matrix &a, const Matrix &b);
+
+// Name of the instruction set Multiply was compiled for.
+const char *GetInstructionSet();
+} // namespace TransformHierarchy
@@ -0,0 +1,219 @@
+#include "VertexQuantizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace VertexQuantizer;
+
+namespace
+{
+const double kRadiansToDegrees = 57.29577951308232;
+
+double Dot(const float a[3], const float b[3])
+{
+    return double(a[0]) * b[0] + double(a[1]) * b[1] + double(a[2]) * b[2];
+}
+
+double Length(const float v[3])
+{
+    return std::sqrt(Dot(v, v));
+}
+
+// The position a coordinate takes between the faces of the box, rounded to 16 bits.
+uint16_t QuantizeUnorm(float value, float center, float extent)
+{
+    if (extent <= 0.0f)
+        return 0;
+    double t = (double(value) - (double(center) - extent)) / (2.0 * extent);
+    return uint16_t(std::lround(std::clamp(t, 0.0, 1.0) * 65535.0));
+}
+
+int16_t ClampSnorm(double value)
+{
+    return int16_t(std::clamp(value, -32767.0, 32767.0));
+}
+
+// Angle between v and its encoding, or -1 for a zero vector, which is encoded as +z.
+double EncodeUnitVector(const float v[3], int16_t encoded[2])
+{
+    double length = Length(v);
+    if (length == 0.0) {
+        encoded[0] = 0;
+        encoded[1] = 0;
+        return -1.0;
+    }
+
+    // Projected onto the octahedron |x| + |y| + |z| = 1, the lower half folded over the upper.
+    double l1 = std::abs(v[0]) + std::abs(v[1]) + std::abs(v[2]);
+    double x = v[0] / l1;
+    double y = v[1] / l1;
+    if (v[2] < 0.0f) {
+        double foldedX = (1.0 - std::abs(y)) * (x >= 0.0 ? 1.0 : -1.0);
+        double foldedY = (1.0 - std::abs(x)) * (y >= 0.0 ? 1.0 : -1.0);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    // Rounding each coordinate on its own can miss the nearest code, so the four around the
+    // point are decoded and the closest kept.
+    float unit[3] = {float(v[0] / length), float(v[1] / length), float(v[2] / length)};
+    double baseX = std::floor(x * 32767.0);
+    double baseY = std::floor(y * 32767.0);
+    double bestDot = -2.0;
+    for (int dx = 0; dx < 2; ++dx) {
+        for (int dy = 0; dy < 2; ++dy) {
+            int16_t candidate[2] = {ClampSnorm(baseX + dx), ClampSnorm(baseY + dy)};
+            float decoded[3];
+            DecodeUnitVector(candidate, decoded);
+            double dot = Dot(unit, decoded);
+            if (dot > bestDot) {
+                bestDot = dot;
+                encoded[0] = candidate[0];
+                encoded[1] = candidate[1];
+            }
+        }
+    }
+    return std::acos(std::clamp(bestDot, -1.0, 1.0)) * kRadiansToDegrees;
+}
+} // namespace
+
+Report VertexQuantizer::Quantize(const FloatVertex *vertices,
+                                 size_t count,
+                                 const float center[3],
+                                 const float extents[3],
+                                 QuantizedVertex *quantized)
+{
+    Report report;
+    for (size_t i = 0; i < count; ++i) {
+        const auto &vertex = vertices[i];
+        auto &q = quantized[i];
+
+        for (int c = 0; c < 3; ++c) {
+            q.pos[c] = QuantizeUnorm(vertex.pos[c], center[c], extents[c]);
+        }
+        q.pos[3] = 0;
+        float pos[3];
+        DecodePosition(q, center, extents, pos);
+        float d[3] = {pos[0] - vertex.pos[0], pos[1] - vertex.pos[1], pos[2] - vertex.pos[2]};
+        report.position = std::max(report.position, float(Length(d)));
+
+        report.normal = std::max(report.normal, float(EncodeUnitVector(vertex.normal, q.normal)));
+        report.tangent = std::max(report.tangent,
+                                  float(EncodeUnitVector(vertex.tangent, q.tangent)));
+
+        for (int c = 0; c < 2; ++c) {
+            q.texCoord[c] = FloatToHalf(vertex.texCoord[c]);
+            float error = std::abs(HalfToFloat(q.texCoord[c]) - vertex.texCoord[c]);
+            report.texCoord = std::max(report.texCoord, error);
+        }
+    }
+    return report;
+}
+
+void VertexQuantizer::DecodePosition(const QuantizedVertex &vertex,
+                                     const float center[3],
+                                     const float extents[3],
+                                     float pos[3])
+{
+    for (int c = 0; c < 3; ++c) {
+        pos[c] = center[c] + extents[c] * (2.0f * (vertex.pos[c] / 65535.0f) - 1.0f);
+    }
+}
+
+void VertexQuantizer::DecodeUnitVector(const int16_t encoded[2], float v[3])
+{
+    // Both -32768 and -32767 are -1, as the input assembler reads SNORM.
+    float x = std::max(encoded[0] / 32767.0f, -1.0f);
+    float y = std::max(encoded[1] / 32767.0f, -1.0f);
+    float z = 1.0f - std::abs(x) - std::abs(y);
+    if (z < 0.0f) {
+        float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+    float length = std::sqrt(x * x + y * y + z * z);
+    v[0] = x / length;
+    v[1] = y / length;
+    v[2] = z / length;
+}
+
+uint16_t VertexQuantizer::FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    // Infinity and NaN, which stays a NaN.
+    if (magnitude >= 0x7f800000)
+        return uint16_t(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+    // At least 65520, which rounds past the largest half.
+    if (magnitude >= 0x477ff000)
+        return uint16_t(sign | 0x7c00);
+    // Below 2^-14 the half is denormal, a multiple of 2^-24.
+    if (magnitude < 0x38800000) {
+        float scaled;
+        std::memcpy(&scaled, &magnitude, sizeof(scaled));
+        return uint16_t(sign | uint32_t(std::nearbyint(scaled * 16777216.0f)));
+    }
+
+    // Rebiased exponent and the top 10 mantissa bits, rounded to nearest even; a carry out of
+    // the mantissa correctly bumps the exponent.
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    uint32_t rest = magnitude & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        ++half;
+    }
+    return uint16_t(sign | half);
+}
+
+float VertexQuantizer::HalfToFloat(uint16_t value)
+{
+    uint32_t sign = uint32_t(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+
+    uint32_t bits;
+    if (exponent == 0) {
+        float magnitude = std::ldexp(float(mantissa), -24);
+        std::memcpy(&bits, &magnitude, sizeof(bits));
+        bits |= sign;
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+bool VertexQuantizer::Fits16BitIndices(const uint32_t *indices, size_t count)
+{
+    return std::all_of(indices, indices + count, [](uint32_t index) { return index <= 0xffff; });
+}
+
+std::vector<uint16_t> VertexQuantizer::To16BitIndices(const uint32_t *indices, size_t count)
+{
+    std::vector<uint16_t> result(count);
+    std::transform(indices, indices + count, result.begin(), [](uint32_t index) {
+        return uint16_t(index);
+    });
+    return result;
+}
+
+std::vector<uint8_t> VertexQuantizer::ExtractPositions(const void *vertices,
+                                                       size_t count,
+                                                       size_t stride,
+                                                       size_t positionSize)
+{
+    std::vector<uint8_t> positions(count * positionSize);
+    auto source = static_cast<const uint8_t *>(vertices);
+    for (size_t i = 0; i < count; ++i) {
+        std::memcpy(&positions[i * positionSize], source + i * stride, positionSize);
+    }
+    return positions;
+}
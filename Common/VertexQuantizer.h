@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Packs static mesh vertices into 20 bytes instead of 44: positions as 16 bit fractions of the
+// submesh's bounding box, normals and tangents as octahedral 16 bit pairs and texture
+// coordinates as halves.  Indices go down to 16 bits when every vertex can be reached with
+// them.  Portable so the offline tools share it; the input layouts are described with DXGI
+// format values so the app can build its D3D12_INPUT_ELEMENT_DESCs from the same tables.
+namespace VertexQuantizer
+{
+// The 44 byte vertex the meshes are built with, as Vertex in LandAndWaves/FrameResource.h.
+struct FloatVertex
+{
+    float pos[3];
+    float normal[3];
+    float texCoord[2];
+    float tangent[3];
+};
+
+// Attributes in the same order as FloatVertex, which is also the order of MeshFileAttributes.
+struct QuantizedVertex
+{
+    // 0 and 65535 are the faces of the bounding box; the fourth component is padding.
+    uint16_t pos[4];
+    // Octahedral, in [-32767, 32767].
+    int16_t normal[2];
+    // IEEE half floats.
+    uint16_t texCoord[2];
+    int16_t tangent[2];
+};
+
+static_assert(sizeof(FloatVertex) == 44, "FloatVertex is not packed");
+static_assert(sizeof(QuantizedVertex) == 20, "QuantizedVertex is not packed");
+
+// The DXGI_FORMAT values the layouts use.
+enum Format : uint32_t
+{
+    kFormatR32G32B32Float = 6,
+    kFormatR16G16B16A16Unorm = 11,
+    kFormatR32G32Float = 16,
+    kFormatR16G16Float = 34,
+    kFormatR16G16Snorm = 37,
+    kFormatR32Uint = 42,
+    kFormatR16Uint = 57,
+};
+
+struct InputElement
+{
+    const char *semantic;
+    uint32_t format;
+    uint32_t offset;
+};
+
+const size_t kInputElementCount = 4;
+
+constexpr InputElement kFloatLayout[kInputElementCount] = {
+    {"POSITION", kFormatR32G32B32Float, offsetof(FloatVertex, pos)},
+    {"NORMAL", kFormatR32G32B32Float, offsetof(FloatVertex, normal)},
+    {"TEXCOORD", kFormatR32G32Float, offsetof(FloatVertex, texCoord)},
+    {"TANGENT", kFormatR32G32B32Float, offsetof(FloatVertex, tangent)},
+};
+
+constexpr InputElement kQuantizedLayout[kInputElementCount] = {
+    {"POSITION", kFormatR16G16B16A16Unorm, offsetof(QuantizedVertex, pos)},
+    {"NORMAL", kFormatR16G16Snorm, offsetof(QuantizedVertex, normal)},
+    {"TEXCOORD", kFormatR16G16Float, offsetof(QuantizedVertex, texCoord)},
+    {"TANGENT", kFormatR16G16Snorm, offsetof(QuantizedVertex, tangent)},
+};
+
+// The position-only streams passes that need nothing else read: each vertex's position alone,
+// the first kPositionSize or kQuantizedPositionSize bytes of the vertex.
+const uint32_t kPositionSize = sizeof(FloatVertex::pos);
+const uint32_t kQuantizedPositionSize = sizeof(QuantizedVertex::pos);
+
+static_assert(offsetof(FloatVertex, pos) == 0 && offsetof(QuantizedVertex, pos) == 0,
+              "positions do not lead the vertices");
+
+constexpr InputElement kFloatPositionLayout[] = {kFloatLayout[0]};
+constexpr InputElement kQuantizedPositionLayout[] = {kQuantizedLayout[0]};
+
+// Largest differences between the vertices and their decoded encodings.
+struct Report
+{
+    // Distance, in object units.
+    float position = 0.0f;
+    // Angles, in degrees.  Zero length vectors, which decode to +z, are left out.
+    float normal = 0.0f;
+    float tangent = 0.0f;
+    float texCoord = 0.0f;
+};
+
+// Encodes count vertices, which must lie within the box given by center and extents.
+Report Quantize(const FloatVertex *vertices,
+                size_t count,
+                const float center[3],
+                const float extents[3],
+                QuantizedVertex *quantized);
+
+// The inverses, as the vertex shader computes them.
+void DecodePosition(const QuantizedVertex &vertex,
+                    const float center[3],
+                    const float extents[3],
+                    float pos[3]);
+void DecodeUnitVector(const int16_t encoded[2], float v[3]);
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+// True if every index fits in 16 bits.
+bool Fits16BitIndices(const uint32_t *indices, size_t count);
+
+std::vector<uint16_t> To16BitIndices(const uint32_t *indices, size_t count);
+
+// The position-only stream of count vertices stride bytes apart: the leading positionSize bytes
+// of each, back to back.
+std::vector<uint8_t> ExtractPositions(const void *vertices,
+                                      size_t count,
+                                      size_t stride,
+                                      size_t positionSize);
+
+template <typename Vertex>
+Report Quantize(const std::vector<Vertex> &vertices,
+                const float center[3],
+                const float extents[3],
+                std::vector<QuantizedVertex> &quantized)
+{
+    static_assert(sizeof(Vertex) == sizeof(FloatVertex), "Vertex is not a FloatVertex");
+    quantized.resize(vertices.size());
+    return Quantize(reinterpret_cast<const FloatVertex *>(vertices.data()),
+                    vertices.size(),
+                    center,
+                    extents,
+                    quantized.data());
+}
+} // namespace VertexQuantizer
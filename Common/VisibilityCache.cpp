@@ -0,0 +1,84 @@
+#include "VisibilityCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace VisibilityCache;
+
+namespace
+{
+bool CameraMoved(const Cache &cache, const float viewProj[16])
+{
+    for (int i = 0; i < 16; ++i) {
+        if (std::abs(viewProj[i] - cache.viewProj[i]) > kCameraEpsilon)
+            return true;
+    }
+    return false;
+}
+
+// Records the instance's new containment, adding it to visible or swapping it out with the last.
+void SetContainment(Cache &cache, uint32_t instance, FrustumCuller::Containment containment)
+{
+    cache.containments[instance] = containment;
+    auto &index = cache.visibleIndices[instance];
+    if (containment != FrustumCuller::kOutside) {
+        if (index == kNotVisible) {
+            index = uint32_t(cache.visible.size());
+            cache.visible.push_back({instance, containment});
+        } else {
+            cache.visible[index].containment = containment;
+        }
+    } else if (index != kNotVisible) {
+        auto last = cache.visible.back();
+        cache.visible[index] = last;
+        cache.visibleIndices[last.instance] = index;
+        cache.visible.pop_back();
+        index = kNotVisible;
+    }
+}
+} // namespace
+
+Stats VisibilityCache::Update(Cache &cache,
+                              const InstanceBvh::Tree &tree,
+                              const float viewProj[16],
+                              const uint32_t *generations,
+                              uint32_t generation)
+{
+    Stats stats;
+    auto count = uint32_t(tree.instances.size());
+    auto frustum = FrustumCuller::ExtractFrustum(viewProj);
+    if (!cache.valid || cache.containments.size() != count || CameraMoved(cache, viewProj)) {
+        InstanceBvh::Cull(tree, frustum, cache.visible);
+        cache.containments.assign(count, FrustumCuller::kOutside);
+        cache.rejectingPlanes.resize(count, 0);
+        cache.visibleIndices.assign(count, kNotVisible);
+        for (uint32_t i = 0; i < uint32_t(cache.visible.size()); ++i) {
+            cache.containments[cache.visible[i].instance] = cache.visible[i].containment;
+            cache.visibleIndices[cache.visible[i].instance] = i;
+        }
+        cache.valid = true;
+        std::copy(viewProj, viewProj + 16, cache.viewProj);
+        cache.generation = generation;
+        stats.fullCull = true;
+        return stats;
+    }
+    if (generation == cache.generation)
+        return stats;
+
+    // Generations only grow, but may wrap.
+    for (uint32_t instance = 0; instance < count; ++instance) {
+        if (int32_t(generations[instance] - cache.generation) <= 0)
+            continue;
+        auto box = tree.boxes.Get(tree.slots[instance]);
+        auto containment = FrustumCuller::Test(frustum, box, cache.rejectingPlanes[instance]);
+        SetContainment(cache, instance, containment);
+        ++stats.retested;
+    }
+    cache.generation = generation;
+    return stats;
+}
+
+void VisibilityCache::Invalidate(Cache &cache)
+{
+    cache.valid = false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "InstanceBvh.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Frame to frame coherence for InstanceBvh::Cull.  While the camera stays within kCameraEpsilon
+// of where the instances were last culled from, only those whose transform generation changed
+// since are tested again, each starting with the plane that last rejected it, and the others keep
+// their containment; with nothing moved an update costs a comparison.  Portable so the tools can
+// measure it.
+namespace VisibilityCache
+{
+// Largest change of any element of the view-projection matrix that does not cull everything
+// again.
+const float kCameraEpsilon = 1e-5f;
+
+const uint32_t kNotVisible = UINT32_MAX;
+
+struct Cache
+{
+    // The instances not outside the frustum, in no particular order.
+    std::vector<InstanceBvh::VisibleInstance> visible;
+
+    // The camera everything was last culled from, and the generation the instances were
+    // last tested at.
+    bool valid = false;
+    float viewProj[16];
+    uint32_t generation = 0;
+
+    // Per instance: its containment, the plane that last put it outside, and its index in
+    // visible, or kNotVisible.
+    std::vector<uint8_t> containments;
+    std::vector<uint8_t> rejectingPlanes;
+    std::vector<uint32_t> visibleIndices;
+};
+
+// What an update did.
+struct Stats
+{
+    bool fullCull = false;
+    size_t retested = 0;
+};
+
+// Brings cache.visible up to date for the frustum of viewProj (as FrustumCuller::ExtractFrustum
+// takes it).  generations has one entry per instance of tree, the value of generation when the
+// instance last moved; generation grows whenever any does.  The tree must already be refit.
+Stats Update(Cache &cache,
+             const InstanceBvh::Tree &tree,
+             const float viewProj[16],
+             const uint32_t *generations,
+             uint32_t generation);
+
+// Makes the next update cull everything, as when culling was switched off meanwhile.
+void Invalidate(Cache &cache);
+} // namespace VisibilityCache
@@ -0,0 +1,80 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned threadCount)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for (unsigned i = 1; i < threadCount; ++i) {
+        mWorkers.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mShutdown = true;
+    }
+    mJobAvailable.notify_all();
+    for (auto &worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void WorkerPool::Run(size_t taskCount, const std::function<void(size_t)> &task)
+{
+    // Jobs too small to share run on the calling thread alone.
+    if (taskCount <= 1 || mWorkers.empty()) {
+        for (size_t i = 0; i < taskCount; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTask = &task;
+        mTaskCount = taskCount;
+        mNextTask = 0;
+        mBusyCount = unsigned(mWorkers.size());
+        ++mJob;
+    }
+    mJobAvailable.notify_all();
+
+    RunTasks();
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mJobDone.wait(lock, [this] { return mBusyCount == 0; });
+    mTask = nullptr;
+}
+
+void WorkerPool::WorkerLoop()
+{
+    unsigned lastJob = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mJobAvailable.wait(lock, [&] { return mShutdown || mJob != lastJob; });
+            if (mShutdown)
+                return;
+            lastJob = mJob;
+        }
+
+        RunTasks();
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (--mBusyCount == 0) {
+            mJobDone.notify_one();
+        }
+    }
+}
+
+void WorkerPool::RunTasks()
+{
+    for (size_t i = mNextTask++; i < mTaskCount; i = mNextTask++) {
+        (*mTask)(i);
+    }
+}
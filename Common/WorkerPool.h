@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads kept alive to run the tasks of one job at a time alongside the calling thread, for
+// work done every frame that is too short to start threads for.  Tasks are numbered and taken in
+// any order by any thread, so jobs whose tasks write only their own outputs give the same result
+// whatever the thread count.  Portable so the tools can measure what uses it.
+class WorkerPool
+{
+public:
+    // threadCount counts the calling thread; 0 uses every core.
+    explicit WorkerPool(unsigned threadCount = 0);
+    WorkerPool(const WorkerPool &rhs) = delete;
+    WorkerPool &operator=(const WorkerPool &rhs) = delete;
+    ~WorkerPool();
+
+    unsigned GetThreadCount() const { return unsigned(mWorkers.size()) + 1; }
+
+    // Calls task(i) for every i below taskCount and returns once all calls have returned.  Not
+    // reentrant: tasks must not call Run.
+    void Run(size_t taskCount, const std::function<void(size_t)> &task);
+
+private:
+    void WorkerLoop();
+    void RunTasks();
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    std::condition_variable mJobDone;
+
+    // The job being run, and the number that bumps for each new one.
+    const std::function<void(size_t)> *mTask = nullptr;
+    size_t mTaskCount = 0;
+    std::atomic<size_t> mNextTask{0};
+    unsigned mJob = 0;
+    // Workers still taking tasks of the current job.
+    unsigned mBusyCount = 0;
+
+    bool mShutdown = false;
+    std::vector<std::thread> mWorkers;
+};
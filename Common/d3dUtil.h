@@ -28,6 +28,7 @@
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
+#include "MeshletBuilder.h"
 
 extern const int gNumFrameResources;
 
@@ -155,6 +156,15 @@ struct SubmeshGeometry
     // Bounding box of the geometry defined by this submesh. 
     // This is used in later chapters of the book.
     DirectX::BoundingBox Bounds;
+
+    // Clusters of the submesh's triangles, their indices relative to StartIndexLocation.  They
+    // index a copy of the triangles in meshlet order, which may lie past IndexCount so that full
+    // draws keep their cache order.  Empty unless MeshletBuilder ordered such a copy.
+    std::vector<MeshletBuilder::Meshlet> Meshlets;
+
+    // For a level of detail, the furthest its surface strays from the full mesh's, in object
+    // units.
+    float SimplificationError = 0.0f;
 };
 
 struct MeshGeometry
@@ -173,11 +183,22 @@ struct MeshGeometry
     Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
     Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
 
+    // The vertices' positions alone, in the vertex buffer's encoding, for passes that need
+    // nothing else.  Null unless the geometry is drawn by such a pass.
+    Microsoft::WRL::ComPtr<ID3D12Resource> PositionBufferGPU = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> PositionBufferUploader = nullptr;
+
     // Data about the buffers.
     UINT VertexByteStride = 0;
     UINT VertexBufferByteSize = 0;
     DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
     UINT IndexBufferByteSize = 0;
+    UINT PositionByteStride = 0;
+    UINT PositionBufferByteSize = 0;
+
+    // The vertices are VertexQuantizer::QuantizedVertex, each submesh's positions relative to
+    // its Bounds.
+    bool Quantized = false;
 
     // A MeshGeometry may store multiple geometries in one vertex/index buffer.
     // Use this container to define the Submesh geometries so we can draw
@@ -194,6 +215,16 @@ struct MeshGeometry
         return vbv;
     }
 
+    D3D12_VERTEX_BUFFER_VIEW PositionBufferView()const
+    {
+        D3D12_VERTEX_BUFFER_VIEW vbv;
+        vbv.BufferLocation = PositionBufferGPU->GetGPUVirtualAddress();
+        vbv.StrideInBytes = PositionByteStride;
+        vbv.SizeInBytes = PositionBufferByteSize;
+
+        return vbv;
+    }
+
     D3D12_INDEX_BUFFER_VIEW IndexBufferView()const
     {
         D3D12_INDEX_BUFFER_VIEW ibv;
@@ -209,6 +240,7 @@ struct MeshGeometry
     {
         VertexBufferUploader = nullptr;
         IndexBufferUploader = nullptr;
+        PositionBufferUploader = nullptr;
     }
 };
 
@@ -275,6 +307,16 @@ struct Texture
 
     std::wstring Filename;
 
+    // What the texture's slices hold, which decides how the streamer block compresses it: colour
+    // to BC1 or BC3, tangent space normals to BC5 (x and y only), and a mix of both not at all.
+    enum class Content
+    {
+        Color,
+        NormalMap,
+        Mixed,
+    };
+    Content Contents = Content::Color;
+
     Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
     Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
 };
@@ -14,9 +14,31 @@ FrameResource::FrameResource(
 
     materialBuffer = std::make_unique<UploadBuffer<MaterialData>>(device, materialCount, false);
     instanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(device, objectCount, false);
+    visibleInstanceBuffer = std::make_unique<UploadBuffer<UINT>>(device, objectCount, false);
+    instanceUsage.capacity = instanceUsage.highWater = objectCount;
+    materialUsage.capacity = materialUsage.highWater = materialCount;
 
     wavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertexCount, false);
 
 }
 
 FrameResource::~FrameResource() {}
+
+bool FrameResource::ReserveInstances(ID3D12Device *device, UINT count)
+{
+    UINT capacity = GrowCapacity(instanceUsage, count);
+    if (capacity == 0)
+        return false;
+    instanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(device, capacity, false);
+    visibleInstanceBuffer = std::make_unique<UploadBuffer<UINT>>(device, capacity, false);
+    return true;
+}
+
+bool FrameResource::ReserveMaterials(ID3D12Device *device, UINT count)
+{
+    UINT capacity = GrowCapacity(materialUsage, count);
+    if (capacity == 0)
+        return false;
+    materialBuffer = std::make_unique<UploadBuffer<MaterialData>>(device, capacity, false);
+    return true;
+}
@@ -1,19 +1,35 @@
 #pragma once
 
+#include "../Common/BufferUsage.h"
 #include "../Common/MathHelper.h"
 #include "../Common/UploadBuffer.h"
 #include "FrameResource.h"
 
+#include <cstddef>
+
+// An instance as the shaders read it, 64 bytes.  The world matrix keeps the rows of its
+// transpose, its last column (0, 0, 0, 1) dropped; the texture transform only what moves 2D
+// texture coordinates, the first two entries of its rows 0, 1 and 3, as halves, low half first.
+// The material index takes the low kMaterialIndexBits of materialAndFlags, the instance's flags
+// the rest.
 struct InstanceData
 {
-    DirectX::XMFLOAT4X4 world = MathHelper::Identity4x4();
-    DirectX::XMFLOAT4X4 texTransform = MathHelper::Identity4x4();
-    UINT materialIndex;
-    UINT objPad0;
-    UINT objPad1;
-    UINT objPad2;
+    static const UINT kMaterialIndexBits = 16;
+
+    float world[3][4] = {
+        {1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}};
+    UINT texTransform[3] = {0x00003c00, 0x3c000000, 0x00000000};
+    UINT materialAndFlags = 0;
 };
 
+// Structured buffer elements are packed without padding, so every field sits where the shaders'
+// float3x4, uint3 and uint follow one another.
+static_assert(sizeof(InstanceData) == 64, "InstanceData must match Common.hlsl");
+static_assert(offsetof(InstanceData, world) == 0, "InstanceData must match Common.hlsl");
+static_assert(offsetof(InstanceData, texTransform) == 48, "InstanceData must match Common.hlsl");
+static_assert(offsetof(InstanceData, materialAndFlags) == 60,
+              "InstanceData must match Common.hlsl");
+
 struct PassConstants
 {
     DirectX::XMFLOAT4X4 view = MathHelper::Identity4x4();
@@ -77,8 +93,9 @@ struct MaterialData
 
     INT diffuseMapIndex = 0;
     INT normalMapIndex = 0;
-    UINT materialPad1;
-    UINT materialPad2;
+    // Slice of the texture array each map lives in.
+    UINT diffuseMapSlice = 0;
+    UINT normalMapSlice = 0;
 };
 
 struct FrameResource
@@ -95,11 +112,26 @@ public:
     FrameResource &operator=(const FrameResource &rhs) = delete;
     ~FrameResource();
 
+    // Make room for count instances or materials, replacing the buffers with larger ones, as
+    // GrowCapacity sizes them, when they are too small.  The old buffers are released at once,
+    // so call only once the frame's fence has passed.  Returns whether the buffers were
+    // replaced, and their contents lost; they are bound by address as each frame is drawn, so
+    // there are no descriptors to update.
+    bool ReserveInstances(ID3D12Device *device, UINT count);
+    bool ReserveMaterials(ID3D12Device *device, UINT count);
+
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> cmdListAlloc;
 
     std::unique_ptr<UploadBuffer<PassConstants>> passCB = nullptr;
     std::unique_ptr<UploadBuffer<MaterialData>> materialBuffer = nullptr;
+    // A slot per instance, written only when the instance changes, and the slots of the
+    // instances drawn this frame, render item after render item.
     std::unique_ptr<UploadBuffer<InstanceData>> instanceBuffer = nullptr;
+    std::unique_ptr<UploadBuffer<UINT>> visibleInstanceBuffer = nullptr;
+    BufferUsage instanceUsage;
+    // The scene store generation instanceBuffer's slots were last brought up to date at.
+    uint32_t instanceGeneration = 0;
+    BufferUsage materialUsage;
 
     std::unique_ptr<UploadBuffer<Vertex>> wavesVB = nullptr;
 
@@ -1,5 +1,9 @@
+#include <algorithm>
 #include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <numeric>
 
 #include "../Common/DDSTextureLoader.h"
 #include "../Common/GeometryGenerator.h"
@@ -9,6 +13,204 @@ const int gNumFrameResources = 3;
 
 const std::string gSkyBoxTexName("skyBoxTex");
 
+// Index ranges an instance drawn in part may take; the smallest runs of culled clusters between
+// them are drawn anyway.
+const size_t gMaxClusterDrawsPerInstance = 8;
+// Share of an instance's indices cluster culling has to drop for the instance to be drawn in
+// part rather than whole with the others.
+const float gMinClusterCulledFraction = 0.1f;
+// Visible instances culled by each task of UpdateInstanceBuffer's worker pool.
+const size_t gCullChunkSize = 256;
+// Scene store flag of the instances the occluders may hide.
+const uint32_t gOcclusionCulledFlag = 1;
+
+// Welds the mesh and reorders it for the post-transform cache, overdraw and vertex fetch. The
+// cache statistics go to the debugger output.
+template <typename VertexType>
+static void OptimizeMesh(const char *name,
+                         std::vector<VertexType> &vertices,
+                         std::vector<std::uint32_t> &indices)
+{
+    auto report = MeshOptimizer::Optimize(vertices, indices);
+
+    char text[256];
+    snprintf(text,
+             sizeof(text),
+             "%s: %zu -> %zu vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+             name,
+             report.vertexCountBefore,
+             report.vertexCountAfter,
+             report.before.acmr,
+             report.after.acmr,
+             report.before.atvr,
+             report.after.atvr);
+    ::OutputDebugStringA(text);
+}
+
+// Encodes the vertices of a static mesh relative to its bounds. The largest encoding errors go
+// to the debugger output.
+template <typename VertexType>
+static std::vector<VertexQuantizer::QuantizedVertex> QuantizeMesh(
+    const char *name, const std::vector<VertexType> &vertices, const BoundingBox &bounds)
+{
+    std::vector<VertexQuantizer::QuantizedVertex> quantized;
+    auto report = VertexQuantizer::Quantize(
+        vertices, &bounds.Center.x, &bounds.Extents.x, quantized);
+
+    char text[256];
+    snprintf(text,
+             sizeof(text),
+             "%s: %zu vertices quantized from %zu to %zu bytes, max error position %.6f, normal "
+             "%.3f deg, tangent %.3f deg, texCoord %.6f\n",
+             name,
+             vertices.size(),
+             sizeof(VertexType),
+             sizeof(VertexQuantizer::QuantizedVertex),
+             report.position,
+             report.normal,
+             report.tangent,
+             report.texCoord);
+    ::OutputDebugStringA(text);
+    return quantized;
+}
+
+// One of VertexQuantizer's layout tables as a D3D12 input layout, all in slot 0.
+template <size_t N>
+static std::vector<D3D12_INPUT_ELEMENT_DESC> MakeInputLayout(
+    const VertexQuantizer::InputElement (&elements)[N])
+{
+    std::vector<D3D12_INPUT_ELEMENT_DESC> layout;
+    for (const auto &element : elements) {
+        layout.push_back({element.semantic,
+                          0,
+                          (DXGI_FORMAT) element.format,
+                          0,
+                          element.offset,
+                          D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
+                          0});
+    }
+    return layout;
+}
+
+// Copies the positions, the leading positionByteSize bytes of each vertex, into geo's position
+// buffer.
+static void CreatePositionBuffer(ID3D12Device *device,
+                                 ID3D12GraphicsCommandList *cmdList,
+                                 const void *vertices,
+                                 UINT vertexCount,
+                                 UINT vertexByteStride,
+                                 UINT positionByteSize,
+                                 MeshGeometry &geo)
+{
+    auto positions = VertexQuantizer::ExtractPositions(
+        vertices, vertexCount, vertexByteStride, positionByteSize);
+
+    geo.PositionByteStride = positionByteSize;
+    geo.PositionBufferByteSize = (UINT) positions.size();
+    geo.PositionBufferGPU = d3dUtil::CreateDefaultBuffer(
+        device, cmdList, positions.data(), positions.size(), geo.PositionBufferUploader);
+}
+
+// The scene store and the transform hierarchy keep matrices laid out as XMFLOAT4X4s.
+template <typename Matrix>
+static XMMATRIX LoadMatrix(const Matrix &matrix)
+{
+    static_assert(sizeof(Matrix) == sizeof(XMFLOAT4X4), "Matrix must be laid out as XMFLOAT4X4");
+    return XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4 *>(&matrix));
+}
+
+template <typename Matrix>
+static Matrix StoreMatrix(FXMMATRIX matrix)
+{
+    static_assert(sizeof(Matrix) == sizeof(XMFLOAT4X4), "Matrix must be laid out as XMFLOAT4X4");
+    Matrix stored;
+    XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4 *>(&stored), matrix);
+    return stored;
+}
+
+// The world matrix transposed with its last column dropped, the texture transform reduced to the
+// 2D affine part as halves, and the material index and flags sharing a word, as Common.hlsl
+// reads them.
+static InstanceData PackInstance(const SceneStore::Store &scene, uint32_t instance)
+{
+    InstanceData data;
+    auto worldTranspose
+        = StoreMatrix<XMFLOAT4X4>(XMMatrixTranspose(LoadMatrix(scene.worlds[instance])));
+    std::memcpy(data.world, worldTranspose.m, sizeof(data.world));
+
+    const auto &tex = scene.texTransforms[instance].m;
+    const int rows[3] = {0, 1, 3};
+    for (int i = 0; i < 3; ++i) {
+        data.texTransform[i] = UINT(XMConvertFloatToHalf(tex[rows[i]][0]))
+                               | UINT(XMConvertFloatToHalf(tex[rows[i]][1])) << 16;
+    }
+    UINT materialIndex = scene.materialIndices[instance];
+    assert(materialIndex < 1u << InstanceData::kMaterialIndexBits);
+    data.materialAndFlags = materialIndex
+                            | scene.flags[instance] << InstanceData::kMaterialIndexBits;
+    return data;
+}
+
+// Collects the index ranges of the clusters that face eye and, unless frustum is null, intersect
+// it; both are in the mesh's local space.  Returns the number of culled indices.
+static UINT CullClusters(const std::vector<MeshletBuilder::Meshlet> &meshlets,
+                         const BoundingFrustum *frustum,
+                         const XMFLOAT3 &eye,
+                         std::vector<ClusterDraw> &draws)
+{
+    const float eyePos[3] = {eye.x, eye.y, eye.z};
+    UINT culledIndexCount = 0;
+    for (const auto &meshlet : meshlets) {
+        bool visible = !MeshletBuilder::IsBackfacing(meshlet, eyePos);
+        if (visible && frustum != nullptr) {
+            visible = frustum->Intersects(BoundingSphere(XMFLOAT3(meshlet.center), meshlet.radius));
+        }
+        if (!visible) {
+            culledIndexCount += meshlet.indexCount;
+            continue;
+        }
+
+        auto *last = draws.empty() ? nullptr : &draws.back();
+        if (last != nullptr && last->startIndex + last->indexCount == meshlet.startIndex) {
+            last->indexCount += meshlet.indexCount;
+        } else {
+            draws.push_back({0, meshlet.startIndex, meshlet.indexCount});
+        }
+    }
+
+    if (draws.size() > gMaxClusterDrawsPerInstance) {
+        // Keep the largest gaps and draw across the others.
+        std::vector<UINT> gapSizes(draws.size() - 1);
+        for (size_t i = 0; i < gapSizes.size(); ++i) {
+            gapSizes[i] = draws[i + 1].startIndex - (draws[i].startIndex + draws[i].indexCount);
+        }
+        std::vector<size_t> gaps(gapSizes.size());
+        std::iota(gaps.begin(), gaps.end(), size_t(0));
+        std::nth_element(gaps.begin(),
+                         gaps.begin() + (gMaxClusterDrawsPerInstance - 1),
+                         gaps.end(),
+                         [&](size_t a, size_t b) { return gapSizes[a] > gapSizes[b]; });
+        std::vector<bool> keepGap(gaps.size(), false);
+        for (size_t i = 0; i < gMaxClusterDrawsPerInstance - 1; ++i) {
+            keepGap[gaps[i]] = true;
+        }
+
+        size_t count = 0;
+        for (size_t i = 0; i < draws.size(); ++i) {
+            if (i > 0 && !keepGap[i - 1]) {
+                auto &merged = draws[count - 1];
+                culledIndexCount -= gapSizes[i - 1];
+                merged.indexCount = draws[i].startIndex + draws[i].indexCount - merged.startIndex;
+            } else {
+                draws[count++] = draws[i];
+            }
+        }
+        draws.resize(count);
+    }
+
+    return culledIndexCount;
+}
+
 LandAndWavesApp::LandAndWavesApp(HINSTANCE hInstance)
     : D3DApp(hInstance)
 {}
@@ -34,6 +236,7 @@ bool LandAndWavesApp::Initialize()
     //BuildTreeSpritesGeometry();
 
     BuildRenderItems();
+    BuildScene();
     BuildFrameResources();
 
     BuildRootSignature();
@@ -59,6 +262,9 @@ void LandAndWavesApp::OnResize()
     mCamera.SetLens(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
 
     BoundingFrustum::CreateFromMatrix(mCamFrustum, mCamera.GetProj());
+
+    // The levels of detail depend on the height in pixels.
+    mInstanceBufferFramesDirty = gNumFrameResources;
 }
 
 void LandAndWavesApp::Update(const GameTimer &gt)
@@ -76,9 +282,13 @@ void LandAndWavesApp::Update(const GameTimer &gt)
         CloseHandle(eventHandle);
     }
 
+    mTextureStreamer->ReleaseUploadHeaps(mFence->GetCompletedValue());
+
     // 
     AnimateMaterials(gt);
+    UpdateTransforms();
     UpdateInstanceBuffer(gt);
+    UpdateTexturePriorities();
     UpdateMainPassCB(gt);
     UpdateWaves(gt);
     UpdateMaterialBuffer(gt);
@@ -96,6 +306,12 @@ void LandAndWavesApp::Draw(const GameTimer &gt)
         ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
     }
 
+    // Upload the textures the streamer has finished reading. Their SRVs are written now, but
+    // materials only switch over to them from the next frame's material buffer.
+    for (auto texture : mTextureStreamer->FlushUploads(mCommandList.Get(), mCurrentFence + 1)) {
+        OnTextureChanged(texture);
+    }
+
     mCommandList->RSSetViewports(1, &mScreenViewport);
     mCommandList->RSSetScissorRects(1, &mScissorRect);
 
@@ -120,17 +336,23 @@ void LandAndWavesApp::Draw(const GameTimer &gt)
     auto curPasssResource = mCurrFrameResource->passCB->Resource();
     mCommandList->SetGraphicsRootShaderResourceView(
         1, mCurrFrameResource->materialBuffer->Resource()->GetGPUVirtualAddress());
+    mCommandList->SetGraphicsRootShaderResourceView(
+        6, mCurrFrameResource->instanceBuffer->Resource()->GetGPUVirtualAddress());
     mCommandList->SetGraphicsRootConstantBufferView(2, curPasssResource->GetGPUVirtualAddress());
     
+    CD3DX12_GPU_DESCRIPTOR_HANDLE skyHandle(mSRVDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+    skyHandle.Offset(mCurrentSrvSlot[0], mCbvSrvUavDescriptorSize);
+    mCommandList->SetGraphicsRootDescriptorTable(3, skyHandle);
+
     CD3DX12_GPU_DESCRIPTOR_HANDLE srvHandle(mSRVDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-    mCommandList->SetGraphicsRootDescriptorTable(3, srvHandle);
     mCommandList->SetGraphicsRootDescriptorTable(4, srvHandle.Offset(1, mCbvSrvUavDescriptorSize));
 
     // ȻƲ͸
-    DrawRenderItems(mCommandList.Get(), mRenderItemLayer[int(RenderLayer::Opaque)]);
+    mStateChangeCount = 0;
+    DrawRenderItems(
+        mCommandList.Get(), RenderLayer::Opaque, mIsWireframe ? "opaque_wireframe" : "opaque");
 
-    mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItemLayer[int(RenderLayer::AlphaTested)]);
+    DrawRenderItems(mCommandList.Get(), RenderLayer::AlphaTested, "alphaTested");
 
     // tree sprite
     /*mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
@@ -138,29 +360,24 @@ void LandAndWavesApp::Draw(const GameTimer &gt)
 
     // ģ建пɼľرΪ1
     mCommandList->OMSetStencilRef(1);
-    mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItemLayer[int(RenderLayer::Mirrors)]);
+    DrawRenderItems(mCommandList.Get(), RenderLayer::Mirrors, "markStencilMirrors");
 
     // ֻƾӷΧڵľ񣨼ģ建бΪ1أ
     // עǱʹȾ̳һ洢徵һվ
     UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
     mCommandList->SetGraphicsRootConstantBufferView(
         2, curPasssResource->GetGPUVirtualAddress() + 1 * passCBByteSize);
-    mCommandList->SetPipelineState(mPSOs["drawStencilReflections"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItemLayer[int(RenderLayer::Reflected)]);
+    DrawRenderItems(mCommandList.Get(), RenderLayer::Reflected, "drawStencilReflections");
 
     mCommandList->SetGraphicsRootConstantBufferView(2, curPasssResource->GetGPUVirtualAddress());
     mCommandList->OMSetStencilRef(0);
 
     // ͸ľ棬ʹ֮ں
-    mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItemLayer[int(RenderLayer::Transparent)]);
+    DrawRenderItems(mCommandList.Get(), RenderLayer::Transparent, "transparent");
 
-    mCommandList->SetPipelineState(mPSOs["shadow"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItemLayer[int(RenderLayer::Shadow)]);
+    DrawRenderItems(mCommandList.Get(), RenderLayer::Shadow, "shadow");
 
-    mCommandList->SetPipelineState(mPSOs["sky"].Get());
-    DrawRenderItems(mCommandList.Get(), mRenderItemLayer[(int) RenderLayer::Sky]);
+    DrawRenderItems(mCommandList.Get(), RenderLayer::Sky, "sky");
 
     // Դ;ָʾ״̬ת, ˴ԴȾĿ״̬תΪ״̬
     auto resourceBarrierRenderTargetToPresent = CD3DX12_RESOURCE_BARRIER::Transition(
@@ -218,11 +435,68 @@ void LandAndWavesApp::OnKeyboardInput(const GameTimer &gt)
     else
         mIsWireframe = false;
 
-    if (GetAsyncKeyState('2') & 0x8000)
+    if (GetAsyncKeyState('2') & 0x8000) {
         mFrustumCullingEnabled = true;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
 
-    if (GetAsyncKeyState('3') & 0x8000)
+    if (GetAsyncKeyState('3') & 0x8000) {
         mFrustumCullingEnabled = false;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
+
+    if (GetAsyncKeyState('4') & 0x8000) {
+        mClusterCullingEnabled = true;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
+
+    if (GetAsyncKeyState('5') & 0x8000) {
+        mClusterCullingEnabled = false;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
+
+    if (GetAsyncKeyState('6') & 0x8000) {
+        mLodEnabled = true;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
+
+    if (GetAsyncKeyState('7') & 0x8000) {
+        mLodEnabled = false;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
+
+    if (GetAsyncKeyState('8') & 0x8000) {
+        mOcclusionCullingEnabled = true;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
+
+    if (GetAsyncKeyState('9') & 0x8000) {
+        mOcclusionCullingEnabled = false;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
+
+    // [ and ] halve or double the level of detail error allowed per second held, - and = the
+    // screen area below which instances are dropped.
+    float scale = exp2f(gt.DeltaTime());
+    if (GetAsyncKeyState(VK_OEM_4) & 0x8000) {
+        mMaxLodPixelError /= scale;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
+
+    if (GetAsyncKeyState(VK_OEM_6) & 0x8000) {
+        mMaxLodPixelError *= scale;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
+
+    if (GetAsyncKeyState(VK_OEM_MINUS) & 0x8000) {
+        mMinScreenArea /= scale;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
+
+    if (GetAsyncKeyState(VK_OEM_PLUS) & 0x8000) {
+        mMinScreenArea *= scale;
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
 
     const float dt = gt.DeltaTime();
     if (GetAsyncKeyState(VK_LEFT) & 0x8000 || GetAsyncKeyState('A') & 0x8000) {
@@ -274,23 +548,17 @@ void LandAndWavesApp::ChangeSkullTranslation(const GameTimer &gt)
     XMMATRIX skullOffset
         = XMMatrixTranslation(mSkullTranslation.x, mSkullTranslation.y, mSkullTranslation.z);
     XMMATRIX skullWorld = skullRotate * skullScale * skullOffset;
-    XMStoreFloat4x4(&mSkullRenderItem->instances[0].world, skullWorld);
+    TransformHierarchy::SetLocal(
+        mTransforms, mSkullNode, StoreMatrix<TransformHierarchy::Matrix>(skullWorld));
 
-    // Update reflection world matrix.
-    XMVECTOR mirrorPlane = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane
-    XMMATRIX R = XMMatrixReflect(mirrorPlane);
-    XMStoreFloat4x4(&mReflectedSkullRenderItem->instances[0].world, skullWorld * R);
-
-    // Update shadow world matrix.
+    // The reflection follows the skull by itself; the shadow's projection follows the light.
     XMVECTOR shadowPlane = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f); // xz plane
     XMVECTOR toMainLight = -XMLoadFloat3(&mMainPassCB.lights[0].Direction);
     XMMATRIX S = XMMatrixShadow(shadowPlane, toMainLight);
     XMMATRIX shadowOffsetY = XMMatrixTranslation(0.0f, 0.001f, 0.0f);
-    XMStoreFloat4x4(&mShadowedSkullRenderItem->instances[0].world, skullWorld * S * shadowOffsetY);
-
-    mSkullRenderItem->numFramesDirty = gNumFrameResources;
-    mReflectedSkullRenderItem->numFramesDirty = gNumFrameResources;
-    mShadowedSkullRenderItem->numFramesDirty = gNumFrameResources;
+    TransformHierarchy::SetLocal(mTransforms,
+                                 mShadowedSkullNode,
+                                 StoreMatrix<TransformHierarchy::Matrix>(S * shadowOffsetY));
 }
 
 void LandAndWavesApp::AnimateMaterials(const GameTimer &gt)
@@ -333,52 +601,412 @@ void LandAndWavesApp::AnimateMaterials(const GameTimer &gt)
 //    XMStoreFloat4x4(&mView, view);
 //}
 
+void LandAndWavesApp::UpdateInstanceBounds()
+{
+    // The instances moved, added or renumbered since the last frame get their world bounds
+    // from their render item's box.
+    std::vector<uint32_t> moved;
+    SceneStore::TakeMoved(mScene, moved);
+    for (uint32_t instance : moved) {
+        const auto &box = mAllRenderItems[mScene.meshes[instance]]->boundingBox;
+        const FrustumCuller::Box localBox = {{box.Center.x, box.Center.y, box.Center.z},
+                                             {box.Extents.x, box.Extents.y, box.Extents.z}};
+        mScene.bounds.Set(instance,
+                          FrustumCuller::TransformBox(localBox, &mScene.worlds[instance].m[0][0]));
+    }
+
+    size_t instanceCount = SceneStore::Size(mScene);
+    mInstanceLodLevels.resize(instanceCount);
+    // Added instances join the hierarchy as new leaves; removing one renumbers another, which
+    // only a build follows.
+    if (instanceCount < mInstanceBvh.instances.size()) {
+        InstanceBvh::Build(mScene.bounds, mInstanceBvh);
+    } else if (!moved.empty()) {
+        InstanceBvh::Insert(mInstanceBvh, mScene.bounds);
+        InstanceBvh::Refit(mInstanceBvh, mScene.bounds, moved.data(), moved.size());
+    }
+}
+
 void LandAndWavesApp::UpdateInstanceBuffer(const GameTimer &gt)
 {
     auto view = mCamera.GetView();
     auto invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+    auto eyePos = mCamera.GetPosition();
+
+    // The instances not outside the frustum, from the hierarchy, culled again only as far as
+    // the camera or the instances moved.
+    XMFLOAT4X4 viewProj;
+    XMStoreFloat4x4(&viewProj, XMMatrixMultiply(view, mCamera.GetProj()));
+    UpdateInstanceBounds();
+
+    // Instances may be added at any time; the frame resource's buffers grow to hold them now
+    // that the GPU is done with them, and everything they held is written again.
+    auto instanceCount = (UINT) SceneStore::Size(mScene);
+    bool reallocated = mCurrFrameResource->ReserveInstances(md3dDevice.Get(), instanceCount);
+    if (reallocated) {
+        mInstanceBufferFramesDirty = gNumFrameResources;
+    }
 
+    // Every instance keeps its slot, numbered as in the scene store, in each frame resource's
+    // instance buffer; only those that moved since that buffer was last used are written again.
     auto currInstanceBuffer = mCurrFrameResource->instanceBuffer.get();
-    auto allVisibleCount = 0;
-    for (auto &item : mAllRenderItems) {
-        auto currItemVisibleInstanceCount = 0;
-        item->objCBIndex = allVisibleCount;
-        for (const auto &instance : item->instances) {
-            InstanceData objConstans;
-            auto world = XMLoadFloat4x4(&instance.world);
-            auto texTransform = XMLoadFloat4x4(&instance.texTransform);
-
-            auto invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
-
-            // ɹ۲ռ䵽ֲı任
-            auto viewToLocal = XMMatrixMultiply(invView, invWorld);
-
-            // ׶ɹ۲ռ任ľֲռ
-            BoundingFrustum localSpaceFrustum;
-            mCamFrustum.Transform(localSpaceFrustum, viewToLocal);
-            if (!mFrustumCullingEnabled
-                || localSpaceFrustum.Contains(item->boundingBox) != DirectX::DISJOINT) {
-                XMStoreFloat4x4(&objConstans.world, XMMatrixTranspose(world));
-                XMStoreFloat4x4(&objConstans.texTransform, XMMatrixTranspose(texTransform));
-                objConstans.materialIndex = instance.materialIndex;
-
-                currInstanceBuffer
-                    ->CopyData(item->objCBIndex + currItemVisibleInstanceCount++, objConstans);
+    mCurrFrameResource->instanceGeneration = SceneStore::WriteStale(
+        mScene, mCurrFrameResource->instanceGeneration, reallocated, [&](uint32_t i) {
+            currInstanceBuffer->CopyData(i, PackInstance(mScene, i));
+        });
+
+    std::vector<InstanceBvh::VisibleInstance> visible;
+    if (mFrustumCullingEnabled) {
+        auto stats = VisibilityCache::Update(mVisibilityCache,
+                                             mInstanceBvh,
+                                             &viewProj.m[0][0],
+                                             mScene.movedGenerations.data(),
+                                             mScene.generation);
+        if (stats.fullCull || stats.retested > 0) {
+            mInstanceBufferFramesDirty = gNumFrameResources;
+        }
+    } else {
+        VisibilityCache::Invalidate(mVisibilityCache);
+        mInstanceBufferFramesDirty = gNumFrameResources;
+        visible.resize(instanceCount);
+        for (uint32_t i = 0; i < (uint32_t) visible.size(); ++i) {
+            visible[i] = {i, FrustumCuller::kInside};
+        }
+    }
+
+    // Nothing the instances drawn depend on has changed for as many frames as there are frame
+    // resources, so the current one's visible list already holds them, and the render items'
+    // counts and cluster draws are still right.
+    if (mInstanceBufferFramesDirty == 0)
+        return;
+    --mInstanceBufferFramesDirty;
+
+    if (mFrustumCullingEnabled) {
+        visible = mVisibilityCache.visible;
+    }
+
+    // Less those the occluders hide, drawn into the CPU depth buffer across the workers.
+    size_t occludedCount = 0;
+    if (mOcclusionCullingEnabled) {
+        OcclusionCuller::Render(mOcclusionBuffer,
+                                &viewProj.m[0][0],
+                                mOccluders.data(),
+                                mOccluders.size(),
+                                &mCullWorkers);
+
+        // The boxes are tested in chunks of gCullChunkSize across the workers, then the visible
+        // ones are kept in order.
+        std::vector<uint8_t> occluded(visible.size());
+        size_t chunkCount = (visible.size() + gCullChunkSize - 1) / gCullChunkSize;
+        mCullWorkers.Run(chunkCount, [&](size_t chunkIndex) {
+            size_t begin = chunkIndex * gCullChunkSize;
+            size_t end = std::min(begin + gCullChunkSize, visible.size());
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t instance = visible[i].instance;
+                occluded[i] = (mScene.flags[instance] & gOcclusionCulledFlag) != 0
+                              && !OcclusionCuller::IsVisible(mOcclusionBuffer,
+                                                             &viewProj.m[0][0],
+                                                             mScene.bounds.Get(instance));
+            }
+        });
+        size_t keptCount = 0;
+        for (size_t i = 0; i < visible.size(); ++i) {
+            if (!occluded[i]) {
+                visible[keptCount++] = visible[i];
             }
         }
+        occludedCount = visible.size() - keptCount;
+        visible.resize(keptCount);
+    }
+
+    // Grouped by render item.
+    mMaterialScreenSize.assign(mMaterials.size(), 0.0f);
+    std::vector<size_t> itemVisibleStarts(mAllRenderItems.size() + 1, 0);
+    for (const auto &visibleInstance : visible) {
+        ++itemVisibleStarts[mScene.meshes[visibleInstance.instance] + 1];
+    }
+    std::partial_sum(
+        itemVisibleStarts.begin(), itemVisibleStarts.end(), itemVisibleStarts.begin());
+    std::vector<InstanceBvh::VisibleInstance> itemVisible(visible.size());
+    auto itemVisibleEnds = itemVisibleStarts;
+    for (const auto &visibleInstance : visible) {
+        itemVisible[itemVisibleEnds[mScene.meshes[visibleInstance.instance]]++]
+            = visibleInstance;
+    }
+
+    // The visible instances are split into chunks of gCullChunkSize whatever the thread count.
+    // Each render item's instances fall into buckets, laid out in the visible list in order:
+    // drawn whole, at each coarser level of detail, then drawn in part.  A first pass picks each
+    // instance's bucket and counts the chunk's, the counts' prefix sums give every chunk where
+    // its instances of each bucket go, and a second pass writes them there in visible order, so
+    // the buffer comes out the same however many threads fill it.
+    std::vector<UINT> itemFirstBuckets(mAllRenderItems.size() + 1, 0);
+    for (size_t itemIndex = 0; itemIndex < mAllRenderItems.size(); ++itemIndex) {
+        itemFirstBuckets[itemIndex + 1] = itemFirstBuckets[itemIndex]
+                                          + (UINT) mAllRenderItems[itemIndex]->lods.size() + 2;
+    }
+    mCullChunks.resize((itemVisible.size() + gCullChunkSize - 1) / gCullChunkSize);
+    float pixelsPerUnitAtUnitDistance = mClientHeight / (2.0f * tanf(0.5f * mCamera.GetFovY()));
+    mCullWorkers.Run(mCullChunks.size(), [&](size_t chunkIndex) {
+        auto &chunk = mCullChunks[chunkIndex];
+        size_t begin = chunkIndex * gCullChunkSize;
+        size_t end = std::min(begin + gCullChunkSize, itemVisible.size());
+        UINT lastItemIndex = mScene.meshes[itemVisible[end - 1].instance];
+        chunk.firstBucket = itemFirstBuckets[mScene.meshes[itemVisible[begin].instance]];
+        chunk.bucketCounts.assign(itemFirstBuckets[lastItemIndex + 1] - chunk.firstBucket, 0);
+        chunk.clusterDrawCounts.assign(chunk.bucketCounts.size(), 0);
+        chunk.buckets.resize(end - begin);
+        chunk.clusterDraws.clear();
+        chunk.drawnIndexCount = 0;
+        chunk.tooSmallCount = 0;
+        chunk.materialScreenSize.assign(mMaterials.size(), 0.0f);
+        chunk.itemNearest.assign(mAllRenderItems.size(), MathHelper::Infinity);
+        chunk.itemFarthest.assign(mAllRenderItems.size(), 0.0f);
+
+        std::vector<ClusterDraw> clusterRanges;
+        for (size_t v = begin; v < end; ++v) {
+            uint32_t instance = itemVisible[v].instance;
+            UINT itemIndex = mScene.meshes[instance];
+            const auto &item = mAllRenderItems[itemIndex];
+            auto containment = itemVisible[v].containment;
+            auto world = LoadMatrix(mScene.worlds[instance]);
+            chunk.buckets[v - begin] = CullChunk::kCulled;
+
+            BoundingSphere worldSphere;
+            BoundingSphere::CreateFromBoundingBox(worldSphere, item->boundingBox);
+            float localRadius = worldSphere.Radius;
+            worldSphere.Transform(worldSphere, world);
+            float distance = XMVectorGetX(
+                XMVector3Length(XMLoadFloat3(&worldSphere.Center) - eyePos));
+
+            // Instances whose bounding sphere covers less than mMinScreenArea pixels add too
+            // little to the image to be drawn.
+            float screenRadius = worldSphere.Radius * pixelsPerUnitAtUnitDistance
+                                 / MathHelper::Max(distance, mCamera.GetNearZ());
+            if (MathHelper::Pi * screenRadius * screenRadius < mMinScreenArea) {
+                ++chunk.tooSmallCount;
+                continue;
+            }
 
-        item->instanceCount = currItemVisibleInstanceCount;
-        allVisibleCount += currItemVisibleInstanceCount;
+            // The coarsest level of detail whose error, projected at the nearest point of the
+            // bounding sphere, stays under mMaxLodPixelError, held within mLodHysteresis of it.
+            auto &lodLevel = mInstanceLodLevels[instance];
+            size_t level = 0;
+            if (mLodEnabled && !item->lods.empty() && localRadius > 0.0f) {
+                float worldScale = worldSphere.Radius / localRadius;
+                float nearest
+                    = MathHelper::Max(distance - worldSphere.Radius, mCamera.GetNearZ());
+                float pixelsPerUnit = pixelsPerUnitAtUnitDistance / nearest;
+                level = MeshSimplifier::SelectLevel(
+                    item->lods.size(),
+                    [&](size_t i) {
+                        return item->lods[i]->SimplificationError * worldScale * pixelsPerUnit;
+                    },
+                    mMaxLodPixelError,
+                    mLodHysteresis,
+                    lodLevel);
+            }
+            lodLevel = (uint8_t) level;
+
+            // Clusters facing away are culled, and those off screen if the frustum cuts the
+            // instance.  Instances that lose enough are drawn by range after the others.
+            size_t bucket = level;
+            if (level == 0 && mClusterCullingEnabled && item->meshlets != nullptr) {
+                auto invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
+                XMFLOAT3 localEye;
+                XMStoreFloat3(&localEye, XMVector3TransformCoord(eyePos, invWorld));
+
+                // Only instances the frustum cuts test their clusters against it, taken from
+                // view space into the instance's local space.
+                bool inside = containment == FrustumCuller::kInside;
+                BoundingFrustum localSpaceFrustum;
+                if (!inside) {
+                    auto viewToLocal = XMMatrixMultiply(invView, invWorld);
+                    mCamFrustum.Transform(localSpaceFrustum, viewToLocal);
+                }
+
+                clusterRanges.clear();
+                UINT culledIndexCount = CullClusters(*item->meshlets,
+                                                     inside ? nullptr : &localSpaceFrustum,
+                                                     localEye,
+                                                     clusterRanges);
+                if (clusterRanges.empty())
+                    continue;
+                if (culledIndexCount >= gMinClusterCulledFraction * item->indexCount) {
+                    bucket = item->lods.size() + 1;
+                    // Numbered by the instance's place in the chunk until the second pass.
+                    for (auto draw : clusterRanges) {
+                        draw.instance = UINT(v - begin);
+                        chunk.clusterDraws.push_back(draw);
+                        chunk.drawnIndexCount += draw.indexCount;
+                    }
+                }
+            }
+            if (bucket == 0) {
+                chunk.drawnIndexCount += item->indexCount;
+            } else if (bucket <= item->lods.size()) {
+                chunk.drawnIndexCount += item->lods[bucket - 1]->IndexCount;
+            }
+            UINT chunkBucket = itemFirstBuckets[itemIndex] + (UINT) bucket - chunk.firstBucket;
+            chunk.buckets[v - begin] = chunkBucket;
+            ++chunk.bucketCounts[chunkBucket];
+            if (bucket == item->lods.size() + 1) {
+                chunk.clusterDrawCounts[chunkBucket] += (UINT) clusterRanges.size();
+            }
+
+            // Approximate screen size (bounding sphere radius over distance) drives the order
+            // in which the streamer loads this material's textures.
+            float screenSize = worldSphere.Radius / MathHelper::Max(distance, mCamera.GetNearZ());
+
+            auto &materialScreenSize = chunk.materialScreenSize[mScene.materialIndices[instance]];
+            materialScreenSize = MathHelper::Max(materialScreenSize, screenSize);
+
+            auto &itemNearest = chunk.itemNearest[itemIndex];
+            auto &itemFarthest = chunk.itemFarthest[itemIndex];
+            itemNearest = MathHelper::Min(itemNearest, distance);
+            itemFarthest = MathHelper::Max(itemFarthest, distance);
+        }
+    });
+
+    // Totals of every bucket, which give the render items' counts and, summed, where each
+    // bucket starts.
+    std::vector<UINT> bucketStarts(itemFirstBuckets.back(), 0);
+    std::vector<UINT> clusterDrawStarts(itemFirstBuckets.back(), 0);
+    size_t drawnIndexCount = 0;
+    size_t tooSmallCount = 0;
+    std::vector<float> itemNearest(mAllRenderItems.size(), MathHelper::Infinity);
+    std::vector<float> itemFarthest(mAllRenderItems.size(), 0.0f);
+    for (const auto &chunk : mCullChunks) {
+        for (size_t j = 0; j < chunk.bucketCounts.size(); ++j) {
+            bucketStarts[chunk.firstBucket + j] += chunk.bucketCounts[j];
+            clusterDrawStarts[chunk.firstBucket + j] += chunk.clusterDrawCounts[j];
+        }
+        drawnIndexCount += chunk.drawnIndexCount;
+        tooSmallCount += chunk.tooSmallCount;
+        for (size_t i = 0; i < mMaterialScreenSize.size(); ++i) {
+            mMaterialScreenSize[i]
+                = MathHelper::Max(mMaterialScreenSize[i], chunk.materialScreenSize[i]);
+        }
+        for (size_t i = 0; i < mAllRenderItems.size(); ++i) {
+            itemNearest[i] = MathHelper::Min(itemNearest[i], chunk.itemNearest[i]);
+            itemFarthest[i] = MathHelper::Max(itemFarthest[i], chunk.itemFarthest[i]);
+        }
+    }
+    UINT allVisibleCount = 0;
+    size_t clusterDrawCount = 0;
+    for (size_t itemIndex = 0; itemIndex < mAllRenderItems.size(); ++itemIndex) {
+        auto &item = mAllRenderItems[itemIndex];
+        UINT firstBucket = itemFirstBuckets[itemIndex];
+        UINT partialBucket = firstBucket + (UINT) item->lods.size() + 1;
+        item->objCBIndex = allVisibleCount;
+        item->instanceCount = bucketStarts[firstBucket];
+        item->lodInstanceCounts.assign(bucketStarts.begin() + firstBucket + 1,
+                                       bucketStarts.begin() + partialBucket);
+        item->clusterDraws.resize(clusterDrawStarts[partialBucket]);
+        item->nearestDistance = itemNearest[itemIndex];
+        item->farthestDistance = itemFarthest[itemIndex];
+        clusterDrawCount += item->clusterDraws.size();
+        for (UINT bucket = firstBucket; bucket <= partialBucket; ++bucket) {
+            UINT count = bucketStarts[bucket];
+            bucketStarts[bucket] = allVisibleCount;
+            allVisibleCount += count;
+        }
     }
+    std::fill(clusterDrawStarts.begin(), clusterDrawStarts.end(), 0);
+    for (auto &chunk : mCullChunks) {
+        chunk.bucketOffsets.resize(chunk.bucketCounts.size());
+        chunk.clusterDrawOffsets.resize(chunk.bucketCounts.size());
+        for (size_t j = 0; j < chunk.bucketCounts.size(); ++j) {
+            chunk.bucketOffsets[j] = bucketStarts[chunk.firstBucket + j];
+            bucketStarts[chunk.firstBucket + j] += chunk.bucketCounts[j];
+            chunk.clusterDrawOffsets[j] = clusterDrawStarts[chunk.firstBucket + j];
+            clusterDrawStarts[chunk.firstBucket + j] += chunk.clusterDrawCounts[j];
+        }
+    }
+
+    // Each chunk writes the slots of its instances straight to the mapped visible list, and its
+    // cluster draws to their render items, at the places it was given.
+    auto currVisibleInstanceBuffer = mCurrFrameResource->visibleInstanceBuffer.get();
+    mCullWorkers.Run(mCullChunks.size(), [&](size_t chunkIndex) {
+        auto &chunk = mCullChunks[chunkIndex];
+        size_t begin = chunkIndex * gCullChunkSize;
+        size_t nextClusterDraw = 0;
+        for (size_t i = 0; i < chunk.buckets.size(); ++i) {
+            UINT chunkBucket = chunk.buckets[i];
+            if (chunkBucket == CullChunk::kCulled)
+                continue;
+
+            const auto &visibleInstance = itemVisible[begin + i];
+            const auto &item = mAllRenderItems[mScene.meshes[visibleInstance.instance]];
+            UINT index = chunk.bucketOffsets[chunkBucket]++;
+            currVisibleInstanceBuffer->CopyData(index, visibleInstance.instance);
+
+            for (; nextClusterDraw < chunk.clusterDraws.size()
+                   && chunk.clusterDraws[nextClusterDraw].instance == i;
+                 ++nextClusterDraw) {
+                auto draw = chunk.clusterDraws[nextClusterDraw];
+                draw.instance = index - item->objCBIndex;
+                item->clusterDraws[chunk.clusterDrawOffsets[chunkBucket]++] = draw;
+            }
+        }
+    });
+    SortDraws();
 
     std::wostringstream outs;
     outs.precision(6);
-    outs << L"All instance count: " << mAllInstanceDataCount << L"; objects visible count: "
-         << allVisibleCount;
+    outs << L"All instance count: " << SceneStore::Size(mScene) << L"; objects visible count: "
+         << allVisibleCount << L"; occluded: " << occludedCount << L"; too small: "
+         << tooSmallCount << L"; cluster draws: " << clusterDrawCount << L"; triangles: "
+         << drawnIndexCount / 3 << L"; LOD error: " << mMaxLodPixelError
+         << L" px; min area: " << mMinScreenArea << L" px; draws: " << mDraws.size()
+         << L"; state changes: " << mStateChangeCount;
+    const auto &usage = mCurrFrameResource->instanceUsage;
+    outs << L"; instance buffer: " << usage.highWater << L" peak of " << usage.capacity << L", "
+         << usage.reallocations << L" reallocations";
     mMainWndCaption = outs.str();
     std::wcout << outs.str() << std::endl;
 }
 
+// Queues each render item with instances to draw once in each of its layers and sorts the queue.
+// The transparent layer goes back to front, so that what is behind shows through what blends
+// over it; the others go by state, so that state shared is set once, then nearest first, so that
+// the nearest draws hide what is behind them before it is shaded.
+void LandAndWavesApp::SortDraws()
+{
+    static_assert((int) RenderLayer::Count <= 1 << DrawSort::kLayerBits,
+                  "Render layers must fit the sort key");
+    float nearZ = mCamera.GetNearZ();
+    float farZ = mCamera.GetFarZ();
+    mDraws.clear();
+    for (int layer = 0; layer < (int) RenderLayer::Count; ++layer) {
+        auto order = layer == (int) RenderLayer::Transparent ? DrawSort::kBackToFront
+                                                              : DrawSort::kFrontToBack;
+        const auto &items = mRenderItemLayer[layer];
+        for (uint32_t i = 0; i < (uint32_t) items.size(); ++i) {
+            const auto *item = items[i];
+            bool drawn = item->instanceCount > 0 || !item->clusterDraws.empty()
+                         || std::any_of(item->lodInstanceCounts.begin(),
+                                        item->lodInstanceCounts.end(),
+                                        [](UINT count) { return count > 0; });
+            if (!drawn)
+                continue;
+            float distance = order == DrawSort::kBackToFront ? item->farthestDistance
+                                                             : item->nearestDistance;
+            auto depth = DrawSort::QuantizeDepth(distance, nearZ, farZ);
+            mDraws.push_back({DrawSort::MakeKey(layer, item->drawState, depth, order), i});
+        }
+    }
+    DrawSort::Sort(mDraws, mDrawScratch, &mCullWorkers);
+
+    size_t next = 0;
+    for (int layer = 0; layer <= (int) RenderLayer::Count; ++layer) {
+        while (next < mDraws.size() && DrawSort::GetLayer(mDraws[next].key) < (uint32_t) layer) {
+            ++next;
+        }
+        mLayerDrawStarts[layer] = next;
+    }
+}
+
 void LandAndWavesApp::UpdateMainPassCB(const GameTimer &gt)
 {
     auto view = mCamera.GetView();
@@ -417,6 +1045,12 @@ void LandAndWavesApp::UpdateMainPassCB(const GameTimer &gt)
 
 void LandAndWavesApp::UpdateMaterialBuffer(const GameTimer &gt)
 {
+    if (mCurrFrameResource->ReserveMaterials(md3dDevice.Get(), (UINT) mMaterials.size())) {
+        for (const auto &it : mMaterials) {
+            it.second->NumFramesDirty = gNumFrameResources;
+        }
+    }
+
     auto currMaterialBuffer = mCurrFrameResource->materialBuffer.get();
     for (const auto &it : mMaterials) {
         auto material = it.second.get();
@@ -425,8 +1059,10 @@ void LandAndWavesApp::UpdateMaterialBuffer(const GameTimer &gt)
             mc.diffuseAlbedo = material->DiffuseAlbedo;
             mc.fresnelR0 = material->FresnelR0;
             mc.roughness = material->Roughness;
-            mc.diffuseMapIndex = material->DiffuseSrvHeapIndex;
-            mc.normalMapIndex = material->NormalSrvHeapIndex;
+            mc.diffuseMapIndex = ResolveSrvHeapIndex(
+                material->DiffuseSrvHeapIndex, "white1x1Tex", mc.diffuseMapSlice);
+            mc.normalMapIndex = ResolveSrvHeapIndex(
+                material->NormalSrvHeapIndex, "default_nmapTex", mc.normalMapSlice);
 
             XMMATRIX matTransform = XMLoadFloat4x4(&material->MatTransform);
             XMStoreFloat4x4(&mc.matTransform, XMMatrixTranspose(matTransform));
@@ -454,6 +1090,35 @@ void LandAndWavesApp::UpdateReflectedPassCB(const GameTimer &gt)
     mCurrFrameResource->passCB->CopyData(1, mReflectedPassCB);
 }
 
+void LandAndWavesApp::UpdateTexturePriorities()
+{
+    // A texture needs as much detail as the largest visible material sampling it; textures of
+    // culled materials fall back to their mip tail.
+    std::vector<float> screenSizes(mSRVHeapTexture.size(), 0.0f);
+    for (const auto &it : mMaterials) {
+        auto material = it.second.get();
+        float screenSize = mMaterialScreenSize[material->MatCBIndex];
+        if (screenSize <= 0.0f)
+            continue;
+
+        for (int srvHeapIndex : {material->DiffuseSrvHeapIndex, material->NormalSrvHeapIndex}) {
+            if (srvHeapIndex >= 0) {
+                auto &textureScreenSize = screenSizes[mTextureSlices[srvHeapIndex].array + 1];
+                textureScreenSize = MathHelper::Max(textureScreenSize, screenSize);
+            }
+        }
+    }
+
+    // The sky surrounds the camera, so its cube map follows the sky sphere's screen size.
+    screenSizes[0] = mMaterialScreenSize[mMaterials["skyMat"]->MatCBIndex];
+
+    // Radius over distance to the diameter in pixels.
+    float pixelsPerUnit = mClientHeight / tanf(0.5f * mCamera.GetFovY());
+    for (size_t i = 0; i < mSRVHeapTexture.size(); ++i) {
+        mTextureStreamer->SetScreenSize(mSRVHeapTexture[i], screenSizes[i] * pixelsPerUnit);
+    }
+}
+
 void LandAndWavesApp::BuildLandGeometry()
 {
     XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
@@ -463,6 +1128,7 @@ void LandAndWavesApp::BuildLandGeometry()
 
     GeometryGenerator geoGen;
     GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 50, 50);
+    OptimizeMesh("land", grid.Vertices, grid.Indices32);
     std::vector<Vertex> vertices(grid.Vertices.size());
     for (size_t i = 0; i < grid.Vertices.size(); ++i) {
         auto &p = grid.Vertices[i].Position;
@@ -594,6 +1260,7 @@ void LandAndWavesApp::BuildBoxGeometry()
 {
     GeometryGenerator geoGen;
     GeometryGenerator::MeshData box = geoGen.CreateBox(8.0f, 8.0f, 8.0f, 3);
+    OptimizeMesh("box", box.Vertices, box.Indices32);
 
     XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
     XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
@@ -790,6 +1457,15 @@ void LandAndWavesApp::BuildRoomGeometry()
     geo->IndexFormat = DXGI_FORMAT_R16_UINT;
     geo->IndexBufferByteSize = ibByteSize;
 
+    // The mirror is marked in the stencil buffer from its positions alone.
+    CreatePositionBuffer(md3dDevice.Get(),
+                         mCommandList.Get(),
+                         vertices.data(),
+                         (UINT) vertices.size(),
+                         sizeof(Vertex),
+                         VertexQuantizer::kPositionSize,
+                         *geo);
+
     geo->DrawArgs["floor"] = floorSubmesh;
     geo->DrawArgs["wall"] = wallSubmesh;
     geo->DrawArgs["mirror"] = mirrorSubmesh;
@@ -799,22 +1475,42 @@ void LandAndWavesApp::BuildRoomGeometry()
 
 void LandAndWavesApp::BuildSkullGeometry()
 {
-    auto appPath = UnicodeToUTF8(GetAppPath());
-    auto modelFilePath = appPath + "/Assets/Models/skull.txt";
-    std::ifstream fin(modelFilePath);
-
-    if (!fin) {
-        MessageBox(0, UTF8ToUnicode(modelFilePath).c_str(), 0, 0);
+    // Assets/Models/skull.mesh, written by Tools/MeshConverter, is mapped and copied into upload
+    // memory as it is, texture coordinates and bounds included.  Without it the text model is
+    // parsed instead.  Either way the vertices end up quantized, unless the mesh was converted
+    // without.
+    constexpr uint32_t skullAttributes = kMeshFilePosition | kMeshFileNormal | kMeshFileTexCoord
+                                     | kMeshFileTangent;
+    constexpr uint32_t quantizedSkullAttributes = skullAttributes | kMeshFileQuantized;
+    static_assert(sizeof(Vertex) == GetMeshFileVertexSize(skullAttributes),
+                  "Vertex does not match the mesh stream");
+    static_assert(sizeof(VertexQuantizer::QuantizedVertex)
+                      == GetMeshFileVertexSize(quantizedSkullAttributes),
+                  "QuantizedVertex does not match the mesh stream");
+
+    MeshFile meshFile;
+    HRESULT hr = meshFile.Open(GetAppPath() + L"/Assets/Models/skull.mesh");
+    if (hr != HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)) {
+        ThrowIfFailed(hr);
+
+        auto geo = std::make_unique<MeshGeometry>();
+        geo->Name = "skullGeo";
+        uint32_t attributes = meshFile.FindStream(quantizedSkullAttributes) != nullptr
+                                  ? quantizedSkullAttributes
+                                  : skullAttributes;
+        ThrowIfFailed(
+            meshFile.CreateGeometry(md3dDevice.Get(), mCommandList.Get(), attributes, *geo));
+
+        mGeometries[geo->Name] = std::move(geo);
         return;
     }
 
-    UINT vcount = 0;
-    UINT tcount = 0;
-    std::string ignore;
-
-    fin >> ignore >> vcount;
-    fin >> ignore >> tcount;
-    fin >> ignore >> ignore >> ignore >> ignore;
+    auto modelFilePath = GetAppPath() + L"/Assets/Models/skull.txt";
+    TextModelParser::Model model;
+    if (!TextModelParser::ParseFile(modelFilePath, model)) {
+        MessageBox(0, modelFilePath.c_str(), 0, 0);
+        return;
+    }
 
     XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
     XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
@@ -822,10 +1518,10 @@ void LandAndWavesApp::BuildSkullGeometry()
     XMVECTOR vMin = XMLoadFloat3(&vMinf3);
     XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
 
-    std::vector<Vertex> vertices(vcount);
-    for (UINT i = 0; i < vcount; ++i) {
-        fin >> vertices[i].pos.x >> vertices[i].pos.y >> vertices[i].pos.z;
-        fin >> vertices[i].normal.x >> vertices[i].normal.y >> vertices[i].normal.z;
+    std::vector<Vertex> vertices(model.vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        vertices[i].pos = XMFLOAT3(model.vertices[i].pos);
+        vertices[i].normal = XMFLOAT3(model.vertices[i].normal);
 
         XMVECTOR P = XMLoadFloat3(&vertices[i].pos);
 
@@ -854,52 +1550,94 @@ void LandAndWavesApp::BuildSkullGeometry()
     XMStoreFloat3(&bounds.Center, 0.5f * (vMin + vMax));
     XMStoreFloat3(&bounds.Extents, 0.5f * (vMax - vMin));
 
-    fin >> ignore;
-    fin >> ignore;
-    fin >> ignore;
+    std::vector<std::uint32_t> &indices = model.indices;
+    OptimizeMesh("skull", vertices, indices);
+    // Meshlet order costs the full draw its cache order, so the clusters get a copy of their own.
+    std::vector<std::uint32_t> meshletIndices = indices;
+    auto meshlets = MeshletBuilder::Build(vertices, meshletIndices);
+
+    // Levels of detail follow the full mesh in the index buffer, over the same vertices.
+    const UINT fullIndexCount = (UINT) indices.size();
+    auto levels = MeshSimplifier::BuildLodChain(vertices, indices);
+    for (auto &level : levels) {
+        MeshOptimizer::OptimizeTriangleOrder(level.indices.data(),
+                                             level.indices.size(),
+                                             &vertices[0].pos.x,
+                                             sizeof(Vertex),
+                                             vertices.size());
+        indices.insert(indices.end(), level.indices.begin(), level.indices.end());
+    }
 
-    std::vector<std::int32_t> indices(3 * tcount);
-    for (UINT i = 0; i < tcount; ++i) {
-        fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+    // The meshlet order follows the levels of detail.
+    for (auto &meshlet : meshlets) {
+        meshlet.startIndex += (UINT) indices.size();
     }
+    indices.insert(indices.end(), meshletIndices.begin(), meshletIndices.end());
 
-    fin.close();
+    auto quantizedVertices = QuantizeMesh("skull", vertices, bounds);
+
+    // 16 bit indices whenever every vertex can be reached with them.
+    std::vector<std::uint16_t> indices16;
+    if (VertexQuantizer::Fits16BitIndices(indices.data(), indices.size())) {
+        indices16 = VertexQuantizer::To16BitIndices(indices.data(), indices.size());
+    }
+    const bool use16BitIndices = !indices16.empty();
+    const void *indexData = use16BitIndices ? (const void *) indices16.data() : indices.data();
 
     //
     // Pack the indices of all the meshes into one index buffer.
     //
 
-    const UINT vbByteSize = (UINT) vertices.size() * sizeof(Vertex);
-    const UINT ibByteSize = (UINT) indices.size() * sizeof(std::int32_t);
+    const UINT vbByteSize = (UINT) quantizedVertices.size()
+                            * sizeof(VertexQuantizer::QuantizedVertex);
+    const UINT ibByteSize = (UINT) indices.size()
+                            * (use16BitIndices ? sizeof(std::uint16_t) : sizeof(std::uint32_t));
 
     auto geo = std::make_unique<MeshGeometry>();
     geo->Name = "skullGeo";
 
     ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), quantizedVertices.data(), vbByteSize);
 
     ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indexData, ibByteSize);
 
-    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(
-        md3dDevice.Get(), mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+                                                        mCommandList.Get(),
+                                                        quantizedVertices.data(),
+                                                        vbByteSize,
+                                                        geo->VertexBufferUploader);
 
     geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(
-        md3dDevice.Get(), mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+        md3dDevice.Get(), mCommandList.Get(), indexData, ibByteSize, geo->IndexBufferUploader);
 
-    geo->VertexByteStride = sizeof(Vertex);
+    geo->VertexByteStride = sizeof(VertexQuantizer::QuantizedVertex);
     geo->VertexBufferByteSize = vbByteSize;
-    geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+    geo->IndexFormat = use16BitIndices ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
     geo->IndexBufferByteSize = ibByteSize;
+    geo->Quantized = true;
 
     SubmeshGeometry submesh;
-    submesh.IndexCount = (UINT) indices.size();
+    submesh.IndexCount = fullIndexCount;
     submesh.StartIndexLocation = 0;
     submesh.BaseVertexLocation = 0;
     submesh.Bounds = bounds;
+    submesh.Meshlets = std::move(meshlets);
 
     geo->DrawArgs["skull"] = submesh;
 
+    UINT levelStart = fullIndexCount;
+    for (size_t i = 0; i < levels.size(); ++i) {
+        SubmeshGeometry levelSubmesh;
+        levelSubmesh.IndexCount = (UINT) levels[i].indices.size();
+        levelSubmesh.StartIndexLocation = levelStart;
+        levelSubmesh.BaseVertexLocation = 0;
+        levelSubmesh.Bounds = bounds;
+        levelSubmesh.SimplificationError = levels[i].error;
+        geo->DrawArgs[MeshSimplifier::GetLevelName("skull", i + 1)] = levelSubmesh;
+        levelStart += levelSubmesh.IndexCount;
+    }
+
     mGeometries[geo->Name] = std::move(geo);
 }
 
@@ -977,6 +1715,10 @@ void LandAndWavesApp::BuildShapeGeometry()
     GeometryGenerator::MeshData grid = geoGen.CreateGrid(20.0f, 30.0f, 60, 40);
     GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
     GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
+    OptimizeMesh("shape box", box.Vertices, box.Indices32);
+    OptimizeMesh("shape grid", grid.Vertices, grid.Indices32);
+    OptimizeMesh("shape sphere", sphere.Vertices, sphere.Indices32);
+    OptimizeMesh("shape cylinder", cylinder.Vertices, cylinder.Indices32);
 
     //
     // We are concatenating all the geometry into one big vertex/index buffer.  So
@@ -1098,33 +1840,23 @@ void LandAndWavesApp::BuildShapeGeometry()
 
 void LandAndWavesApp::BuildDescriptorHeaps()
 {
+    // Every texture has two slots, see GetInactiveSrvSlot.
+    auto textureCount = (UINT) mSRVHeapTexture.size();
+
     // 
     D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc;
-    srvHeapDesc.NumDescriptors = mTextures.size();
+    srvHeapDesc.NumDescriptors = 2 * textureCount;
     srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
     srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
     srvHeapDesc.NodeMask = 0;
     ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSRVDescriptorHeap)));
 
     // ʹSRV
-    CD3DX12_CPU_DESCRIPTOR_HANDLE handle(mSRVDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
-
-    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
-    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.Texture2D.MostDetailedMip = 0;
-
-    for (const auto it : mSRVHeapTexture) {
-        if (it->Name == gSkyBoxTexName) {
-            srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;     
-        } else {
-            srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D; 
-        }
-
-        auto resource = it->Resource.Get();
-        srvDesc.Format = resource->GetDesc().Format;
-        srvDesc.Texture2D.MipLevels = resource->GetDesc().MipLevels;
-        md3dDevice->CreateShaderResourceView(resource, &srvDesc, handle);
-        handle.Offset(1, mCbvSrvUavDescriptorSize);
+    mCurrentSrvSlot.resize(textureCount);
+    for (UINT i = 0; i < textureCount; ++i) {
+        mCurrentSrvSlot[i] = i;
+        BuildTextureSRV(mSRVHeapTexture[i], i);
+        BuildTextureSRV(mSRVHeapTexture[i], GetInactiveSrvSlot(i));
     }
 
     // 
@@ -1138,21 +1870,107 @@ void LandAndWavesApp::BuildDescriptorHeaps()
     md3dDevice->CreateShaderResourceView(treeArrayTex.Get(), &srvDesc, handle);*/
 }
 
+void LandAndWavesApp::BuildTextureSRV(const Texture *texture, UINT heapIndex)
+{
+    CD3DX12_CPU_DESCRIPTOR_HANDLE handle(mSRVDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+    handle.Offset(heapIndex, mCbvSrvUavDescriptorSize);
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.Texture2D.MostDetailedMip = 0;
+
+    if (texture->Name == gSkyBoxTexName) {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+    } else {
+        // Loose textures are viewed as arrays of one slice, so the shader samples every 2D
+        // texture the same way.
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+    }
+
+    // Textures that are still streaming get a placeholder: 2D textures alias the resource
+    // holding the white 1x1 texture and the sky gets a null cube view, which samples as black.
+    auto resource = texture->Resource.Get();
+    if (resource == nullptr && srvDesc.ViewDimension == D3D12_SRV_DIMENSION_TEXTURE2DARRAY) {
+        auto placeholder = mTextureSlices[mDynamicTextureIndex["white1x1Tex"]];
+        resource = mSRVHeapTexture[placeholder.array + 1]->Resource.Get();
+    }
+
+    if (resource != nullptr) {
+        srvDesc.Format = resource->GetDesc().Format;
+        srvDesc.Texture2D.MipLevels = resource->GetDesc().MipLevels;
+        if (srvDesc.ViewDimension == D3D12_SRV_DIMENSION_TEXTURE2DARRAY) {
+            srvDesc.Texture2DArray.ArraySize = resource->GetDesc().DepthOrArraySize;
+        }
+    } else {
+        srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        srvDesc.Texture2D.MipLevels = 1;
+    }
+    md3dDevice->CreateShaderResourceView(resource, &srvDesc, handle);
+}
+
+UINT LandAndWavesApp::GetInactiveSrvSlot(UINT textureIndex) const
+{
+    // Slots [0, n) hold the sky followed by the 2D textures, slots [n, 2n) the 2D textures
+    // followed by the sky, so both halves of the 2D table stay contiguous behind slot 0.
+    auto textureCount = (UINT) mSRVHeapTexture.size();
+    UINT alternateSlot = textureIndex == 0 ? 2 * textureCount - 1
+                                           : textureIndex + textureCount - 1;
+    return mCurrentSrvSlot[textureIndex] == textureIndex ? alternateSlot : textureIndex;
+}
+
+void LandAndWavesApp::OnTextureChanged(const Texture *texture)
+{
+    // Frames in flight still read the texture through its current slot, so the new view goes to
+    // the other one. The streamer does not replace a texture again before those frames are done.
+    auto textureIndex = (UINT) (std::find(mSRVHeapTexture.begin(), mSRVHeapTexture.end(), texture)
+                                - mSRVHeapTexture.begin());
+
+    UINT slot = GetInactiveSrvSlot(textureIndex);
+    BuildTextureSRV(texture, slot);
+    mCurrentSrvSlot[textureIndex] = slot;
+
+    for (auto &it : mMaterials) {
+        it.second->NumFramesDirty = gNumFrameResources;
+    }
+}
+
+int LandAndWavesApp::ResolveSrvHeapIndex(int srvHeapIndex,
+                                         const std::string &placeholderName,
+                                         UINT &slice)
+{
+    slice = 0;
+    if (srvHeapIndex < 0)
+        return srvHeapIndex;
+
+    auto textureSlice = mTextureSlices[srvHeapIndex];
+    if (mSRVHeapTexture[textureSlice.array + 1]->Resource == nullptr) {
+        textureSlice = mTextureSlices[mDynamicTextureIndex[placeholderName]];
+    }
+
+    // mSRVHeapTexture starts with the sky cube map, the 2D texture table follows it.
+    slice = textureSlice.slice;
+    return mCurrentSrvSlot[textureSlice.array + 1] - 1;
+}
+
 void LandAndWavesApp::BuildRootSignature()
 {
     CD3DX12_DESCRIPTOR_RANGE texTables[2];
     texTables[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
-    texTables[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, mTextures.size() - 1, 1);
+    texTables[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2 * ((UINT) mSRVHeapTexture.size() - 1), 1);
 
-    CD3DX12_ROOT_PARAMETER slotRootParameter[5];
+    CD3DX12_ROOT_PARAMETER slotRootParameter[7];
     // Ƶɸߵ
-    slotRootParameter[0].InitAsShaderResourceView(0, 1); // objectsBufferSRV
+    slotRootParameter[0].InitAsShaderResourceView(0, 1); // visibleInstancesBufferSRV
     slotRootParameter[1].InitAsShaderResourceView(1, 1); // materialsBufferSRV
     slotRootParameter[2].InitAsConstantBufferView(0);    // passCBV
     slotRootParameter[3]
         .InitAsDescriptorTable(1, &texTables[0], D3D12_SHADER_VISIBILITY_PIXEL); // textureSRV
     slotRootParameter[4]
         .InitAsDescriptorTable(1, &texTables[1], D3D12_SHADER_VISIBILITY_PIXEL); // textureSRV
+    // Bounds quantized vertices are decoded within: center, pad, extents, pad
+    slotRootParameter[5].InitAsConstants(8, 1, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+    // Every instance's slot, which the visible list indexes; bound once per frame.
+    slotRootParameter[6].InitAsShaderResourceView(2, 1); // instancesBufferSRV
 
     auto staticSamplers = GetStaticSamplers();
     CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(
@@ -1198,8 +2016,22 @@ void LandAndWavesApp::BuildShadersAndInputLayout()
         {nullptr, nullptr},
     };
 
+    const D3D_SHADER_MACRO quantizedDefines[] = {
+        {"QUANTIZED_VERTICES", "1"},
+        {nullptr, nullptr},
+    };
+
     mShaders["standardVS"] = d3dUtil::CompileShader(
         GetAppPath() + L"/Assets/Shaders/Default.hlsl", nullptr, "VS", "vs_5_1");
+    mShaders["quantizedVS"] = d3dUtil::CompileShader(
+        GetAppPath() + L"/Assets/Shaders/Default.hlsl", quantizedDefines, "VS", "vs_5_1");
+
+    mShaders["positionVS"] = d3dUtil::CompileShader(
+        GetAppPath() + L"/Assets/Shaders/PositionOnly.hlsl", nullptr, "VS", "vs_5_1");
+    mShaders["quantizedPositionVS"] = d3dUtil::CompileShader(
+        GetAppPath() + L"/Assets/Shaders/PositionOnly.hlsl", quantizedDefines, "VS", "vs_5_1");
+    mShaders["positionPS"] = d3dUtil::CompileShader(
+        GetAppPath() + L"/Assets/Shaders/PositionOnly.hlsl", nullptr, "PS", "ps_5_1");
     mShaders["opaquePS"] = d3dUtil::CompileShader(
         GetAppPath() + L"/Assets/Shaders/Default.hlsl", defines, "PS", "ps_5_1");
     mShaders["alphaTestedPS"] = d3dUtil::CompileShader(
@@ -1217,35 +2049,16 @@ void LandAndWavesApp::BuildShadersAndInputLayout()
     mShaders["skyPS"]
         = d3dUtil::CompileShader(GetAppPath() + L"/Assets/Shaders/Sky.hlsl", nullptr, "PS", "ps_5_1");
 
-    mInputLayout
-        = {{"POSITION",
-            0,
-            DXGI_FORMAT_R32G32B32_FLOAT,
-            0,
-            offsetof(Vertex, pos),
-            D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
-            0},
-           {"NORMAL",
-            0,
-            DXGI_FORMAT_R32G32B32_FLOAT,
-            0,
-            offsetof(Vertex, normal),
-            D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
-            0},
-           {"TEXCOORD",
-            0,
-            DXGI_FORMAT_R32G32_FLOAT,
-            0,
-            offsetof(Vertex, texCoord),
-            D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
-            0},
-           {"TANGENT",
-            0,
-            DXGI_FORMAT_R32G32B32_FLOAT,
-            0,
-            offsetof(Vertex, tangent),
-            D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
-            0}};
+    static_assert(offsetof(Vertex, normal) == offsetof(VertexQuantizer::FloatVertex, normal)
+                      && offsetof(Vertex, texCoord)
+                             == offsetof(VertexQuantizer::FloatVertex, texCoord)
+                      && offsetof(Vertex, tangent)
+                             == offsetof(VertexQuantizer::FloatVertex, tangent),
+                  "Vertex does not match VertexQuantizer::FloatVertex");
+    mInputLayout = MakeInputLayout(VertexQuantizer::kFloatLayout);
+    mQuantizedInputLayout = MakeInputLayout(VertexQuantizer::kQuantizedLayout);
+    mPositionInputLayout = MakeInputLayout(VertexQuantizer::kFloatPositionLayout);
+    mQuantizedPositionInputLayout = MakeInputLayout(VertexQuantizer::kQuantizedPositionLayout);
 
     mTreeSpriteInputLayout
         = {{"POSITION",
@@ -1266,6 +2079,32 @@ void LandAndWavesApp::BuildShadersAndInputLayout()
 
 void LandAndWavesApp::BuildPSOs()
 {
+    // Every PSO drawing meshes has a "_quantized" twin for quantized geometry. Position-only
+    // PSOs read the position-only streams and draw surfaces in their material's flat colour.
+    auto createPSOs = [this](D3D12_GRAPHICS_PIPELINE_STATE_DESC desc,
+                             const std::string &name,
+                             bool positionOnly) {
+        const auto &layout = positionOnly ? mPositionInputLayout : mInputLayout;
+        const auto &quantizedLayout = positionOnly ? mQuantizedPositionInputLayout
+                                                   : mQuantizedInputLayout;
+        const auto &vs = mShaders[positionOnly ? "positionVS" : "standardVS"];
+        const auto &quantizedVS = mShaders[positionOnly ? "quantizedPositionVS" : "quantizedVS"];
+        if (positionOnly) {
+            desc.PS = {mShaders["positionPS"]->GetBufferPointer(),
+                       mShaders["positionPS"]->GetBufferSize()};
+            mPositionOnlyPSOs.insert(name);
+        }
+
+        desc.InputLayout = {layout.data(), (UINT) layout.size()};
+        desc.VS = {vs->GetBufferPointer(), vs->GetBufferSize()};
+        ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&mPSOs[name])));
+
+        desc.InputLayout = {quantizedLayout.data(), (UINT) quantizedLayout.size()};
+        desc.VS = {quantizedVS->GetBufferPointer(), quantizedVS->GetBufferSize()};
+        ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
+            &desc, IID_PPV_ARGS(&mPSOs[name + "_quantized"])));
+    };
+
     // opaque PSO
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePSODesc{};
     ZeroMemory(&opaquePSODesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
@@ -1291,15 +2130,13 @@ void LandAndWavesApp::BuildPSOs()
 
     opaquePSODesc.NumRenderTargets = 1;
     opaquePSODesc.RTVFormats[0] = mBackBufferFormat;
-    ThrowIfFailed(
-        md3dDevice->CreateGraphicsPipelineState(&opaquePSODesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+    createPSOs(opaquePSODesc, "opaque", false);
 
     // wireframe PSO
     auto opaqueWireframePSODesc = opaquePSODesc;
     opaqueWireframePSODesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
     opaqueWireframePSODesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-        &opaqueWireframePSODesc, IID_PPV_ARGS(&mPSOs["opaque_wireframe"])));
+    createPSOs(opaqueWireframePSODesc, "opaque_wireframe", false);
 
     // transparent PSO
     auto transparentPSODesc = opaquePSODesc;
@@ -1315,9 +2152,7 @@ void LandAndWavesApp::BuildPSOs()
     transparentBlendDesc.LogicOp = D3D12_LOGIC_OP_NOOP;
     transparentBlendDesc.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
     transparentPSODesc.BlendState.RenderTarget[0] = transparentBlendDesc;
-    ThrowIfFailed(
-        md3dDevice
-            ->CreateGraphicsPipelineState(&transparentPSODesc, IID_PPV_ARGS(&mPSOs["transparent"])));
+    createPSOs(transparentPSODesc, "transparent", false);
 
     // alpha tested PSO
     auto alphaTestedPSODesc = opaquePSODesc;
@@ -1326,9 +2161,7 @@ void LandAndWavesApp::BuildPSOs()
         mShaders["alphaTestedPS"]->GetBufferSize(),
     };
     alphaTestedPSODesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-    ThrowIfFailed(
-        md3dDevice
-            ->CreateGraphicsPipelineState(&alphaTestedPSODesc, IID_PPV_ARGS(&mPSOs["alphaTested"])));
+    createPSOs(alphaTestedPSODesc, "alphaTested", false);
 
     // ڱģ建沿ֵPSO
     // ֹȾĿд
@@ -1361,8 +2194,7 @@ void LandAndWavesApp::BuildPSOs()
     auto markMirrorsPSODesc = opaquePSODesc;
     markMirrorsPSODesc.BlendState = mirrorBlendDesc;
     markMirrorsPSODesc.DepthStencilState = mirrorDSDesc;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-        &markMirrorsPSODesc, IID_PPV_ARGS(&mPSOs["markStencilMirrors"])));
+    createPSOs(markMirrorsPSODesc, "markStencilMirrors", true);
 
     // Ⱦģ建з侵PSO
     D3D12_DEPTH_STENCIL_DESC reflectionsDSDesc;
@@ -1392,8 +2224,7 @@ void LandAndWavesApp::BuildPSOs()
     drawReflecttionsPSODesc.DepthStencilState = reflectionsDSDesc;
     drawReflecttionsPSODesc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
     drawReflecttionsPSODesc.RasterizerState.FrontCounterClockwise = true;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-        &drawReflecttionsPSODesc, IID_PPV_ARGS(&mPSOs["drawStencilReflections"])));
+    createPSOs(drawReflecttionsPSODesc, "drawStencilReflections", false);
 
     // ӰPSO
     D3D12_DEPTH_STENCIL_DESC shadowDSDesc;
@@ -1416,8 +2247,8 @@ void LandAndWavesApp::BuildPSOs()
 
     auto shadowPSODesc = transparentPSODesc;
     shadowPSODesc.DepthStencilState = shadowDSDesc;
-    ThrowIfFailed(
-        md3dDevice->CreateGraphicsPipelineState(&shadowPSODesc, IID_PPV_ARGS(&mPSOs["shadow"])));
+    // Lit like the skull it flattens, so that it keeps the sky's faint reflections.
+    createPSOs(shadowPSODesc, "shadow", false);
 
     // sky PSO
     auto skyPSODesc = opaquePSODesc;
@@ -1463,7 +2294,7 @@ void LandAndWavesApp::BuildFrameResources()
             md3dDevice.Get(),
             2,
             //static_cast<uint32_t>(mAllRenderItems.size()),
-            mAllInstanceDataCount,
+            (uint32_t) SceneStore::Size(mScene),
             static_cast<uint32_t>(mMaterials.size()),
             mWaves->VertexCount()));
     }
@@ -1474,7 +2305,6 @@ void LandAndWavesApp::BuildRenderItems()
     auto skyRenderItem = std::make_unique<RenderItem>();
     //XMStoreFloat4x4(&skyRenderItem->world, XMMatrixScaling(5000.0f, 5000.0f, 5000.0f));
     skyRenderItem->texTransform = MathHelper::Identity4x4();
-    skyRenderItem->objCBIndex = mAllInstanceDataCount++;
     skyRenderItem->mat = mMaterials["skyMat"].get();
     skyRenderItem->geo = mGeometries["shapeGeo"].get();
     skyRenderItem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1491,7 +2321,6 @@ void LandAndWavesApp::BuildRenderItems()
     auto wavesRenderItem = std::make_unique<RenderItem>();
     //XMStoreFloat4x4(&wavesRenderItem->world, XMMatrixTranslation(0.0f, -5.0f, 0.0f));
     //XMStoreFloat4x4(&wavesRenderItem->texTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-    wavesRenderItem->objCBIndex = mAllInstanceDataCount++;
     wavesRenderItem->geo = mGeometries["waterGeo"].get();
     wavesRenderItem->mat = mMaterials["waterMat"].get();
     wavesRenderItem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1510,7 +2339,6 @@ void LandAndWavesApp::BuildRenderItems()
     auto gridRenderItem = std::make_unique<RenderItem>();
     //XMStoreFloat4x4(&gridRenderItem->world, XMMatrixTranslation(0.0f, -5.0f, 0.0f));
     //XMStoreFloat4x4(&gridRenderItem->texTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-    gridRenderItem->objCBIndex = mAllInstanceDataCount++;
     gridRenderItem->geo = mGeometries["landGeo"].get();
     gridRenderItem->mat = mMaterials["grassMat"].get();
     gridRenderItem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1523,11 +2351,11 @@ void LandAndWavesApp::BuildRenderItems()
     XMStoreFloat4x4(&gridRenderItem->instances[0].world, XMMatrixTranslation(0.0f, -5.0f, 0.0f));
     XMStoreFloat4x4(&gridRenderItem->instances[0].texTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
     mRenderItemLayer[(int) RenderLayer::Opaque].emplace_back(gridRenderItem.get());
+    AddOccluder(*gridRenderItem);
     mAllRenderItems.emplace_back(std::move(gridRenderItem));
 
     auto boxRenderItem = std::make_unique<RenderItem>();
     XMStoreFloat4x4(&boxRenderItem->world, XMMatrixTranslation(6.0f, -5.0f, -15.0f));
-    boxRenderItem->objCBIndex = mAllInstanceDataCount++;
     boxRenderItem->mat = mMaterials["wirefenceMat"].get();
     boxRenderItem->geo = mGeometries["boxGeo"].get();
     boxRenderItem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1543,7 +2371,6 @@ void LandAndWavesApp::BuildRenderItems()
 
     auto floorRenderItem = std::make_unique<RenderItem>();
     //XMStoreFloat4x4(&floorRenderItem->world, XMMatrixTranslation(0.0f, 0.0f, 0.0f));
-    floorRenderItem->objCBIndex = mAllInstanceDataCount++;
     floorRenderItem->geo = mGeometries["roomGeo"].get();
     floorRenderItem->mat = mMaterials["checkertileMat"].get();
     floorRenderItem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1554,11 +2381,11 @@ void LandAndWavesApp::BuildRenderItems()
     floorRenderItem->instances.resize(1);
     floorRenderItem->instances[0].materialIndex = floorRenderItem->mat->MatCBIndex;
     mRenderItemLayer[(int) RenderLayer::Opaque].emplace_back(floorRenderItem.get());
+    AddOccluder(*floorRenderItem);
     mAllRenderItems.emplace_back(std::move(floorRenderItem));
 
     auto wallsRenderItem = std::make_unique<RenderItem>();
     //XMStoreFloat4x4(&wallsRenderItem->world, XMMatrixTranslation(0.0f, 0.0f, 0.0f));
-    wallsRenderItem->objCBIndex = mAllInstanceDataCount++;
     wallsRenderItem->geo = mGeometries["roomGeo"].get();
     wallsRenderItem->mat = mMaterials["bricks3Mat"].get();
     wallsRenderItem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1569,11 +2396,11 @@ void LandAndWavesApp::BuildRenderItems()
     wallsRenderItem->instances.resize(1);
     wallsRenderItem->instances[0].materialIndex = wallsRenderItem->mat->MatCBIndex;
     mRenderItemLayer[(int) RenderLayer::Opaque].emplace_back(wallsRenderItem.get());
+    AddOccluder(*wallsRenderItem);
     mAllRenderItems.emplace_back(std::move(wallsRenderItem));
 
     auto skullRenderItem = std::make_unique<RenderItem>();
     //XMStoreFloat4x4(&skullRenderItem->world, XMMatrixTranslation(0.0f, 0.0f, -5.0f));
-    skullRenderItem->objCBIndex = mAllInstanceDataCount++;
     skullRenderItem->geo = mGeometries["skullGeo"].get();
     skullRenderItem->mat = mMaterials["skullMat"].get();
     skullRenderItem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1581,6 +2408,16 @@ void LandAndWavesApp::BuildRenderItems()
     skullRenderItem->startIndexLocation = skullRenderItem->geo->DrawArgs["skull"].StartIndexLocation;
     skullRenderItem->baseVertexLocation = skullRenderItem->geo->DrawArgs["skull"].BaseVertexLocation;
     skullRenderItem->boundingBox = skullRenderItem->geo->DrawArgs["skull"].Bounds;
+    if (!skullRenderItem->geo->DrawArgs["skull"].Meshlets.empty()) {
+        skullRenderItem->meshlets = &skullRenderItem->geo->DrawArgs["skull"].Meshlets;
+    }
+    auto &skullArgs = skullRenderItem->geo->DrawArgs;
+    for (size_t level = 1;; ++level) {
+        auto lod = skullArgs.find(MeshSimplifier::GetLevelName("skull", level));
+        if (lod == skullArgs.end())
+            break;
+        skullRenderItem->lods.push_back(&lod->second);
+    }
     skullRenderItem->instances.resize(1);
     skullRenderItem->instances[0].materialIndex = skullRenderItem->mat->MatCBIndex;
     XMStoreFloat4x4(&skullRenderItem->instances[0].world, XMMatrixTranslation(0.0f, 1.0f, -5.0f));
@@ -1590,7 +2427,6 @@ void LandAndWavesApp::BuildRenderItems()
     
     auto reflectedSkullRenderItem = std::make_unique<RenderItem>();
     *reflectedSkullRenderItem = *skullRenderItem;
-    reflectedSkullRenderItem->objCBIndex = mAllInstanceDataCount++;
     reflectedSkullRenderItem->instances.resize(1);
     reflectedSkullRenderItem->instances[0].materialIndex = reflectedSkullRenderItem->mat->MatCBIndex;
     mRenderItemLayer[(int) RenderLayer::Reflected].emplace_back(reflectedSkullRenderItem.get());
@@ -1598,8 +2434,9 @@ void LandAndWavesApp::BuildRenderItems()
 
     auto shadowSkullRenderItem = std::make_unique<RenderItem>();
     *shadowSkullRenderItem = *skullRenderItem;
-    shadowSkullRenderItem->objCBIndex = mAllInstanceDataCount++;
     shadowSkullRenderItem->mat = mMaterials["shadowMat"].get();
+    // Flattened onto the floor, where the clusters' facing means nothing.
+    shadowSkullRenderItem->meshlets = nullptr;
     shadowSkullRenderItem->instances.resize(1);
     shadowSkullRenderItem->instances[0].materialIndex = shadowSkullRenderItem->mat->MatCBIndex;
     mRenderItemLayer[(int) RenderLayer::Shadow].emplace_back(shadowSkullRenderItem.get());
@@ -1611,7 +2448,6 @@ void LandAndWavesApp::BuildRenderItems()
 
     auto mirrorRenderItem = std::make_unique<RenderItem>();
     //XMStoreFloat4x4(&mirrorRenderItem->world, XMMatrixTranslation(0.0f, 0.0f, 0.0f));
-    mirrorRenderItem->objCBIndex = mAllInstanceDataCount++;
     mirrorRenderItem->geo = mGeometries["roomGeo"].get();
     mirrorRenderItem->mat = mMaterials["icemirrorMat"].get();
     mirrorRenderItem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1643,7 +2479,6 @@ void LandAndWavesApp::BuildRenderItems()
 
     {
         auto boxRitem = std::make_unique<RenderItem>();
-        boxRitem->objCBIndex = mAllInstanceDataCount++;
         boxRitem->mat = mMaterials["bricks2Mat"].get();
         boxRitem->geo = mGeometries["shapeGeo"].get();
         boxRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1661,7 +2496,6 @@ void LandAndWavesApp::BuildRenderItems()
         mAllRenderItems.emplace_back(std::move(boxRitem));
 
         auto skullRitem = std::make_unique<RenderItem>();
-        skullRitem->objCBIndex = mAllInstanceDataCount++;
         skullRitem->mat = mMaterials["skullMat"].get();
         skullRitem->geo = mGeometries["skullGeo"].get();
         skullRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1678,7 +2512,6 @@ void LandAndWavesApp::BuildRenderItems()
         mAllRenderItems.emplace_back(std::move(skullRitem));
 
         auto gridRitem = std::make_unique<RenderItem>();
-        gridRitem->objCBIndex = mAllInstanceDataCount++;
         gridRitem->mat = mMaterials["tileMat"].get();
         gridRitem->geo = mGeometries["shapeGeo"].get();
         gridRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1702,8 +2535,6 @@ void LandAndWavesApp::BuildRenderItems()
         cylRitem->baseVertexLocation = cylRitem->geo->DrawArgs["cylinder"].BaseVertexLocation;
         cylRitem->boundingBox = cylRitem->geo->DrawArgs["cylinder"].Bounds;
         cylRitem->instances.resize(10);
-        cylRitem->objCBIndex = mAllInstanceDataCount;
-        mAllInstanceDataCount += 10;
 
         auto sphereRitem = std::make_unique<RenderItem>();
         sphereRitem->mat = mMaterials["mirrorMat"].get();
@@ -1714,8 +2545,6 @@ void LandAndWavesApp::BuildRenderItems()
         sphereRitem->baseVertexLocation = sphereRitem->geo->DrawArgs["sphere"].BaseVertexLocation;
         sphereRitem->boundingBox = sphereRitem->geo->DrawArgs["sphere"].Bounds;
         sphereRitem->instances.resize(10);
-        sphereRitem->objCBIndex = mAllInstanceDataCount;
-        mAllInstanceDataCount += 10;
 
         XMMATRIX brickTexTransform = XMMatrixScaling(1.5f, 2.0f, 1.0f);
         for (int i = 0; i < 5; ++i) {
@@ -1747,6 +2576,112 @@ void LandAndWavesApp::BuildRenderItems()
         mAllRenderItems.push_back(std::move(cylRitem));
         mAllRenderItems.push_back(std::move(sphereRitem));
     }
+
+    for (auto layer : {RenderLayer::Opaque, RenderLayer::AlphaTested}) {
+        for (auto *item : mRenderItemLayer[(int) layer]) {
+            item->occlusionCulled = true;
+        }
+    }
+}
+
+// Moves the render items' instances into the scene store.  Render layers stay lists of render
+// items, which are drawn per item.
+void LandAndWavesApp::BuildScene()
+{
+    for (uint32_t itemIndex = 0; itemIndex < (uint32_t) mAllRenderItems.size(); ++itemIndex) {
+        auto &item = mAllRenderItems[itemIndex];
+        for (const auto &instance : item->instances) {
+            SceneStore::Instance sceneInstance;
+            sceneInstance.world = StoreMatrix<SceneStore::Matrix>(XMLoadFloat4x4(&instance.world));
+            sceneInstance.texTransform
+                = StoreMatrix<SceneStore::Matrix>(XMLoadFloat4x4(&instance.texTransform));
+            sceneInstance.materialIndex = instance.materialIndex;
+            sceneInstance.mesh = itemIndex;
+            sceneInstance.flags = item->occlusionCulled ? gOcclusionCulledFlag : 0;
+            item->handles.push_back(SceneStore::Add(mScene, sceneInstance));
+        }
+        item->instances.clear();
+        item->instances.shrink_to_fit();
+    }
+
+    // Render items drawn from the same buffers with the same topology share a geometry number.
+    std::vector<std::pair<const MeshGeometry *, D3D12_PRIMITIVE_TOPOLOGY>> geometries;
+    for (auto &item : mAllRenderItems) {
+        std::pair<const MeshGeometry *, D3D12_PRIMITIVE_TOPOLOGY> geometry(item->geo,
+                                                                           item->primitiveType);
+        auto found = std::find(geometries.begin(), geometries.end(), geometry);
+        if (found == geometries.end()) {
+            found = geometries.insert(found, geometry);
+        }
+        item->drawState = DrawSort::MakeState(item->geo->Quantized ? 1 : 0,
+                                              uint32_t(found - geometries.begin()),
+                                              item->mat != nullptr ? item->mat->MatCBIndex : 0);
+    }
+
+    // The skull moves its reflection in the mirror and its shadow on the floor with it.
+    auto addNode = [this](uint32_t parent,
+                          const RenderItem *item,
+                          FXMMATRIX local,
+                          TransformHierarchy::Composition composition) {
+        mTransformInstances.push_back(item->handles[0]);
+        return TransformHierarchy::Add(
+            mTransforms, parent, StoreMatrix<TransformHierarchy::Matrix>(local), composition);
+    };
+    XMVECTOR mirrorPlane = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane
+    uint32_t skull = SceneStore::Find(mScene, mSkullRenderItem->handles[0]);
+    mSkullNode = addNode(TransformHierarchy::kNoParent,
+                         mSkullRenderItem,
+                         LoadMatrix(mScene.worlds[skull]),
+                         TransformHierarchy::kAttached);
+    addNode(mSkullNode,
+            mReflectedSkullRenderItem,
+            XMMatrixReflect(mirrorPlane),
+            TransformHierarchy::kDerived);
+    mShadowedSkullNode = addNode(
+        mSkullNode, mShadowedSkullRenderItem, XMMatrixIdentity(), TransformHierarchy::kDerived);
+}
+
+// Carries the world transforms of the nodes that moved, and of their descendants, over to the
+// instances they place.
+void LandAndWavesApp::UpdateTransforms()
+{
+    std::vector<uint32_t> changed;
+    TransformHierarchy::Update(mTransforms, changed);
+    for (uint32_t node : changed) {
+        uint32_t instance = SceneStore::Find(mScene, mTransformInstances[node]);
+        if (instance == SceneStore::kInvalid)
+            continue;
+        auto world = StoreMatrix<SceneStore::Matrix>(LoadMatrix(mTransforms.worlds[node]));
+        SceneStore::SetWorld(mScene, instance, world);
+    }
+}
+
+// Adds the render item's triangles, in the world space of its first instance, to the occluders.
+// The geometry must be kept on the CPU as Vertex.
+void LandAndWavesApp::AddOccluder(const RenderItem &item)
+{
+    const auto *geo = item.geo;
+    const auto *vertexData = static_cast<const uint8_t *>(geo->VertexBufferCPU->GetBufferPointer());
+    const void *indexData = geo->IndexBufferCPU->GetBufferPointer();
+    auto world = XMLoadFloat4x4(&item.instances[0].world);
+
+    OcclusionCuller::Mesh mesh;
+    UINT vertexCount = geo->VertexBufferByteSize / geo->VertexByteStride;
+    mesh.positions.resize(3 * vertexCount);
+    for (UINT i = 0; i < vertexCount; ++i) {
+        auto pos = reinterpret_cast<const Vertex *>(vertexData + i * geo->VertexByteStride)->pos;
+        XMStoreFloat3(reinterpret_cast<XMFLOAT3 *>(&mesh.positions[3 * i]),
+                      XMVector3TransformCoord(XMLoadFloat3(&pos), world));
+    }
+    mesh.indices.resize(item.indexCount);
+    for (UINT i = 0; i < item.indexCount; ++i) {
+        UINT index = item.startIndexLocation + i;
+        UINT vertex = geo->IndexFormat == DXGI_FORMAT_R16_UINT
+                          ? static_cast<const std::uint16_t *>(indexData)[index]
+                          : static_cast<const std::uint32_t *>(indexData)[index];
+        mesh.indices[i] = UINT(item.baseVertexLocation + (int) vertex);
+    }
+    mOccluders.push_back(std::move(mesh));
 }
 
 void LandAndWavesApp::BuildInstanceDataForSkullRenderItem(RenderItem *skullRenderItem)
@@ -1793,8 +2728,6 @@ void LandAndWavesApp::BuildInstanceDataForSkullRenderItem(RenderItem *skullRende
                     &skullRenderItem->instances[index].texTransform,
                     XMMatrixScaling(2.0f, 2.0f, 1.0f));
                 skullRenderItem->instances[index].materialIndex = index % (mMaterials.size()-1);
-
-                mAllInstanceDataCount++;
             }
         }
     }
@@ -1954,50 +2887,197 @@ void LandAndWavesApp::LoadTextures()
         //{"treeArray2Tex", L"/Assets/Textures/treeArray2.dds"},
     };
 
-    UINT index = 0;
+    // Materials bind these placeholders while their own textures stream in. Both are tiny, so
+    // they are loaded before the first frame; everything else is left to the streamer.
+    const std::array<std::string, 2> placeholderNames = {"white1x1Tex", "default_nmapTex"};
+
+    // Textures packed with Tools/TextureArchiveBuilder load from one file; any texture missing
+    // from the archive, or the whole set without one, falls back to its loose .dds file.
+    auto textureArchive = std::make_unique<TextureArchive>();
+    HRESULT hr = textureArchive->Open(GetAppPath() + L"/Assets/Textures/Textures.pak");
+    if (hr != HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)) {
+        ThrowIfFailed(hr);
+        mTextureArchive = std::move(textureArchive);
+    }
+
+    UINT workerCount = MathHelper::Clamp(std::thread::hardware_concurrency(), 2u, 5u) - 1;
+    mTextureStreamer = std::make_unique<TextureStreamer>(md3dDevice.Get(),
+                                                         workerCount,
+                                                         4 * 1024 * 1024,
+                                                         64 * 1024 * 1024,
+                                                         mTextureArchive.get());
+    // Several of the .dds files have no mips and the normal maps are uncompressed; the workers
+    // fix both up, the normal maps to BC5.  Archives built with --generate-mips and
+    // --block-compress already hold both for every texture loaded here; the builder reports the
+    // inputs it could not give mips, such as the BC2 tree sprites, which are not.
+    mTextureStreamer->SetGenerateMipsOnLoad(true);
+    mTextureStreamer->SetBlockCompressOnLoad(true);
+
+    // Archives built with --pack-arrays merge textures of the same format, size and mip count
+    // into texture arrays.  Each array is one resource and one SRV; materials name the slice.
+    // Loose textures are arrays of one slice.
+    std::vector<bool> holdsPlaceholder;
     for (const auto &it : texInfo) {
-        auto tex = std::make_unique<Texture>();
-        tex->Name = it.first;
-        tex->Filename = GetAppPath() + it.second;
-        ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(
-            md3dDevice.Get(),
-            mCommandList.Get(),
-            tex->Filename.c_str(),
-            tex->Resource,
-            tex->UploadHeap));
-
-        mSRVHeapTexture.emplace_back(tex.get());
-        if (tex->Name != gSkyBoxTexName) {
-            mDynamicTextureIndex.insert({it.first, index++});
+        std::string resourceName = it.first;
+        std::wstring filename = GetAppPath() + it.second;
+
+        std::string arrayName;
+        UINT slice = 0;
+        if (mTextureArchive && mTextureArchive->FindArraySlice(filename, arrayName, slice)) {
+            resourceName = arrayName;
+            filename = GetAppPath() + L"/Assets/Textures/"
+                       + std::wstring(arrayName.begin(), arrayName.end());
+        }
+
+        // Normal maps are named after the texture they go with.
+        auto content = it.first.find("_nmapTex") != std::string::npos ? Texture::Content::NormalMap
+                                                                       : Texture::Content::Color;
+        auto &tex = mTextures[resourceName];
+        if (tex == nullptr) {
+            tex = std::make_unique<Texture>();
+            tex->Name = resourceName;
+            tex->Filename = filename;
+            tex->Contents = content;
+            mSRVHeapTexture.emplace_back(tex.get());
+            holdsPlaceholder.push_back(false);
+        } else if (tex->Contents != content) {
+            tex->Contents = Texture::Content::Mixed;
         }
 
-        mTextures[it.first] = std::move(tex);
+        // mSRVHeapTexture starts with the sky cube map, the 2D texture table follows it.
+        auto resourceIndex = (UINT) (std::find(mSRVHeapTexture.begin(), mSRVHeapTexture.end(),
+                                               tex.get())
+                                     - mSRVHeapTexture.begin());
+        if (std::find(placeholderNames.begin(), placeholderNames.end(), it.first)
+            != placeholderNames.end()) {
+            holdsPlaceholder[resourceIndex] = true;
+        }
+
+        if (it.first != gSkyBoxTexName) {
+            mDynamicTextureIndex.insert({it.first, (uint32_t) mTextureSlices.size()});
+            mTextureSlices.push_back({resourceIndex - 1, slice});
+        }
+    }
+
+    for (size_t i = 0; i < mSRVHeapTexture.size(); ++i) {
+        auto tex = mSRVHeapTexture[i];
+        if (holdsPlaceholder[i] && mTextureArchive && mTextureArchive->Contains(tex->Filename)) {
+            ThrowIfFailed(mTextureArchive->CreateTexture(
+                md3dDevice.Get(), mCommandList.Get(), tex->Filename, tex->Resource, tex->UploadHeap));
+        } else if (holdsPlaceholder[i]) {
+            ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(
+                md3dDevice.Get(),
+                mCommandList.Get(),
+                tex->Filename.c_str(),
+                tex->Resource,
+                tex->UploadHeap));
+        } else {
+            mTextureStreamer->Request(tex);
+        }
     }
 }
 
-void LandAndWavesApp::DrawRenderItems(
-    ID3D12GraphicsCommandList *cmdList, const std::vector<RenderItem *> &renderItems)
+void LandAndWavesApp::DrawRenderItems(ID3D12GraphicsCommandList *cmdList,
+                                      RenderLayer layer,
+                                      const std::string &psoName)
 {
     //auto objCbByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    auto instanceByteSize = sizeof(InstanceData);
-
-    auto resourceObj = mCurrFrameResource->instanceBuffer->Resource();
+    // Draws read their instances' slots from the visible list, from objCBIndex on.
+    auto slotByteSize = sizeof(UINT);
+
+    auto resourceObj = mCurrFrameResource->visibleInstanceBuffer->Resource();
+
+    ID3D12PipelineState *pso = mPSOs[psoName].Get();
+    auto quantized = mPSOs.find(psoName + "_quantized");
+    ID3D12PipelineState *quantizedPSO = quantized != mPSOs.end() ? quantized->second.Get()
+                                                                 : nullptr;
+    ID3D12PipelineState *currentPSO = nullptr;
+    const bool positionOnly = mPositionOnlyPSOs.count(psoName) != 0;
+
+    // Sorted by state, so that items sharing it follow one another and only the first sets it.
+    const auto &renderItems = mRenderItemLayer[(int) layer];
+    const MeshGeometry *currentGeo = nullptr;
+    D3D12_PRIMITIVE_TOPOLOGY currentTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+    const BoundingBox *currentBounds = nullptr;
+    for (size_t d = mLayerDrawStarts[(int) layer]; d < mLayerDrawStarts[(int) layer + 1]; ++d) {
+        const auto *item = renderItems[mDraws[d].value];
+        auto *itemPSO = item->geo->Quantized ? quantizedPSO : pso;
+        assert(itemPSO != nullptr);
+        if (itemPSO != currentPSO) {
+            cmdList->SetPipelineState(itemPSO);
+            currentPSO = itemPSO;
+            ++mStateChangeCount;
+        }
+        const auto &bounds = item->boundingBox;
+        if (item->geo->Quantized
+            && (currentBounds == nullptr
+                || std::memcmp(currentBounds, &bounds, sizeof(BoundingBox)) != 0)) {
+            // The render item's box is its submesh's, which the positions are relative to.
+            const float quantizationBounds[8] = {bounds.Center.x,
+                                                 bounds.Center.y,
+                                                 bounds.Center.z,
+                                                 0.0f,
+                                                 bounds.Extents.x,
+                                                 bounds.Extents.y,
+                                                 bounds.Extents.z,
+                                                 0.0f};
+            cmdList->SetGraphicsRoot32BitConstants(
+                5, _countof(quantizationBounds), quantizationBounds, 0);
+            currentBounds = &bounds;
+        }
 
-    for (const auto &item : renderItems) {
-        cmdList->IASetIndexBuffer(&item->geo->IndexBufferView());
-        cmdList->IASetVertexBuffers(0, 1, &item->geo->VertexBufferView());
-        cmdList->IASetPrimitiveTopology(item->primitiveType);
+        if (item->geo != currentGeo) {
+            cmdList->IASetIndexBuffer(&item->geo->IndexBufferView());
+            if (positionOnly) {
+                assert(item->geo->PositionBufferGPU != nullptr);
+                cmdList->IASetVertexBuffers(0, 1, &item->geo->PositionBufferView());
+            } else {
+                cmdList->IASetVertexBuffers(0, 1, &item->geo->VertexBufferView());
+            }
+            currentGeo = item->geo;
+            ++mStateChangeCount;
+        }
+        if (item->primitiveType != currentTopology) {
+            cmdList->IASetPrimitiveTopology(item->primitiveType);
+            currentTopology = item->primitiveType;
+        }
 
         auto bufferLocation = resourceObj->GetGPUVirtualAddress();
-        bufferLocation += (item->objCBIndex * instanceByteSize);
-        cmdList->SetGraphicsRootShaderResourceView(0, bufferLocation);
-
-        cmdList->DrawIndexedInstanced(
-            item->indexCount,
-            item->instanceCount,
-            item->startIndexLocation,
-            item->baseVertexLocation,
-            0);
+        bufferLocation += (item->objCBIndex * slotByteSize);
+        if (item->instanceCount > 0) {
+            cmdList->SetGraphicsRootShaderResourceView(0, bufferLocation);
+            cmdList->DrawIndexedInstanced(item->indexCount,
+                                          item->instanceCount,
+                                          item->startIndexLocation,
+                                          item->baseVertexLocation,
+                                          0);
+        }
+
+        UINT firstInstance = item->instanceCount;
+        for (size_t i = 0; i < item->lods.size(); ++i) {
+            UINT instanceCount = item->lodInstanceCounts[i];
+            if (instanceCount == 0)
+                continue;
+            const auto *lod = item->lods[i];
+            cmdList->SetGraphicsRootShaderResourceView(
+                0, bufferLocation + firstInstance * slotByteSize);
+            cmdList->DrawIndexedInstanced(lod->IndexCount,
+                                          instanceCount,
+                                          lod->StartIndexLocation,
+                                          lod->BaseVertexLocation,
+                                          0);
+            firstInstance += instanceCount;
+        }
+
+        for (const auto &draw : item->clusterDraws) {
+            cmdList->SetGraphicsRootShaderResourceView(
+                0, bufferLocation + draw.instance * slotByteSize);
+            cmdList->DrawIndexedInstanced(draw.indexCount,
+                                          1,
+                                          item->startIndexLocation + draw.startIndex,
+                                          item->baseVertexLocation,
+                                          0);
+        }
     }
 }
 
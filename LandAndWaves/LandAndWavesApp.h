@@ -1,4 +1,6 @@
 #pragma once
+#include <unordered_set>
+
 #include "FrameResource.h"
 #include "Waves.h"
 
@@ -6,11 +8,70 @@
 #include "../Common/UploadBuffer.h"
 #include "../Common/d3dApp.h"
 #include "../Common/Camera.h"
+#include "../Common/DrawSort.h"
+#include "../Common/FrustumCuller.h"
+#include "../Common/InstanceBvh.h"
+#include "../Common/MeshFile.h"
+#include "../Common/MeshOptimizer.h"
+#include "../Common/MeshSimplifier.h"
+#include "../Common/MeshletBuilder.h"
+#include "../Common/OcclusionCuller.h"
+#include "../Common/SceneStore.h"
+#include "../Common/TextModelParser.h"
+#include "../Common/TextureArrayPacker.h"
+#include "../Common/TextureStreamer.h"
+#include "../Common/TransformHierarchy.h"
+#include "../Common/VertexQuantizer.h"
+#include "../Common/VisibilityCache.h"
+#include "../Common/WorkerPool.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
 using namespace DirectX::PackedVector;
 
+// The visible clusters of an instance drawn in part, as one range of the render item's indices.
+struct ClusterDraw
+{
+    // Relative to the render item's objCBIndex and startIndexLocation.
+    UINT instance = 0;
+    UINT startIndex = 0;
+    UINT indexCount = 0;
+};
+
+// What UpdateInstanceBuffer's first pass decides for a chunk of the visible instances, and where
+// its second pass writes them.  Buckets are numbered within the chunk, from firstBucket.
+struct CullChunk
+{
+    static const UINT kCulled = UINT(-1);
+
+    // Bucket of each instance, or kCulled when none of its clusters is visible.
+    std::vector<UINT> buckets;
+    // Cluster ranges of the instances drawn in part, in the chunk's order.
+    std::vector<ClusterDraw> clusterDraws;
+    UINT firstBucket = 0;
+    // Instances and cluster draws of each bucket, and where in the instance buffer and the
+    // render item's clusterDraws they go.
+    std::vector<UINT> bucketCounts;
+    std::vector<UINT> clusterDrawCounts;
+    std::vector<UINT> bucketOffsets;
+    std::vector<UINT> clusterDrawOffsets;
+    size_t drawnIndexCount = 0;
+    // Instances dropped for covering too little of the screen.
+    size_t tooSmallCount = 0;
+    std::vector<float> materialScreenSize;
+    // Distance of each render item's nearest and farthest instance drawn.
+    std::vector<float> itemNearest;
+    std::vector<float> itemFarthest;
+};
+
+// An instance of a render item as built; BuildScene moves it into the scene store.
+struct Instance
+{
+    XMFLOAT4X4 world = MathHelper::Identity4x4();
+    XMFLOAT4X4 texTransform = MathHelper::Identity4x4();
+    UINT materialIndex = 0;
+};
+
 struct RenderItem
 {
     RenderItem() = default;
@@ -19,8 +80,7 @@ struct RenderItem
 
     XMFLOAT4X4 texTransform = MathHelper::Identity4x4();
 
-    int numFramesDirty = gNumFrameResources;
-
+    // The first of the item's instances in the visible list, set each frame.
     UINT objCBIndex = -1;
 
     MeshGeometry *geo = nullptr;
@@ -29,12 +89,33 @@ struct RenderItem
     D3D12_PRIMITIVE_TOPOLOGY primitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
     BoundingBox boundingBox;
-    std::vector<InstanceData> instances;
+    std::vector<Instance> instances;
+    // The instances in the scene store, once built.
+    std::vector<SceneStore::Handle> handles;
+    // Whether instances the occluders hide are dropped; only for items drawn in the main pass,
+    // as reflections and shadows show where the occluders are not.
+    bool occlusionCulled = false;
 
     UINT indexCount = 0;
     UINT instanceCount = 0;
     UINT startIndexLocation = 0;
     int baseVertexLocation = 0;
+
+    // Clusters of the submesh culled per instance, or nullptr to always draw instances whole.
+    const std::vector<MeshletBuilder::Meshlet> *meshlets = nullptr;
+    // Coarser levels of detail of the submesh, finest first, and the number of instances drawn
+    // with each, after the instanceCount instances drawn at full detail.
+    std::vector<const SubmeshGeometry *> lods;
+    std::vector<UINT> lodInstanceCounts;
+
+    // Instances with clusters culled, after those drawn whole.
+    std::vector<ClusterDraw> clusterDraws;
+
+    // The PSO variant, material and geometry its draws need, packed by DrawSort::MakeState, and
+    // the distance of its nearest and farthest instance drawn, which place it in its layers.
+    uint64_t drawState = 0;
+    float nearestDistance = 0.0f;
+    float farthestDistance = 0.0f;
 };
 
 enum class RenderLayer : int { 
@@ -73,10 +154,14 @@ private:
 
     void AnimateMaterials(const GameTimer &gt);
     //void UpdateCamera(const GameTimer &gt);
+    void UpdateTransforms();
+    void UpdateInstanceBounds();
     void UpdateInstanceBuffer(const GameTimer &gt);
     void UpdateMainPassCB(const GameTimer &gt);
     void UpdateMaterialBuffer(const GameTimer &gt);
     void UpdateReflectedPassCB(const GameTimer &gt);
+    void UpdateTexturePriorities();
+    void SortDraws();
 
     void UpdateWaves(const GameTimer &gt);
 
@@ -94,16 +179,26 @@ private:
     void BuildMaterial();
 
     void BuildRenderItems();
+    void BuildScene();
     void BuildInstanceDataForSkullRenderItem(RenderItem* renderItem);
+    void AddOccluder(const RenderItem &item);
 
     void BuildFrameResources();
     void BuildDescriptorHeaps();
+    void BuildTextureSRV(const Texture *texture, UINT heapIndex);
+    UINT GetInactiveSrvSlot(UINT textureIndex) const;
+    void OnTextureChanged(const Texture *texture);
+    int ResolveSrvHeapIndex(int srvHeapIndex, const std::string &placeholderName, UINT &slice);
     void BuildRootSignature();
     void BuildShadersAndInputLayout();
     void BuildPSOs();
 
-    void DrawRenderItems(
-        ID3D12GraphicsCommandList *cmdList, const std::vector<RenderItem *> &renderItems);
+    // Draws the layer's render items in their sorted order with the PSO named psoName, or with
+    // its "_quantized" twin for quantized geometry, binding the position-only streams for
+    // position-only PSOs.  State the previous item left is not set again.
+    void DrawRenderItems(ID3D12GraphicsCommandList *cmdList,
+                         RenderLayer layer,
+                         const std::string &psoName);
 
     std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
@@ -125,8 +220,13 @@ private:
 
     std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
     std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+    // PSOs that read the position-only vertex streams.
+    std::unordered_set<std::string> mPositionOnlyPSOs;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> mQuantizedInputLayout;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> mPositionInputLayout;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> mQuantizedPositionInputLayout;
     std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
 
     std::vector<std::unique_ptr<RenderItem>> mAllRenderItems;
@@ -146,7 +246,35 @@ private:
 
     BoundingFrustum mCamFrustum;
 
-    UINT mAllInstanceDataCount = 0;
+    // Every instance of every render item, its mesh the item's index in mAllRenderItems; its
+    // number is also its bounds' in the hierarchy and its slot in the instance buffers.  The
+    // hierarchy is rebuilt when the number of instances changes and refit when some move.
+    SceneStore::Store mScene;
+    InstanceBvh::Tree mInstanceBvh;
+    // Transforms derived from one another, and the instance each node places.
+    TransformHierarchy::Hierarchy mTransforms;
+    std::vector<SceneStore::Handle> mTransformInstances;
+    uint32_t mSkullNode = TransformHierarchy::kNoParent;
+    uint32_t mShadowedSkullNode = TransformHierarchy::kNoParent;
+    // The level of detail each instance was last drawn with.
+    std::vector<uint8_t> mInstanceLodLevels;
+    VisibilityCache::Cache mVisibilityCache;
+    // Frames whose visible instance list still has to be written because what decides the
+    // instances drawn changed; the others' already hold them.
+    int mInstanceBufferFramesDirty = gNumFrameResources;
+
+    // Threads culling and writing the visible instances, and their chunks, kept between frames.
+    WorkerPool mCullWorkers;
+    std::vector<CullChunk> mCullChunks;
+
+    // The render items with instances to draw, once in each of their layers, sorted by their
+    // DrawSort keys, so the layers follow one another; and where each layer's start.  Kept with
+    // the items' counts while the visible instances do not change.
+    std::vector<DrawSort::Entry> mDraws;
+    std::vector<DrawSort::Entry> mDrawScratch;
+    size_t mLayerDrawStarts[(int) RenderLayer::Count + 1] = {};
+    // PSOs and geometry bound by the last frame's draws.
+    size_t mStateChangeCount = 0;
 
     bool mIsWireframe = false;
 
@@ -155,8 +283,35 @@ private:
     POINT mLastMousePos;
 
     bool mFrustumCullingEnabled = true;
+    bool mClusterCullingEnabled = true;
+    bool mLodEnabled = true;
+    bool mOcclusionCullingEnabled = true;
+
+    // Tunable at run time: the error in pixels a level of detail may show to be drawn instead of
+    // a finer one, the share of it an instance's level holds past it either way, and the screen
+    // area in pixels below which instances are not drawn.
+    float mMaxLodPixelError = 1.0f;
+    float mLodHysteresis = 0.25f;
+    float mMinScreenArea = 1.0f;
+
+    // Static geometry in world space that hides what is behind it, and the CPU depth buffer drawn
+    // from it each frame the instances are culled.
+    std::vector<OcclusionCuller::Mesh> mOccluders;
+    OcclusionCuller::DepthBuffer mOcclusionBuffer;
 
     // 
     std::unordered_map<std::string, uint32_t> mDynamicTextureIndex;
     std::vector<Texture*> mSRVHeapTexture;
+    // Indexed by mDynamicTextureIndex: the 2D texture table entry (mSRVHeapTexture minus the sky)
+    // and slice each texture lives in.
+    std::vector<TextureArrayPacker::ArraySlice> mTextureSlices;
+
+    // Packed textures, when Assets/Textures/Textures.pak has been built. Declared before the
+    // streamer so it outlives the streamer's worker threads.
+    std::unique_ptr<TextureArchive> mTextureArchive;
+    std::unique_ptr<TextureStreamer> mTextureStreamer;
+    // Largest visible screen size of each material this frame, indexed by MatCBIndex.
+    std::vector<float> mMaterialScreenSize;
+    // Heap slot holding the live SRV of each texture, indexed like mSRVHeapTexture.
+    std::vector<UINT> mCurrentSrvSlot;
 };
\ No newline at end of file
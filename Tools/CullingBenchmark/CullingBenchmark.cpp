@@ -0,0 +1,785 @@
+// Measures Common/FrustumCuller against the per-instance local space test UpdateInstanceBuffer
+// used before it, Common/InstanceBvh against the flat kernel, Common/VisibilityCache against
+// culling every frame, and the kernel split over a Common/WorkerPool, on a scene of randomly
+// placed, rotated and scaled boxes, and checks the bookkeeping of Common/SceneStore they are fed
+// from, down to the instance buffer slots the app writes from it as its buffers grow.  Portable
+// C++17, built outside the Visual Studio solution:
+//
+//   g++ -std=c++17 -O2 -pthread -o CullingBenchmark CullingBenchmark.cpp ../../Common/FrustumCuller.cpp ../../Common/InstanceBvh.cpp ../../Common/SceneStore.cpp ../../Common/VisibilityCache.cpp ../../Common/WorkerPool.cpp
+//   ./CullingBenchmark --count 100000
+//
+// Add -mavx2 (or /arch:AVX2) to build the AVX2 kernel.
+
+#include "../../Common/BufferUsage.h"
+#include "../../Common/FrustumCuller.h"
+#include "../../Common/InstanceBvh.h"
+#include "../../Common/SceneStore.h"
+#include "../../Common/VisibilityCache.h"
+#include "../../Common/WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using FrustumCuller::Box;
+using FrustumCuller::Containment;
+
+namespace
+{
+// Row-major, row vector matrices, as DirectXMath's.
+struct Matrix
+{
+    float m[16];
+};
+
+Matrix Multiply(const Matrix &a, const Matrix &b)
+{
+    Matrix result;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                sum += a.m[i * 4 + k] * b.m[k * 4 + j];
+            }
+            result.m[i * 4 + j] = sum;
+        }
+    }
+    return result;
+}
+
+// The general inverse by cofactors, as XMMatrixInverse computes it.
+Matrix Inverse(const Matrix &matrix)
+{
+    const float *m = matrix.m;
+    float inv[16];
+    inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15]
+             + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15]
+             - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15]
+             + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14]
+              - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15]
+             - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15]
+             + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15]
+             - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14]
+              + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15]
+             + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15]
+             - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15]
+              + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14]
+              - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11]
+             - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11]
+             + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11]
+              - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10]
+              + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    float determinant = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    Matrix result;
+    for (int i = 0; i < 16; ++i) {
+        result.m[i] = inv[i] / determinant;
+    }
+    return result;
+}
+
+// XMMatrixLookAtLH and XMMatrixPerspectiveFovLH.
+Matrix LookAt(const float eye[3], const float target[3])
+{
+    float z[3] = {target[0] - eye[0], target[1] - eye[1], target[2] - eye[2]};
+    float length = std::sqrt(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+    for (float &c : z) {
+        c /= length;
+    }
+    float x[3] = {z[2], 0.0f, -z[0]};
+    length = std::sqrt(x[0] * x[0] + x[2] * x[2]);
+    x[0] /= length;
+    x[2] /= length;
+    float y[3] = {z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0]};
+    auto dot = [&](const float *a) { return -(a[0] * eye[0] + a[1] * eye[1] + a[2] * eye[2]); };
+    return {{x[0], y[0], z[0], 0.0f,
+             x[1], y[1], z[1], 0.0f,
+             x[2], y[2], z[2], 0.0f,
+             dot(x), dot(y), dot(z), 1.0f}};
+}
+
+Matrix Perspective(float fovY, float aspect, float nearZ, float farZ)
+{
+    float yScale = 1.0f / std::tan(0.5f * fovY);
+    float range = farZ / (farZ - nearZ);
+    return {{yScale / aspect, 0.0f, 0.0f, 0.0f,
+             0.0f, yScale, 0.0f, 0.0f,
+             0.0f, 0.0f, range, 1.0f,
+             0.0f, 0.0f, -range * nearZ, 0.0f}};
+}
+
+Matrix Transform(float yaw, float pitch, float scale, const float translation[3])
+{
+    float cy = std::cos(yaw), sy = std::sin(yaw);
+    float cp = std::cos(pitch), sp = std::sin(pitch);
+    // Pitch about x, then yaw about y.
+    return {{scale * cy, 0.0f, -scale * sy, 0.0f,
+             scale * sy * sp, scale * cp, scale * cy * sp, 0.0f,
+             scale * sy * cp, -scale * sp, scale * cy * cp, 0.0f,
+             translation[0], translation[1], translation[2], 1.0f}};
+}
+
+// The plane transformed into the space a row vector matrix maps points to from the plane's;
+// the matrix must be the inverse of the points' transform.
+FrustumCuller::Plane TransformPlane(const FrustumCuller::Plane &plane, const Matrix &inverse)
+{
+    const float p[4] = {plane.a, plane.b, plane.c, plane.d};
+    float q[4];
+    for (int i = 0; i < 4; ++i) {
+        q[i] = inverse.m[i * 4 + 0] * p[0] + inverse.m[i * 4 + 1] * p[1]
+               + inverse.m[i * 4 + 2] * p[2] + inverse.m[i * 4 + 3] * p[3];
+    }
+    float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+    return {q[0] / length, q[1] / length, q[2] / length, q[3] / length};
+}
+
+struct Scene
+{
+    Box localBox;
+    std::vector<Matrix> worlds;
+    Matrix view;
+    // Looking up from above the instances, which are all out of sight.
+    Matrix skyView;
+    Matrix proj;
+};
+
+Scene BuildScene(size_t count, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> angle(-3.14159265f, 3.14159265f);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+    Scene scene;
+    scene.localBox = {{0.0f, 0.5f, 0.0f}, {1.0f, 1.5f, 0.75f}};
+    scene.worlds.resize(count);
+    for (auto &world : scene.worlds) {
+        float translation[3] = {position(random), position(random), position(random)};
+        world = Transform(angle(random), angle(random), scale(random), translation);
+    }
+    const float eye[3] = {-120.0f, 40.0f, -300.0f};
+    const float target[3] = {0.0f, 0.0f, 0.0f};
+    scene.view = LookAt(eye, target);
+    const float skyEye[3] = {0.0f, 600.0f, 0.0f};
+    const float skyTarget[3] = {0.0f, 1000.0f, 100.0f};
+    scene.skyView = LookAt(skyEye, skyTarget);
+    scene.proj = Perspective(0.25f * 3.14159265f, 16.0f / 9.0f, 1.0f, 1000.0f);
+    return scene;
+}
+
+// Boxes whose containment and bounds are known by hand, against Test, TransformBox and the
+// kernel, on more boxes than a SIMD batch so that the remainder is tested too.  Returns what
+// failed first, or null.
+const char *CheckFrustumCuller(const Scene &scene)
+{
+    auto frustum = FrustumCuller::ExtractFrustum(Multiply(scene.view, scene.proj).m);
+    const FrustumCuller::Box inside = {{0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}};
+    const FrustumCuller::Box behind = {{-240.0f, 80.0f, -600.0f}, {1.0f, 1.0f, 1.0f}};
+    const FrustumCuller::Box around = {{-120.0f, 40.0f, -300.0f}, {5.0f, 5.0f, 5.0f}};
+    if (FrustumCuller::Test(frustum, inside) != FrustumCuller::kInside
+        || FrustumCuller::Test(frustum, behind) != FrustumCuller::kOutside
+        || FrustumCuller::Test(frustum, around) != FrustumCuller::kIntersects)
+        return "Test gives the wrong containment";
+
+    // Turned a quarter about y and doubled, x takes the local z extent and z the local x one.
+    const float translation[3] = {10.0f, 0.0f, 0.0f};
+    auto world = Transform(0.5f * 3.14159265f, 0.0f, 2.0f, translation);
+    auto box = FrustumCuller::TransformBox(scene.localBox, world.m);
+    const float center[3] = {10.0f, 1.0f, 0.0f};
+    const float extents[3] = {1.5f, 3.0f, 2.0f};
+    for (int c = 0; c < 3; ++c) {
+        if (std::fabs(box.center[c] - center[c]) > 1e-4f
+            || std::fabs(box.extents[c] - extents[c]) > 1e-4f)
+            return "TransformBox gives the wrong bounds";
+    }
+
+    const FrustumCuller::Box boxes[3] = {inside, behind, around};
+    FrustumCuller::BoxArray bounds;
+    bounds.Resize(11);
+    for (size_t i = 0; i < bounds.Size(); ++i) {
+        bounds.Set(i, boxes[i % 3]);
+    }
+    uint8_t containments[11];
+    FrustumCuller::Cull(frustum, bounds, 0, bounds.Size(), containments);
+    for (size_t i = 0; i < bounds.Size(); ++i) {
+        if (containments[i] != FrustumCuller::Test(frustum, boxes[i % 3]))
+            return "the kernel differs from Test";
+    }
+    return nullptr;
+}
+
+template <typename Function>
+double MeasureNanoseconds(size_t count, int passes, Function function)
+{
+    double best = 1e30;
+    for (int pass = 0; pass < passes; ++pass) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        double seconds
+            = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+    }
+    return best * 1e9 / double(count);
+}
+
+template <typename Function>
+double MeasureMilliseconds(int passes, Function function)
+{
+    return MeasureNanoseconds(1000000, passes, function);
+}
+
+// The hierarchy against the flat kernel it must agree with, from both views and after 1% of the
+// instances moved, built over all of them and grown by inserting 1% one at a time.  Returns false
+// if they disagree.
+bool RunBvhBenchmark(const Scene &scene, FrustumCuller::BoxArray &bounds, int passes, unsigned seed)
+{
+    size_t count = bounds.Size();
+    InstanceBvh::Tree tree;
+    double buildTime = MeasureMilliseconds(passes, [&] { InstanceBvh::Build(bounds, tree); });
+
+    size_t addedCount = std::max<size_t>(count / 100, 1);
+    InstanceBvh::Tree grown;
+    FrustumCuller::BoxArray growing;
+    growing.Resize(count - addedCount);
+    for (size_t i = 0; i < growing.Size(); ++i) {
+        growing.Set(i, bounds.Get(i));
+    }
+    InstanceBvh::Build(growing, grown);
+    double insertTime = MeasureMilliseconds(1, [&] {
+        for (size_t i = count - addedCount; i < count; ++i) {
+            growing.Resize(i + 1);
+            growing.Set(i, bounds.Get(i));
+            InstanceBvh::Insert(grown, growing);
+        }
+    });
+
+    std::mt19937 random(seed + 1);
+    std::uniform_int_distribution<uint32_t> pick(0, uint32_t(count - 1));
+    std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+    std::vector<uint32_t> moved(std::max<size_t>(count / 100, 1));
+    for (auto &instance : moved) {
+        instance = pick(random);
+        auto box = bounds.Get(instance);
+        for (float &c : box.center) {
+            c += offset(random);
+        }
+        bounds.Set(instance, box);
+    }
+    double refitTime = MeasureMilliseconds(passes, [&] {
+        InstanceBvh::Refit(tree, bounds, moved.data(), moved.size());
+    });
+    InstanceBvh::Refit(grown, bounds, moved.data(), moved.size());
+
+    printf("  hierarchy build        %8.2f ms, %zu nodes\n", buildTime, tree.nodes.size());
+    printf("  hierarchy insert       %8.2f ms for %zu instances one at a time\n",
+           insertTime,
+           addedCount);
+    printf("  hierarchy refit        %8.2f ms for %zu moved instances\n", refitTime, moved.size());
+
+    bool agree = true;
+    const std::pair<const char *, const Matrix *> views[] = {{"scene", &scene.view},
+                                                             {"sky", &scene.skyView}};
+    for (const auto &view : views) {
+        auto frustum = FrustumCuller::ExtractFrustum(Multiply(*view.second, scene.proj).m);
+        std::vector<uint8_t> flat(count);
+        double flatTime = MeasureMilliseconds(passes, [&] {
+            FrustumCuller::Cull(frustum, bounds, 0, count, flat.data());
+        });
+        std::vector<InstanceBvh::VisibleInstance> visible, grownVisible;
+        double bvhTime = MeasureMilliseconds(passes, [&] {
+            InstanceBvh::Cull(tree, frustum, visible);
+        });
+        double grownTime = MeasureMilliseconds(passes, [&] {
+            InstanceBvh::Cull(grown, frustum, grownVisible);
+        });
+
+        size_t flatVisible = count - std::count(flat.begin(), flat.end(), FrustumCuller::kOutside);
+        bool same = flatVisible == visible.size() && flatVisible == grownVisible.size();
+        for (const auto &instance : visible) {
+            same = same && flat[instance.instance] != FrustumCuller::kOutside;
+        }
+        for (const auto &instance : grownVisible) {
+            same = same && flat[instance.instance] != FrustumCuller::kOutside;
+        }
+        agree = agree && same;
+        printf("  %-5s view, %6zu visible: kernel %8.3f ms, hierarchy %8.3f ms  %6.1fx, "
+               "grown %8.3f ms%s\n",
+               view.first,
+               visible.size(),
+               flatTime,
+               bvhTime,
+               flatTime / bvhTime,
+               grownTime,
+               same ? "" : "  (differ)");
+    }
+    return agree;
+}
+
+// Whether two lists hold the same instances with the same containments, in any order.
+bool SameVisible(std::vector<InstanceBvh::VisibleInstance> a,
+                 std::vector<InstanceBvh::VisibleInstance> b)
+{
+    auto less = [](const InstanceBvh::VisibleInstance &x, const InstanceBvh::VisibleInstance &y) {
+        return x.instance < y.instance;
+    };
+    std::sort(a.begin(), a.end(), less);
+    std::sort(b.begin(), b.end(), less);
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const auto &x, const auto &y) {
+        return x.instance == y.instance && x.containment == y.containment;
+    });
+}
+
+// The cache's update with the camera still, first with nothing moved and then with 0.1% of the
+// instances moved each frame, against culling the hierarchy again.  Returns false if the cache
+// ends up with other instances than the hierarchy.
+bool RunCacheBenchmark(const Scene &scene, FrustumCuller::BoxArray bounds, int passes, unsigned seed)
+{
+    size_t count = bounds.Size();
+    InstanceBvh::Tree tree;
+    InstanceBvh::Build(bounds, tree);
+    auto viewProj = Multiply(scene.view, scene.proj);
+    auto frustum = FrustumCuller::ExtractFrustum(viewProj.m);
+
+    VisibilityCache::Cache cache;
+    std::vector<uint32_t> generations(count, 0);
+    uint32_t generation = 0;
+    double fullTime = MeasureMilliseconds(passes, [&] {
+        VisibilityCache::Invalidate(cache);
+        VisibilityCache::Update(cache, tree, viewProj.m, generations.data(), generation);
+    });
+    double steadyTime = MeasureMilliseconds(passes, [&] {
+        VisibilityCache::Update(cache, tree, viewProj.m, generations.data(), generation);
+    });
+
+    // Instances drift a little every frame, as the skull does, and only they are tested again.
+    std::mt19937 random(seed + 2);
+    std::uniform_int_distribution<uint32_t> pick(0, uint32_t(count - 1));
+    std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+    std::vector<uint32_t> moved(std::max<size_t>(count / 1000, 1));
+    size_t retested = 0;
+    double movedTime = MeasureMilliseconds(passes, [&] {
+        ++generation;
+        for (auto &instance : moved) {
+            instance = pick(random);
+            auto box = bounds.Get(instance);
+            for (float &c : box.center) {
+                c += offset(random);
+            }
+            bounds.Set(instance, box);
+            generations[instance] = generation;
+        }
+        InstanceBvh::Refit(tree, bounds, moved.data(), moved.size());
+        retested = VisibilityCache::Update(
+                       cache, tree, viewProj.m, generations.data(), generation)
+                       .retested;
+    });
+
+    std::vector<InstanceBvh::VisibleInstance> visible;
+    InstanceBvh::Cull(tree, frustum, visible);
+    bool same = SameVisible(cache.visible, visible);
+    printf("  cache full cull        %8.3f ms\n", fullTime);
+    printf("  cache, nothing moved   %8.3f ms\n", steadyTime);
+    printf("  cache, %4zu moved      %8.3f ms (refit included), %zu retested%s\n",
+           moved.size(),
+           movedTime,
+           retested,
+           same ? "" : "  (differs from the hierarchy)");
+    return same;
+}
+
+// Only moved instances are tested again while the camera stays, and moving the camera culls
+// everything again.  Returns what failed first, or null.
+const char *CheckVisibilityCache(const Scene &scene)
+{
+    // One box at the point the scene view looks at, one behind the camera.
+    FrustumCuller::BoxArray bounds;
+    bounds.Resize(2);
+    bounds.Set(0, {{0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}});
+    bounds.Set(1, {{-240.0f, 80.0f, -600.0f}, {1.0f, 1.0f, 1.0f}});
+    InstanceBvh::Tree tree;
+    InstanceBvh::Build(bounds, tree);
+    auto viewProj = Multiply(scene.view, scene.proj);
+
+    VisibilityCache::Cache cache;
+    std::vector<uint32_t> generations(2, 0);
+    auto stats = VisibilityCache::Update(cache, tree, viewProj.m, generations.data(), 0);
+    if (!stats.fullCull || cache.visible.size() != 1 || cache.visible[0].instance != 0)
+        return "the first update does not cull everything";
+
+    stats = VisibilityCache::Update(cache, tree, viewProj.m, generations.data(), 0);
+    if (stats.fullCull || stats.retested != 0 || cache.visible.size() != 1)
+        return "an update with nothing moved tests instances again";
+
+    // The box behind the camera moves next to the other.
+    const uint32_t moved = 1;
+    bounds.Set(moved, {{10.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}});
+    generations[moved] = 1;
+    InstanceBvh::Refit(tree, bounds, &moved, 1);
+    stats = VisibilityCache::Update(cache, tree, viewProj.m, generations.data(), 1);
+    if (stats.fullCull || stats.retested != 1 || cache.visible.size() != 2)
+        return "a moved instance is not tested again alone";
+
+    auto skyViewProj = Multiply(scene.skyView, scene.proj);
+    stats = VisibilityCache::Update(cache, tree, skyViewProj.m, generations.data(), 1);
+    if (!stats.fullCull || !cache.visible.empty())
+        return "a moved camera does not cull everything again";
+    return nullptr;
+}
+
+// The kernel run in chunks on pools of growing size, each chunk counting its visible instances so
+// that a prefix sum places them in the visible list, as UpdateInstanceBuffer does.  Returns false
+// if any pool's list differs from the one of a single thread.
+bool RunThreadedBenchmark(const FrustumCuller::Frustum &frustum,
+                          const FrustumCuller::BoxArray &bounds,
+                          int passes)
+{
+    const size_t kChunkSize = 256;
+    size_t count = bounds.Size();
+    size_t chunkCount = (count + kChunkSize - 1) / kChunkSize;
+    std::vector<unsigned> threadCounts = {1, 2, 4};
+    if (std::thread::hardware_concurrency() > 4) {
+        threadCounts.push_back(std::thread::hardware_concurrency());
+    }
+
+    std::vector<uint32_t> reference;
+    bool agree = true;
+    for (unsigned threadCount : threadCounts) {
+        WorkerPool pool(threadCount);
+        std::vector<uint8_t> containments(count);
+        std::vector<uint32_t> chunkCounts(chunkCount), chunkOffsets(chunkCount);
+        std::vector<uint32_t> visible;
+        double time = MeasureMilliseconds(passes, [&] {
+            pool.Run(chunkCount, [&](size_t chunk) {
+                size_t begin = chunk * kChunkSize, end = std::min(begin + kChunkSize, count);
+                FrustumCuller::Cull(frustum, bounds, begin, end, &containments[begin]);
+                chunkCounts[chunk] = uint32_t(std::count_if(
+                    containments.begin() + begin, containments.begin() + end, [](uint8_t c) {
+                        return c != FrustumCuller::kOutside;
+                    }));
+            });
+            uint32_t total = 0;
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+                chunkOffsets[chunk] = total;
+                total += chunkCounts[chunk];
+            }
+            visible.resize(total);
+            pool.Run(chunkCount, [&](size_t chunk) {
+                size_t begin = chunk * kChunkSize, end = std::min(begin + kChunkSize, count);
+                uint32_t next = chunkOffsets[chunk];
+                for (size_t i = begin; i < end; ++i) {
+                    if (containments[i] != FrustumCuller::kOutside) {
+                        visible[next++] = uint32_t(i);
+                    }
+                }
+            });
+        });
+
+        if (threadCount == 1) {
+            reference = visible;
+        }
+        bool same = visible == reference;
+        agree = agree && same;
+        printf("  %2u thread chunked kernel %7.3f ms%s\n",
+               threadCount,
+               time,
+               same ? "" : "  (differs from 1 thread)");
+    }
+    return agree;
+}
+
+// Handles follow the instances the store renumbers and find nothing once theirs is removed, and
+// only frames in which something moved close a generation.  Returns what failed first, or null.
+const char *CheckSceneStore()
+{
+    SceneStore::Store store;
+    std::vector<uint32_t> moved;
+    SceneStore::Handle handles[3];
+    for (uint32_t i = 0; i < 3; ++i) {
+        SceneStore::Instance instance;
+        instance.mesh = i;
+        handles[i] = SceneStore::Add(store, instance);
+    }
+    uint32_t generation = SceneStore::TakeMoved(store, moved);
+    if (moved.size() != 3 || generation != 1)
+        return "added instances are not moved";
+
+    generation = SceneStore::TakeMoved(store, moved);
+    if (!moved.empty() || generation != 1 || store.generation != 1)
+        return "a frame with nothing moved changes the generation";
+
+    const SceneStore::Matrix world = {};
+    SceneStore::SetWorld(store, 1, world);
+    SceneStore::SetWorld(store, 1, world);
+    generation = SceneStore::TakeMoved(store, moved);
+    if (moved != std::vector<uint32_t>{1} || generation != 2 || store.movedGenerations[1] != 2)
+        return "an instance moved twice is not listed once";
+
+    // Removing the first instance moves the last into its place.
+    if (!SceneStore::Remove(store, handles[0]))
+        return "a live handle does not remove its instance";
+    if (SceneStore::Size(store) != 2 || SceneStore::Find(store, handles[2]) != 0
+        || store.meshes[0] != 2)
+        return "the last instance does not take the removed one's place";
+    if (SceneStore::Find(store, handles[0]) != SceneStore::kInvalid
+        || SceneStore::Remove(store, handles[0]))
+        return "a removed instance's handle still finds one";
+    SceneStore::TakeMoved(store, moved);
+    if (moved != std::vector<uint32_t>{0})
+        return "the renumbered instance is not moved";
+
+    auto reused = SceneStore::Add(store, {});
+    if (reused.slot != handles[0].slot || SceneStore::Find(store, reused) != 2
+        || SceneStore::Find(store, handles[0]) != SceneStore::kInvalid)
+        return "a reused slot revives the handle of its old instance";
+    return nullptr;
+}
+
+const char *CheckBufferGrowth()
+{
+    BufferUsage usage;
+    usage.capacity = usage.highWater = 8;
+    if (GrowCapacity(usage, 5) != 0 || GrowCapacity(usage, 8) != 0 || usage.reallocations != 0)
+        return "a buffer large enough is replaced";
+    if (GrowCapacity(usage, 9) != 12 || usage.capacity != 12 || usage.reallocations != 1)
+        return "a buffer one too small does not grow by half";
+    if (GrowCapacity(usage, 40) != 40 || usage.highWater != 40 || usage.reallocations != 2)
+        return "a buffer far too small does not grow to the count";
+    if (GrowCapacity(usage, 10) != 0 || usage.capacity != 40 || usage.highWater != 40)
+        return "a buffer shrinks or forgets its high water mark";
+    BufferUsage empty;
+    if (GrowCapacity(empty, 1) != 1 || GrowCapacity(empty, 2) != 2)
+        return "an empty buffer does not grow";
+    return nullptr;
+}
+
+// The app's instance buffers, one per frame resource, each holding a slot per instance numbered
+// as in the store, grown through GrowCapacity and written through WriteStale when its frame
+// comes round.  After any mix of adds, removes, reused slots and moves, and buffers replaced by
+// larger ones that hold nothing, every instance a handle finds must be in its slot of the buffer
+// drawn from, as the visible lists index it.
+const char *CheckInstanceSlots()
+{
+    const int kFrameResourceCount = 3;
+    struct Slot
+    {
+        uint32_t mesh = SceneStore::kInvalid;
+        float x = 0.0f;
+    };
+    struct InstanceBuffer
+    {
+        std::vector<Slot> slots;
+        BufferUsage usage;
+        uint32_t generation = 0;
+    };
+    InstanceBuffer buffers[kFrameResourceCount];
+
+    SceneStore::Store store;
+    std::vector<std::pair<SceneStore::Handle, uint32_t>> live;
+    std::vector<uint32_t> moved;
+    std::mt19937 random(7);
+    uint32_t nextMesh = 0;
+    for (int frame = 0; frame < 1000; ++frame) {
+        for (uint32_t edit = random() % 5; edit > 0; --edit) {
+            uint32_t kind = random() % 3;
+            if (kind == 0) {
+                SceneStore::Instance instance = {};
+                instance.mesh = nextMesh++;
+                live.push_back({SceneStore::Add(store, instance), instance.mesh});
+            } else if (kind == 1 && !live.empty()) {
+                size_t removed = random() % live.size();
+                if (!SceneStore::Remove(store, live[removed].first))
+                    return "a live handle does not remove its instance";
+                live.erase(live.begin() + removed);
+            } else if (kind == 2 && !live.empty()) {
+                SceneStore::Matrix world = {};
+                world.m[3][0] = float(frame);
+                SceneStore::SetWorld(store, random() % uint32_t(live.size()), world);
+            }
+        }
+        SceneStore::TakeMoved(store, moved);
+
+        auto &buffer = buffers[frame % kFrameResourceCount];
+        uint32_t capacity = GrowCapacity(buffer.usage, uint32_t(SceneStore::Size(store)));
+        if (capacity != 0) {
+            buffer.slots.assign(capacity, Slot());
+        }
+        buffer.generation =
+            SceneStore::WriteStale(store, buffer.generation, capacity != 0, [&](uint32_t i) {
+                buffer.slots[i] = {store.meshes[i], store.worlds[i].m[3][0]};
+            });
+        for (const auto &handle : live) {
+            uint32_t i = SceneStore::Find(store, handle.first);
+            if (i >= SceneStore::Size(store))
+                return "a live handle finds no instance";
+            const auto &slot = buffer.slots[i];
+            if (slot.mesh != handle.second || slot.x != store.worlds[i].m[3][0])
+                return "an instance's slot holds another's or an old transform";
+        }
+    }
+    for (const auto &buffer : buffers) {
+        if (buffer.usage.reallocations < 2 || buffer.slots.size() != buffer.usage.capacity)
+            return "the buffers do not grow with the scene";
+    }
+    return nullptr;
+}
+
+int PrintUsage()
+{
+    fprintf(stderr,
+            "usage: CullingBenchmark [--count <instances>] [--passes <n>] [--seed <n>]\n");
+    return 1;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = 100000;
+    int passes = 10;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc) {
+            count = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--passes" && i + 1 < argc) {
+            passes = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            return PrintUsage();
+        }
+    }
+    if (count == 0 || passes <= 0)
+        return PrintUsage();
+
+    const char *storeFailure = CheckSceneStore();
+    if (storeFailure != nullptr) {
+        printf("error: scene store: %s\n", storeFailure);
+        return 1;
+    }
+    const char *growthFailure = CheckBufferGrowth();
+    if (growthFailure != nullptr) {
+        printf("error: buffer growth: %s\n", growthFailure);
+        return 1;
+    }
+    const char *slotFailure = CheckInstanceSlots();
+    if (slotFailure != nullptr) {
+        printf("error: instance slots: %s\n", slotFailure);
+        return 1;
+    }
+
+    auto scene = BuildScene(count, seed);
+    const char *cullerFailure = CheckFrustumCuller(scene);
+    if (cullerFailure != nullptr) {
+        printf("error: frustum culler: %s\n", cullerFailure);
+        return 1;
+    }
+    const char *cacheFailure = CheckVisibilityCache(scene);
+    if (cacheFailure != nullptr) {
+        printf("error: visibility cache: %s\n", cacheFailure);
+        return 1;
+    }
+    auto viewFrustum = FrustumCuller::ExtractFrustum(scene.proj.m);
+    auto worldFrustum = FrustumCuller::ExtractFrustum(Multiply(scene.view, scene.proj).m);
+
+    // Before: the view space frustum taken into each instance's local space through the inverse
+    // of its world matrix, then tested against the local box.  BoundingFrustum::Transform
+    // decomposes the matrix and moves eight corners, so this is, if anything, a cheap stand-in.
+    std::vector<uint8_t> local(count);
+    double localTime = MeasureNanoseconds(count, passes, [&] {
+        auto invView = Inverse(scene.view);
+        for (size_t i = 0; i < count; ++i) {
+            auto viewToLocal = Multiply(invView, Inverse(scene.worlds[i]));
+            auto localToView = Inverse(viewToLocal);
+            FrustumCuller::Frustum localFrustum;
+            for (size_t p = 0; p < FrustumCuller::kPlaneCount; ++p) {
+                localFrustum.planes[p] = TransformPlane(viewFrustum.planes[p], localToView);
+            }
+            local[i] = FrustumCuller::Test(localFrustum, scene.localBox);
+        }
+    });
+
+    // After: world bounds, refreshed only for instances that moved, then the kernel.
+    FrustumCuller::BoxArray bounds;
+    bounds.Resize(count);
+    double refreshTime = MeasureNanoseconds(count, passes, [&] {
+        for (size_t i = 0; i < count; ++i) {
+            bounds.Set(i, FrustumCuller::TransformBox(scene.localBox, scene.worlds[i].m));
+        }
+    });
+
+    std::vector<uint8_t> scalar(count);
+    double scalarTime = MeasureNanoseconds(count, passes, [&] {
+        for (size_t i = 0; i < count; ++i) {
+            scalar[i] = FrustumCuller::Test(worldFrustum, bounds.Get(i));
+        }
+    });
+
+    std::vector<uint8_t> simd(count);
+    double simdTime = MeasureNanoseconds(count, passes, [&] {
+        FrustumCuller::Cull(worldFrustum, bounds, 0, count, simd.data());
+    });
+
+    // The world bounds enclose the rotated boxes, so they may keep instances the local test
+    // drops, but must never drop one it keeps.
+    size_t visible = 0, extra = 0, missed = 0, mismatches = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bool localVisible = local[i] != FrustumCuller::kOutside;
+        bool worldVisible = simd[i] != FrustumCuller::kOutside;
+        visible += worldVisible;
+        extra += worldVisible && !localVisible;
+        missed += localVisible && !worldVisible;
+        mismatches += simd[i] != scalar[i];
+    }
+
+    printf("%zu instances, %zu visible (%zu kept only by the world bounds), kernel %s\n",
+           count,
+           visible,
+           extra,
+           FrustumCuller::GetInstructionSet());
+    printf("  local space test       %8.2f ns/instance\n", localTime);
+    printf("  world bounds refresh   %8.2f ns/instance\n", refreshTime);
+    printf("  world scalar test      %8.2f ns/instance  %6.1fx\n",
+           scalarTime,
+           localTime / scalarTime);
+    printf("  world %-6s kernel    %8.2f ns/instance  %6.1fx\n",
+           FrustumCuller::GetInstructionSet(),
+           simdTime,
+           localTime / simdTime);
+    bool threadsAgree = RunThreadedBenchmark(worldFrustum, bounds, passes);
+    bool cacheAgrees = RunCacheBenchmark(scene, bounds, passes, seed);
+    bool bvhAgrees = RunBvhBenchmark(scene, bounds, passes, seed);
+    if (missed != 0 || mismatches != 0 || !bvhAgrees || !threadsAgree || !cacheAgrees) {
+        printf("error: %zu visible instances culled, %zu kernel results differ from Test, "
+               "hierarchy %s the kernel, thread counts %s, cache %s the hierarchy\n",
+               missed,
+               mismatches,
+               bvhAgrees ? "agrees with" : "differs from",
+               threadsAgree ? "agree" : "disagree",
+               cacheAgrees ? "agrees with" : "differs from");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Checks MeshSimplifier::SelectLevel: the coarsest level under the error limit, the level drawn
+// before held within the hysteresis either way, and an instance whose error wavers around the
+// limit from frame to frame keeping its level.  Portable C++17, built outside the Visual Studio
+// solution:
+//
+//   g++ -std=c++17 -O2 -o LodSelectionTest LodSelectionTest.cpp
+//   ./LodSelectionTest
+
+#include "../../Common/MeshSimplifier.h"
+
+#include <cstdio>
+
+namespace
+{
+// Errors of levels 1 to 4, in pixels at one pixel per unit.
+const float kErrors[] = {1.0f, 2.0f, 4.0f, 8.0f};
+const size_t kLevelCount = 4;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what)
+{
+    if (!condition) {
+        printf("  failed: %s\n", what);
+        ++gFailures;
+    }
+}
+
+size_t Select(float pixelsPerUnit, float maxError, float hysteresis, size_t current)
+{
+    return MeshSimplifier::SelectLevel(
+        kLevelCount,
+        [&](size_t i) { return kErrors[i] * pixelsPerUnit; },
+        maxError,
+        hysteresis,
+        current);
+}
+
+void CheckCoarsestUnderLimit()
+{
+    Check(Select(1.0f, 3.0f, 0.0f, 0) == 2, "the coarsest level under the limit is drawn");
+    Check(Select(1.0f, 3.0f, 0.0f, 4) == 2, "a coarser level than allowed is refined");
+    Check(Select(1.0f, 0.5f, 0.0f, 3) == 0, "the full mesh is drawn when no level fits");
+    Check(Select(0.01f, 1.0f, 0.0f, 0) == kLevelCount, "the last level is drawn from afar");
+    Check(MeshSimplifier::SelectLevel(0, [](size_t) { return 0.0f; }, 1.0f, 0.25f, 2) == 0,
+          "a mesh without levels is drawn whole");
+}
+
+void CheckHysteresis()
+{
+    // Under a limit of 2.1 with a quarter of hysteresis, level 1 must be drawn (1 <= 1.68) and
+    // level 2 may be (2 <= 2.625), but not level 3.
+    Check(Select(1.0f, 2.1f, 0.25f, 0) == 1, "a finer level than needed is given up");
+    Check(Select(1.0f, 2.1f, 0.25f, 1) == 1, "a level inside the band is held");
+    Check(Select(1.0f, 2.1f, 0.25f, 2) == 2, "a coarser level inside the band is held");
+    Check(Select(1.0f, 2.1f, 0.25f, 3) == 2, "a level past the band is refined");
+}
+
+void CheckWaveringError()
+{
+    // Level 2's error wavers around the limit of 2 as the instance moves back and forth.
+    size_t withoutHysteresis = 2, withHysteresis = 2;
+    size_t switches = 0;
+    bool held = true;
+    for (int frame = 0; frame < 20; ++frame) {
+        float pixelsPerUnit = frame % 2 == 0 ? 1.05f : 0.95f;
+        size_t level = Select(pixelsPerUnit, 2.0f, 0.0f, withoutHysteresis);
+        switches += level != withoutHysteresis;
+        withoutHysteresis = level;
+        withHysteresis = Select(pixelsPerUnit, 2.0f, 0.25f, withHysteresis);
+        held = held && withHysteresis == 2;
+    }
+    Check(switches > 0, "without hysteresis the level switches");
+    Check(held, "with hysteresis the level holds");
+}
+} // namespace
+
+int main()
+{
+    CheckCoarsestUnderLimit();
+    CheckHysteresis();
+    CheckWaveringError();
+    if (gFailures > 0) {
+        printf("error: %d checks failed\n", gFailures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,458 @@
+// Converts the text models in Assets/Models into binary meshes (see Common/MeshFileFormat.h).
+// Portable C++17, built outside the Visual Studio solution:
+//
+//   g++ -std=c++17 -O2 -pthread -o MeshConverter MeshConverter.cpp ../../Common/MeshletBuilder.cpp ../../Common/MeshOptimizer.cpp ../../Common/MeshSimplifier.cpp ../../Common/TextModelParser.cpp ../../Common/VertexQuantizer.cpp
+//   ./MeshConverter ../../Assets/Models/skull.mesh ../../Assets/Models/skull.txt
+//   ./MeshConverter --bench ../../Assets/Models/skull.mesh ../../Assets/Models/skull.txt
+//
+// Each input becomes a submesh named after its file, sharing one vertex and one index buffer.
+// Submeshes are welded and reordered with Common/MeshOptimizer, then split into meshlets with
+// Common/MeshletBuilder and given levels of detail by Common/MeshSimplifier, unless
+// --no-optimize is given.  Levels of detail are submeshes named <input>_lod1, _lod2 and so on.
+// Vertices are quantized with Common/VertexQuantizer unless --no-quantize is given, and the
+// indices are 16 bit whenever they fit.  A stream of the positions alone follows the vertices.
+
+#include "../../Common/MeshFileFormat.h"
+#include "../../Common/MeshletBuilder.h"
+#include "../../Common/MeshOptimizer.h"
+#include "../../Common/MeshSimplifier.h"
+#include "../../Common/TextModelParser.h"
+#include "../../Common/VertexQuantizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+// Matches Vertex in LandAndWaves/FrameResource.h.
+struct Vertex
+{
+    float pos[3];
+    float normal[3];
+    float texCoord[2];
+    float tangent[3];
+};
+
+const uint32_t kVertexAttributes = kMeshFilePosition | kMeshFileNormal | kMeshFileTexCoord
+                                   | kMeshFileTangent;
+static_assert(sizeof(Vertex) == 44, "Vertex does not match the stream");
+
+struct Model
+{
+    std::string name;
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    // A copy of indices in meshlet order, so that full draws keep the cache order of indices.
+    std::vector<uint32_t> meshletIndices;
+    std::vector<MeshletBuilder::Meshlet> meshlets;
+    // Coarser index lists over the same vertices, finest first.
+    std::vector<MeshSimplifier::Level> levels;
+    // The vertices relative to their bounds, if quantized.
+    std::vector<VertexQuantizer::QuantizedVertex> quantizedVertices;
+};
+
+Model ReadTextModel(const fs::path &path, unsigned threadCount = 0)
+{
+    TextModelParser::Model parsed;
+    if (!TextModelParser::ParseFile(path, parsed, threadCount))
+        throw std::runtime_error("cannot parse " + path.string());
+
+    Model model;
+    model.name = path.stem().string();
+    model.vertices.resize(parsed.vertices.size());
+    for (size_t i = 0; i < parsed.vertices.size(); ++i) {
+        std::memcpy(model.vertices[i].pos, parsed.vertices[i].pos, sizeof(float) * 3);
+        std::memcpy(model.vertices[i].normal, parsed.vertices[i].normal, sizeof(float) * 3);
+    }
+    model.indices = std::move(parsed.indices);
+    return model;
+}
+
+// The stream parse LandAndWavesApp used before TextModelParser, kept to compare against.
+Model ReadTextModelWithStream(const fs::path &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("cannot open " + path.string());
+
+    uint32_t vertexCount = 0;
+    uint32_t triangleCount = 0;
+    std::string ignore;
+    file >> ignore >> vertexCount;
+    file >> ignore >> triangleCount;
+    file >> ignore >> ignore >> ignore >> ignore;
+
+    Model model;
+    model.name = path.stem().string();
+    model.vertices.resize(vertexCount);
+    for (auto &vertex : model.vertices) {
+        file >> vertex.pos[0] >> vertex.pos[1] >> vertex.pos[2];
+        file >> vertex.normal[0] >> vertex.normal[1] >> vertex.normal[2];
+    }
+
+    file >> ignore >> ignore >> ignore;
+
+    model.indices.resize(size_t(triangleCount) * 3);
+    for (auto &index : model.indices) {
+        file >> index;
+    }
+
+    if (!file)
+        throw std::runtime_error(path.string() + " is truncated");
+    for (auto index : model.indices) {
+        if (index >= vertexCount)
+            throw std::runtime_error(path.string() + " indexes a vertex it does not have");
+    }
+
+    return model;
+}
+
+// Spherical texture coordinates, the way LandAndWavesApp derived them at load: the position is
+// projected onto the unit sphere and its angles mapped to [0, 1].
+void GenerateSphericalTexCoords(std::vector<Vertex> &vertices)
+{
+    const float pi = 3.14159265358979f;
+    for (auto &vertex : vertices) {
+        const float *p = vertex.pos;
+        float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        float x = length > 0.0f ? p[0] / length : 0.0f;
+        float y = length > 0.0f ? p[1] / length : 0.0f;
+        float z = length > 0.0f ? p[2] / length : 0.0f;
+
+        float theta = std::atan2(z, x);
+        if (theta < 0.0f) {
+            theta += 2.0f * pi;
+        }
+        float phi = std::acos(std::clamp(y, -1.0f, 1.0f));
+
+        vertex.texCoord[0] = theta / (2.0f * pi);
+        vertex.texCoord[1] = phi / pi;
+    }
+}
+
+MeshFileBounds ComputeBounds(const Vertex *vertices, size_t count)
+{
+    float lo[3] = {+INFINITY, +INFINITY, +INFINITY};
+    float hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (size_t i = 0; i < count; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            lo[c] = std::min(lo[c], vertices[i].pos[c]);
+            hi[c] = std::max(hi[c], vertices[i].pos[c]);
+        }
+    }
+
+    MeshFileBounds bounds = {};
+    if (count > 0) {
+        for (int c = 0; c < 3; ++c) {
+            bounds.center[c] = 0.5f * (lo[c] + hi[c]);
+            bounds.extents[c] = 0.5f * (hi[c] - lo[c]);
+        }
+    }
+    return bounds;
+}
+
+uint64_t AlignUp(uint64_t value)
+{
+    return (value + kMeshFileDataAlignment - 1) & ~uint64_t(kMeshFileDataAlignment - 1);
+}
+
+void WriteMesh(const fs::path &path, const std::vector<Model> &models, bool quantize)
+{
+    std::vector<Vertex> vertices;
+    std::vector<VertexQuantizer::QuantizedVertex> quantizedVertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshFileSubmesh> submeshes;
+    std::vector<MeshFileMeshlet> meshlets;
+    for (const auto &model : models) {
+        std::string longestName = model.levels.empty()
+                                      ? model.name
+                                      : MeshSimplifier::GetLevelName(model.name,
+                                                                     model.levels.size());
+        if (longestName.size() >= sizeof(MeshFileSubmesh::name))
+            throw std::runtime_error("submesh name " + longestName + " is too long");
+
+        MeshFileSubmesh submesh = {};
+        std::memcpy(submesh.name, model.name.c_str(), model.name.size());
+        submesh.indexCount = (uint32_t) model.indices.size();
+        submesh.startIndex = (uint32_t) indices.size();
+        submesh.baseVertex = (int32_t) vertices.size();
+        submesh.bounds = ComputeBounds(model.vertices.data(), model.vertices.size());
+        submesh.firstMeshlet = (uint32_t) meshlets.size();
+        submesh.meshletCount = (uint32_t) model.meshlets.size();
+        submeshes.push_back(submesh);
+
+        vertices.insert(vertices.end(), model.vertices.begin(), model.vertices.end());
+        quantizedVertices.insert(quantizedVertices.end(),
+                                 model.quantizedVertices.begin(),
+                                 model.quantizedVertices.end());
+        indices.insert(indices.end(), model.indices.begin(), model.indices.end());
+
+        for (size_t i = 0; i < model.levels.size(); ++i) {
+            const auto &level = model.levels[i];
+            auto levelName = MeshSimplifier::GetLevelName(model.name, i + 1);
+
+            MeshFileSubmesh levelSubmesh = {};
+            std::memcpy(levelSubmesh.name, levelName.c_str(), levelName.size());
+            levelSubmesh.indexCount = (uint32_t) level.indices.size();
+            levelSubmesh.startIndex = (uint32_t) indices.size();
+            levelSubmesh.baseVertex = submesh.baseVertex;
+            levelSubmesh.bounds = submesh.bounds;
+            levelSubmesh.simplificationError = level.error;
+            submeshes.push_back(levelSubmesh);
+            indices.insert(indices.end(), level.indices.begin(), level.indices.end());
+        }
+
+        // The meshlet order follows the levels of detail.
+        uint32_t meshletStart = (uint32_t) indices.size() - submesh.startIndex;
+        indices.insert(indices.end(), model.meshletIndices.begin(), model.meshletIndices.end());
+        for (const auto &meshlet : model.meshlets) {
+            MeshFileMeshlet record = {};
+            record.startIndex = meshletStart + meshlet.startIndex;
+            record.indexCount = meshlet.indexCount;
+            record.vertexCount = meshlet.vertexCount;
+            std::copy_n(meshlet.center, 3, record.center);
+            record.radius = meshlet.radius;
+            std::copy_n(meshlet.coneAxis, 3, record.coneAxis);
+            record.coneCutoff = meshlet.coneCutoff;
+            meshlets.push_back(record);
+        }
+    }
+
+    if (quantize && quantizedVertices.size() != vertices.size())
+        throw std::runtime_error("not every model was quantized");
+
+    // The full vertices, then their positions alone.
+    MeshFileStream streams[2] = {};
+    streams[0].attributes = quantize ? kVertexAttributes | kMeshFileQuantized : kVertexAttributes;
+    streams[0].stride = quantize ? sizeof(VertexQuantizer::QuantizedVertex) : sizeof(Vertex);
+    streams[1].attributes = quantize ? kMeshFilePosition | kMeshFileQuantized : kMeshFilePosition;
+    streams[1].stride = GetMeshFileVertexSize(streams[1].attributes);
+    const void *vertexData = quantize ? (const void *) quantizedVertices.data() : vertices.data();
+    auto positions = VertexQuantizer::ExtractPositions(
+        vertexData, vertices.size(), streams[0].stride, streams[1].stride);
+
+    // Indices are relative to their submesh's baseVertex, so the whole buffer can go down to 16
+    // bits as long as no single model needs more.
+    bool use16BitIndices = VertexQuantizer::Fits16BitIndices(indices.data(), indices.size());
+    size_t indexSize = use16BitIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    MeshFileHeader header = {};
+    header.magic = kMeshFileMagic;
+    header.version = kMeshFileVersion;
+    header.vertexCount = (uint32_t) vertices.size();
+    header.indexCount = (uint32_t) indices.size();
+    header.streamCount = 2;
+    header.submeshCount = (uint32_t) submeshes.size();
+    header.meshletCount = (uint32_t) meshlets.size();
+    header.indexFormat = use16BitIndices ? VertexQuantizer::kFormatR16Uint
+                                         : VertexQuantizer::kFormatR32Uint;
+    header.bounds = ComputeBounds(vertices.data(), vertices.size());
+
+    uint64_t tablesSize = sizeof(header) + sizeof(streams)
+                          + sizeof(MeshFileSubmesh) * submeshes.size()
+                          + sizeof(MeshFileMeshlet) * meshlets.size();
+    streams[0].offset = AlignUp(tablesSize);
+    streams[1].offset = AlignUp(streams[0].offset + uint64_t(streams[0].stride) * vertices.size());
+    header.indexOffset = AlignUp(streams[1].offset + positions.size());
+
+    std::ofstream file(path, std::ios::binary);
+    auto write = [&](const void *data, size_t size) {
+        file.write(static_cast<const char *>(data), size);
+    };
+    auto pad = [&](uint64_t offset) {
+        static const char zeros[kMeshFileDataAlignment] = {};
+        write(zeros, size_t(offset - (uint64_t) file.tellp()));
+    };
+
+    write(&header, sizeof(header));
+    write(streams, sizeof(streams));
+    write(submeshes.data(), sizeof(MeshFileSubmesh) * submeshes.size());
+    write(meshlets.data(), sizeof(MeshFileMeshlet) * meshlets.size());
+    pad(streams[0].offset);
+    write(vertexData, streams[0].stride * vertices.size());
+    pad(streams[1].offset);
+    write(positions.data(), positions.size());
+    pad(header.indexOffset);
+    if (use16BitIndices) {
+        auto indices16 = VertexQuantizer::To16BitIndices(indices.data(), indices.size());
+        write(indices16.data(), indexSize * indices16.size());
+    } else {
+        write(indices.data(), indexSize * indices.size());
+    }
+
+    if (!file.flush())
+        throw std::runtime_error("cannot write " + path.string());
+}
+
+// Times the ways of loading the inputs: the stream parse the app used to do, TextModelParser on
+// one thread and on every core, and reading the converted file.
+void Bench(const fs::path &meshPath, const std::vector<fs::path> &inputs)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto time = [&](const char *label, const std::function<Model(const fs::path &)> &read) {
+        for (const auto &input : inputs) {
+            // Best of several runs, so the first does not pay for the page cache.
+            double best = INFINITY;
+            for (int run = 0; run < 5; ++run) {
+                auto start = Clock::now();
+                auto model = read(input);
+                GenerateSphericalTexCoords(model.vertices);
+                ComputeBounds(model.vertices.data(), model.vertices.size());
+                best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+            }
+            printf("%-24s %-12s %8.3f ms\n",
+                   label,
+                   input.filename().string().c_str(),
+                   best * 1e3);
+        }
+    };
+    time("ifstream", ReadTextModelWithStream);
+    time("TextModelParser 1 thread", [](const fs::path &path) { return ReadTextModel(path, 1); });
+    time("TextModelParser", [](const fs::path &path) { return ReadTextModel(path); });
+
+    auto start = Clock::now();
+    std::ifstream file(meshPath, std::ios::binary | std::ios::ate);
+    if (!file)
+        throw std::runtime_error("cannot open " + meshPath.string());
+    std::vector<char> data((size_t) file.tellg());
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    if (!file || data.size() < sizeof(MeshFileHeader))
+        throw std::runtime_error("cannot read " + meshPath.string());
+    MeshFileHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    double binarySeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf("%-24s %-12s %8.3f ms  (%u vertices, %u indices, %zu bytes)\n",
+           "binary",
+           meshPath.filename().string().c_str(),
+           binarySeconds * 1e3,
+           header.vertexCount,
+           header.indexCount,
+           data.size());
+}
+
+int PrintUsage()
+{
+    fprintf(stderr,
+            "usage: MeshConverter [options] <output.mesh> <input.txt>...\n"
+            "  every input becomes a submesh named after its file\n"
+            "  --no-optimize  keep the vertices and triangles in their input order, without\n"
+            "                 meshlets\n"
+            "  --no-quantize  keep the vertices as 32 bit floats\n"
+            "  --bench        time loading the inputs against loading <output.mesh>\n");
+    return 1;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool bench = false;
+    bool optimize = true;
+    bool quantize = true;
+    std::vector<fs::path> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--bench") {
+            bench = true;
+        } else if (arg == "--no-optimize") {
+            optimize = false;
+        } else if (arg == "--no-quantize") {
+            quantize = false;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            return PrintUsage();
+        } else {
+            paths.emplace_back(arg);
+        }
+    }
+    if (paths.size() < 2)
+        return PrintUsage();
+
+    try {
+        std::vector<fs::path> inputs(paths.begin() + 1, paths.end());
+        if (bench) {
+            Bench(paths[0], inputs);
+            return 0;
+        }
+
+        std::vector<Model> models;
+        for (const auto &input : inputs) {
+            models.push_back(ReadTextModel(input));
+            auto &model = models.back();
+            GenerateSphericalTexCoords(model.vertices);
+
+            printf("%-16s %7zu vertices  %7zu triangles\n",
+                   model.name.c_str(),
+                   model.vertices.size(),
+                   model.indices.size() / 3);
+            if (optimize) {
+                auto report = MeshOptimizer::Optimize(model.vertices, model.indices);
+                printf("    welded to %zu vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                       report.vertexCountAfter,
+                       report.before.acmr,
+                       report.after.acmr,
+                       report.before.atvr,
+                       report.after.atvr);
+
+                model.meshletIndices = model.indices;
+                model.meshlets = MeshletBuilder::Build(model.vertices, model.meshletIndices);
+                auto cache = MeshOptimizer::AnalyzeVertexCache(model.meshletIndices.data(),
+                                                               model.meshletIndices.size(),
+                                                               model.vertices.size());
+                printf("    %zu meshlets of %.1f triangles on average, ACMR %.3f\n",
+                       model.meshlets.size(),
+                       model.indices.size() / 3.0 / std::max<size_t>(model.meshlets.size(), 1),
+                       cache.acmr);
+
+                model.levels = MeshSimplifier::BuildLodChain(model.vertices, model.indices);
+                for (size_t i = 0; i < model.levels.size(); ++i) {
+                    auto &level = model.levels[i];
+                    MeshOptimizer::OptimizeTriangleOrder(level.indices.data(),
+                                                         level.indices.size(),
+                                                         model.vertices[0].pos,
+                                                         sizeof(Vertex),
+                                                         model.vertices.size());
+                    printf("    LOD %zu: %7zu triangles, error %.4f\n",
+                           i + 1,
+                           level.indices.size() / 3,
+                           level.error);
+                }
+            }
+
+            if (quantize) {
+                // WriteMesh gives the submesh the same bounds.
+                auto bounds = ComputeBounds(model.vertices.data(), model.vertices.size());
+                auto report = VertexQuantizer::Quantize(
+                    model.vertices, bounds.center, bounds.extents, model.quantizedVertices);
+                printf("    quantized to %zu bytes a vertex, max error position %.6f, normal "
+                       "%.3f deg, tangent %.3f deg, texCoord %.6f\n",
+                       sizeof(VertexQuantizer::QuantizedVertex),
+                       report.position,
+                       report.normal,
+                       report.tangent,
+                       report.texCoord);
+            }
+        }
+        WriteMesh(paths[0], models, quantize);
+
+        printf("wrote %s\n", paths[0].string().c_str());
+    } catch (const std::exception &e) {
+        fprintf(stderr, "error: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,341 @@
+// Measures Common/OcclusionCuller on the hills and room of LandAndWaves with boxes scattered over
+// the terrain, on worker pools of growing size, and checks that every pool draws the same depth
+// buffer and that it matches a known good one.  Portable C++17, built outside the Visual Studio
+// solution:
+//
+//   g++ -std=c++17 -O2 -pthread -o OcclusionBenchmark OcclusionBenchmark.cpp ../../Common/FrustumCuller.cpp ../../Common/OcclusionCuller.cpp ../../Common/WorkerPool.cpp
+//   ./OcclusionBenchmark --count 10000 --compare-depth ReferenceDepth.pgm
+//
+// Add -mavx2 (or /arch:AVX2) to build the AVX2 rasterizer.  Depth images are binary PGMs, one
+// byte per pixel with the near plane black.  ReferenceDepth.pgm is the depth buffer of the fixed
+// occluders and camera below; --write-depth writes it again after a deliberate change.
+
+#include "../../Common/FrustumCuller.h"
+#include "../../Common/OcclusionCuller.h"
+#include "../../Common/WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using FrustumCuller::Box;
+
+namespace
+{
+// Row-major, row vector matrices, as DirectXMath's.
+struct Matrix
+{
+    float m[16];
+};
+
+Matrix Multiply(const Matrix &a, const Matrix &b)
+{
+    Matrix result;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                sum += a.m[i * 4 + k] * b.m[k * 4 + j];
+            }
+            result.m[i * 4 + j] = sum;
+        }
+    }
+    return result;
+}
+
+// XMMatrixLookAtLH and XMMatrixPerspectiveFovLH.
+Matrix LookAt(const float eye[3], const float target[3])
+{
+    float z[3] = {target[0] - eye[0], target[1] - eye[1], target[2] - eye[2]};
+    float length = std::sqrt(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+    for (float &c : z) {
+        c /= length;
+    }
+    float x[3] = {z[2], 0.0f, -z[0]};
+    length = std::sqrt(x[0] * x[0] + x[2] * x[2]);
+    x[0] /= length;
+    x[2] /= length;
+    float y[3] = {z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0]};
+    auto dot = [&](const float *a) { return -(a[0] * eye[0] + a[1] * eye[1] + a[2] * eye[2]); };
+    return {{x[0], y[0], z[0], 0.0f,
+             x[1], y[1], z[1], 0.0f,
+             x[2], y[2], z[2], 0.0f,
+             dot(x), dot(y), dot(z), 1.0f}};
+}
+
+Matrix Perspective(float fovY, float aspect, float nearZ, float farZ)
+{
+    float yScale = 1.0f / std::tan(0.5f * fovY);
+    float range = farZ / (farZ - nearZ);
+    return {{yScale / aspect, 0.0f, 0.0f, 0.0f,
+             0.0f, yScale, 0.0f, 0.0f,
+             0.0f, 0.0f, range, 1.0f,
+             0.0f, 0.0f, -range * nearZ, 0.0f}};
+}
+
+// LandAndWavesApp::GetHillsHeight, on the land moved down by 5 as the app draws it.
+float GetGroundHeight(float x, float z)
+{
+    return 0.3f * (z * std::sin(0.1f * x) + x * std::cos(0.1f * z)) - 5.0f;
+}
+
+// GeometryGenerator::CreateGrid(160, 160, 50, 50) with the hills' heights.
+OcclusionCuller::Mesh BuildLand()
+{
+    const uint32_t n = 50;
+    const float size = 160.0f, step = size / (n - 1);
+    OcclusionCuller::Mesh mesh;
+    for (uint32_t i = 0; i < n; ++i) {
+        float z = 0.5f * size - i * step;
+        for (uint32_t j = 0; j < n; ++j) {
+            float x = -0.5f * size + j * step;
+            mesh.positions.insert(mesh.positions.end(), {x, GetGroundHeight(x, z), z});
+        }
+    }
+    for (uint32_t i = 0; i + 1 < n; ++i) {
+        for (uint32_t j = 0; j + 1 < n; ++j) {
+            mesh.indices.insert(mesh.indices.end(),
+                                {i * n + j,
+                                 i * n + j + 1,
+                                 (i + 1) * n + j,
+                                 (i + 1) * n + j,
+                                 i * n + j + 1,
+                                 (i + 1) * n + j + 1});
+        }
+    }
+    return mesh;
+}
+
+// The floor and the walls either side of and above the mirror, from BuildRoomGeometry.
+OcclusionCuller::Mesh BuildRoom()
+{
+    OcclusionCuller::Mesh mesh;
+    mesh.positions = {-3.5f, 0.0f, -10.0f, -3.5f, 0.0f, 0.0f, 7.5f, 0.0f, 0.0f, 7.5f, 0.0f, -10.0f,
+                      -3.5f, 0.0f, 0.0f,   -3.5f, 4.0f, 0.0f, -2.5f, 4.0f, 0.0f, -2.5f, 0.0f, 0.0f,
+                      2.5f,  0.0f, 0.0f,   2.5f,  4.0f, 0.0f, 7.5f, 4.0f, 0.0f, 7.5f, 0.0f, 0.0f,
+                      -3.5f, 4.0f, 0.0f,   -3.5f, 6.0f, 0.0f, 7.5f, 6.0f, 0.0f, 7.5f, 4.0f, 0.0f};
+    mesh.indices = {0, 1, 2, 0, 2, 3, 4, 5, 6, 4, 6, 7, 8, 9, 10, 8, 10, 11, 12, 13, 14, 12, 14, 15};
+    return mesh;
+}
+
+template <typename Function>
+double MeasureMilliseconds(int passes, Function function)
+{
+    double best = 1e30;
+    for (int pass = 0; pass < passes; ++pass) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        double seconds
+            = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+    }
+    return best * 1e3;
+}
+
+// Whether a camera above the floor sees it and one below does not, as the GPU culls back faces.
+bool CheckWinding(const OcclusionCuller::Mesh &room, const Matrix &proj)
+{
+    OcclusionCuller::Mesh floor = room;
+    floor.indices.resize(6);
+    OcclusionCuller::DepthBuffer buffer;
+    bool seen[2];
+    const float heights[2] = {10.0f, -10.0f};
+    for (int i = 0; i < 2; ++i) {
+        const float eye[3] = {2.0f, heights[i], -5.5f};
+        const float target[3] = {2.0f, 0.0f, -5.0f};
+        auto viewProj = Multiply(LookAt(eye, target), proj);
+        OcclusionCuller::Render(buffer, viewProj.m, &floor, 1, nullptr);
+        seen[i] = *std::min_element(buffer.depth.begin(), buffer.depth.end()) < 1.0f;
+    }
+    return seen[0] && !seen[1];
+}
+
+// A pixel of a depth image may differ from the reference by this many levels, as rasterizers
+// built for other instruction sets round differently, and this fraction of pixels by more, along
+// the occluders' edges.
+const int kDepthTolerance = 2;
+const double kMaxDifferingFraction = 0.005;
+
+std::vector<uint8_t> EncodeDepth(const OcclusionCuller::DepthBuffer &buffer)
+{
+    std::vector<uint8_t> image;
+    image.reserve(buffer.depth.size());
+    for (float depth : buffer.depth) {
+        // Most of the range is near the far plane; spread it out.
+        float value = std::pow(std::min(std::max(depth, 0.0f), 1.0f), 32.0f) * 255.0f + 0.5f;
+        image.push_back(uint8_t(value));
+    }
+    return image;
+}
+
+bool WriteDepth(const char *path, const OcclusionCuller::DepthBuffer &buffer)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+    auto image = EncodeDepth(buffer);
+    fprintf(file, "P5\n%d %d\n255\n", OcclusionCuller::kWidth, OcclusionCuller::kHeight);
+    fwrite(image.data(), 1, image.size(), file);
+    return fclose(file) == 0;
+}
+
+// A binary PGM of the depth buffer's size, or nothing if the file is not one.
+std::vector<uint8_t> ReadDepth(const char *path)
+{
+    std::vector<uint8_t> image;
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        return image;
+    int width = 0, height = 0, maxValue = 0;
+    if (fscanf(file, "P5 %d %d %d", &width, &height, &maxValue) == 3 && fgetc(file) != EOF
+        && width == OcclusionCuller::kWidth && height == OcclusionCuller::kHeight
+        && maxValue == 255) {
+        image.resize(size_t(width) * height);
+        if (fread(image.data(), 1, image.size(), file) != image.size()) {
+            image.clear();
+        }
+    }
+    fclose(file);
+    return image;
+}
+
+// The number of pixels differing from the reference by more than kDepthTolerance.
+size_t CountDifferingPixels(const std::vector<uint8_t> &image,
+                            const std::vector<uint8_t> &reference)
+{
+    size_t differing = 0;
+    for (size_t i = 0; i < image.size(); ++i) {
+        differing += std::abs(int(image[i]) - int(reference[i])) > kDepthTolerance;
+    }
+    return differing;
+}
+
+int PrintUsage()
+{
+    fprintf(stderr,
+            "usage: OcclusionBenchmark [--count <boxes>] [--passes <n>] [--seed <n>] "
+            "[--write-depth <file.pgm>] [--compare-depth <file.pgm>]\n");
+    return 1;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = 10000;
+    int passes = 20;
+    unsigned seed = 1;
+    const char *depthPath = nullptr;
+    const char *referencePath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc) {
+            count = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--passes" && i + 1 < argc) {
+            passes = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--write-depth" && i + 1 < argc) {
+            depthPath = argv[++i];
+        } else if (arg == "--compare-depth" && i + 1 < argc) {
+            referencePath = argv[++i];
+        } else {
+            return PrintUsage();
+        }
+    }
+    if (passes <= 0)
+        return PrintUsage();
+
+    const OcclusionCuller::Mesh occluders[] = {BuildLand(), BuildRoom()};
+    size_t triangleCount = 0;
+    for (const auto &occluder : occluders) {
+        triangleCount += occluder.indices.size() / 3;
+    }
+
+    // Boxes a little above the ground, looked at from low over the hills.
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> position(-75.0f, 75.0f);
+    std::vector<Box> boxes(count);
+    for (auto &box : boxes) {
+        float x = position(random), z = position(random);
+        box = {{x, GetGroundHeight(x, z) + 1.5f, z}, {1.0f, 1.0f, 1.0f}};
+    }
+    auto proj = Perspective(0.25f * 3.14159265f, 16.0f / 9.0f, 1.0f, 1000.0f);
+    const float eye[3] = {-10.0f, 12.0f, -40.0f};
+    const float target[3] = {10.0f, 0.0f, 60.0f};
+    auto viewProj = Multiply(LookAt(eye, target), proj);
+
+    std::vector<unsigned> threadCounts = {1, 2, 4};
+    if (std::thread::hardware_concurrency() > 4) {
+        threadCounts.push_back(std::thread::hardware_concurrency());
+    }
+    printf("%zu occluder triangles, %zu boxes, %dx%d depth buffer, rasterizer %s\n",
+           triangleCount,
+           count,
+           OcclusionCuller::kWidth,
+           OcclusionCuller::kHeight,
+           OcclusionCuller::GetInstructionSet());
+
+    OcclusionCuller::DepthBuffer reference;
+    bool agree = true;
+    for (unsigned threadCount : threadCounts) {
+        WorkerPool pool(threadCount);
+        OcclusionCuller::DepthBuffer buffer;
+        double renderTime = MeasureMilliseconds(passes, [&] {
+            OcclusionCuller::Render(buffer, viewProj.m, occluders, 2, &pool);
+        });
+        if (threadCount == 1) {
+            reference = buffer;
+        }
+        bool same = buffer.depth == reference.depth;
+        agree = agree && same;
+        printf("  %2u thread render      %8.3f ms%s\n",
+               threadCount,
+               renderTime,
+               same ? "" : "  (differs from 1 thread)");
+    }
+
+    size_t visible = 0;
+    double testTime = MeasureMilliseconds(passes, [&] {
+        visible = 0;
+        for (const auto &box : boxes) {
+            visible += OcclusionCuller::IsVisible(reference, viewProj.m, box);
+        }
+    });
+    printf("  box tests             %8.3f ms, %zu of %zu not hidden\n", testTime, visible, count);
+
+    bool windingRight = CheckWinding(occluders[1], proj);
+    if (depthPath != nullptr && !WriteDepth(depthPath, reference)) {
+        fprintf(stderr, "error: cannot write %s\n", depthPath);
+        return 1;
+    }
+
+    bool matchesReference = true;
+    if (referencePath != nullptr) {
+        auto referenceImage = ReadDepth(referencePath);
+        if (referenceImage.empty()) {
+            fprintf(stderr, "error: cannot read %s\n", referencePath);
+            return 1;
+        }
+        size_t differing = CountDifferingPixels(EncodeDepth(reference), referenceImage);
+        matchesReference = differing <= kMaxDifferingFraction * referenceImage.size();
+        printf("  depth image           %zu of %zu pixels differ from %s\n",
+               differing,
+               referenceImage.size(),
+               referencePath);
+    }
+    if (!agree || !windingRight || !matchesReference) {
+        printf("error: thread counts %s, back faces %s, depth image %s the reference\n",
+               agree ? "agree" : "disagree",
+               windingRight ? "skipped" : "not skipped as the GPU skips them",
+               matchesReference ? "matches" : "differs from");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,187 @@
+// Measures Common/DrawSort on draws with random layers, states and depths, on worker pools of
+// growing size, against std::stable_sort, and checks that every pool gives the same order as it
+// and that keys order a few draws as the renderer expects.
+// Portable C++17, built outside the Visual Studio solution:
+//
+//   g++ -std=c++17 -O2 -pthread -o SortBenchmark SortBenchmark.cpp ../../Common/DrawSort.cpp ../../Common/WorkerPool.cpp
+//   ./SortBenchmark --count 1000000 --states 256
+
+#include "../../Common/DrawSort.h"
+#include "../../Common/WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+template <typename Function>
+double MeasureMilliseconds(int passes, Function function)
+{
+    double best = 1e30;
+    for (int pass = 0; pass < passes; ++pass) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        double seconds
+            = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+    }
+    return best * 1e3;
+}
+
+bool SameOrder(const std::vector<DrawSort::Entry> &a, const std::vector<DrawSort::Entry> &b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const auto &x, const auto &y) {
+        return x.key == y.key && x.value == y.value;
+    });
+}
+
+// Times the state would be set submitting the draws in order, as LandAndWaves skips setting the
+// state the previous draw left.
+size_t CountStateChanges(const std::vector<DrawSort::Entry> &entries,
+                         const std::vector<uint64_t> &states)
+{
+    size_t changes = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        changes += i == 0 || states[entries[i].value] != states[entries[i - 1].value];
+    }
+    return changes;
+}
+
+// Layers come first, opaque draws group by state before depth, blended ones go farthest first,
+// depths clamp, and equal keys keep their order.  Returns what failed first, or null.
+const char *CheckKeys()
+{
+    auto nearDepth = DrawSort::QuantizeDepth(10.0f, 1.0f, 1000.0f);
+    auto farDepth = DrawSort::QuantizeDepth(900.0f, 1.0f, 1000.0f);
+    if (DrawSort::QuantizeDepth(0.5f, 1.0f, 1000.0f) != 0
+        || DrawSort::QuantizeDepth(2000.0f, 1.0f, 1000.0f) != (1u << DrawSort::kDepthBits) - 1
+        || !(nearDepth < farDepth))
+        return "depths are not clamped to the range in order";
+
+    auto cheap = DrawSort::MakeState(0, 0, 1);
+    auto costly = DrawSort::MakeState(1, 0, 0);
+    if (!(cheap < costly) || !(DrawSort::MakeState(0, 1, 0) < costly))
+        return "a PSO change does not outweigh the geometry and material";
+
+    auto opaque = [](uint32_t layer, uint64_t state, uint32_t depth) {
+        return DrawSort::MakeKey(layer, state, depth, DrawSort::kFrontToBack);
+    };
+    auto blended = [](uint32_t layer, uint64_t state, uint32_t depth) {
+        return DrawSort::MakeKey(layer, state, depth, DrawSort::kBackToFront);
+    };
+    if (!(blended(0, costly, farDepth) < opaque(1, cheap, nearDepth))
+        || DrawSort::GetLayer(opaque(5, costly, farDepth)) != 5)
+        return "the layer does not come first";
+    if (!(opaque(0, cheap, farDepth) < opaque(0, costly, nearDepth))
+        || !(opaque(0, cheap, nearDepth) < opaque(0, cheap, farDepth)))
+        return "opaque draws do not go by state, then nearest first";
+    if (!(blended(0, costly, farDepth) < blended(0, cheap, nearDepth)))
+        return "blended draws do not go farthest first";
+
+    std::vector<DrawSort::Entry> entries = {{2, 0}, {1, 1}, {2, 2}, {1, 3}}, scratch;
+    DrawSort::Sort(entries, scratch, nullptr);
+    if (entries[0].value != 1 || entries[1].value != 3 || entries[2].value != 0
+        || entries[3].value != 2)
+        return "equal keys do not keep their order";
+    return nullptr;
+}
+
+int PrintUsage()
+{
+    fprintf(stderr,
+            "usage: SortBenchmark [--count <draws>] [--states <n>] [--passes <n>] "
+            "[--seed <n>]\n");
+    return 1;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = 1000000;
+    uint32_t stateCount = 256;
+    int passes = 20;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc) {
+            count = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--states" && i + 1 < argc) {
+            stateCount = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--passes" && i + 1 < argc) {
+            passes = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            return PrintUsage();
+        }
+    }
+    if (passes <= 0 || stateCount == 0)
+        return PrintUsage();
+
+    const char *keyFailure = CheckKeys();
+    if (keyFailure != nullptr) {
+        printf("error: %s\n", keyFailure);
+        return 1;
+    }
+
+    // Eight layers, the last blended, each draw with one of stateCount states and a depth.
+    std::mt19937 random(seed);
+    std::vector<uint64_t> states(count);
+    std::vector<DrawSort::Entry> draws(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t layer = random() % 8;
+        uint32_t state = random() % stateCount;
+        states[i] = DrawSort::MakeState(state % 4, state / 256, state / 4 % 64);
+        auto order = layer == 7 ? DrawSort::kBackToFront : DrawSort::kFrontToBack;
+        float distance = std::uniform_real_distribution<float>(1.0f, 1000.0f)(random);
+        auto depth = DrawSort::QuantizeDepth(distance, 1.0f, 1000.0f);
+        draws[i] = {DrawSort::MakeKey(layer, states[i], depth, order), uint32_t(i)};
+    }
+
+    printf("%zu draws, %u states\n", count, stateCount);
+
+    auto reference = draws;
+    double stableSortTime = MeasureMilliseconds(passes, [&] {
+        reference = draws;
+        std::stable_sort(reference.begin(), reference.end(), [](const auto &a, const auto &b) {
+            return a.key < b.key;
+        });
+    });
+    printf("  std::stable_sort      %8.3f ms\n", stableSortTime);
+
+    std::vector<unsigned> threadCounts = {1, 2, 4};
+    if (std::thread::hardware_concurrency() > 4) {
+        threadCounts.push_back(std::thread::hardware_concurrency());
+    }
+    bool agree = true;
+    std::vector<DrawSort::Entry> sorted, scratch;
+    for (unsigned threadCount : threadCounts) {
+        WorkerPool pool(threadCount);
+        double sortTime = MeasureMilliseconds(passes, [&] {
+            sorted = draws;
+            DrawSort::Sort(sorted, scratch, &pool);
+        });
+        bool same = SameOrder(sorted, reference);
+        agree = agree && same;
+        printf("  %2u thread radix sort %8.3f ms%s\n",
+               threadCount,
+               sortTime,
+               same ? "" : "  (differs from std::stable_sort)");
+    }
+
+    printf("  state changes         %zu unsorted, %zu sorted\n",
+           CountStateChanges(draws, states),
+           CountStateChanges(reference, states));
+
+    if (!agree) {
+        printf("error: radix sort order differs from std::stable_sort\n");
+        return 1;
+    }
+    return 0;
+}
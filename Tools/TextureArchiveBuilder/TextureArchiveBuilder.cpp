@@ -0,0 +1,835 @@
+// Packs .dds files into a texture archive (see Common/TextureArchiveFormat.h).  Portable C++17,
+// built outside the Visual Studio solution:
+//
+//   g++ -std=c++17 -O2 -pthread -o TextureArchiveBuilder TextureArchiveBuilder.cpp ../../Common/Lz4.cpp ../../Common/BlockCompressor.cpp ../../Common/MipGenerator.cpp ../../Common/TextureArrayPacker.cpp
+//   ./TextureArchiveBuilder --compress ../../Assets/Textures/Textures.pak ../../Assets/Textures
+
+#include "../../Common/BlockCompressor.h"
+#include "../../Common/Lz4.h"
+#include "../../Common/MipGenerator.h"
+#include "../../Common/TextureArchiveFormat.h"
+#include "../../Common/TextureArrayPacker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+const uint32_t kDdsMagic = 0x20534444; // "DDS "
+
+const uint32_t kDdsFourCC = 0x4;
+const uint32_t kDdsRgb = 0x40;
+const uint32_t kDdsLuminance = 0x20000;
+const uint32_t kDdsAlpha = 0x2;
+const uint32_t kDdsCubeMap = 0x200;
+const uint32_t kDdsCubeMapAllFaces = 0xfc00;
+const uint32_t kDdsVolume = 0x200000;
+const uint32_t kDdsResourceMiscTextureCube = 0x4;
+const uint32_t kDdsDimensionTexture3D = 4;
+
+struct DdsPixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rBitMask;
+    uint32_t gBitMask;
+    uint32_t bBitMask;
+    uint32_t aBitMask;
+};
+
+struct DdsHeader
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DdsPixelFormat ddspf;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+
+struct DdsHeaderDxt10
+{
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+struct FormatInfo
+{
+    uint32_t dxgiFormat;
+    // Bytes per 4x4 block for block compressed formats, per pixel otherwise.
+    uint32_t bytes;
+    bool blockCompressed;
+};
+
+// The formats DDSTextureLoader maps DDS files to, by DXGI_FORMAT value.
+const FormatInfo kFormats[] = {
+    {2, 16, false},  {10, 8, false},  {11, 8, false},  {24, 4, false},  {28, 4, false},
+    {29, 4, false},  {34, 4, false},  {35, 4, false},  {41, 4, false},  {49, 2, false},
+    {54, 2, false},  {56, 2, false},  {61, 1, false},  {65, 1, false},  {85, 2, false},
+    {86, 2, false},  {87, 4, false},  {88, 4, false},  {91, 4, false},  {93, 4, false},
+    {71, 8, true},   {72, 8, true},   {74, 16, true},  {75, 16, true},  {77, 16, true},
+    {78, 16, true},  {80, 8, true},   {81, 8, true},   {83, 16, true},  {84, 16, true},
+    {95, 16, true},  {96, 16, true},  {98, 16, true},  {99, 16, true},
+};
+
+constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+{
+    return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16
+           | uint32_t(uint8_t(d)) << 24;
+}
+
+// Same mapping as GetDXGIFormat in DDSTextureLoader.cpp, for the formats listed above.
+uint32_t GetDxgiFormat(const DdsPixelFormat &pf)
+{
+    auto isBitMask = [&pf](uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+        return pf.rBitMask == r && pf.gBitMask == g && pf.bBitMask == b && pf.aBitMask == a;
+    };
+
+    if (pf.flags & kDdsRgb) {
+        if (pf.rgbBitCount == 32) {
+            if (isBitMask(0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000))
+                return 28; // R8G8B8A8_UNORM
+            if (isBitMask(0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000))
+                return 87; // B8G8R8A8_UNORM
+            if (isBitMask(0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000))
+                return 88; // B8G8R8X8_UNORM
+            if (isBitMask(0x0000ffff, 0xffff0000, 0x00000000, 0x00000000))
+                return 35; // R16G16_UNORM
+            if (isBitMask(0xffffffff, 0x00000000, 0x00000000, 0x00000000))
+                return 41; // R32_FLOAT
+        } else if (pf.rgbBitCount == 16) {
+            if (isBitMask(0xf800, 0x07e0, 0x001f, 0x0000))
+                return 85; // B5G6R5_UNORM
+            if (isBitMask(0x7c00, 0x03e0, 0x001f, 0x8000))
+                return 86; // B5G5R5A1_UNORM
+        }
+    } else if (pf.flags & kDdsLuminance) {
+        if (pf.rgbBitCount == 8 && isBitMask(0x000000ff, 0x00000000, 0x00000000, 0x00000000))
+            return 61; // R8_UNORM
+        if (pf.rgbBitCount == 16 && isBitMask(0x0000ffff, 0x00000000, 0x00000000, 0x00000000))
+            return 56; // R16_UNORM
+        if (pf.rgbBitCount == 16 && isBitMask(0x000000ff, 0x00000000, 0x00000000, 0x0000ff00))
+            return 49; // R8G8_UNORM
+    } else if (pf.flags & kDdsAlpha) {
+        if (pf.rgbBitCount == 8)
+            return 65; // A8_UNORM
+    } else if (pf.flags & kDdsFourCC) {
+        switch (pf.fourCC) {
+        case MakeFourCC('D', 'X', 'T', '1'):
+            return 71; // BC1_UNORM
+        case MakeFourCC('D', 'X', 'T', '2'):
+        case MakeFourCC('D', 'X', 'T', '3'):
+            return 74; // BC2_UNORM
+        case MakeFourCC('D', 'X', 'T', '4'):
+        case MakeFourCC('D', 'X', 'T', '5'):
+            return 77; // BC3_UNORM
+        case MakeFourCC('A', 'T', 'I', '1'):
+        case MakeFourCC('B', 'C', '4', 'U'):
+            return 80; // BC4_UNORM
+        case MakeFourCC('B', 'C', '4', 'S'):
+            return 81; // BC4_SNORM
+        case MakeFourCC('A', 'T', 'I', '2'):
+        case MakeFourCC('B', 'C', '5', 'U'):
+            return 83; // BC5_UNORM
+        case MakeFourCC('B', 'C', '5', 'S'):
+            return 84; // BC5_SNORM
+        case 36:
+            return 11; // R16G16B16A16_UNORM
+        case 113:
+            return 10; // R16G16B16A16_FLOAT
+        case 116:
+            return 2; // R32G32B32A32_FLOAT
+        }
+    }
+    return 0;
+}
+
+const FormatInfo &GetFormatInfo(uint32_t dxgiFormat, const fs::path &path)
+{
+    for (const auto &info : kFormats) {
+        if (info.dxgiFormat == dxgiFormat)
+            return info;
+    }
+    throw std::runtime_error(path.string() + ": unsupported pixel format "
+                             + std::to_string(dxgiFormat));
+}
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+struct PackedTexture
+{
+    fs::path path;
+    TextureArchiveEntry entry = {};
+    std::vector<TextureArchiveSubresource> subresources;
+    std::vector<uint8_t> payload;
+    std::vector<std::vector<uint8_t>> storedChunks;
+    // The textures packed into this one, for texture arrays.
+    std::vector<fs::path> slices;
+    bool normalMap = false;
+};
+
+// 8 bit RGBA and BGRA images can be block compressed while packing.
+bool IsBlockCompressible(uint32_t dxgiFormat)
+{
+    return dxgiFormat == 28 || dxgiFormat == 87 || dxgiFormat == 88;
+}
+
+// Converts rows of src pixels in dxgiFormat to RGBA8 with opaque alpha for B8G8R8X8.
+void ConvertToRgba(const uint8_t *src, size_t pixelCount, uint32_t dxgiFormat, uint8_t *rgba)
+{
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const uint8_t *pixel = src + 4 * i;
+        bool bgr = dxgiFormat != 28;
+        rgba[4 * i + 0] = bgr ? pixel[2] : pixel[0];
+        rgba[4 * i + 1] = pixel[1];
+        rgba[4 * i + 2] = bgr ? pixel[0] : pixel[2];
+        rgba[4 * i + 3] = dxgiFormat == 88 ? 255 : pixel[3];
+    }
+}
+
+// Block compressed formats the compressor can decode and encode again, and whether they are sRGB.
+bool GetBlockFormat(uint32_t dxgiFormat, BlockCompressor::Format &format, bool &srgb)
+{
+    srgb = dxgiFormat == 72 || dxgiFormat == 78;
+    switch (dxgiFormat) {
+    case 71: // BC1_UNORM
+    case 72: // BC1_UNORM_SRGB
+        format = BlockCompressor::Format::BC1;
+        return true;
+    case 77: // BC3_UNORM
+    case 78: // BC3_UNORM_SRGB
+        format = BlockCompressor::Format::BC3;
+        return true;
+    case 80: // BC4_UNORM
+        format = BlockCompressor::Format::BC4;
+        return true;
+    case 83: // BC5_UNORM
+        format = BlockCompressor::Format::BC5;
+        return true;
+    }
+    return false;
+}
+
+// The mip chains of sliceCount single level images, tightly packed in DDS order.  Block
+// compressed images are decoded, filtered and encoded again below their own top level, as
+// TextureStreamer::GenerateMips does.
+std::vector<uint8_t> GenerateMipChains(MipGenerator::Filter filter,
+                                       bool srgb,
+                                       bool blockCompressed,
+                                       BlockCompressor::Format blockFormat,
+                                       const uint8_t *src,
+                                       uint32_t width,
+                                       uint32_t height,
+                                       uint32_t sliceCount,
+                                       uint32_t mipCount)
+{
+    size_t pixelTopSize = size_t(width) * height * 4;
+    size_t blockTopSize = BlockCompressor::GetCompressedSize(blockFormat, width, height);
+    std::vector<uint8_t> top;
+    if (blockCompressed) {
+        top.resize(pixelTopSize * sliceCount);
+        for (uint32_t slice = 0; slice < sliceCount; ++slice) {
+            BlockCompressor::Decompress(blockFormat,
+                                        src + slice * blockTopSize,
+                                        width,
+                                        height,
+                                        top.data() + slice * pixelTopSize,
+                                        size_t(width) * 4);
+        }
+    }
+
+    size_t chainSize = MipGenerator::GetChainSize(width, height, mipCount);
+    std::vector<uint8_t> chains(chainSize * sliceCount);
+    MipGenerator::Generate(filter,
+                           srgb,
+                           blockCompressed ? top.data() : src,
+                           width,
+                           height,
+                           sliceCount,
+                           mipCount,
+                           chains.data());
+    if (!blockCompressed)
+        return chains;
+
+    std::vector<uint8_t> blocks;
+    for (uint32_t slice = 0; slice < sliceCount; ++slice) {
+        const uint8_t *level = chains.data() + slice * chainSize;
+        for (uint32_t mip = 0; mip < mipCount; ++mip) {
+            uint32_t levelWidth = std::max(width >> mip, 1u);
+            uint32_t levelHeight = std::max(height >> mip, 1u);
+            size_t offset = blocks.size();
+            blocks.resize(offset
+                          + BlockCompressor::GetCompressedSize(blockFormat, levelWidth, levelHeight));
+            if (mip == 0) {
+                // The original blocks, rather than a second round of compression.
+                memcpy(blocks.data() + offset, src + slice * blockTopSize, blockTopSize);
+            } else {
+                BlockCompressor::Compress(blockFormat,
+                                          BlockCompressor::Quality::High,
+                                          level,
+                                          levelWidth,
+                                          levelHeight,
+                                          size_t(levelWidth) * 4,
+                                          blocks.data() + offset);
+            }
+            level += size_t(levelWidth) * levelHeight * 4;
+        }
+    }
+    return blocks;
+}
+
+struct PackOptions
+{
+    bool blockCompress = false;
+    bool generateMips = false;
+    MipGenerator::Filter mipFilter = MipGenerator::Filter::Kaiser;
+    // File names of normal maps not named like one.
+    std::vector<std::string> normalMaps;
+};
+
+// Tangent space normal maps: files named <texture>_nmap, as the app names the textures it reads
+// as normal maps, and those given with --normal-map.
+bool IsNormalMap(const fs::path &path, const PackOptions &options)
+{
+    const std::string suffix = "_nmap";
+    auto stem = path.stem().string();
+    if (stem.size() >= suffix.size()
+        && stem.compare(stem.size() - suffix.size(), suffix.size(), suffix) == 0)
+        return true;
+    return std::find(options.normalMaps.begin(), options.normalMaps.end(), path.filename().string())
+           != options.normalMaps.end();
+}
+
+PackedTexture PackDds(const fs::path &path, const PackOptions &options)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error(path.string() + ": cannot open file");
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), {});
+
+    uint32_t magic = 0;
+    DdsHeader header = {};
+    if (data.size() < sizeof(magic) + sizeof(header))
+        throw std::runtime_error(path.string() + ": not a DDS file");
+    memcpy(&magic, data.data(), sizeof(magic));
+    memcpy(&header, data.data() + sizeof(magic), sizeof(header));
+    if (magic != kDdsMagic || header.size != sizeof(DdsHeader))
+        throw std::runtime_error(path.string() + ": not a DDS file");
+
+    size_t bitOffset = sizeof(magic) + sizeof(header);
+
+    PackedTexture texture;
+    texture.path = path;
+    texture.normalMap = IsNormalMap(path, options);
+    auto &entry = texture.entry;
+    entry.width = header.width;
+    entry.height = header.height;
+    entry.depth = 1;
+    entry.mipCount = std::max(header.mipMapCount, 1u);
+    entry.arraySize = 1;
+
+    if ((header.ddspf.flags & kDdsFourCC) && header.ddspf.fourCC == MakeFourCC('D', 'X', '1', '0')) {
+        DdsHeaderDxt10 dxt10 = {};
+        if (data.size() < bitOffset + sizeof(dxt10))
+            throw std::runtime_error(path.string() + ": truncated DX10 header");
+        memcpy(&dxt10, data.data() + bitOffset, sizeof(dxt10));
+        bitOffset += sizeof(dxt10);
+
+        entry.format = dxt10.dxgiFormat;
+        entry.arraySize = std::max(dxt10.arraySize, 1u);
+        if (dxt10.resourceDimension == kDdsDimensionTexture3D) {
+            entry.depth = std::max(header.depth, 1u);
+        } else if (dxt10.miscFlag & kDdsResourceMiscTextureCube) {
+            entry.arraySize *= 6;
+            entry.flags |= kTextureArchiveCubeMap;
+        }
+    } else {
+        entry.format = GetDxgiFormat(header.ddspf);
+        if (header.caps2 & kDdsVolume) {
+            entry.depth = std::max(header.depth, 1u);
+        } else if (header.caps2 & kDdsCubeMap) {
+            if ((header.caps2 & kDdsCubeMapAllFaces) != kDdsCubeMapAllFaces)
+                throw std::runtime_error(path.string() + ": partial cube maps are not supported");
+            entry.arraySize = 6;
+            entry.flags |= kTextureArchiveCubeMap;
+        }
+    }
+
+    const uint8_t *src = data.data() + bitOffset;
+    const uint8_t *srcEnd = data.data() + data.size();
+
+    // Single level images get their mip chain here, before any block compression.  Those in
+    // formats that cannot be filtered, or encoded again, are reported and keep their one level.
+    std::vector<uint8_t> generated;
+    auto blockFormat = BlockCompressor::Format::BC1;
+    bool srgb = false;
+    bool blockCompressed = GetBlockFormat(entry.format, blockFormat, srgb);
+    srgb = srgb || entry.format == 91 || entry.format == 93; // B8G8R8A8/X8_UNORM_SRGB
+    uint32_t fullMipCount = MipGenerator::GetFullMipCount(entry.width, entry.height);
+    if (options.generateMips && entry.mipCount == 1 && entry.depth == 1 && fullMipCount > 1) {
+        bool filterable = blockCompressed ? entry.width % 4 == 0 && entry.height % 4 == 0
+                                          : IsBlockCompressible(entry.format) || srgb;
+        uint64_t topSize
+            = blockCompressed
+                  ? BlockCompressor::GetCompressedSize(blockFormat, entry.width, entry.height)
+                  : uint64_t(entry.width) * entry.height * 4;
+        if (!filterable) {
+            fprintf(stderr,
+                    "%s: format %u cannot be filtered, kept without mips\n",
+                    path.filename().string().c_str(),
+                    entry.format);
+        } else if (uint64_t(srcEnd - src) < topSize * entry.arraySize) {
+            throw std::runtime_error(path.string() + ": file is truncated");
+        } else {
+            entry.mipCount = fullMipCount;
+            generated = GenerateMipChains(options.mipFilter,
+                                          srgb,
+                                          blockCompressed,
+                                          blockFormat,
+                                          src,
+                                          entry.width,
+                                          entry.height,
+                                          entry.arraySize,
+                                          entry.mipCount);
+            src = generated.data();
+            srcEnd = src + generated.size();
+        }
+    }
+
+    // D3D needs the top level of a block compressed texture to be a whole number of blocks.
+    // Normal maps keep x and y in BC5, which the shaders rebuild z from, as the streamer does.
+    uint32_t sourceFormat = entry.format;
+    bool encode = options.blockCompress && IsBlockCompressible(sourceFormat) && entry.depth == 1
+                  && entry.width % 4 == 0 && entry.height % 4 == 0;
+    if (encode && texture.normalMap) {
+        entry.format = 83; // BC5_UNORM
+    } else if (encode) {
+        bool opaque = true;
+        for (const uint8_t *pixel = src; sourceFormat != 88 && pixel + 4 <= srcEnd; pixel += 4) {
+            if (pixel[3] != 255) {
+                opaque = false;
+                break;
+            }
+        }
+        entry.format = opaque ? 71 : 77; // BC1_UNORM : BC3_UNORM
+    }
+    blockFormat = entry.format == 71   ? BlockCompressor::Format::BC1
+                  : entry.format == 83 ? BlockCompressor::Format::BC5
+                                       : BlockCompressor::Format::BC3;
+
+    const auto &format = GetFormatInfo(entry.format, path);
+
+    // Copy every subresource from the tightly packed DDS layout into the aligned upload layout.
+    std::vector<uint8_t> rgba;
+    std::vector<uint8_t> blocks;
+    uint64_t payloadSize = 0;
+    for (uint32_t slice = 0; slice < entry.arraySize; ++slice) {
+        uint32_t width = entry.width;
+        uint32_t height = entry.height;
+        uint32_t depth = entry.depth;
+        for (uint32_t mip = 0; mip < entry.mipCount; ++mip) {
+            TextureArchiveSubresource subresource = {};
+            uint32_t columns = format.blockCompressed ? std::max(1u, (width + 3) / 4) : width;
+            subresource.rowCount = format.blockCompressed ? std::max(1u, (height + 3) / 4) : height;
+            subresource.rowSize = columns * format.bytes;
+            subresource.rowPitch = (uint32_t) AlignUp(subresource.rowSize,
+                                                      kTextureArchivePitchAlignment);
+            subresource.depth = depth;
+            subresource.offset = AlignUp(payloadSize, kTextureArchivePlacementAlignment);
+
+            uint64_t rows = uint64_t(subresource.rowCount) * depth;
+            uint64_t srcRowSize = subresource.rowSize;
+            if (encode) {
+                uint64_t pixelCount = uint64_t(width) * height;
+                if (uint64_t(srcEnd - src) < pixelCount * 4)
+                    throw std::runtime_error(path.string() + ": file is truncated");
+
+                rgba.resize(pixelCount * 4);
+                ConvertToRgba(src, pixelCount, sourceFormat, rgba.data());
+                src += pixelCount * 4;
+
+                blocks.resize(BlockCompressor::GetCompressedSize(blockFormat, width, height));
+                BlockCompressor::Compress(blockFormat,
+                                          BlockCompressor::Quality::High,
+                                          rgba.data(),
+                                          width,
+                                          height,
+                                          size_t(width) * 4,
+                                          blocks.data());
+            } else if (uint64_t(srcEnd - src) < rows * srcRowSize) {
+                throw std::runtime_error(path.string() + ": file is truncated");
+            }
+            const uint8_t *rowSrc = encode ? blocks.data() : src;
+
+            payloadSize = subresource.offset + rows * subresource.rowPitch;
+            texture.payload.resize(payloadSize);
+            for (uint64_t row = 0; row < rows; ++row) {
+                memcpy(texture.payload.data() + subresource.offset + row * subresource.rowPitch,
+                       rowSrc + row * subresource.rowSize,
+                       subresource.rowSize);
+            }
+            if (!encode) {
+                src += rows * srcRowSize;
+            }
+            texture.subresources.push_back(subresource);
+
+            width = std::max(width / 2, 1u);
+            height = std::max(height / 2, 1u);
+            depth = std::max(depth / 2, 1u);
+        }
+    }
+    entry.payloadSize = payloadSize;
+
+    auto name = path.filename().string();
+    entry.nameHash = HashTextureArchivePath(name.c_str(), name.size());
+    return texture;
+}
+
+// Merges textures of the same format, size and mip count into texture arrays.  Returns the
+// records mapping each merged texture to its array and slice, sorted by name hash.
+std::vector<TextureArchiveArraySlice> PackArrays(std::vector<PackedTexture> &textures)
+{
+    std::vector<TextureArrayPacker::TextureDesc> descs;
+    for (const auto &texture : textures) {
+        const auto &entry = texture.entry;
+        descs.push_back({entry.format,
+                         entry.width,
+                         entry.height,
+                         entry.depth,
+                         entry.mipCount,
+                         entry.arraySize,
+                         (entry.flags & kTextureArchiveCubeMap) != 0,
+                         texture.normalMap});
+    }
+    auto packing = TextureArrayPacker::Pack(descs);
+
+    std::vector<PackedTexture> packed;
+    std::vector<TextureArchiveArraySlice> arraySlices;
+    uint32_t arrayCount = 0;
+    for (const auto &members : packing.arrays) {
+        if (members.size() == 1) {
+            packed.push_back(std::move(textures[members[0]]));
+            continue;
+        }
+
+        uint32_t arrayIndex = arrayCount++;
+        auto name = TextureArchiveArrayName(arrayIndex);
+        PackedTexture array;
+        array.path = name;
+        array.entry = textures[members[0]].entry;
+        array.entry.arraySize = (uint32_t) members.size();
+        array.entry.nameHash = HashTextureArchiveName(name.c_str(), name.size());
+
+        for (uint32_t slice = 0; slice < members.size(); ++slice) {
+            auto &texture = textures[members[slice]];
+            // Each slice starts where GetCopyableFootprints places its first subresource.
+            uint64_t base = AlignUp(array.payload.size(), kTextureArchivePlacementAlignment);
+            for (auto subresource : texture.subresources) {
+                subresource.offset += base;
+                array.subresources.push_back(subresource);
+            }
+            array.payload.resize(base);
+            array.payload.insert(array.payload.end(), texture.payload.begin(), texture.payload.end());
+
+            arraySlices.push_back({texture.entry.nameHash, arrayIndex, slice});
+            array.slices.push_back(texture.path);
+        }
+        array.entry.payloadSize = array.payload.size();
+        packed.push_back(std::move(array));
+    }
+
+    textures = std::move(packed);
+    std::sort(arraySlices.begin(),
+              arraySlices.end(),
+              [](const TextureArchiveArraySlice &a, const TextureArchiveArraySlice &b) {
+                  return a.nameHash < b.nameHash;
+              });
+    return arraySlices;
+}
+
+void CompressChunks(std::vector<PackedTexture> &textures,
+                    uint32_t chunkSize,
+                    bool compress,
+                    unsigned jobs)
+{
+    struct ChunkJob
+    {
+        PackedTexture *texture;
+        size_t index;
+    };
+
+    std::vector<ChunkJob> chunkJobs;
+    for (auto &texture : textures) {
+        size_t chunkCount = (texture.payload.size() + chunkSize - 1) / chunkSize;
+        texture.storedChunks.resize(chunkCount);
+        for (size_t i = 0; i < chunkCount; ++i) {
+            chunkJobs.push_back({&texture, i});
+        }
+    }
+
+    std::atomic<size_t> nextJob(0);
+    auto work = [&]() {
+        for (size_t i = nextJob++; i < chunkJobs.size(); i = nextJob++) {
+            auto &texture = *chunkJobs[i].texture;
+            size_t begin = chunkJobs[i].index * chunkSize;
+            size_t size = std::min<size_t>(chunkSize, texture.payload.size() - begin);
+            const uint8_t *src = texture.payload.data() + begin;
+            auto &stored = texture.storedChunks[chunkJobs[i].index];
+
+            if (compress) {
+                stored.resize(Lz4::CompressBound(size));
+                stored.resize(Lz4::Compress(src, size, stored.data()));
+            }
+            // Chunks that do not shrink are stored raw; the reader tells them apart by size.
+            if (!compress || stored.size() >= size) {
+                stored.assign(src, src + size);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < jobs; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+template <typename T>
+void WriteArray(std::ofstream &file, const std::vector<T> &values)
+{
+    file.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+void WriteArchive(const fs::path &path,
+                  std::vector<PackedTexture> &textures,
+                  const std::vector<TextureArchiveArraySlice> &arraySlices,
+                  uint32_t chunkSize)
+{
+    std::vector<TextureArchiveEntry> entries;
+    std::vector<TextureArchiveSubresource> subresources;
+    std::vector<TextureArchiveChunk> chunks;
+
+    for (auto &texture : textures) {
+        auto entry = texture.entry;
+        entry.firstSubresource = (uint32_t) subresources.size();
+        entry.firstChunk = (uint32_t) chunks.size();
+        entry.chunkCount = (uint32_t) texture.storedChunks.size();
+        entries.push_back(entry);
+
+        subresources.insert(
+            subresources.end(), texture.subresources.begin(), texture.subresources.end());
+        for (size_t i = 0; i < texture.storedChunks.size(); ++i) {
+            TextureArchiveChunk chunk = {};
+            chunk.storedSize = (uint32_t) texture.storedChunks[i].size();
+            chunk.size = (uint32_t) std::min<size_t>(chunkSize,
+                                                     texture.payload.size() - i * chunkSize);
+            chunks.push_back(chunk);
+        }
+    }
+
+    TextureArchiveHeader header = {};
+    header.magic = kTextureArchiveMagic;
+    header.version = kTextureArchiveVersion;
+    header.entryCount = (uint32_t) entries.size();
+    header.subresourceCount = (uint32_t) subresources.size();
+    header.chunkCount = (uint32_t) chunks.size();
+    header.chunkSize = chunkSize;
+    header.arraySliceCount = (uint32_t) arraySlices.size();
+
+    uint64_t fileOffset = sizeof(header) + entries.size() * sizeof(TextureArchiveEntry)
+                          + subresources.size() * sizeof(TextureArchiveSubresource)
+                          + chunks.size() * sizeof(TextureArchiveChunk)
+                          + arraySlices.size() * sizeof(TextureArchiveArraySlice);
+    for (auto &chunk : chunks) {
+        chunk.fileOffset = fileOffset;
+        fileOffset += chunk.storedSize;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    WriteArray(file, entries);
+    WriteArray(file, subresources);
+    WriteArray(file, chunks);
+    WriteArray(file, arraySlices);
+    for (const auto &texture : textures) {
+        for (const auto &stored : texture.storedChunks) {
+            WriteArray(file, stored);
+        }
+    }
+
+    if (!file)
+        throw std::runtime_error(path.string() + ": cannot write archive");
+}
+
+int PrintUsage()
+{
+    fprintf(stderr,
+            "usage: TextureArchiveBuilder [options] <output> <input>...\n"
+            "  inputs are .dds files or directories holding them\n"
+            "  --compress          LZ4 compress chunks that shrink\n"
+            "  --chunk-size <KiB>  payload chunk size, default 256\n"
+            "  --block-compress    encode 8 bit RGBA inputs as BC1, or BC3 if they have alpha,\n"
+            "                      and normal maps as BC5\n"
+            "  --normal-map <name> treat the input file <name> as a normal map, as files named\n"
+            "                      *_nmap always are\n"
+            "  --pack-arrays       merge textures of equal format, size and mip count into\n"
+            "                      texture arrays\n"
+            "  --generate-mips <box|kaiser>\n"
+            "                      build mip chains for 8 bit RGBA and BC1, BC3, BC4 and BC5\n"
+            "                      inputs stored without them; others are reported\n"
+            "  --jobs <n>          compression threads, default one per core\n");
+    return 1;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool compress = false;
+    PackOptions options;
+    bool packArrays = false;
+    uint32_t chunkSize = 256 * 1024;
+    unsigned jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<fs::path> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--compress") {
+            compress = true;
+        } else if (arg == "--block-compress") {
+            options.blockCompress = true;
+        } else if (arg == "--normal-map" && i + 1 < argc) {
+            options.normalMaps.emplace_back(argv[++i]);
+        } else if (arg == "--pack-arrays") {
+            packArrays = true;
+        } else if (arg == "--generate-mips" && i + 1 < argc) {
+            std::string filter = argv[++i];
+            if (filter != "box" && filter != "kaiser")
+                return PrintUsage();
+            options.generateMips = true;
+            options.mipFilter = filter == "box" ? MipGenerator::Filter::Box
+                                                : MipGenerator::Filter::Kaiser;
+        } else if (arg == "--chunk-size" && i + 1 < argc) {
+            chunkSize = (uint32_t) std::max(std::stoul(argv[++i]), 1ul) * 1024;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = (unsigned) std::max(std::stoul(argv[++i]), 1ul);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            return PrintUsage();
+        } else {
+            paths.emplace_back(arg);
+        }
+    }
+    if (paths.size() < 2)
+        return PrintUsage();
+
+    try {
+        std::vector<fs::path> inputs;
+        for (size_t i = 1; i < paths.size(); ++i) {
+            if (fs::is_directory(paths[i])) {
+                for (const auto &it : fs::directory_iterator(paths[i])) {
+                    auto extension = it.path().extension().string();
+                    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+                    if (it.is_regular_file() && extension == ".dds") {
+                        inputs.push_back(it.path());
+                    }
+                }
+            } else {
+                inputs.push_back(paths[i]);
+            }
+        }
+
+        std::vector<PackedTexture> textures;
+        for (const auto &input : inputs) {
+            textures.push_back(PackDds(input, options));
+        }
+
+        auto byNameHash = [](const PackedTexture &a, const PackedTexture &b) {
+            return a.entry.nameHash < b.entry.nameHash;
+        };
+        auto sortAndCheckNames = [&]() {
+            std::sort(textures.begin(), textures.end(), byNameHash);
+            for (size_t i = 1; i < textures.size(); ++i) {
+                if (textures[i].entry.nameHash == textures[i - 1].entry.nameHash) {
+                    throw std::runtime_error(textures[i - 1].path.string() + " and "
+                                             + textures[i].path.string() + " share a name");
+                }
+            }
+        };
+        sortAndCheckNames();
+
+        std::vector<TextureArchiveArraySlice> arraySlices;
+        if (packArrays) {
+            // Sorted by name so the packing does not depend on directory iteration order.
+            std::sort(textures.begin(), textures.end(), [](const PackedTexture &a, const PackedTexture &b) {
+                return a.path.filename() < b.path.filename();
+            });
+            arraySlices = PackArrays(textures);
+            // Array names are checked against the remaining textures too.
+            sortAndCheckNames();
+        }
+
+        CompressChunks(textures, chunkSize, compress, jobs);
+        WriteArchive(paths[0], textures, arraySlices, chunkSize);
+
+        uint64_t totalPayload = 0;
+        uint64_t totalStored = 0;
+        for (const auto &texture : textures) {
+            uint64_t stored = 0;
+            for (const auto &chunk : texture.storedChunks) {
+                stored += chunk.size();
+            }
+            printf("%-24s format %2u  %4ux%-4u  mips %2u  array %u  %8llu -> %8llu bytes\n",
+                   texture.path.filename().string().c_str(),
+                   texture.entry.format,
+                   texture.entry.width,
+                   texture.entry.height,
+                   texture.entry.mipCount,
+                   texture.entry.arraySize,
+                   (unsigned long long) texture.payload.size(),
+                   (unsigned long long) stored);
+            for (size_t slice = 0; slice < texture.slices.size(); ++slice) {
+                printf("    slice %zu: %s\n", slice, texture.slices[slice].filename().string().c_str());
+            }
+            totalPayload += texture.payload.size();
+            totalStored += stored;
+        }
+        printf("%zu textures, %llu -> %llu bytes\n",
+               textures.size(),
+               (unsigned long long) totalPayload,
+               (unsigned long long) totalStored);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "error: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+// Checks Common/TextureArrayPacker: which textures share an array, how full buckets split, which
+// textures stay alone, and that the slices each texture is given match the arrays' slice order.
+// Portable C++17, built outside the Visual Studio solution:
+//
+//   g++ -std=c++17 -O2 -o TextureArrayPackerTest TextureArrayPackerTest.cpp ../../Common/TextureArrayPacker.cpp
+//   ./TextureArrayPackerTest
+
+#include "../../Common/TextureArrayPacker.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+const uint32_t kBC1 = 71;
+const uint32_t kBC3 = 77;
+const uint32_t kBC5 = 83;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what)
+{
+    if (!condition) {
+        printf("  failed: %s\n", what);
+        ++gFailures;
+    }
+}
+
+TextureArrayPacker::TextureDesc Texture2D(uint32_t format,
+                                          uint32_t width,
+                                          uint32_t height,
+                                          uint32_t mipCount,
+                                          bool normalMap = false)
+{
+    return {format, width, height, 1, mipCount, 1, false, normalMap};
+}
+
+using Arrays = std::vector<std::vector<uint32_t>>;
+
+// Every texture's slice names the place it holds in its array.
+bool SlicesMatchArrays(const TextureArrayPacker::Packing &packing, size_t textureCount)
+{
+    if (packing.slices.size() != textureCount)
+        return false;
+    size_t placed = 0;
+    for (uint32_t array = 0; array < packing.arrays.size(); ++array) {
+        const auto &members = packing.arrays[array];
+        for (uint32_t slice = 0; slice < members.size(); ++slice) {
+            const auto &where = packing.slices[members[slice]];
+            if (where.array != array || where.slice != slice)
+                return false;
+        }
+        placed += members.size();
+    }
+    return placed == textureCount;
+}
+
+void CheckBuckets()
+{
+    // Only textures alike in format, size, mip count and content share an array.
+    std::vector<TextureArrayPacker::TextureDesc> textures = {
+        Texture2D(kBC1, 512, 512, 10),
+        Texture2D(kBC3, 512, 512, 10),
+        Texture2D(kBC1, 512, 512, 10),
+        Texture2D(kBC1, 256, 512, 10),
+        Texture2D(kBC1, 512, 512, 1),
+        Texture2D(kBC3, 512, 512, 10),
+        Texture2D(kBC1, 512, 256, 10),
+        Texture2D(kBC1, 512, 512, 10),
+        Texture2D(kBC5, 512, 512, 10, true),
+        Texture2D(kBC5, 512, 512, 10, true),
+        Texture2D(87, 1, 1, 1, true),
+        Texture2D(87, 1, 1, 1),
+    };
+    auto packing = TextureArrayPacker::Pack(textures);
+    Check(packing.arrays == Arrays{{0, 2, 7}, {1, 5}, {3}, {4}, {6}, {8, 9}, {10}, {11}},
+          "textures are bucketed by format, size, mip count and content");
+    Check(SlicesMatchArrays(packing, textures.size()), "slices follow the arrays' order");
+    Check(packing.slices[7].array == 0 && packing.slices[7].slice == 2,
+          "the third texture of a bucket is its third slice");
+}
+
+void CheckSplit()
+{
+    std::vector<TextureArrayPacker::TextureDesc> textures(7, Texture2D(kBC1, 64, 64, 7));
+    textures.insert(textures.begin() + 3, Texture2D(kBC3, 64, 64, 7));
+    auto packing = TextureArrayPacker::Pack(textures, 3);
+    Check(packing.arrays == Arrays{{0, 1, 2}, {3}, {4, 5, 6}, {7}},
+          "a full bucket starts a new array");
+    Check(SlicesMatchArrays(packing, textures.size()), "split arrays number their own slices");
+
+    packing = TextureArrayPacker::Pack(textures, 0);
+    Check(packing.arrays.size() == textures.size(), "a limit of 0 keeps every texture alone");
+}
+
+void CheckUnpackable()
+{
+    // Cube maps, arrays and volumes are left as they are, even next to textures like them.
+    auto cube = Texture2D(kBC1, 128, 128, 8);
+    cube.arraySize = 6;
+    cube.cubeMap = true;
+    auto array = Texture2D(kBC1, 128, 128, 8);
+    array.arraySize = 4;
+    auto volume = Texture2D(kBC1, 128, 128, 8);
+    volume.depth = 16;
+    std::vector<TextureArrayPacker::TextureDesc> textures = {
+        Texture2D(kBC1, 128, 128, 8), cube, array, volume, Texture2D(kBC1, 128, 128, 8)};
+    auto packing = TextureArrayPacker::Pack(textures);
+    Check(packing.arrays == Arrays{{0, 4}, {1}, {2}, {3}},
+          "cube maps, arrays and volumes stay out of arrays");
+    Check(SlicesMatchArrays(packing, textures.size()),
+          "unpacked textures are slice 0 of their own");
+}
+
+void CheckEmpty()
+{
+    auto packing = TextureArrayPacker::Pack({});
+    Check(packing.arrays.empty() && packing.slices.empty(), "no textures make no arrays");
+}
+} // namespace
+
+int main()
+{
+    CheckBuckets();
+    CheckSplit();
+    CheckUnpackable();
+    CheckEmpty();
+    if (gFailures > 0) {
+        printf("error: %d checks failed\n", gFailures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
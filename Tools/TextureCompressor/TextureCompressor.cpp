@@ -0,0 +1,369 @@
+// Block compresses images into .dds files with Common/BlockCompressor, and measures its quality
+// levels.  Portable C++17, built outside the Visual Studio solution:
+//
+//   g++ -std=c++17 -O2 -pthread -o TextureCompressor TextureCompressor.cpp ../../Common/BlockCompressor.cpp
+//   ./TextureCompressor --format bc3 --quality high ../../Assets/Textures/tree0.bmp tree0.dds
+//   ./TextureCompressor --bench ../../Assets/Textures/tree0.bmp ../../Assets/Textures/tree1.bmp
+//
+// Add -mavx2 (or /arch:AVX2) to build the AVX2 kernels.
+
+#include "../../Common/BlockCompressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+using BlockCompressor::Format;
+using BlockCompressor::Quality;
+
+namespace
+{
+const uint32_t kDdsMagic = 0x20534444; // "DDS "
+
+const uint32_t kDdsCaps = 0x1;
+const uint32_t kDdsHeight = 0x2;
+const uint32_t kDdsWidth = 0x4;
+const uint32_t kDdsPixelFormat = 0x1000;
+const uint32_t kDdsLinearSize = 0x80000;
+const uint32_t kDdsFourCC = 0x4;
+const uint32_t kDdsRgb = 0x40;
+const uint32_t kDdsCapsTexture = 0x1000;
+
+struct DdsPixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rBitMask;
+    uint32_t gBitMask;
+    uint32_t bBitMask;
+    uint32_t aBitMask;
+};
+
+struct DdsHeader
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DdsPixelFormat ddspf;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+
+constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+{
+    return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16
+           | uint32_t(uint8_t(d)) << 24;
+}
+
+struct Image
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> rgba;
+};
+
+std::vector<uint8_t> ReadFile(const fs::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error(path.string() + ": cannot open file");
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), {});
+}
+
+template <typename T>
+T ReadValue(const std::vector<uint8_t> &data, size_t offset)
+{
+    T value;
+    memcpy(&value, data.data() + offset, sizeof(T));
+    return value;
+}
+
+// Uncompressed 24 and 32 bit BMP files.
+Image LoadBmp(const fs::path &path, const std::vector<uint8_t> &data)
+{
+    if (data.size() < 54)
+        throw std::runtime_error(path.string() + ": not a BMP file");
+
+    uint32_t pixelOffset = ReadValue<uint32_t>(data, 10);
+    int32_t width = ReadValue<int32_t>(data, 18);
+    int32_t height = ReadValue<int32_t>(data, 22);
+    uint16_t bitCount = ReadValue<uint16_t>(data, 28);
+    uint32_t compression = ReadValue<uint32_t>(data, 30);
+    // BI_RGB, or BI_BITFIELDS with the usual BGRA masks.
+    if ((bitCount != 24 && bitCount != 32) || (compression != 0 && compression != 3) || width <= 0
+        || height == 0) {
+        throw std::runtime_error(path.string() + ": only uncompressed 24 and 32 bit BMP files are supported");
+    }
+
+    // Rows are stored bottom up unless the height is negative.
+    bool bottomUp = height > 0;
+    Image image;
+    image.width = uint32_t(width);
+    image.height = uint32_t(std::abs(height));
+    size_t bytesPerPixel = bitCount / 8;
+    size_t rowPitch = (image.width * bytesPerPixel + 3) & ~size_t(3);
+    if (data.size() < pixelOffset + rowPitch * image.height)
+        throw std::runtime_error(path.string() + ": file is truncated");
+
+    image.rgba.resize(size_t(image.width) * image.height * 4);
+    for (uint32_t y = 0; y < image.height; ++y) {
+        const uint8_t *src = data.data() + pixelOffset
+                             + rowPitch * (bottomUp ? image.height - 1 - y : y);
+        uint8_t *dst = image.rgba.data() + size_t(y) * image.width * 4;
+        for (uint32_t x = 0; x < image.width; ++x) {
+            dst[4 * x + 0] = src[bytesPerPixel * x + 2];
+            dst[4 * x + 1] = src[bytesPerPixel * x + 1];
+            dst[4 * x + 2] = src[bytesPerPixel * x + 0];
+            dst[4 * x + 3] = bytesPerPixel == 4 ? src[bytesPerPixel * x + 3] : 255;
+        }
+    }
+    return image;
+}
+
+// The top level of 32 bit RGBA, BGRA and BGRX .dds files.
+Image LoadDds(const fs::path &path, const std::vector<uint8_t> &data)
+{
+    if (data.size() < 4 + sizeof(DdsHeader))
+        throw std::runtime_error(path.string() + ": not a DDS file");
+
+    auto header = ReadValue<DdsHeader>(data, 4);
+    const auto &pf = header.ddspf;
+    bool rgba = pf.rBitMask == 0x000000ff && pf.bBitMask == 0x00ff0000;
+    bool bgra = pf.rBitMask == 0x00ff0000 && pf.bBitMask == 0x000000ff;
+    if (!(pf.flags & kDdsRgb) || pf.rgbBitCount != 32 || pf.gBitMask != 0x0000ff00 || !(rgba || bgra))
+        throw std::runtime_error(path.string() + ": only 32 bit RGBA and BGRA DDS files are supported");
+
+    Image image;
+    image.width = header.width;
+    image.height = header.height;
+    size_t size = size_t(image.width) * image.height * 4;
+    if (data.size() < 4 + sizeof(DdsHeader) + size)
+        throw std::runtime_error(path.string() + ": file is truncated");
+
+    image.rgba.assign(data.begin() + 4 + sizeof(DdsHeader), data.begin() + 4 + sizeof(DdsHeader) + size);
+    for (size_t i = 0; i < size; i += 4) {
+        if (bgra) {
+            std::swap(image.rgba[i], image.rgba[i + 2]);
+        }
+        if (pf.aBitMask == 0) {
+            image.rgba[i + 3] = 255;
+        }
+    }
+    return image;
+}
+
+Image LoadImage(const fs::path &path)
+{
+    auto data = ReadFile(path);
+    if (data.size() >= 4 && ReadValue<uint32_t>(data, 0) == kDdsMagic)
+        return LoadDds(path, data);
+    if (data.size() >= 2 && data[0] == 'B' && data[1] == 'M')
+        return LoadBmp(path, data);
+    throw std::runtime_error(path.string() + ": unknown image format");
+}
+
+// Legacy headers with the FourCC codes DDSTextureLoader maps to BC1, BC3, BC4 and BC5.
+void WriteDds(const fs::path &path, Format format, const Image &image, const std::vector<uint8_t> &blocks)
+{
+    static const uint32_t kFourCC[] = {MakeFourCC('D', 'X', 'T', '1'),
+                                       MakeFourCC('D', 'X', 'T', '5'),
+                                       MakeFourCC('A', 'T', 'I', '1'),
+                                       MakeFourCC('A', 'T', 'I', '2')};
+
+    DdsHeader header = {};
+    header.size = sizeof(DdsHeader);
+    header.flags = kDdsCaps | kDdsHeight | kDdsWidth | kDdsPixelFormat | kDdsLinearSize;
+    header.height = image.height;
+    header.width = image.width;
+    header.pitchOrLinearSize = (uint32_t) blocks.size();
+    header.mipMapCount = 1;
+    header.ddspf.size = sizeof(DdsPixelFormat);
+    header.ddspf.flags = kDdsFourCC;
+    header.ddspf.fourCC = kFourCC[int(format)];
+    header.caps = kDdsCapsTexture;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&kDdsMagic), sizeof(kDdsMagic));
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(blocks.data()), blocks.size());
+    if (!file)
+        throw std::runtime_error(path.string() + ": cannot write file");
+}
+
+std::vector<uint8_t> Compress(const Image &image, Format format, Quality quality, unsigned threadCount)
+{
+    std::vector<uint8_t> blocks(BlockCompressor::GetCompressedSize(format, image.width, image.height));
+    BlockCompressor::Compress(format,
+                              quality,
+                              image.rgba.data(),
+                              image.width,
+                              image.height,
+                              size_t(image.width) * 4,
+                              blocks.data(),
+                              threadCount);
+    return blocks;
+}
+
+// Over the channels the format stores; alpha only counts for BC3.
+double ComputePsnr(const Image &image, Format format, const std::vector<uint8_t> &blocks)
+{
+    std::vector<uint8_t> decoded(image.rgba.size());
+    BlockCompressor::Decompress(
+        format, blocks.data(), image.width, image.height, decoded.data(), size_t(image.width) * 4);
+
+    int channelCount = format == Format::BC4 ? 1 : format == Format::BC5 ? 2 : 3;
+    bool alpha = format == Format::BC3;
+    double errorSum = 0.0;
+    size_t sampleCount = 0;
+    for (size_t i = 0; i < image.rgba.size(); i += 4) {
+        for (int c = 0; c < 4; ++c) {
+            if (c >= channelCount && !(alpha && c == 3))
+                continue;
+            double d = double(image.rgba[i + c]) - decoded[i + c];
+            errorSum += d * d;
+            ++sampleCount;
+        }
+    }
+
+    double mse = errorSum / double(std::max<size_t>(sampleCount, 1));
+    return mse == 0.0 ? INFINITY : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+// Times each quality level on one thread and compares it with the reference encoder.
+void RunBenchmark(const std::vector<fs::path> &paths, Format format)
+{
+    static const char *kQualityNames[] = {"fast", "normal", "high", "reference"};
+
+    printf("kernels: %s\n", BlockCompressor::GetInstructionSet());
+    for (const auto &path : paths) {
+        auto image = LoadImage(path);
+        double pixels = double(image.width) * image.height;
+        printf("%s (%ux%u)\n", path.filename().string().c_str(), image.width, image.height);
+
+        double referencePsnr = 0.0;
+        for (int q = int(Quality::Reference); q >= int(Quality::Fast); --q) {
+            auto quality = Quality(q);
+            // Repeat until the timing covers at least a quarter of a second.
+            std::vector<uint8_t> blocks;
+            int runs = 0;
+            auto start = std::chrono::steady_clock::now();
+            double seconds = 0.0;
+            do {
+                blocks = Compress(image, format, quality, 1);
+                ++runs;
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            } while (seconds < 0.25);
+
+            double psnr = ComputePsnr(image, format, blocks);
+            if (quality == Quality::Reference) {
+                referencePsnr = psnr;
+            }
+            printf("  %-9s %8.2f MPix/s  PSNR %6.2f dB  (%+.2f dB against reference)\n",
+                   kQualityNames[q],
+                   pixels * runs / seconds / 1e6,
+                   psnr,
+                   psnr - referencePsnr);
+        }
+    }
+}
+
+int PrintUsage()
+{
+    fprintf(stderr,
+            "usage: TextureCompressor [options] <input> <output.dds>\n"
+            "       TextureCompressor [options] --bench <input>...\n"
+            "  inputs are 24 or 32 bit .bmp files or 32 bit RGBA/BGRA .dds files\n"
+            "  --format <bc1|bc3|bc4|bc5>                  default bc1\n"
+            "  --quality <fast|normal|high|reference>      default high\n"
+            "  --bench    report speed and PSNR of every quality level\n");
+    return 1;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    static const char *kFormatNames[] = {"bc1", "bc3", "bc4", "bc5"};
+    static const char *kQualityNames[] = {"fast", "normal", "high", "reference"};
+
+    auto format = Format::BC1;
+    auto quality = Quality::High;
+    bool bench = false;
+    std::vector<fs::path> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc) {
+            auto name = std::find_if(std::begin(kFormatNames), std::end(kFormatNames), [&](const char *n) {
+                return n == std::string(argv[i + 1]);
+            });
+            if (name == std::end(kFormatNames))
+                return PrintUsage();
+            format = Format(name - std::begin(kFormatNames));
+            ++i;
+        } else if (arg == "--quality" && i + 1 < argc) {
+            auto name = std::find_if(std::begin(kQualityNames), std::end(kQualityNames), [&](const char *n) {
+                return n == std::string(argv[i + 1]);
+            });
+            if (name == std::end(kQualityNames))
+                return PrintUsage();
+            quality = Quality(name - std::begin(kQualityNames));
+            ++i;
+        } else if (arg == "--bench") {
+            bench = true;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            return PrintUsage();
+        } else {
+            paths.emplace_back(arg);
+        }
+    }
+    if (bench ? paths.empty() : paths.size() != 2)
+        return PrintUsage();
+
+    try {
+        if (bench) {
+            RunBenchmark(paths, format);
+            return 0;
+        }
+
+        auto image = LoadImage(paths[0]);
+        auto start = std::chrono::steady_clock::now();
+        auto blocks = Compress(image, format, quality, 0);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        WriteDds(paths[1], format, image, blocks);
+
+        printf("%s -> %s  %ux%u %s %s  PSNR %.2f dB  %.1f ms\n",
+               paths[0].string().c_str(),
+               paths[1].string().c_str(),
+               image.width,
+               image.height,
+               kFormatNames[int(format)],
+               kQualityNames[int(quality)],
+               ComputePsnr(image, format, blocks),
+               seconds * 1000.0);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "error: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
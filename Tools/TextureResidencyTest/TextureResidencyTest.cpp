@@ -0,0 +1,171 @@
+// Checks Common/TextureResidency's plans: what it loads, evicts and holds back under the budget,
+// counting both chains of a texture with a change in flight, and that a scene of textures whose
+// wishes keep changing never goes over the budget while their changes are applied as planned.
+// Portable C++17, built outside the Visual Studio solution:
+//
+//   g++ -std=c++17 -O2 -o TextureResidencyTest TextureResidencyTest.cpp ../../Common/TextureResidency.cpp
+//   ./TextureResidencyTest
+
+#include "../../Common/TextureResidency.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+// Mips of 64, 16, 4 and 1 bytes, the last two the tail.
+const std::vector<uint64_t> kMipBytes = {64, 16, 4, 1};
+const uint32_t kTailMip = 2;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what)
+{
+    if (!condition) {
+        printf("  failed: %s\n", what);
+        ++gFailures;
+    }
+}
+
+// Begins and ends every planned change, as the streamer does once the GPU is done with the old
+// copy.  Returns false if the resident size went over the budget while they were in flight.
+bool ApplyPlan(TextureResidency &residency)
+{
+    auto changes = residency.Plan();
+    for (const auto &change : changes) {
+        residency.BeginChange(change.texture, change.mip);
+    }
+    bool underBudget = residency.GetResidentBytes() <= residency.GetBudget();
+    for (const auto &change : changes) {
+        residency.EndChange(change.texture);
+    }
+    return underBudget;
+}
+
+void CheckTailsCounted()
+{
+    // Room for one tail of 5 bytes, not two.
+    TextureResidency residency(8);
+    residency.AddTexture(kMipBytes, kTailMip);
+    residency.AddTexture(kMipBytes, kTailMip);
+    auto changes = residency.Plan();
+    Check(changes.size() == 1 && changes[0].mip == kTailMip, "only the tails that fit load");
+}
+
+void CheckLoadsBudgetWholeChain()
+{
+    // Loading mip 1 creates the 21 byte chain of mips 1 to 3 next to the resident 5 byte tail,
+    // and keeps room for another 5 byte tail to drop back to.
+    for (uint64_t budget : {30, 31}) {
+        TextureResidency residency(budget);
+        auto texture = residency.AddTexture(kMipBytes, kTailMip);
+        ApplyPlan(residency);
+        residency.SetDesired(texture, 0, 1.0f);
+        auto changes = residency.Plan();
+        bool loads = changes.size() == 1 && changes[0].mip == 1;
+        Check(loads == (budget >= 31), "a load needs room for its whole chain");
+    }
+}
+
+void CheckPendingChainsCounted()
+{
+    // With the first texture's mip 1 in flight, 5 + 21 bytes are resident for it, and the second
+    // texture's 21 byte chain does not fit next to that, its own tail and the room kept to drop
+    // back to a tail.
+    TextureResidency residency(54);
+    auto first = residency.AddTexture(kMipBytes, kTailMip);
+    auto second = residency.AddTexture(kMipBytes, kTailMip);
+    ApplyPlan(residency);
+    residency.SetDesired(first, 1, 2.0f);
+    residency.SetDesired(second, 1, 1.0f);
+    auto changes = residency.Plan();
+    Check(changes.size() == 1 && changes[0].texture == first, "the first load fits, not both");
+    residency.BeginChange(first, 1);
+    Check(residency.GetResidentBytes() == 5 + 21 + 5, "both chains of a pending change count");
+    Check(residency.Plan().empty(), "nothing fits next to a pending change");
+    residency.EndChange(first);
+    changes = residency.Plan();
+    Check(changes.size() == 1 && changes[0].texture == second, "the second load follows");
+}
+
+void CheckEvictionsFirst()
+{
+    // The first texture holds mip 1; once the second matters more, the first gives its detail
+    // back before the second loads.
+    TextureResidency residency(40);
+    auto first = residency.AddTexture(kMipBytes, kTailMip);
+    auto second = residency.AddTexture(kMipBytes, kTailMip);
+    ApplyPlan(residency);
+    residency.SetDesired(first, 1, 1.0f);
+    ApplyPlan(residency);
+    Check(residency.GetResidentMip(first) == 1, "the first texture loads mip 1");
+
+    residency.SetDesired(first, 1, 1.0f);
+    residency.SetDesired(second, 1, 2.0f);
+    auto changes = residency.Plan();
+    Check(!changes.empty() && changes[0].texture == first && changes[0].mip == kTailMip,
+          "the eviction comes first");
+    Check(ApplyPlan(residency), "the eviction stays within the budget");
+    ApplyPlan(residency);
+    Check(residency.GetResidentMip(first) == kTailMip && residency.GetResidentMip(second) == 1,
+          "the second texture gets the room");
+}
+
+void CheckRandomScene()
+{
+    // Textures whose wishes change every few frames, on a budget a fraction of their total.
+    std::mt19937 random(1);
+    TextureResidency residency(600);
+    std::vector<uint32_t> textures;
+    for (int i = 0; i < 20; ++i) {
+        textures.push_back(residency.AddTexture(kMipBytes, kTailMip));
+    }
+    bool underBudget = true;
+    for (int frame = 0; frame < 1000; ++frame) {
+        if (frame % 5 == 0) {
+            for (auto texture : textures) {
+                residency.SetDesired(texture, random() % 4, float(random() % 100));
+            }
+        }
+        underBudget = ApplyPlan(residency) && underBudget;
+    }
+    Check(underBudget, "a changing scene stays within the budget");
+
+    // Once the wishes settle, every texture gets what it asks for if it all fits.
+    for (auto texture : textures) {
+        residency.SetDesired(texture, 1, 1.0f);
+    }
+    for (int frame = 0; frame < 100; ++frame) {
+        ApplyPlan(residency);
+    }
+    bool settled = true;
+    for (auto texture : textures) {
+        settled = settled && residency.GetResidentMip(texture) == 1;
+    }
+    Check(settled, "settled wishes that fit are all met");
+}
+
+void CheckMipForScreenSize()
+{
+    Check(TextureResidency::MipForScreenSize(256, 256, 256.0f) == 0, "full size needs mip 0");
+    Check(TextureResidency::MipForScreenSize(256, 256, 64.0f) == 2, "a quarter needs mip 2");
+    Check(TextureResidency::MipForScreenSize(256, 128, 0.0f) == 8, "nothing needs the last mip");
+}
+} // namespace
+
+int main()
+{
+    CheckTailsCounted();
+    CheckLoadsBudgetWholeChain();
+    CheckPendingChainsCounted();
+    CheckEvictionsFirst();
+    CheckRandomScene();
+    CheckMipForScreenSize();
+    if (gFailures > 0) {
+        printf("error: %d checks failed\n", gFailures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}